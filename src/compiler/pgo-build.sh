@@ -0,0 +1,101 @@
+#!/bin/bash
+# Builds the compiler with link-time optimization and profile-guided optimization, trained on the
+# bundled dictation corpus, and reports the speedup over a release build without them.
+#
+# Usage: ./pgo-build.sh [PGO_BUILD_DIR] [BASELINE_BUILD_DIR]
+# The build directories must be new or made by this script, so that it never reconfigures the
+# ordinary build/ directory. Set TALKTEX_GENERATOR_LIBRARY to the optimised library to have the
+# Python frontend use it.
+
+PGO_BUILD_DIR="${1:-build-pgo}"
+BASELINE_BUILD_DIR="${2:-build-release}"
+CORPUS="src/benchmarks/corpora/dictation.txt"
+TRAINING_SECONDS="0.05" # Per benchmark; the profile needs coverage, not precision
+BENCHMARK_SECONDS="0.3"
+BENCHMARK_REPETITIONS=3 # The builds take turns, and the fastest run of each benchmark counts
+
+set -e # Quit on error, saying which step failed
+STEP="starting"
+trap 'echo "pgo-build.sh: $STEP failed (exit code $?)" >&2' ERR
+cd -- "$(dirname -- "$(readlink -f -- "${BASH_SOURCE[0]}")")" >/dev/null
+
+# The file that marks the build directories of this script
+MARKER=".pgo-build"
+
+# Configures build directory $1 with the options after it, or reconfigures it if this script made it
+configure() {
+	local dir="$1"
+	shift
+	if [ -d "$dir" ]; then
+		if [ ! -f "$dir/$MARKER" ]; then
+			echo "pgo-build.sh: $dir was not made by this script; pass a new build directory" >&2
+			exit 1
+		fi
+		meson setup --reconfigure "$dir" "$@" >/dev/null
+	else
+		meson setup "$dir" "$@" >/dev/null
+		touch "$dir/$MARKER"
+	fi
+}
+
+# The libraries are static, so that LTO can inline across them into the executables and into
+# libcompiler_latex_generator.so, and calls between them do not go through the PLT
+PGO_OPTIONS=(--buildtype=release -Db_lto=true -Ddefault_library=static -Db_ndebug=true)
+
+echo "Building instrumented binaries in $PGO_BUILD_DIR"
+STEP="building the instrumented binaries"
+configure "$PGO_BUILD_DIR" "${PGO_OPTIONS[@]}" -Db_pgo=generate
+ninja -C "$PGO_BUILD_DIR" >/dev/null
+find "$PGO_BUILD_DIR" -name '*.gcda' -delete # Train from scratch
+
+echo "Training on $CORPUS"
+STEP="training with the benchmarks"
+"$PGO_BUILD_DIR/src/benchmarks/compiler_benchmarks" --corpus "$CORPUS" --min-time "$TRAINING_SECONDS" --scaling-tokens 1000 >/dev/null
+# The file conversion of the command line, with and without threads, and its error path, whose
+# errors we expect
+"$PGO_BUILD_DIR/src/latex-generator/compiler_latex_generator" -f "$CORPUS" -j 1 >/dev/null 2>&1 || true
+"$PGO_BUILD_DIR/src/latex-generator/compiler_latex_generator" -f "$CORPUS" -d >/dev/null 2>&1 || true
+
+echo "Building optimised binaries in $PGO_BUILD_DIR"
+STEP="building the optimised binaries"
+configure "$PGO_BUILD_DIR" "${PGO_OPTIONS[@]}" -Db_pgo=use
+ninja -C "$PGO_BUILD_DIR" >/dev/null
+
+echo "Building baseline binaries in $BASELINE_BUILD_DIR"
+STEP="building the baseline binaries"
+configure "$BASELINE_BUILD_DIR" --buildtype=release -Db_ndebug=true
+ninja -C "$BASELINE_BUILD_DIR" >/dev/null
+
+echo "Benchmarking"
+STEP="benchmarking"
+for repetition in $(seq 1 "$BENCHMARK_REPETITIONS"); do
+	for dir in "$BASELINE_BUILD_DIR" "$PGO_BUILD_DIR"; do
+		"$dir/src/benchmarks/compiler_benchmarks" --corpus "$CORPUS" --min-time "$BENCHMARK_SECONDS" \
+			--json "$dir/src/benchmarks/benchmarks_$repetition.json" >/dev/null
+	done
+done
+
+# Prints the speedup of every benchmark, and their geometric mean
+STEP="comparing the benchmarks"
+python3 - "$BASELINE_BUILD_DIR" "$PGO_BUILD_DIR" "$BENCHMARK_REPETITIONS" <<'EOF'
+import json, math, sys
+
+def load(build_dir, repetitions):
+	fastest = {}
+	for repetition in range(1, repetitions + 1):
+		with open(f"{build_dir}/src/benchmarks/benchmarks_{repetition}.json") as file:
+			for result in json.load(file)["benchmarks"]:
+				fastest[result["name"]] = min(fastest.get(result["name"], math.inf), result["ns_per_op"])
+	return fastest
+
+baseline, optimised = load(sys.argv[1], int(sys.argv[3])), load(sys.argv[2], int(sys.argv[3]))
+print(f"{'benchmark':36}{'baseline ns/op':>16}{'pgo+lto ns/op':>16}{'speedup':>10}")
+log_sum = 0
+for name, baseline_ns in baseline.items():
+	speedup = baseline_ns / optimised[name]
+	log_sum += math.log(speedup)
+	print(f"{name:36}{baseline_ns:16.1f}{optimised[name]:16.1f}{speedup:9.2f}x")
+print(f"{'geometric mean':68}{math.exp(log_sum / len(baseline)):9.2f}x")
+EOF
+
+echo "Optimised library: $PGO_BUILD_DIR/src/latex-generator/libcompiler_latex_generator.so"
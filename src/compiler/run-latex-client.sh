@@ -0,0 +1,15 @@
+#!/bin/bash
+
+# Like run-latex-generator.sh, but converts through a long-running compiler_latex_generator server,
+# which is started when none is listening yet. The server stops after 10 idle minutes; stop it
+# yourself (e.g. with pkill -f "compiler_latex_generator --serve") to pick up a rebuilt compiler.
+
+BUILD_DIR="build"
+
+set -e # Quit on error
+cd -- "$(dirname -- "$(readlink -f -- "${BASH_SOURCE[0]}")")" >/dev/null
+
+
+"./make.sh" | grep -Fxv "ninja: no work to do." >&2 || true
+"$BUILD_DIR/src/latex-generator/compiler_latex_client" \
+	--server "$BUILD_DIR/src/latex-generator/compiler_latex_generator" "$@"
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <tclap/CmdLine.h>
+
+#include "aec_styles.h"
+#include "vad_stream.h"
+#include "wav.h"
+
+using namespace audio;
+
+// =================================================================================================
+// Segmentation
+// =================================================================================================
+
+/** Collects the utterances of a stream as ranges of samples */
+class Segment_collector : public Utterance_listener {
+public:
+	struct Segment {
+		uint64_t begin; // In samples
+		uint64_t end;
+	};
+
+	Segment_collector(const Vad_stream& stream, size_t frame_samples)
+			: stream(stream), frame_samples(frame_samples) {}
+
+	void on_audio(const int16_t*, size_t count) override {
+		if (samples == 0) begin = stream.segmenter().utterance_begin() * frame_samples;
+		samples += count;
+	}
+
+	void on_utterance_end() override {
+		segments.push_back({begin, begin + samples});
+		samples = 0;
+	}
+
+	std::vector<Segment> segments;
+
+private:
+	const Vad_stream& stream;
+	size_t frame_samples;
+	uint64_t begin = 0;
+	uint64_t samples = 0;
+};
+
+/**
+ * Streams the audio of [wav] through a Vad_stream, in blocks of [block_samples] from a producer
+ * thread as a microphone would deliver them, and prints the utterances it finds
+ */
+void segment(
+	const std::string& path, const Wav& wav, const Vad_stream_options& options, const Vad& vad,
+	size_t block_samples
+) {
+	std::vector<int16_t> samples = to_mono(wav);
+	Vad_stream stream(options, vad);
+	Segment_collector collector(stream, options.frame_samples);
+
+	auto start = std::chrono::steady_clock::now();
+	std::atomic<bool> produced{false};
+	std::thread producer([&] {
+		for (size_t position = 0; position < samples.size(); position += block_samples) {
+			size_t count = std::min(block_samples, samples.size() - position);
+			// A file can wait for the consumer, unlike a microphone
+			while (!stream.push(&samples[position], count)) std::this_thread::yield();
+		}
+		produced.store(true, std::memory_order_release);
+	});
+	while (true) {
+		bool last = produced.load(std::memory_order_acquire); // Then the ring has all samples
+		if (stream.process(collector) == 0) {
+			if (last) break;
+			std::this_thread::yield();
+		}
+	}
+	producer.join();
+	stream.finish(collector);
+	std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+	std::cout << path << ": " << collector.segments.size() << " utterances in " << wav.seconds()
+	          << " s of audio, segmented in " << seconds.count() << " s\n";
+	std::cout << std::fixed << std::setprecision(2);
+	for (const auto& segment : collector.segments) {
+		std::cout << "  " << static_cast<double>(segment.begin) / wav.sample_rate << " - "
+		          << static_cast<double>(segment.end) / wav.sample_rate << "\n";
+	}
+	std::cout << std::defaultfloat;
+}
+
+// =================================================================================================
+// Command-line interface
+// =================================================================================================
+
+int main(int argc, char** argv) {
+	TCLAP::CmdLine cmd("TalkTex compiler - utterances of WAV files", ' ', "1.0");
+
+	try {
+		TCLAP::ValueArg<size_t> frame_arg("", "frame-ms", "Length of a frame in milliseconds.", false, 20, "unsigned integer", cmd);
+		TCLAP::ValueArg<size_t> padding_arg("p", "padding-ms", "Length of the window of the voice activity detection in milliseconds.", false, 3000, "unsigned integer", cmd);
+		TCLAP::ValueArg<double> ratio_arg("r", "ratio", "Fraction of silence in the window that ends an utterance; a quarter of it in speech begins one.", false, 0.6, "fraction", cmd);
+		TCLAP::ValueArg<double> threshold_arg("t", "threshold", "Frames louder than this many decibels relative to full scale are speech.", false, -40, "decibels", cmd);
+		TCLAP::UnlabeledMultiArg<std::string> files_arg("files", "16-bit PCM WAV files to segment.", true, "paths", cmd);
+		cmd.parse(argc, argv);
+
+		Energy_vad vad(threshold_arg.getValue());
+		int result = 0;
+		for (const auto& path : files_arg.getValue()) {
+			try {
+				Wav wav = read_wav(path);
+				Vad_stream_options options;
+				options.frame_samples = wav.sample_rate * frame_arg.getValue() / 1000;
+				options.padding_frames = padding_arg.getValue() / std::max<size_t>(frame_arg.getValue(), 1);
+				options.ratio = ratio_arg.getValue();
+				segment(path, wav, options, vad, options.frame_samples);
+			} catch (std::runtime_error& e) {
+				std::cerr << aec_style::error << "Error:" << aec::reset << " " << e.what() << "\n";
+				result = 1;
+			}
+		}
+		return result;
+
+	} catch (TCLAP::ArgException& e) {
+		std::cerr << aec_style::error << "command-line error: " << aec::reset << e.error()
+		          << " for arg " << e.argId() << std::endl;
+		return 1;
+	}
+}
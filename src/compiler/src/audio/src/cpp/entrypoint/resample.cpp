@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <tclap/CmdLine.h>
+
+#include "aec_styles.h"
+#include "resampler.h"
+#include "wav.h"
+
+using namespace audio;
+
+// =================================================================================================
+// Verification
+// =================================================================================================
+
+/**
+ * Checks the output of every instruction set against the reference, in blocks of random sizes.
+ * Returns whether they all agree to within a unit of the last place of 16-bit samples.
+ */
+bool verify(const std::vector<int16_t>& samples, uint32_t input_rate, uint32_t output_rate, size_t zero_crossings) {
+	std::vector<int16_t> input(samples.begin(), samples.begin() + std::min<size_t>(samples.size(), input_rate));
+	bool success = true;
+	std::mt19937 random(1);
+	for (Simd simd : {Simd::SCALAR, Simd::SSE, Simd::AVX2}) {
+		if (simd > best_simd()) continue;
+		Resampler resampler(input_rate, output_rate, zero_crossings, simd);
+		std::vector<int16_t> output;
+		for (size_t position = 0; position < input.size();) {
+			size_t count = std::min<size_t>(1 + random() % 2000, input.size() - position);
+			resampler.process(&input[position], count, output);
+			position += count;
+		}
+		std::vector<double> expected = reference_resample(resampler, input, output.size());
+		double max_error = 0;
+		for (size_t i = 0; i < output.size(); ++i) {
+			double clamped = std::clamp(std::nearbyint(expected[i]), -32768.0, 32767.0);
+			max_error = std::max(max_error, std::abs(output[i] - clamped));
+		}
+		bool ok = max_error <= 1;
+		success = success && ok;
+		std::cerr << simd_name(simd) << ": " << output.size() << " samples, largest difference with the reference "
+		          << max_error << (ok ? "" : " (too large)") << "\n";
+	}
+	return success;
+}
+
+// =================================================================================================
+// Command-line interface
+// =================================================================================================
+
+int main(int argc, char** argv) {
+	TCLAP::CmdLine cmd("TalkTex compiler - resampling of WAV files", ' ', "1.0");
+
+	try {
+		TCLAP::ValueArg<uint32_t> rate_arg("r", "rate", "Sample rate to resample to.", false, 16000, "hertz", cmd);
+		TCLAP::ValueArg<size_t> crossings_arg("z", "zero-crossings", "Zero crossings of the filter on either side; more give a sharper filter.", false, 16, "unsigned integer", cmd);
+		TCLAP::ValueArg<size_t> block_arg("b", "block-ms", "Resample in blocks of this many milliseconds, like a microphone delivers them.", false, 20, "unsigned integer", cmd);
+		TCLAP::ValueArg<std::string> simd_arg("", "simd", "Instructions to use: scalar, sse or avx2 (default: the fastest available).", false, "", "string", cmd);
+		TCLAP::SwitchArg verify_switch("", "verify", "Check the first second against a reference implementation, with every instruction set.", cmd, false);
+		TCLAP::ValueArg<std::string> output_arg("o", "output", "Write the resampled audio to this WAV file.", false, "", "string", cmd);
+		TCLAP::UnlabeledValueArg<std::string> input_arg("input", "16-bit PCM WAV file to resample.", true, "", "path", cmd);
+		cmd.parse(argc, argv);
+
+		try {
+			Simd simd = best_simd();
+			if (simd_arg.isSet()) {
+				const std::string& name = simd_arg.getValue();
+				if (name == "scalar") simd = Simd::SCALAR;
+				else if (name == "sse" && best_simd() >= Simd::SSE) simd = Simd::SSE;
+				else if (name == "avx2" && best_simd() >= Simd::AVX2) simd = Simd::AVX2;
+				else throw std::runtime_error("the instructions " + name + " are not available");
+			}
+
+			Wav wav = read_wav(input_arg.getValue());
+			std::vector<int16_t> samples = to_mono(wav);
+			uint32_t output_rate = rate_arg.getValue();
+			if (verify_switch.getValue() && !verify(samples, wav.sample_rate, output_rate, crossings_arg.getValue())) {
+				return 1;
+			}
+
+			Resampler resampler(wav.sample_rate, output_rate, crossings_arg.getValue(), simd);
+			size_t block = std::max<size_t>(wav.sample_rate * block_arg.getValue() / 1000, 1);
+			Wav output;
+			output.sample_rate = output_rate;
+			output.channels = 1;
+			output.samples.reserve(samples.size() * output_rate / wav.sample_rate + 1);
+			auto start = std::chrono::steady_clock::now();
+			for (size_t position = 0; position < samples.size(); position += block) {
+				resampler.process(&samples[position], std::min(block, samples.size() - position), output.samples);
+			}
+			std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+			double audio_seconds = static_cast<double>(samples.size()) / wav.sample_rate;
+			std::cerr << "Resampled " << audio_seconds << " s from " << wav.sample_rate << " Hz to "
+			          << output_rate << " Hz (L/M = " << resampler.up() << "/" << resampler.down() << ", " << resampler.taps_per_phase()
+			          << " taps) with " << simd_name(simd) << " in " << seconds.count() << " s: "
+			          << samples.size() / seconds.count() << " samples/s, "
+			          << 100 * seconds.count() / audio_seconds << "% of a core in real time\n";
+			if (output_arg.isSet()) write_wav(output_arg.getValue(), output);
+			return 0;
+		} catch (std::runtime_error& e) {
+			std::cerr << aec_style::error << "Error:" << aec::reset << " " << e.what() << "\n";
+			return 1;
+		}
+
+	} catch (TCLAP::ArgException& e) {
+		std::cerr << aec_style::error << "command-line error: " << aec::reset << e.error()
+		          << " for arg " << e.argId() << std::endl;
+		return 1;
+	}
+}
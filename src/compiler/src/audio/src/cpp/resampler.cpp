@@ -0,0 +1,247 @@
+#include "resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RESAMPLER_X86
+#include <immintrin.h>
+#endif
+
+namespace audio {
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+
+/** The fraction of the lower Nyquist frequency that the filter passes */
+constexpr double ROLLOFF = 0.9;
+
+/** The shape parameter of the Kaiser window, for about 80 dB of stopband attenuation */
+constexpr double KAISER_BETA = 8.0;
+
+/** The modified Bessel function of the first kind of order 0 */
+double bessel_i0(double x) {
+	double sum = 1;
+	double term = 1;
+	for (int k = 1; k < 50; ++k) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+		if (term < sum * 1e-16) break;
+	}
+	return sum;
+}
+
+/** The filter arrays that the output loop reads, and where it is in the input */
+struct Polyphase {
+	const float* filters;
+	size_t taps;
+	uint32_t up;
+	uint32_t down;
+	const float* input;
+	size_t available; // The number of samples at [input]
+};
+
+/**
+ * Computes the output samples until the next one needs an input sample that is not available yet,
+ * appends them to [out], and returns the time of the next output sample. It is compiled once for
+ * every instruction set, with [dot] inlined.
+ */
+template<typename Dot>
+__attribute__((always_inline)) inline uint64_t polyphase_loop(
+	const Polyphase& p, uint64_t time, std::vector<float>& out, Dot dot
+) {
+	uint64_t base = time / p.up; // The last input sample of the dot product
+	size_t phase = time % p.up;
+	while (base < p.available) {
+		out.push_back(dot(p.filters + phase * p.taps, p.input + base + 1 - p.taps, p.taps));
+		phase += p.down;
+		base += phase / p.up;
+		phase %= p.up;
+		time += p.down;
+	}
+	return time;
+}
+
+__attribute__((always_inline)) inline float dot_scalar(const float* a, const float* b, size_t n) {
+	float sum = 0;
+	for (size_t i = 0; i < n; ++i) sum += a[i] * b[i];
+	return sum;
+}
+
+uint64_t polyphase_scalar(const Polyphase& p, uint64_t time, std::vector<float>& out) {
+	return polyphase_loop(p, time, out, dot_scalar);
+}
+
+#ifdef RESAMPLER_X86
+/** [n] must be a multiple of 8 */
+__attribute__((always_inline)) inline float dot_sse(const float* a, const float* b, size_t n) {
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	for (size_t i = 0; i < n; i += 8) {
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	__m128 sum = _mm_add_ps(sum0, sum1);
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum);
+}
+
+uint64_t polyphase_sse(const Polyphase& p, uint64_t time, std::vector<float>& out) {
+	return polyphase_loop(p, time, out, dot_sse);
+}
+
+/** [n] must be a multiple of 8 */
+__attribute__((target("avx2,fma"), always_inline)) inline float dot_avx2(const float* a, const float* b, size_t n) {
+	__m256 sum0 = _mm256_setzero_ps();
+	__m256 sum1 = _mm256_setzero_ps();
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+		sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);
+	}
+	if (i < n) sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+	__m256 sum8 = _mm256_add_ps(sum0, sum1);
+	__m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx2,fma")))
+uint64_t polyphase_avx2(const Polyphase& p, uint64_t time, std::vector<float>& out) {
+	return polyphase_loop(p, time, out, dot_avx2);
+}
+#endif
+
+using Polyphase_function = uint64_t (*)(const Polyphase&, uint64_t, std::vector<float>&);
+
+Polyphase_function polyphase_for(Simd simd) {
+#ifdef RESAMPLER_X86
+	switch (simd) {
+		case Simd::AVX2: return polyphase_avx2;
+		case Simd::SSE: return polyphase_sse;
+		case Simd::SCALAR: break;
+	}
+#else
+	(void) simd;
+#endif
+	return polyphase_scalar;
+}
+
+int16_t to_int16(float sample) {
+	float scaled = std::nearbyint(sample);
+	return static_cast<int16_t>(std::clamp(scaled, -32768.0f, 32767.0f));
+}
+
+} // namespace
+
+Simd best_simd() {
+#ifdef RESAMPLER_X86
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return Simd::AVX2;
+	return Simd::SSE;
+#else
+	return Simd::SCALAR;
+#endif
+}
+
+const char* simd_name(Simd simd) {
+	switch (simd) {
+		case Simd::AVX2: return "avx2";
+		case Simd::SSE: return "sse";
+		case Simd::SCALAR: break;
+	}
+	return "scalar";
+}
+
+Resampler::Resampler(uint32_t input_rate, uint32_t output_rate, size_t zero_crossings, Simd simd)
+		: upsampling(output_rate / std::gcd(input_rate, output_rate))
+		, downsampling(input_rate / std::gcd(input_rate, output_rate))
+		, instructions(simd)
+{
+	// The prototype filter runs at the upsampled rate, and passes the lower of both Nyquist frequencies
+	double cutoff = ROLLOFF * 0.5 / std::max(upsampling, downsampling); // In cycles per sample
+	// The zero crossings of the sinc are 1 / (2 * cutoff) upsampled samples apart
+	double crossing_taps = std::max<size_t>(zero_crossings, 1) / cutoff / upsampling;
+	taps = (static_cast<size_t>(std::ceil(crossing_taps)) + 7) / 8 * 8;
+	size_t length = taps * upsampling;
+	double center = (length - 1) / 2.0;
+	std::vector<double> prototype(length);
+	for (size_t i = 0; i < length; ++i) {
+		double x = i - center;
+		double sinc = x == 0 ? 1 : std::sin(2 * PI * cutoff * x) / (2 * PI * cutoff * x);
+		double r = 2 * x / (length - 1);
+		double window = bessel_i0(KAISER_BETA * std::sqrt(std::max(0.0, 1 - r * r))) / bessel_i0(KAISER_BETA);
+		// The gain of L makes up for the zeros of the upsampling
+		prototype[i] = upsampling * 2 * cutoff * sinc * window;
+	}
+
+	filters.resize(length);
+	for (size_t phase = 0; phase < upsampling; ++phase) {
+		for (size_t j = 0; j < taps; ++j) {
+			filters[phase * taps + j] = static_cast<float>(prototype[phase + (taps - 1 - j) * upsampling]);
+		}
+	}
+	reset();
+}
+
+void Resampler::reset() {
+	buffer.assign(taps - 1, 0.0f);
+	time = static_cast<uint64_t>(taps - 1) * upsampling; // The first output is at the first input
+}
+
+void Resampler::process(const int16_t* input, size_t count, std::vector<int16_t>& out) {
+	buffer.insert(buffer.end(), input, input + count);
+	run(out, to_int16);
+}
+
+void Resampler::process(const float* input, size_t count, std::vector<float>& out) {
+	size_t start = buffer.size();
+	buffer.insert(buffer.end(), input, input + count);
+	for (size_t i = start; i < buffer.size(); ++i) buffer[i] *= 32768.0f;
+	run(out, [](float sample) { return sample / 32768.0f; });
+}
+
+template<typename Out, typename Convert>
+void Resampler::run(std::vector<Out>& out, Convert convert) {
+	size_t available = buffer.size();
+	Polyphase polyphase{filters.data(), taps, upsampling, downsampling, buffer.data(), available};
+	output.clear();
+	time = polyphase_for(instructions)(polyphase, time, output);
+	size_t size = out.size();
+	out.resize(size + output.size());
+	std::transform(output.begin(), output.end(), out.begin() + size, convert);
+	// Keep the last taps - 1 samples, which the next outputs need
+	size_t consumed = available - (taps - 1);
+	buffer.erase(buffer.begin(), buffer.begin() + consumed);
+	time -= static_cast<uint64_t>(consumed) * upsampling;
+}
+
+std::vector<double> reference_resample(const Resampler& resampler, const std::vector<int16_t>& input, size_t count) {
+	size_t up = resampler.up();
+	size_t taps = resampler.taps_per_phase();
+	size_t length = taps * up;
+	std::vector<double> prototype(length);
+	for (size_t phase = 0; phase < up; ++phase) {
+		for (size_t j = 0; j < taps; ++j) prototype[phase + (taps - 1 - j) * up] = resampler.phase_filter(phase)[j];
+	}
+	// The input is preceded by taps - 1 silent samples, like the history of a new resampler
+	size_t padding = taps - 1;
+	std::vector<double> output(count);
+	for (size_t n = 0; n < count; ++n) {
+		size_t t = padding * up + n * resampler.down(); // In the zero-stuffed stream
+		double sum = 0;
+		for (size_t i = 0; i < length && i <= t; ++i) {
+			size_t position = t - i;
+			if (position % up != 0) continue; // A stuffed zero
+			size_t sample = position / up;
+			if (sample >= padding && sample - padding < input.size()) sum += prototype[i] * input[sample - padding];
+		}
+		output[n] = sum;
+	}
+	return output;
+}
+
+} // namespace audio
@@ -0,0 +1,67 @@
+#include "vad_segmenter.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace audio {
+
+Energy_vad::Energy_vad(double threshold_dbfs)
+		: threshold(32768.0 * 32768.0 * std::pow(10.0, threshold_dbfs / 10))
+{}
+
+bool Energy_vad::operator()(const int16_t* samples, size_t count) const {
+	if (count == 0) return false;
+	int64_t sum = 0;
+	for (size_t i = 0; i < count; ++i) {
+		sum += static_cast<int32_t>(samples[i]) * samples[i];
+	}
+	return static_cast<double>(sum) / count > threshold;
+}
+
+Vad_segmenter::Vad_segmenter(size_t padding_frames, double ratio)
+		: window(std::max<size_t>(padding_frames, 1))
+		, begin_threshold(ratio * window.size() / 4)
+		, end_threshold(ratio * window.size())
+{}
+
+Vad_segmenter::Event Vad_segmenter::push(bool speech) {
+	++pushed;
+	append(speech);
+	if (!triggered) {
+		if (voiced > begin_threshold) {
+			triggered = true;
+			begin = pushed - window_count;
+			clear_window();
+			return Event::BEGIN;
+		}
+	}
+	else if (window_count - voiced > end_threshold) {
+		triggered = false;
+		clear_window();
+		return Event::END;
+	}
+	return Event::NONE;
+}
+
+void Vad_segmenter::append(bool speech) {
+	size_t capacity = window.size();
+	if (window_count == capacity) {
+		voiced -= window[window_start];
+		window[window_start] = speech;
+		window_start = window_start + 1 == capacity ? 0 : window_start + 1;
+	}
+	else {
+		size_t end = window_start + window_count;
+		window[end >= capacity ? end - capacity : end] = speech;
+		++window_count;
+	}
+	voiced += speech;
+}
+
+void Vad_segmenter::clear_window() {
+	window_start = 0;
+	window_count = 0;
+	voiced = 0;
+}
+
+} // namespace audio
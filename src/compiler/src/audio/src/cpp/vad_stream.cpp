@@ -0,0 +1,68 @@
+#include "vad_stream.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace audio {
+
+namespace {
+
+size_t power_of_two_at_least(size_t n) {
+	size_t power = 1;
+	while (power < n) power *= 2;
+	return power;
+}
+
+} // namespace
+
+Vad_stream::Vad_stream(const Vad_stream_options& options, Vad vad)
+		: frame_samples(std::max<size_t>(options.frame_samples, 1))
+		, vad(std::move(vad))
+		, segments(options.padding_frames, options.ratio)
+		, ring(power_of_two_at_least(std::max(options.ring_samples, frame_samples)))
+		, frame(frame_samples)
+		, padding(segments.padding_frames() * frame_samples)
+{}
+
+bool Vad_stream::push(const int16_t* samples, size_t count) {
+	if (ring.try_push_n(samples, count)) return true;
+	dropped.fetch_add(count, std::memory_order_relaxed);
+	return false;
+}
+
+size_t Vad_stream::process(Utterance_listener& listener) {
+	size_t frames = 0;
+	while (ring.try_pop_n(frame.data(), frame_samples)) {
+		process_frame(listener);
+		++frames;
+	}
+	return frames;
+}
+
+void Vad_stream::finish(Utterance_listener& listener) {
+	process(listener);
+	if (segments.in_utterance()) listener.on_utterance_end();
+}
+
+void Vad_stream::process_frame(Utterance_listener& listener) {
+	uint64_t number = segments.frames();
+	bool was_in_utterance = segments.in_utterance();
+	if (was_in_utterance) listener.on_audio(frame.data(), frame_samples);
+
+	Vad_segmenter::Event event = segments.push(vad(frame.data(), frame_samples));
+	size_t padding_frames = segments.padding_frames();
+	if (!was_in_utterance) {
+		std::copy(frame.begin(), frame.end(), padding.begin() + number % padding_frames * frame_samples);
+	}
+	if (event == Vad_segmenter::Event::BEGIN) {
+		// Pass on the window, which ends with this frame
+		for (uint64_t n = segments.utterance_begin(); n <= number; ++n) {
+			listener.on_audio(&padding[n % padding_frames * frame_samples], frame_samples);
+		}
+	}
+	else if (event == Vad_segmenter::Event::END) {
+		listener.on_utterance_end();
+	}
+}
+
+} // namespace audio
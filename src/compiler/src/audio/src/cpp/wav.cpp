@@ -0,0 +1,203 @@
+#include "wav.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "mapped_file.h"
+
+namespace audio {
+
+namespace {
+
+constexpr uint16_t FORMAT_PCM = 1;
+constexpr uint16_t FORMAT_EXTENSIBLE = 0xFFFE;
+
+uint16_t read_u16(const char* data) {
+	auto bytes = reinterpret_cast<const unsigned char*>(data);
+	return static_cast<uint16_t>(bytes[0] | bytes[1] << 8);
+}
+
+uint32_t read_u32(const char* data) {
+	return read_u16(data) | static_cast<uint32_t>(read_u16(data + 2)) << 16;
+}
+
+void write_u16(std::string& out, uint16_t value) {
+	out += static_cast<char>(value & 0xFF);
+	out += static_cast<char>(value >> 8);
+}
+
+void write_u32(std::string& out, uint32_t value) {
+	write_u16(out, static_cast<uint16_t>(value & 0xFFFF));
+	write_u16(out, static_cast<uint16_t>(value >> 16));
+}
+
+/**
+ * Reads the format chunk of [available] bytes at [body] into [channels] and [sample_rate]. Throws
+ * std::runtime_error if it is not 16-bit PCM.
+ */
+void parse_format(const char* body, size_t available, uint16_t& channels, uint32_t& sample_rate) {
+	if (available < 16) throw std::runtime_error("truncated format chunk");
+	uint16_t format = read_u16(body);
+	channels = read_u16(body + 2);
+	sample_rate = read_u32(body + 4);
+	uint16_t bits = read_u16(body + 14);
+	if (format == FORMAT_EXTENSIBLE && available >= 26) format = read_u16(body + 24);
+	if (format != FORMAT_PCM || bits != 16) {
+		throw std::runtime_error("only 16-bit PCM is supported");
+	}
+	if (channels == 0 || sample_rate == 0) {
+		throw std::runtime_error("no channels or no sample rate");
+	}
+}
+
+} // namespace
+
+Wav read_wav(const std::string& path) {
+	Mapped_file file;
+	if (!file.open(path)) throw std::runtime_error("could not read " + path);
+	try {
+		return parse_wav(file.data(), file.size());
+	} catch (std::runtime_error& e) {
+		throw std::runtime_error(path + ": " + e.what());
+	}
+}
+
+Wav parse_wav(const char* data, size_t size) {
+	if (size < 12 || std::memcmp(data, "RIFF", 4) != 0 || std::memcmp(data + 8, "WAVE", 4) != 0) {
+		throw std::runtime_error("not a WAV file");
+	}
+	Wav wav;
+	bool has_format = false;
+	size_t position = 12;
+	// The file is a sequence of chunks of an id and a size, padded to an even size
+	while (position + 8 <= size) {
+		const char* chunk = data + position;
+		size_t chunk_size = read_u32(chunk + 4);
+		const char* body = chunk + 8;
+		size_t available = std::min(chunk_size, size - position - 8);
+		if (std::memcmp(chunk, "fmt ", 4) == 0) {
+			parse_format(body, available, wav.channels, wav.sample_rate);
+			has_format = true;
+		}
+		else if (std::memcmp(chunk, "data", 4) == 0) {
+			if (!has_format) throw std::runtime_error("data chunk before the format chunk");
+			// Recorders that are stopped abruptly may leave a data size that is too large
+			size_t frame_bytes = 2 * static_cast<size_t>(wav.channels);
+			size_t samples = available / frame_bytes * wav.channels;
+			wav.samples.resize(samples);
+			for (size_t i = 0; i < samples; ++i) {
+				wav.samples[i] = static_cast<int16_t>(read_u16(body + 2 * i));
+			}
+			return wav;
+		}
+		position += 8 + chunk_size + (chunk_size & 1);
+	}
+	throw std::runtime_error("no data chunk");
+}
+
+void write_wav(const std::string& path, const Wav& wav) {
+	uint32_t data_size = static_cast<uint32_t>(wav.samples.size() * 2);
+	std::string file;
+	file.reserve(44 + data_size);
+	file += "RIFF";
+	write_u32(file, 36 + data_size);
+	file += "WAVEfmt ";
+	write_u32(file, 16);
+	write_u16(file, FORMAT_PCM);
+	write_u16(file, wav.channels);
+	write_u32(file, wav.sample_rate);
+	write_u32(file, wav.sample_rate * wav.channels * 2); // Bytes per second
+	write_u16(file, static_cast<uint16_t>(wav.channels * 2)); // Bytes per frame
+	write_u16(file, 16);
+	file += "data";
+	write_u32(file, data_size);
+	for (int16_t sample : wav.samples) write_u16(file, static_cast<uint16_t>(sample));
+
+	std::ofstream stream(path, std::ios::binary);
+	if (!stream.write(file.data(), file.size())) throw std::runtime_error("could not write " + path);
+}
+
+std::vector<int16_t> to_mono(const Wav& wav) {
+	if (wav.channels == 1) return wav.samples;
+	std::vector<int16_t> mono(wav.frames());
+	mix_to_mono(wav.samples.data(), mono.size(), wav.channels, mono.data());
+	return mono;
+}
+
+void mix_to_mono(const int16_t* samples, size_t frames, uint16_t channels, int16_t* out) {
+	for (size_t frame = 0; frame < frames; ++frame) {
+		int sum = 0;
+		for (size_t channel = 0; channel < channels; ++channel) {
+			sum += samples[frame * channels + channel];
+		}
+		out[frame] = static_cast<int16_t>(sum / channels);
+	}
+}
+
+//==================================================================================================
+// Wav_reader
+//==================================================================================================
+
+Wav_reader::Wav_reader(const std::string& path)
+		: path(path)
+		, file(path, std::ios::binary)
+{
+	if (!file.is_open()) throw std::runtime_error("could not read " + path);
+	file.seekg(0, std::ios::end);
+	size_t size = static_cast<size_t>(file.tellg());
+	file.seekg(0);
+
+	// Like parse_wav, but only the chunk headers and the format are read
+	char header[40];
+	auto fail = [&](const std::string& message) {
+		throw std::runtime_error(path + ": " + message);
+	};
+	if (size < 12 || !file.read(header, 12) || std::memcmp(header, "RIFF", 4) != 0 || std::memcmp(header + 8, "WAVE", 4) != 0) {
+		fail("not a WAV file");
+	}
+	bool has_format = false;
+	size_t position = 12;
+	while (position + 8 <= size) {
+		file.seekg(static_cast<std::streamoff>(position));
+		if (!file.read(header, 8)) fail("could not read the chunk at " + std::to_string(position));
+		size_t chunk_size = read_u32(header + 4);
+		size_t available = std::min(chunk_size, size - position - 8);
+		if (std::memcmp(header, "fmt ", 4) == 0) {
+			size_t length = std::min(available, sizeof(header));
+			if (!file.read(header, static_cast<std::streamsize>(length))) fail("could not read the format chunk");
+			try {
+				parse_format(header, length, channel_count, rate);
+			} catch (std::runtime_error& e) {
+				fail(e.what());
+			}
+			has_format = true;
+		}
+		else if (std::memcmp(header, "data", 4) == 0) {
+			if (!has_format) fail("data chunk before the format chunk");
+			// The file is now at the first sample
+			total_frames = available / (2 * static_cast<size_t>(channel_count));
+			return;
+		}
+		position += 8 + chunk_size + (chunk_size & 1);
+	}
+	fail("no data chunk");
+}
+
+size_t Wav_reader::read(std::vector<int16_t>& out, size_t max_frames) {
+	size_t frames = std::min(max_frames, total_frames - frames_read);
+	size_t samples = frames * channel_count;
+	bytes.resize(2 * samples);
+	if (!file.read(bytes.data(), static_cast<std::streamsize>(bytes.size()))) {
+		throw std::runtime_error("could not read " + path);
+	}
+	out.resize(samples);
+	for (size_t i = 0; i < samples; ++i) {
+		out[i] = static_cast<int16_t>(read_u16(&bytes[2 * i]));
+	}
+	frames_read += frames;
+	return frames;
+}
+
+} // namespace audio
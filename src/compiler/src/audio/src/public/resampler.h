@@ -0,0 +1,100 @@
+/* Conversion of streaming audio between sample rates */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace audio {
+
+/** The instructions that the inner loop of a Resampler uses */
+enum class Simd {
+	SCALAR,
+	SSE,  // SSE2, which every x86-64 processor has
+	AVX2  // AVX2 with FMA
+};
+
+/** The fastest instructions that the processor supports */
+Simd best_simd();
+
+const char* simd_name(Simd simd);
+
+/**
+ * Resamples a stream of audio from one rate to another with a polyphase FIR filter, block by block.
+ *
+ * The rates are related by L / M in lowest terms: conceptually, the input is upsampled by L,
+ * low-pass filtered and downsampled by M. Only the filter taps that meet input samples are
+ * evaluated: every output sample is a dot product of taps_per_phase() input samples with one of the
+ * L phases of the filter. The last input samples are kept between blocks, so the output of a stream
+ * does not depend on how it is split into blocks, and has no discontinuities at their edges.
+ *
+ * The filter is a Kaiser-windowed sinc with [zero_crossings] zero crossings on either side, at the
+ * lower of both rates. It passes 90% of the lower Nyquist frequency; more zero crossings make the
+ * band in which it goes from passing to blocking narrower. With 16, from 48 kHz to 16 kHz, it passes
+ * up to 7.2 kHz and blocks everything from 8.5 kHz on. The filter delays the output by half of its
+ * length.
+ */
+class Resampler {
+public:
+	Resampler(uint32_t input_rate, uint32_t output_rate, size_t zero_crossings = 16, Simd simd = best_simd());
+
+	/** Resamples the [count] samples at [input], and appends the output samples to [out] */
+	void process(const int16_t* input, size_t count, std::vector<int16_t>& out);
+
+	/** Like process, for samples in [-1, 1] */
+	void process(const float* input, size_t count, std::vector<float>& out);
+
+	/** Forgets the samples of the stream so far */
+	void reset();
+
+	/** The L and M of the rates */
+	uint32_t up() const {
+		return upsampling;
+	}
+
+	uint32_t down() const {
+		return downsampling;
+	}
+
+	/** The number of input samples that every output sample depends on, a multiple of 8 */
+	size_t taps_per_phase() const {
+		return taps;
+	}
+
+	Simd simd() const {
+		return instructions;
+	}
+
+	/**
+	 * The filter of phase [phase], reversed: output sample n, whose position in the upsampled stream
+	 * is t = n * M, is the dot product of the filter of phase t % L with the input samples up to and
+	 * including sample t / L.
+	 */
+	const float* phase_filter(size_t phase) const {
+		return &filters[phase * taps];
+	}
+
+private:
+	/** Appends the output samples that the samples in [buffer] make, in [convert]ed form, and keeps the history */
+	template<typename Out, typename Convert>
+	void run(std::vector<Out>& out, Convert convert);
+
+	uint32_t upsampling;
+	uint32_t downsampling;
+	size_t taps;
+	Simd instructions;
+	std::vector<float> filters;  // L filters of [taps] taps each
+	std::vector<float> buffer;   // The last taps - 1 input samples, followed by the new ones
+	std::vector<float> output;   // Of the block being resampled
+	uint64_t time;               // Of the next output sample in the upsampled stream, from buffer[0]
+};
+
+/**
+ * Resamples [input] the textbook way, in double precision, to check [resampler] against: by putting
+ * L - 1 zeros after every input sample, convolving with the whole filter of [resampler] and keeping
+ * every M-th sample. Returns the first [count] output samples, unrounded, of a new resampler.
+ */
+std::vector<double> reference_resample(const Resampler& resampler, const std::vector<int16_t>& input, size_t count);
+
+} // namespace audio
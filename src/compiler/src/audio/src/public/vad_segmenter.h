@@ -0,0 +1,96 @@
+/* Segmentation of audio into utterances with voice activity detection */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace audio {
+
+/** A voice activity detector: whether the [count] samples at [samples] are speech */
+using Vad = std::function<bool(const int16_t* samples, size_t count)>;
+
+/**
+ * A voice activity detector that takes a frame for speech if its energy is above a threshold. It
+ * stands in for a real detector, like the one of WebRTC, on recordings without much noise.
+ */
+class Energy_vad {
+public:
+	/** Frames louder than [threshold_dbfs] decibels relative to full scale are speech */
+	explicit Energy_vad(double threshold_dbfs = -40);
+
+	bool operator()(const int16_t* samples, size_t count) const;
+
+private:
+	double threshold; // Of the mean square of a sample
+};
+
+/**
+ * Finds the utterances in a stream of frames, from whether every frame is speech, like
+ * VADAudio.vad_collector of talktex.py does.
+ *
+ * It looks at a window of the last [padding_frames] frames. Outside an utterance, an utterance
+ * begins when more than [ratio] / 4 of the window is speech, and it begins at the oldest frame of
+ * the window. Inside an utterance, it ends after the frame that makes more than [ratio] of the
+ * window silence. The window is emptied at both. The numbers of voiced and unvoiced frames of the
+ * window are kept as the window moves, so every frame takes constant time.
+ */
+class Vad_segmenter {
+public:
+	enum class Event {
+		NONE,
+		BEGIN, // An utterance begins at frame utterance_begin(), and includes this frame
+		END    // The utterance ends after this frame
+	};
+
+	/** A [padding_frames] of 0 is taken as 1 */
+	Vad_segmenter(size_t padding_frames, double ratio);
+
+	/** Adds the next frame, which is speech if [speech] is set */
+	Event push(bool speech);
+
+	/** Whether the last frame pushed is part of an utterance */
+	bool in_utterance() const {
+		return triggered;
+	}
+
+	/** The first frame of the current or last utterance */
+	uint64_t utterance_begin() const {
+		return begin;
+	}
+
+	/** The number of frames pushed so far */
+	uint64_t frames() const {
+		return pushed;
+	}
+
+	/** The number of frames in the window */
+	size_t window_size() const {
+		return window_count;
+	}
+
+	/** The capacity of the window */
+	size_t padding_frames() const {
+		return window.size();
+	}
+
+private:
+	/** Appends a frame to the window, dropping the oldest if it is full */
+	void append(bool speech);
+
+	void clear_window();
+
+	std::vector<bool> window; // A ring: the frames are at [window_start, window_start + window_count)
+	size_t window_start = 0;
+	size_t window_count = 0;
+	size_t voiced = 0;        // The number of frames of the window that are speech
+	double begin_threshold;   // More voiced frames than this begin an utterance
+	double end_threshold;     // More unvoiced frames than this end an utterance
+	bool triggered = false;
+	uint64_t begin = 0;
+	uint64_t pushed = 0;
+};
+
+} // namespace audio
@@ -0,0 +1,90 @@
+/* Utterances from a live stream of audio, passed from a capture thread through a lock-free ring */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "spsc_ring.h"
+#include "vad_segmenter.h"
+
+namespace audio {
+
+/** Receives the audio of the utterances that a Vad_stream finds */
+class Utterance_listener {
+public:
+	virtual ~Utterance_listener() = default;
+
+	/**
+	 * The next [count] samples of the current utterance. The first ones of an utterance are those of
+	 * the padding before it, the frames from Vad_segmenter::utterance_begin() on.
+	 */
+	virtual void on_audio(const int16_t* samples, size_t count) = 0;
+
+	/** The utterance ended; audio after this belongs to the next one */
+	virtual void on_utterance_end() = 0;
+};
+
+struct Vad_stream_options {
+	size_t frame_samples = 320;   // 20 ms at 16 kHz, like talktex.py
+	size_t padding_frames = 150;  // The padding_ms of vad_collector, in frames
+	double ratio = 0.6;
+	size_t ring_samples = 1 << 16; // The capacity of the ring; rounded up to a power of two
+};
+
+/**
+ * Splits a stream of audio into utterances. The thread that captures the audio pushes samples into
+ * a single-producer single-consumer ring, without locks or allocation, so it never waits for the
+ * consumer. The consumer takes whole frames from the ring, asks the voice activity detector about
+ * each, and passes the utterances on to an Utterance_listener.
+ *
+ * The frames of the window of the segmenter are kept in a ring as well, to pass the padding before
+ * an utterance on when it begins. Every frame takes constant time, apart from the detector.
+ */
+class Vad_stream {
+public:
+	Vad_stream(const Vad_stream_options& options, Vad vad);
+
+	/**
+	 * Producer only. Appends the [count] samples at [samples] to the stream. Returns false, and drops
+	 * them, if the ring has no room for them; the consumer is then too slow.
+	 */
+	bool push(const int16_t* samples, size_t count);
+
+	/**
+	 * Consumer only. Takes all whole frames out of the ring and passes the audio of the utterances in
+	 * them to [listener]. Returns the number of frames taken.
+	 */
+	size_t process(Utterance_listener& listener);
+
+	/**
+	 * Consumer only. Ends the utterance in progress, if any, at the end of the stream. Samples that do
+	 * not make a whole frame are dropped, like vad_collector drops them.
+	 */
+	void finish(Utterance_listener& listener);
+
+	const Vad_segmenter& segmenter() const {
+		return segments;
+	}
+
+	/** The number of samples dropped because the ring was full. May be called from any thread. */
+	uint64_t dropped_samples() const {
+		return dropped.load(std::memory_order_relaxed);
+	}
+
+private:
+	/** Passes one frame, in [frame], through the segmenter */
+	void process_frame(Utterance_listener& listener);
+
+	size_t frame_samples;
+	Vad vad;
+	Vad_segmenter segments;
+	Spsc_ring<int16_t> ring;
+	std::vector<int16_t> frame;
+	std::vector<int16_t> padding; // The audio of the frames of the window, at frame number modulo padding_frames
+	std::atomic<uint64_t> dropped{0}; // Only written by the producer
+};
+
+} // namespace audio
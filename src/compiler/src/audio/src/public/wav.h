@@ -0,0 +1,90 @@
+/* Reading of 16-bit PCM WAV files */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace audio {
+
+/** The audio of a WAV file */
+struct Wav {
+	uint32_t sample_rate = 0;
+	uint16_t channels = 0;
+	std::vector<int16_t> samples; // Interleaved if there are several channels
+
+	/** The number of samples per channel */
+	size_t frames() const {
+		return channels == 0 ? 0 : samples.size() / channels;
+	}
+
+	double seconds() const {
+		return sample_rate == 0 ? 0 : static_cast<double>(frames()) / sample_rate;
+	}
+};
+
+/**
+ * Reads the 16-bit PCM WAV file at [path]. Throws std::runtime_error if it can not be read, or is
+ * not such a file.
+ */
+Wav read_wav(const std::string& path);
+
+/** Reads a 16-bit PCM WAV file from the [size] bytes at [data], like read_wav */
+Wav parse_wav(const char* data, size_t size);
+
+/** Writes [wav] to the file at [path] as 16-bit PCM. Throws std::runtime_error on failure. */
+void write_wav(const std::string& path, const Wav& wav);
+
+/** Returns the samples of [wav] with its channels averaged into one */
+std::vector<int16_t> to_mono(const Wav& wav);
+
+/** Averages the [channels] channels of the [frames] interleaved frames at [samples] into [out] */
+void mix_to_mono(const int16_t* samples, size_t frames, uint16_t channels, int16_t* out);
+
+/**
+ * Reads a 16-bit PCM WAV file block by block, so that only a block of its samples is in memory at a
+ * time. It accepts the same files as read_wav.
+ */
+class Wav_reader {
+public:
+	/** Opens the file at [path] and reads its header. Throws std::runtime_error like read_wav. */
+	explicit Wav_reader(const std::string& path);
+
+	uint32_t sample_rate() const {
+		return rate;
+	}
+
+	uint16_t channels() const {
+		return channel_count;
+	}
+
+	/** The number of samples per channel */
+	size_t frames() const {
+		return total_frames;
+	}
+
+	double seconds() const {
+		return static_cast<double>(total_frames) / rate;
+	}
+
+	/**
+	 * Reads the next frames, at most [max_frames], into [out] as interleaved samples. Returns the
+	 * number of frames read, which is 0 at the end. Throws std::runtime_error if the file can not be
+	 * read.
+	 */
+	size_t read(std::vector<int16_t>& out, size_t max_frames);
+
+private:
+	std::string path;
+	std::ifstream file;
+	uint32_t rate = 0;
+	uint16_t channel_count = 0;
+	size_t total_frames = 0;
+	size_t frames_read = 0;
+	std::vector<char> bytes; // Of the block being read
+};
+
+} // namespace audio
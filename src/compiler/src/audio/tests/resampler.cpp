@@ -0,0 +1,81 @@
+/* Tests of the resampler against the reference resampling, with every instruction set */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "aec_styles.h"
+#include "resampler.h"
+
+using namespace audio;
+
+namespace {
+
+bool success = true;
+
+void fail(const std::string& test, const std::string& message) {
+	std::cerr << aec_style::error << "Error:" << aec::reset << " " << test << ": " << message << "\n";
+	success = false;
+}
+
+/**
+ * Returns a second of audio at [rate]: a sweep over the whole band, which crosses the cutoff of the
+ * filter, with noise. It peaks near full scale, so that the output is clamped at times.
+ */
+std::vector<int16_t> test_signal(uint32_t rate) {
+	constexpr double PI = 3.14159265358979323846;
+	std::mt19937 random(rate);
+	std::normal_distribution<double> noise(0, 1000);
+	std::vector<int16_t> samples(rate);
+	double phase = 0;
+	for (size_t i = 0; i < samples.size(); ++i) {
+		double frequency = 0.5 * rate * i / samples.size();
+		phase += 2 * PI * frequency / rate;
+		double sample = 31000 * std::sin(phase) + noise(random);
+		samples[i] = static_cast<int16_t>(std::clamp(std::nearbyint(sample), -32768.0, 32767.0));
+	}
+	return samples;
+}
+
+/** Resamples a second at [input_rate] to 16 kHz in blocks of random sizes, with every instruction set */
+void test_rate(uint32_t input_rate) {
+	const std::string test = "resampling from " + std::to_string(input_rate) + " Hz";
+	std::vector<int16_t> input = test_signal(input_rate);
+	std::mt19937 random(1);
+	for (Simd simd : {Simd::SCALAR, Simd::SSE, Simd::AVX2}) {
+		if (simd > best_simd()) continue;
+		Resampler resampler(input_rate, 16000, 16, simd);
+		std::vector<int16_t> output;
+		for (size_t position = 0; position < input.size();) {
+			size_t count = std::min<size_t>(1 + random() % 2000, input.size() - position);
+			resampler.process(&input[position], count, output);
+			position += count;
+		}
+		size_t expected_count = input.size() * resampler.up() / resampler.down();
+		if (output.size() + 1 < expected_count || output.size() > expected_count + 1) {
+			fail(test, std::string(simd_name(simd)) + " made " + std::to_string(output.size()) + " samples");
+		}
+
+		std::vector<double> expected = reference_resample(resampler, input, output.size());
+		for (size_t i = 0; i < output.size(); ++i) {
+			double clamped = std::clamp(std::nearbyint(expected[i]), -32768.0, 32767.0);
+			if (std::abs(output[i] - clamped) > 1) {
+				fail(test, std::string(simd_name(simd)) + ": sample " + std::to_string(i) + " is "
+					+ std::to_string(output[i]) + " instead of " + std::to_string(static_cast<int>(clamped)));
+				break;
+			}
+		}
+	}
+}
+
+} // unnamed namespace
+
+int main() {
+	test_rate(48000);
+	test_rate(44100);
+	test_rate(22050);
+	return (success ? 0 : 1);
+}
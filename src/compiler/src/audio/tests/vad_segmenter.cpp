@@ -0,0 +1,153 @@
+/* Tests of the streaming segmentation of audio against VADAudio.vad_collector of talktex.py */
+
+#include <deque>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "aec_styles.h"
+#include "vad_stream.h"
+
+using namespace audio;
+
+namespace {
+
+bool success = true;
+
+void fail(const std::string& test, const std::string& message) {
+	std::cerr << aec_style::error << "Error:" << aec::reset << " " << test << ": " << message << "\n";
+	success = false;
+}
+
+/** Marks the end of an utterance in the frames that a segmentation yields */
+constexpr int64_t END = -1;
+
+/**
+ * A line-by-line port of vad_collector, which recounts its window for every frame. Returns the
+ * numbers of the frames that it yields for the frames whose speech flags are [speech], with END
+ * where it yields None.
+ */
+std::vector<int64_t> vad_collector(const std::vector<bool>& speech, size_t padding_frames, double ratio) {
+	std::deque<std::pair<int64_t, bool>> ring_buffer;
+	bool triggered = false;
+	std::vector<int64_t> yielded;
+	auto append = [&](int64_t frame, bool is_speech) {
+		if (ring_buffer.size() == padding_frames) ring_buffer.pop_front();
+		ring_buffer.emplace_back(frame, is_speech);
+	};
+	for (size_t frame = 0; frame < speech.size(); ++frame) {
+		bool is_speech = speech[frame];
+		if (!triggered) {
+			append(frame, is_speech);
+			size_t num_voiced = 0;
+			for (const auto& [f, s] : ring_buffer) num_voiced += s;
+			if (num_voiced > ratio * padding_frames / 4) {
+				triggered = true;
+				for (const auto& [f, s] : ring_buffer) yielded.push_back(f);
+				ring_buffer.clear();
+			}
+		}
+		else {
+			yielded.push_back(frame);
+			append(frame, is_speech);
+			size_t num_unvoiced = 0;
+			for (const auto& [f, s] : ring_buffer) num_unvoiced += !s;
+			if (num_unvoiced > ratio * padding_frames) {
+				triggered = false;
+				yielded.push_back(END);
+				ring_buffer.clear();
+			}
+		}
+	}
+	return yielded;
+}
+
+/** Records the frames of the utterances, whose first sample is their frame number */
+class Recorder : public Utterance_listener {
+public:
+	explicit Recorder(size_t frame_samples) : frame_samples(frame_samples) {}
+
+	void on_audio(const int16_t* samples, size_t count) override {
+		for (size_t i = 0; i < count; i += frame_samples) frames.push_back(samples[i]);
+	}
+
+	void on_utterance_end() override {
+		frames.push_back(END);
+	}
+
+	size_t frame_samples;
+	std::vector<int64_t> frames;
+};
+
+/** Returns [count] speech flags in bursts of random lengths, which are speech with [speech_probability] */
+std::vector<bool> random_speech(size_t count, double speech_probability, std::mt19937& random) {
+	std::vector<bool> speech;
+	std::bernoulli_distribution is_speech(speech_probability);
+	std::uniform_int_distribution<size_t> burst(1, 40);
+	while (speech.size() < count) {
+		bool flag = is_speech(random);
+		for (size_t length = burst(random); length > 0 && speech.size() < count; --length) speech.push_back(flag);
+	}
+	return speech;
+}
+
+/**
+ * Streams frames with the flags [speech] through a Vad_stream, in pushes of random sizes, and checks
+ * that it yields the frames that vad_collector yields
+ */
+void test_stream(const std::vector<bool>& speech, size_t padding_frames, double ratio, std::mt19937& random) {
+	const std::string test = "padding " + std::to_string(padding_frames) + ", ratio " + std::to_string(ratio);
+	constexpr size_t FRAME_SAMPLES = 4;
+	Vad_stream_options options;
+	options.frame_samples = FRAME_SAMPLES;
+	options.padding_frames = padding_frames;
+	options.ratio = ratio;
+	options.ring_samples = 1 << 12;
+	// The frames carry their number, for the detector and the Recorder
+	Vad_stream stream(options, [&speech](const int16_t* samples, size_t) { return speech[samples[0]]; });
+
+	std::vector<int16_t> audio(speech.size() * FRAME_SAMPLES);
+	for (size_t i = 0; i < audio.size(); ++i) audio[i] = static_cast<int16_t>(i / FRAME_SAMPLES);
+	Recorder recorder(FRAME_SAMPLES);
+	std::uniform_int_distribution<size_t> push_size(1, 1000);
+	for (size_t position = 0; position < audio.size();) {
+		size_t count = std::min(push_size(random), audio.size() - position);
+		if (!stream.push(&audio[position], count)) {
+			fail(test, "the ring has no room for a push");
+			return;
+		}
+		stream.process(recorder);
+		position += count;
+	}
+
+	std::vector<int64_t> expected = vad_collector(speech, padding_frames, ratio);
+	if (recorder.frames != expected) {
+		size_t i = 0;
+		while (i < expected.size() && i < recorder.frames.size() && expected[i] == recorder.frames[i]) ++i;
+		fail(test, "the segmentations differ from yield " + std::to_string(i) + " on");
+		return;
+	}
+
+	// At the end of the stream, an utterance in progress ends, where vad_collector just stops
+	bool in_utterance = !expected.empty() && expected.back() != END;
+	stream.finish(recorder);
+	if (in_utterance != (recorder.frames.size() == expected.size() + 1)) {
+		fail(test, "finish does not end exactly the utterance in progress");
+	}
+}
+
+} // unnamed namespace
+
+int main() {
+	std::mt19937 random(1);
+	for (size_t padding_frames : {1, 2, 15, 50, 150}) {
+		for (double ratio : {0.3, 0.6, 0.75, 0.9}) {
+			for (double speech_probability : {0.2, 0.5, 0.8}) {
+				test_stream(random_speech(20000, speech_probability, random), padding_frames, ratio, random);
+			}
+		}
+	}
+	return (success ? 0 : 1);
+}
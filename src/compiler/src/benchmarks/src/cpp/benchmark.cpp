@@ -0,0 +1,166 @@
+#include "benchmark.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <new>
+
+//==================================================================================================
+// Allocation counting
+//==================================================================================================
+
+/*
+	Replacing the global operator new in the executable also replaces it for the shared libraries
+	we benchmark. Every other form of operator new and operator delete ends up in these.
+*/
+
+namespace {
+
+std::atomic<uint64_t> allocation_count{0};
+std::atomic<uint64_t> allocated_bytes{0};
+
+void* counted_allocation(std::size_t size) {
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	return std::malloc(size == 0 ? 1 : size);
+}
+
+} // unnamed namespace
+
+void* operator new(std::size_t size) {
+	if (void* ptr = counted_allocation(size)) return ptr;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+	return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	return counted_allocation(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	return counted_allocation(size);
+}
+
+void operator delete(void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+namespace benchmarking {
+
+Allocation_counts allocation_counts() noexcept {
+	Allocation_counts counts;
+	counts.allocations = allocation_count.load(std::memory_order_relaxed);
+	counts.bytes = allocated_bytes.load(std::memory_order_relaxed);
+	return counts;
+}
+
+//==================================================================================================
+// Running
+//==================================================================================================
+
+Result run(const Benchmark& benchmark, double min_seconds) {
+	using Clock = std::chrono::steady_clock;
+
+	benchmark.run(); // Warm up caches, the scanner of this thread, etc.
+
+	Result result;
+	result.name = benchmark.name;
+	auto allocations_before = allocation_counts();
+	auto start = Clock::now();
+	double seconds = 0;
+	// Check the clock less often for fast benchmarks, but never run much longer than asked
+	size_t batch = 1;
+	while (seconds < min_seconds) {
+		for (size_t i = 0; i < batch; ++i) {
+			benchmark.run();
+		}
+		result.runs += batch;
+		seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		if (seconds < min_seconds / 100) batch *= 2;
+	}
+	auto allocations_after = allocation_counts();
+
+	result.ops = result.runs * benchmark.ops_per_run;
+	double ops = static_cast<double>(result.ops);
+	result.ns_per_op = seconds * 1e9 / ops;
+	result.allocations_per_op = (allocations_after.allocations - allocations_before.allocations) / ops;
+	result.allocated_bytes_per_op = (allocations_after.bytes - allocations_before.bytes) / ops;
+	if (benchmark.bytes_per_run != 0) {
+		result.megabytes_per_second = result.runs * benchmark.bytes_per_run / 1e6 / seconds;
+	}
+	return result;
+}
+
+//==================================================================================================
+// Output
+//==================================================================================================
+
+void print_table_header(std::ostream& os) {
+	os << std::left << std::setw(36) << "benchmark" << std::right
+	   << std::setw(14) << "ns/op"
+	   << std::setw(14) << "allocs/op"
+	   << std::setw(14) << "bytes/op"
+	   << std::setw(12) << "MB/s"
+	   << std::setw(14) << "ops" << "\n";
+}
+
+void print_table_row(std::ostream& os, const Result& result) {
+	os << std::left << std::setw(36) << result.name << std::right << std::fixed
+	   << std::setprecision(1) << std::setw(14) << result.ns_per_op
+	   << std::setprecision(2) << std::setw(14) << result.allocations_per_op
+	   << std::setprecision(1) << std::setw(14) << result.allocated_bytes_per_op
+	   << std::setprecision(2) << std::setw(12) << result.megabytes_per_second
+	   << std::setw(14) << result.ops << "\n";
+}
+
+void write_json(std::ostream& os, const std::vector<Result>& results, double min_seconds) {
+	// Benchmark names are plain ASCII without quotes or backslashes, so nothing needs escaping
+	std::time_t now = std::time(nullptr);
+	char date[32];
+	std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+	os << std::setprecision(6) << std::defaultfloat;
+	os << "{\n"
+	   << "  \"context\": {\n"
+	   << "    \"date\": \"" << date << "\",\n"
+	   << "    \"compiler\": \"" << __VERSION__ << "\",\n"
+#ifdef NDEBUG
+	   << "    \"assertions\": false,\n"
+#else
+	   << "    \"assertions\": true,\n"
+#endif
+	   << "    \"min_seconds\": " << min_seconds << "\n"
+	   << "  },\n"
+	   << "  \"benchmarks\": [";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const Result& result = results[i];
+		os << (i == 0 ? "\n" : ",\n")
+		   << "    {\"name\": \"" << result.name << "\""
+		   << ", \"runs\": " << result.runs
+		   << ", \"ops\": " << result.ops
+		   << ", \"ns_per_op\": " << result.ns_per_op
+		   << ", \"allocations_per_op\": " << result.allocations_per_op
+		   << ", \"allocated_bytes_per_op\": " << result.allocated_bytes_per_op
+		   << ", \"megabytes_per_second\": " << result.megabytes_per_second << "}";
+	}
+	os << "\n  ]\n}\n";
+}
+
+} // namespace benchmarking
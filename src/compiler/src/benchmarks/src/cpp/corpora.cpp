@@ -0,0 +1,190 @@
+#include "corpora.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+
+#include "logger.h"
+#include "sample_inputs.h"
+#include "sentence_check.h"
+#include "sentence_generator.h"
+#include "syntax_visitor.h"
+
+namespace benchmarking {
+
+//==================================================================================================
+// Helper functions
+//==================================================================================================
+
+namespace {
+
+const char* const GREEK_LETTERS[] = {"alpha", "beta", "gamma", "delta", "epsilon", "theta", "pi", "omega"};
+const char* const DIGITS[] = {"zero", "one", "two", "three", "four", "five", "six", "seven", "eight", "nine"};
+const char* const TYPESETTINGS[] = {"bold", "calligraphic", "fraktur"};
+const char* const ACCENTS[] = {"tilde", "hat", "bar"};
+const char* const SPECIAL_SYMBOLS[] = {"empty set", "infinity"};
+const char* const UNARY_OPERATORS[] = {"sin", "cos", "tan", "exp", "log", "square root"};
+const char* const BINARY_OPERATORS[] = {
+	"plus", "times", "power", "divided by", "equals", "less", "greater equal", "and", "union", "in"
+};
+
+class Generator {
+public:
+	explicit Generator(unsigned int seed) : random(seed) {}
+
+	/** Appends a chain of 1 to [max_terms] terms joined by binary operators to [out] */
+	void chain(std::string& out, size_t max_terms, int nesting) {
+		size_t terms = uniform(1, max_terms);
+		for (size_t i = 0; i < terms; ++i) {
+			if (i != 0) {
+				out += ' ';
+				out += pick(BINARY_OPERATORS);
+				out += ' ';
+			}
+			term(out, nesting);
+		}
+	}
+
+private:
+	/** A term that can appear anywhere, including before a binary operator and inside fractions */
+	void simple_term(std::string& out) {
+		switch (uniform(0, 9)) {
+		case 0:
+		case 1:
+			out += pick(DIGITS);
+			break;
+		case 2:
+			out += pick(SPECIAL_SYMBOLS);
+			break;
+		case 3:
+			out += pick(UNARY_OPERATORS);
+			out += " of ";
+			variable(out);
+			break;
+		default:
+			variable(out);
+		}
+	}
+
+	void term(std::string& out, int nesting) {
+		switch (nesting > 0 ? uniform(0, 9) : 9) {
+		case 0:
+			out += "fraction ";
+			simple_term(out);
+			out += " over ";
+			simple_term(out);
+			out += " end";
+			break;
+		case 1:
+			out += "open parenthesis ";
+			chain(out, 3, nesting - 1);
+			out += " close parenthesis";
+			break;
+		default:
+			simple_term(out);
+		}
+	}
+
+	void variable(std::string& out) {
+		if (uniform(0, 7) == 0) {
+			out += pick(TYPESETTINGS);
+			out += ' ';
+		}
+		switch (uniform(0, 3)) {
+		case 0:
+			out += pick(GREEK_LETTERS);
+			break;
+		case 1:
+			out += "capital ";
+			out += static_cast<char>('a' + uniform(0, 25));
+			break;
+		default:
+			out += static_cast<char>('a' + uniform(0, 25));
+		}
+		if (uniform(0, 7) == 0) {
+			out += ' ';
+			out += pick(ACCENTS);
+		}
+	}
+
+	size_t uniform(size_t min, size_t max) {
+		return std::uniform_int_distribution<size_t>(min, max)(random);
+	}
+
+	template<size_t N>
+	const char* pick(const char* const (&options)[N]) {
+		return options[uniform(0, N - 1)];
+	}
+
+	std::mt19937 random;
+};
+
+} // unnamed namespace
+
+//==================================================================================================
+// Corpora
+//==================================================================================================
+
+Corpus sample_corpus() {
+	Corpus corpus;
+	corpus.name = "sample";
+	for (const char* input : grammar::SAMPLE_INPUTS) {
+		corpus.text += input;
+		corpus.text += '\n';
+		++corpus.lines;
+	}
+	return corpus;
+}
+
+Corpus synthetic_corpus(const std::string& name, size_t lines, size_t max_terms, unsigned int seed) {
+	Generator generator(seed);
+	Corpus corpus;
+	corpus.name = name;
+	corpus.lines = lines;
+	for (size_t i = 0; i < lines; ++i) {
+		generator.chain(corpus.text, max_terms, 2);
+		corpus.text += '\n';
+	}
+	return corpus;
+}
+
+Corpus file_corpus(const std::string& path) {
+	std::ifstream file(path);
+	if (!file.is_open()) throw std::runtime_error("could not open " + path);
+	Corpus corpus;
+	corpus.name = path.substr(path.find_last_of('/') + 1);
+	corpus.text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	if (!corpus.text.empty() && corpus.text.back() != '\n') corpus.text += '\n';
+	corpus.lines = static_cast<size_t>(std::count(corpus.text.begin(), corpus.text.end(), '\n'));
+	return corpus;
+}
+
+Corpus generated_corpus(const std::string& name, size_t lines, size_t tokens, unsigned int seed) {
+	grammar_tools::Generator_options options;
+	options.min_tokens = options.max_tokens = tokens;
+	options.seed = seed;
+	grammar_tools::Sentence_generator generator(
+		grammar_tools::built_in_grammar(), options
+	);
+
+	Logger logger(NULL_SINK);
+	Syntax_visitor visitor(logger);
+	Corpus corpus;
+	corpus.name = name;
+	std::string line;
+	for (size_t i = 0; i < lines; ++i) {
+		grammar_tools::Derivation derivation;
+		if (!grammar_tools::generate_valid_sentence(generator, visitor, 100 + tokens / 10, derivation, line)) {
+			continue;
+		}
+		corpus.text += line;
+		corpus.text += '\n';
+		++corpus.lines;
+		corpus.tokens += derivation.tokens.size();
+	}
+	return corpus;
+}
+
+} // namespace benchmarking
@@ -0,0 +1,858 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <tclap/CmdLine.h>
+#include <unistd.h>
+
+#include "avds/tree/tree_algorithms.h"
+#include "aec_styles.h"
+#include "benchmark.h"
+#include "compile_scheduler.h"
+#include "corpora.h"
+#include "grammar.h"
+#include "incremental_line.h"
+#include "latex_generation.h"
+#include "line_cache.h"
+#include "logger.h"
+#include "next_words.h"
+#include "prefix_oracle.h"
+#include "session_history.h"
+#include "speculative_preview.h"
+#include "spoken_tokens.h"
+#include "syntax_tree.h"
+#include "syntax_visitor.h"
+#include "thread_util.h"
+#include "resampler.h"
+#include "vad_stream.h"
+#include "wav.h"
+#include "wav_batch.h"
+
+// The C API of libcompiler_latex_generator, as used by the Python frontend
+extern "C" bool texify(const char* input, char* output, size_t output_size);
+
+using namespace benchmarking;
+
+// =================================================================================================
+// Benchmarks
+// =================================================================================================
+
+/** A corpus together with everything the benchmarks need to prepare from it */
+struct Prepared_corpus {
+	Corpus corpus;
+	std::string padded_text;          // For scanning in place
+	std::vector<Syntax_tree> trees;   // One per line
+	size_t removed_lines = 0;
+};
+
+/**
+ * Removes the lines of [corpus] that don't parse, because texify would log their errors to stderr,
+ * and parses the others.
+ */
+Prepared_corpus prepare(Corpus corpus, Syntax_visitor& visitor) {
+	Prepared_corpus prepared;
+	prepared.corpus.name = corpus.name;
+	grammar::for_each_line(corpus.text.data(), corpus.text.size(), [&](char* line, size_t length) {
+		visitor.syntax_tree = Syntax_tree();
+		if (grammar::generate_from_string(std::string(line, length), visitor) == 0) {
+			prepared.corpus.text.append(line, length).push_back('\n');
+			++prepared.corpus.lines;
+			prepared.trees.push_back(visitor.syntax_tree);
+		}
+		else {
+			++prepared.removed_lines;
+		}
+	});
+	prepared.corpus.tokens = prepared.removed_lines == 0 ? corpus.tokens : 0;
+	prepared.padded_text = grammar::padded_copy(prepared.corpus.text);
+	return prepared;
+}
+
+void add_corpus_benchmarks(
+	std::vector<Benchmark>& benchmarks, Prepared_corpus& prepared, Syntax_visitor& visitor
+) {
+	const Corpus& corpus = prepared.corpus;
+	std::string& text = prepared.padded_text;
+	size_t text_size = corpus.text.size();
+	const char* text_end = text.data() + text.size();
+
+	benchmarks.push_back({"lex/" + corpus.name, corpus.lines, text_size, [&, text_size, text_end] {
+		static std::vector<int> tokens;
+		grammar::for_each_line(text.data(), text_size, [&](char* line, size_t length) {
+			tokens.clear();
+			grammar::tokenize(line, length, text_end, tokens);
+			do_not_optimize(tokens.size());
+		});
+	}});
+
+	benchmarks.push_back({"parse/" + corpus.name, corpus.lines, text_size, [&, text_size, text_end] {
+		grammar::for_each_line(text.data(), text_size, [&](char* line, size_t length) {
+			grammar::generate_from_buffer(line, length, text_end, visitor);
+			do_not_optimize(visitor.syntax_tree);
+		});
+	}});
+
+	benchmarks.push_back({"to_latex/" + corpus.name, prepared.trees.size(), 0, [&] {
+		for (const auto& tree : prepared.trees) {
+			do_not_optimize(generation::to_latex(tree.entrance()));
+		}
+	}});
+
+	benchmarks.push_back({"texify/" + corpus.name, corpus.lines, text_size, [&] {
+		static std::vector<char> output;
+		output.resize(corpus.text.size() * 16 + 1024);
+		texify(corpus.text.c_str(), output.data(), output.size());
+		do_not_optimize(output.data());
+	}});
+}
+
+/**
+ * Adds benchmarks that parse and emit the lines of [prepared], counting tokens as operations, so
+ * that corpora with lines of different lengths show how the time per token grows with the length.
+ */
+void add_scaling_benchmarks(
+	std::vector<Benchmark>& benchmarks, Prepared_corpus& prepared, Syntax_visitor& visitor
+) {
+	const Corpus& corpus = prepared.corpus;
+	std::string& text = prepared.padded_text;
+	size_t text_size = corpus.text.size();
+	const char* text_end = text.data() + text.size();
+
+	benchmarks.push_back({"parse/" + corpus.name, corpus.tokens, text_size, [&, text_size, text_end] {
+		grammar::for_each_line(text.data(), text_size, [&](char* line, size_t length) {
+			grammar::generate_from_buffer(line, length, text_end, visitor);
+			do_not_optimize(visitor.syntax_tree);
+		});
+	}});
+
+	benchmarks.push_back({"to_latex/" + corpus.name, corpus.tokens, 0, [&] {
+		for (const auto& tree : prepared.trees) {
+			do_not_optimize(generation::to_latex(tree.entrance()));
+		}
+	}});
+}
+
+/** Returns a copy of the tree at [t] that shares none of its nodes, unlike a copy of a Syntax_tree */
+Syntax_tree deep_copy(Syntax_tree::const_traverser t) {
+	Syntax_tree copy(*t);
+	for (auto child = t.begin(); child != t.end(); ++child) {
+		copy.append_subtree(deep_copy(child));
+	}
+	return copy;
+}
+
+/**
+ * Combines the trees of [prepared] into one big tree, under a root of their own. The nodes are
+ * copied one by one, so the result does not share them with [prepared] or other results.
+ */
+Syntax_tree forest(const Prepared_corpus& prepared) {
+	Syntax_tree tree(Construction::Type::Expr_parentheses);
+	for (const auto& subtree : prepared.trees) {
+		tree.append_subtree(deep_copy(subtree.entrance()));
+	}
+	return tree;
+}
+
+/** [other] should be equal to [tree], but not share its nodes */
+void add_tree_benchmarks(
+	std::vector<Benchmark>& benchmarks, const Syntax_tree& tree, const Syntax_tree& other
+) {
+	size_t nodes = avds::tree::node_count(tree.entrance());
+
+	benchmarks.push_back({"tree/node_count", nodes, 0, [&] {
+		do_not_optimize(avds::tree::node_count(tree.entrance()));
+	}});
+	benchmarks.push_back({"tree/depth", nodes, 0, [&] {
+		do_not_optimize(avds::tree::depth(tree.entrance()));
+	}});
+	benchmarks.push_back({"tree/equal_tree", nodes, 0, [&] {
+		do_not_optimize(avds::tree::equal_tree(tree.entrance(), other.entrance()));
+	}});
+	// Per copy: shares the nodes until one of the copies is modified
+	benchmarks.push_back({"tree/copy", 1, 0, [&] {
+		Syntax_tree copy = tree;
+		do_not_optimize(copy);
+	}});
+	// Per node: modifying a shared tree copies only the nodes on the path to the change, here the root
+	benchmarks.push_back({"tree/copy_and_modify", nodes, 0, [&] {
+		Syntax_tree copy = tree;
+		copy.append_subtree(Syntax_tree(Construction::Type::Letter, 'x'));
+		do_not_optimize(copy);
+	}});
+}
+
+/** The lines of [prepared] with their LaTeX, as a Line_cache would hold them */
+std::vector<std::pair<std::string, Line_cache::Entry>> cache_entries(const Prepared_corpus& prepared) {
+	std::vector<std::pair<std::string, Line_cache::Entry>> entries;
+	size_t line_start = 0;
+	for (const auto& tree : prepared.trees) {
+		size_t line_end = prepared.corpus.text.find('\n', line_start);
+		Line_cache::Entry entry;
+		entry.output = generation::to_latex(tree.entrance()) + "\n";
+		entries.emplace_back(prepared.corpus.text.substr(line_start, line_end - line_start), entry);
+		line_start = line_end + 1;
+	}
+	return entries;
+}
+
+/**
+ * Runs [work](thread, lookups) on [threads] threads at once, where [lookups] is the number of
+ * operations that each thread should do
+ */
+template<typename Work>
+void run_on_threads(size_t threads, size_t lookups, Work work) {
+	std::vector<std::thread> workers;
+	for (size_t thread = 0; thread < threads; ++thread) {
+		workers.emplace_back([&, thread] { work(thread, lookups); });
+	}
+	for (auto& worker : workers) worker.join();
+}
+
+/**
+ * Benchmarks looking up the lines of [entries] in a Line_cache from several threads at once, per
+ * lookup. If the cache scales, the time per lookup drops with every thread, up to the number of
+ * cores. The caches with a single shard show what one lock over the whole cache would cost.
+ */
+void add_line_cache_benchmarks(
+	std::vector<Benchmark>& benchmarks, const std::vector<std::pair<std::string, Line_cache::Entry>>& entries,
+	std::deque<Line_cache>& caches
+) {
+	constexpr size_t OPERATIONS_PER_THREAD = 20000;
+	size_t entry_bytes = 0;
+	for (const auto& [line, entry] : entries) entry_bytes += line.size() + entry.output.size() + 128;
+
+	std::vector<size_t> thread_counts{1, 2, 4};
+	if (std::thread::hardware_concurrency() > 4) thread_counts.push_back(std::thread::hardware_concurrency());
+
+	// Every line fits in a cache of four times their size, even if the shards are uneven
+	Line_cache& sharded = caches.emplace_back(entry_bytes * 4);
+	Line_cache& one_shard = caches.emplace_back(entry_bytes * 4, 1);
+	for (Line_cache* cache : {&sharded, &one_shard}) {
+		for (const auto& [line, entry] : entries) cache->insert(line, entry);
+	}
+	// Holds about half of the lines, so that one in ten operations stores a line and evicts others
+	Line_cache& small = caches.emplace_back(entry_bytes / 2);
+
+	for (size_t threads : thread_counts) {
+		std::string suffix = "/threads_" + std::to_string(threads);
+		for (auto [name, cache] : {std::pair("line_cache/find", &sharded), std::pair("line_cache/find_one_shard", &one_shard)}) {
+			benchmarks.push_back({name + suffix, threads * OPERATIONS_PER_THREAD, 0, [&, threads, cache = cache] {
+				run_on_threads(threads, OPERATIONS_PER_THREAD, [&](size_t thread, size_t lookups) {
+					Line_cache::Entry entry;
+					for (size_t i = 0; i < lookups; ++i) {
+						do_not_optimize(cache->find(entries[(thread * 7919 + i) % entries.size()].first, entry));
+					}
+				});
+			}});
+		}
+		benchmarks.push_back({"line_cache/mixed" + suffix, threads * OPERATIONS_PER_THREAD, 0, [&, threads] {
+			run_on_threads(threads, OPERATIONS_PER_THREAD, [&](size_t thread, size_t lookups) {
+				Line_cache::Entry entry;
+				for (size_t i = 0; i < lookups; ++i) {
+					const auto& [line, line_entry] = entries[(thread * 7919 + i) % entries.size()];
+					if (i % 10 == 0) small.insert(line, line_entry);
+					else do_not_optimize(small.find(line, entry));
+				}
+			});
+		}});
+	}
+}
+
+/**
+ * Benchmarks editing a digit a tenth into, halfway and nine tenths into the line of [prepared], per
+ * edit, against converting the line from scratch. An edit reparses and regenerates
+ * only the expression around it, so its time should hardly grow with the length of the line.
+ */
+void add_edit_benchmarks(
+	std::vector<Benchmark>& benchmarks, Prepared_corpus& prepared, std::deque<Incremental_line>& lines,
+	Logger& logger
+) {
+	static const std::vector<std::string> DIGITS{"zero", "one", "two", "three", "four", "five", "six", "seven", "eight", "nine"};
+	const Corpus& corpus = prepared.corpus;
+	std::string line = corpus.text.substr(0, corpus.text.find('\n'));
+
+	Incremental_line& converted = lines.emplace_back(logger);
+	benchmarks.push_back({"edit/convert/" + corpus.name, 1, line.size(), [&, line] {
+		converted.convert(line);
+		do_not_optimize(converted.latex().data());
+	}});
+
+	Incremental_line& edited = lines.emplace_back(logger);
+	edited.convert(line);
+	std::vector<size_t> digits;
+	for (size_t i = 0; i < edited.parsed().tokens().size(); ++i) {
+		const std::string& phrase = edited.parsed().tokens()[i].phrase;
+		if (std::find(DIGITS.begin(), DIGITS.end(), phrase) != DIGITS.end()) digits.push_back(i);
+	}
+	if (digits.empty()) return;
+
+	for (auto [where, index] : {std::pair("start", digits[digits.size() / 10]), std::pair("middle", digits[digits.size() / 2]), std::pair("end", digits[digits.size() * 9 / 10])}) {
+		std::string digit = edited.parsed().tokens()[index].phrase;
+		std::string other = digit == "one" ? "two" : "one";
+		benchmarks.push_back({"edit/" + std::string(where) + "/" + corpus.name, 2, 0, [&, index = index, digit, other] {
+			edited.edit(index, index + 1, other);
+			edited.edit(index, index + 1, digit);
+			do_not_optimize(edited.latex().data());
+		}});
+	}
+}
+
+/** The recognized tokens of the lines of a corpus, one per character, as DeepSpeech gives them */
+struct Recognized_lines {
+	std::vector<std::string> characters;                    // Every character as a string, by its value
+	std::vector<std::vector<grammar::Recognized_token>> lines;
+};
+
+/**
+ * Benchmarks turning the character tokens of a speech recognizer into the syntax tree of a line, per
+ * line of [prepared]: by joining them into text with "end" at the long pauses, as talktex.py did,
+ * and scanning and parsing that, and by scanning them between the pauses and parsing the tokens.
+ * Every pause between words takes 0.1 to 0.3 seconds, and one in ten 1.5 seconds.
+ */
+void add_spoken_benchmarks(
+	std::vector<Benchmark>& benchmarks, const Prepared_corpus& prepared, Recognized_lines& recognized,
+	Syntax_visitor& visitor
+) {
+	for (int c = 0; c < 256; ++c) recognized.characters.emplace_back(1, static_cast<char>(c));
+	std::mt19937 random(1);
+	size_t line_start = 0;
+	const std::string& text = prepared.corpus.text;
+	while (line_start < text.size()) {
+		size_t line_end = text.find('\n', line_start);
+		auto& tokens = recognized.lines.emplace_back();
+		double time = 0;
+		for (size_t i = line_start; i < line_end; ++i) {
+			if (text[i] == ' ') time += (random() % 10 == 0 ? 1.5 : 0.1 + (random() % 200) / 1000.0);
+			tokens.push_back({recognized.characters[static_cast<unsigned char>(text[i])].c_str(), time});
+			time += 0.04;
+		}
+		line_start = line_end + 1;
+	}
+
+	benchmarks.push_back({"spoken/" + prepared.corpus.name + "/text", recognized.lines.size(), 0, [&] {
+		for (const auto& tokens : recognized.lines) {
+			std::string line;
+			double last_time = 0;
+			for (const auto& token : tokens) {
+				line += token.text;
+				if (token.text[0] == ' ' && token.start_time - last_time > 1.0) line += "end ";
+				last_time = token.start_time;
+			}
+			visitor.syntax_tree = Syntax_tree();
+			do_not_optimize(grammar::generate_from_string(line, visitor));
+		}
+	}});
+	benchmarks.push_back({"spoken/" + prepared.corpus.name + "/tokens", recognized.lines.size(), 0, [&] {
+		grammar::Pause_model pauses(1.0);
+		grammar::Spoken_line line;
+		for (const auto& tokens : recognized.lines) {
+			grammar::read_spoken_line(tokens.data(), tokens.size(), pauses, line);
+			visitor.syntax_tree = Syntax_tree();
+			do_not_optimize(grammar::parse_token_list(line.tokens.data(), line.tokens.size(), visitor));
+		}
+	}});
+}
+
+/**
+ * Benchmarks telling whether the starts of the lines of [prepared] can still become lines:
+ * "tokens" gives the tokens of every line to a grammar::Prefix_oracle one by one, and "next_kinds"
+ * also lists the tokens that can come after every one. "next_words" looks up the words that may
+ * come after every one in a grammar::Next_word_table of the words of the corpus instead. The items
+ * are the tokens.
+ */
+void add_prefix_benchmarks(
+	std::vector<Benchmark>& benchmarks, const Prepared_corpus& prepared,
+	std::vector<std::vector<grammar::Token>>& lines, std::unique_ptr<grammar::Next_word_table>& table
+) {
+	size_t count = 0;
+	std::string text = grammar::padded_copy(prepared.corpus.text);
+	grammar::for_each_line(text.data(), prepared.corpus.text.size(), [&](char* line, size_t length) {
+		auto& tokens = lines.emplace_back();
+		grammar::scan_tokens(line, length, text.data() + text.size(), tokens);
+		count += tokens.size();
+	});
+
+	benchmarks.push_back({"prefix/" + prepared.corpus.name + "/tokens", count, 0, [&] {
+		grammar::Prefix_oracle oracle;
+		for (const auto& tokens : lines) {
+			oracle.reset();
+			for (const grammar::Token& token : tokens) {
+				do_not_optimize(oracle.push(token.kind));
+			}
+		}
+	}});
+	benchmarks.push_back({"prefix/" + prepared.corpus.name + "/next_kinds", count, 0, [&] {
+		grammar::Prefix_oracle oracle;
+		std::vector<int> kinds;
+		for (const auto& tokens : lines) {
+			oracle.reset();
+			for (const grammar::Token& token : tokens) {
+				oracle.push(token.kind);
+				oracle.next_kinds(kinds);
+				do_not_optimize(kinds.data());
+			}
+		}
+	}});
+
+	std::vector<std::string> words;
+	const std::string& corpus_text = prepared.corpus.text;
+	for (size_t begin = 0; begin < corpus_text.size();) {
+		size_t end = corpus_text.find_first_of(" \n", begin);
+		if (end > begin) words.push_back(corpus_text.substr(begin, end - begin));
+		begin = end + 1;
+	}
+	std::sort(words.begin(), words.end());
+	words.erase(std::unique(words.begin(), words.end()), words.end());
+	table = std::make_unique<grammar::Next_word_table>(std::move(words));
+	benchmarks.push_back({"prefix/" + prepared.corpus.name + "/next_words", count, 0, [&] {
+		grammar::Prefix_oracle oracle;
+		for (const auto& tokens : lines) {
+			oracle.reset();
+			for (const grammar::Token& token : tokens) {
+				oracle.push(token.kind);
+				do_not_optimize(table->row(oracle.state()));
+			}
+		}
+	}});
+}
+
+/**
+ * Benchmarks previewing the lines of [prepared] while they are spoken: every line is given to a
+ * Speculative_preview as hypotheses of one more word each time, and its final words confirm the
+ * last one. The items are the hypotheses. "from_scratch" forgets the parser states of the last
+ * hypothesis before every update, so that it follows all tokens again.
+ */
+void add_preview_benchmarks(
+	std::vector<Benchmark>& benchmarks, const Prepared_corpus& prepared,
+	std::vector<std::vector<std::string>>& hypotheses, std::unique_ptr<Speculative_preview>& preview,
+	Logger& logger
+) {
+	size_t count = 0;
+	size_t line_start = 0;
+	const std::string& text = prepared.corpus.text;
+	while (line_start < text.size()) {
+		size_t line_end = text.find('\n', line_start);
+		auto& line = hypotheses.emplace_back();
+		for (size_t i = line_start; i <= line_end; ++i) {
+			if (i == line_end || text[i] == ' ') line.push_back(text.substr(line_start, i - line_start));
+		}
+		count += line.size();
+		line_start = line_end + 1;
+	}
+	preview = std::make_unique<Speculative_preview>(logger);
+
+	for (bool from_scratch : {false, true}) {
+		std::string name = "preview/" + prepared.corpus.name + (from_scratch ? "/from_scratch" : "/words");
+		benchmarks.push_back({name, count, 0, [&, from_scratch] {
+			for (const auto& line : hypotheses) {
+				for (const std::string& hypothesis : line) {
+					if (from_scratch) preview->reset();
+					do_not_optimize(preview->update(hypothesis));
+				}
+				do_not_optimize(preview->confirms(line.back()));
+				preview->reset();
+			}
+		}});
+	}
+}
+
+/**
+ * Benchmarks of edits and undo in sessions of [sizes] lines, made of the lines of [prepared]. Every
+ * run makes a new version and undoes it, so the history does not grow.
+ */
+void add_session_benchmarks(
+	std::vector<Benchmark>& benchmarks, const Prepared_corpus& prepared,
+	const std::vector<size_t>& sizes, std::deque<Session_history>& sessions, Logger& logger
+) {
+	std::vector<std::string> corpus_lines;
+	size_t line_start = 0;
+	while (line_start < prepared.corpus.text.size()) {
+		size_t line_end = prepared.corpus.text.find('\n', line_start);
+		corpus_lines.push_back(prepared.corpus.text.substr(line_start, line_end - line_start));
+		line_start = line_end + 1;
+	}
+	for (size_t size : sizes) {
+		Session_history& session = sessions.emplace_back();
+		for (size_t i = 0; session.size() < size && i < 2 * size; ++i) {
+			session.add_line(corpus_lines[i % corpus_lines.size()], logger);
+		}
+		std::string suffix = "/lines_" + std::to_string(size);
+		size_t middle = session.size() / 2;
+		std::string replacement = corpus_lines[0];
+		benchmarks.push_back({"session/erase_undo" + suffix, 1, 0, [&session, middle] {
+			session.erase_line(middle);
+			session.undo();
+		}});
+		benchmarks.push_back({"session/replace_undo" + suffix, 1, 0, [&session, &logger, middle, replacement] {
+			session.replace_line(middle, replacement, logger);
+			session.undo();
+		}});
+		benchmarks.push_back({"session/line" + suffix, 1, 0, [&session, middle] {
+			do_not_optimize(session.line(middle).latex.data());
+		}});
+	}
+}
+
+/** Counts the samples of the utterances of a Vad_stream */
+class Sample_counter : public audio::Utterance_listener {
+public:
+	void on_audio(const int16_t*, size_t count) override {
+		samples += count;
+	}
+
+	void on_utterance_end() override {
+		++utterances;
+	}
+
+	size_t samples = 0;
+	size_t utterances = 0;
+};
+
+/**
+ * Benchmarks segmenting a minute of synthetic 16 kHz audio, of bursts of tone between silences, into
+ * utterances, per 20 ms frame. The segmenter only keeps counts of its window, so the time per frame
+ * should not depend on the padding.
+ */
+void add_vad_benchmarks(std::vector<Benchmark>& benchmarks, std::vector<int16_t>& samples, std::vector<bool>& speech) {
+	constexpr size_t FRAME = 320;
+	std::mt19937 random(1);
+	while (samples.size() < 60 * 16000) {
+		size_t length = 16000 / 5 + random() % (16000 * 3);
+		bool tone = speech.size() % 2 == 1;
+		for (size_t i = 0; i < length; ++i) {
+			samples.push_back(tone ? static_cast<int16_t>(8000 * std::sin(i * 0.1)) : static_cast<int16_t>(random() % 64) - 32);
+		}
+		speech.push_back(tone);
+	}
+	samples.resize(samples.size() / FRAME * FRAME);
+	audio::Energy_vad vad;
+	speech.clear();
+	for (size_t frame = 0; frame < samples.size(); frame += FRAME) speech.push_back(vad(&samples[frame], FRAME));
+
+	for (size_t padding : {15, 150, 1500}) {
+		benchmarks.push_back({"vad/segmenter/padding_" + std::to_string(padding), speech.size(), 0, [&, padding] {
+			audio::Vad_segmenter segmenter(padding, 0.6);
+			for (bool frame_speech : speech) do_not_optimize(segmenter.push(frame_speech));
+		}});
+	}
+	benchmarks.push_back({"vad/stream", samples.size() / FRAME, samples.size() * sizeof(int16_t), [&] {
+		audio::Vad_stream_options options;
+		audio::Vad_stream stream(options, audio::Energy_vad());
+		Sample_counter counter;
+		for (size_t frame = 0; frame < samples.size(); frame += FRAME) {
+			stream.push(&samples[frame], FRAME);
+			stream.process(counter);
+		}
+		stream.finish(counter);
+		do_not_optimize(counter.samples);
+	}});
+}
+
+/**
+ * Benchmarks resampling four seconds of noise at 48 and 44.1 kHz to 16 kHz, in blocks of 20 ms like
+ * a microphone delivers them, per input sample and with every instruction set. One second of audio is 48000 or 44100 samples,
+ * so the share of a core that resampling in real time takes is ns/op times that, divided by 10^9.
+ */
+void add_resampler_benchmarks(std::vector<Benchmark>& benchmarks, std::vector<int16_t>& samples) {
+	std::mt19937 random(1);
+	samples.resize(48000 * 4);
+	for (int16_t& sample : samples) sample = static_cast<int16_t>(random() % 20000) - 10000;
+	for (uint32_t rate : {48000, 44100}) {
+		for (audio::Simd simd : {audio::Simd::SCALAR, audio::Simd::SSE, audio::Simd::AVX2}) {
+			if (simd > audio::best_simd()) continue;
+			std::string name = "resample/" + std::to_string(rate) + "_16000/" + audio::simd_name(simd);
+			benchmarks.push_back({name, samples.size(), samples.size() * sizeof(int16_t), [&, rate, simd] {
+				audio::Resampler resampler(rate, 16000, 16, simd);
+				std::vector<int16_t> output;
+				output.reserve(samples.size());
+				size_t block = rate / 50;
+				for (size_t position = 0; position + block <= samples.size(); position += block) {
+					resampler.process(&samples[position], block, output);
+				}
+				do_not_optimize(output.data());
+			}});
+		}
+	}
+}
+
+/** Recordings in a temporary directory, which are removed with their .tex files when it goes */
+struct Temporary_recordings {
+	~Temporary_recordings() {
+		for (const auto& path : paths) {
+			unlink(path.c_str());
+			unlink((path.substr(0, path.size() - 4) + ".tex").c_str());
+		}
+		if (!directory.empty()) rmdir(directory.c_str());
+	}
+
+	std::string directory;
+	std::vector<std::string> paths;
+};
+
+/** Recognizes every utterance as the same words, so that the benchmarks measure everything else */
+class Fixed_recognizer : public batch::Recognizer {
+public:
+	bool recognize(const int16_t*, size_t, std::string& out_words) override {
+		out_words = "fraction alpha over beta";
+		return true;
+	}
+};
+
+/**
+ * Benchmarks transcribing eight recordings of 15 seconds of 48 kHz audio, of bursts of tone between
+ * silences, on one thread and on one per hardware thread, per second of audio: reading, resampling,
+ * segmentation and conversion, with a recognizer that takes no time. The number of seconds of audio
+ * transcribed per second is 10^9 divided by ns/op.
+ */
+void add_wav_batch_benchmarks(std::vector<Benchmark>& benchmarks, Temporary_recordings& recordings) {
+	constexpr uint32_t RATE = 48000;
+	constexpr size_t RECORDINGS = 8;
+	constexpr size_t SECONDS = 15;
+	char directory[] = "/tmp/talktex_benchmark_XXXXXX";
+	if (!mkdtemp(directory)) {
+		std::cerr << "Left out the wav_batch benchmarks, because there is no temporary directory\n";
+		return;
+	}
+	recordings.directory = directory;
+	std::mt19937 random(1);
+	for (size_t i = 0; i < RECORDINGS; ++i) {
+		audio::Wav wav;
+		wav.sample_rate = RATE;
+		wav.channels = 1;
+		for (bool tone = false; wav.samples.size() < SECONDS * RATE; tone = !tone) {
+			size_t length = RATE / 2 + random() % (RATE * 3);
+			for (size_t j = 0; j < length; ++j) {
+				wav.samples.push_back(tone ? static_cast<int16_t>(8000 * std::sin(j * 0.03)) : static_cast<int16_t>(random() % 64) - 32);
+			}
+		}
+		wav.samples.resize(SECONDS * RATE);
+		recordings.paths.push_back(recordings.directory + "/recording_" + std::to_string(i) + ".wav");
+		audio::write_wav(recordings.paths.back(), wav);
+	}
+
+	std::vector<unsigned int> thread_counts{1};
+	if (std::thread::hardware_concurrency() > 1) thread_counts.push_back(std::thread::hardware_concurrency());
+	for (unsigned int threads : thread_counts) {
+		std::string name = "wav_batch/threads_" + std::to_string(threads);
+		benchmarks.push_back({name, RECORDINGS * SECONDS, RECORDINGS * SECONDS * RATE * sizeof(int16_t), [&, threads] {
+			batch::Wav_options options;
+			options.threads = threads;
+			batch::Wav_report report;
+			batch::transcribe(recordings.paths, [] { return std::make_unique<Fixed_recognizer>(); }, options, report);
+			do_not_optimize(report.utterances);
+		}});
+	}
+}
+
+/** A temporary directory, which is removed with everything in it when it goes */
+struct Temporary_directory {
+	~Temporary_directory() {
+		std::error_code error;
+		if (!path.empty()) std::filesystem::remove_all(path, error);
+	}
+
+	std::string path;
+};
+
+/** Whether [program] is an executable in one of the directories of the PATH */
+bool on_path(const std::string& program) {
+	const char* path = std::getenv("PATH");
+	std::string directories = path ? path : "";
+	for (size_t begin = 0; begin <= directories.size();) {
+		size_t end = std::min(directories.find(':', begin), directories.size());
+		std::string directory = end > begin ? directories.substr(begin, end - begin) : ".";
+		if (access((directory + "/" + program).c_str(), X_OK) == 0) return true;
+		begin = end + 1;
+	}
+	return false;
+}
+
+/**
+ * Benchmarks the time from an update of a document of 20 display formulas to its PDF, with latexmk
+ * processing the preamble of talktex_header every time (compile/full_preamble) and with the
+ * preamble loaded from the format it was dumped into (compile/precompiled_preamble), like
+ * talktex.py compiles after an utterance. Every run changes a formula, so latexmk runs pdflatex.
+ * Left out if latexmk or pdflatex is not installed.
+ */
+void add_compile_benchmarks(
+	std::vector<Benchmark>& benchmarks, Temporary_directory& directory,
+	std::deque<Compile_scheduler>& schedulers, size_t& update
+) {
+	if (!on_path("latexmk") || !on_path("pdflatex")) {
+		std::cerr << "Left out the compile benchmarks, because latexmk or pdflatex is not installed\n";
+		return;
+	}
+	char path[] = "/tmp/talktex_benchmark_XXXXXX";
+	if (!mkdtemp(path)) {
+		std::cerr << "Left out the compile benchmarks, because there is no temporary directory\n";
+		return;
+	}
+	directory.path = path;
+
+	for (bool precompiled : {false, true}) {
+		Compile_options options;
+		options.output_directory = directory.path + (precompiled ? "/precompiled" : "/full");
+		options.precompile_preamble = precompiled;
+		options.style_path = TALKTEX_STYLE_PATH;
+		std::filesystem::create_directory(options.output_directory);
+		std::filesystem::copy_file(TALKTEX_STYLE_PATH, options.output_directory + "/talktex.sty");
+		Compile_scheduler& scheduler = schedulers.emplace_back(options);
+
+		std::string name = precompiled ? "compile/precompiled_preamble" : "compile/full_preamble";
+		benchmarks.push_back({name, 1, 0, [&] {
+			std::string document = generation::talktex_header();
+			for (size_t i = 0; i < 20; ++i) {
+				document += "\\[ \\frac{x_{" + std::to_string(i) + "}}{" + std::to_string(update) + "} \\]\n";
+			}
+			document += generation::talktex_footer();
+			++update;
+			do_not_optimize(scheduler.compile_now(std::move(document)));
+		}});
+	}
+}
+
+// =================================================================================================
+// Command-line interface
+// =================================================================================================
+
+/** Runs the benchmarks; returns the exit code */
+int run_benchmarks(
+	const std::vector<std::string>& corpus_paths, size_t scaling_tokens, unsigned int seed,
+	const std::string& filter, double min_seconds, const std::string& json_path
+) {
+	// Lines that don't parse are only logged while preparing the corpora
+	Logger logger(NULL_SINK);
+	Syntax_visitor visitor(logger);
+
+	// Benchmarks keep references into the corpora, so they must not move
+	std::deque<Prepared_corpus> corpora;
+	std::deque<Prepared_corpus> scaling_corpora;
+	try {
+		corpora.push_back(prepare(sample_corpus(), visitor));
+		corpora.push_back(prepare(synthetic_corpus("short", 2000, 3, seed), visitor));
+		corpora.push_back(prepare(synthetic_corpus("long", 200, 40, seed), visitor));
+		for (const auto& path : corpus_paths) {
+			corpora.push_back(prepare(file_corpus(path), visitor));
+		}
+		for (size_t tokens = 10; tokens <= scaling_tokens; tokens *= 10) {
+			std::string name = "tokens_" + std::to_string(tokens);
+			scaling_corpora.push_back(prepare(generated_corpus(name, 1, tokens, seed), visitor));
+		}
+	} catch (std::runtime_error& e) {
+		std::cerr << aec_style::error << "Error:" << aec::reset << " " << e.what() << "\n";
+		return 1;
+	}
+
+	std::vector<Benchmark> benchmarks;
+	for (auto& prepared : corpora) {
+		if (prepared.removed_lines != 0) {
+			std::cerr << "Left out " << prepared.removed_lines << " lines of corpus "
+			          << prepared.corpus.name << " that do not parse\n";
+		}
+		add_corpus_benchmarks(benchmarks, prepared, visitor);
+	}
+	for (auto& prepared : scaling_corpora) {
+		add_scaling_benchmarks(benchmarks, prepared, visitor);
+	}
+	Syntax_tree tree = forest(corpora[2]);
+	Syntax_tree other_tree = forest(corpora[2]);
+	add_tree_benchmarks(benchmarks, tree, other_tree);
+	auto entries = cache_entries(corpora[1]);
+	std::deque<Line_cache> caches;
+	add_line_cache_benchmarks(benchmarks, entries, caches);
+	std::deque<Incremental_line> lines;
+	for (auto& prepared : scaling_corpora) {
+		add_edit_benchmarks(benchmarks, prepared, lines, logger);
+	}
+	std::vector<int16_t> vad_samples;
+	std::vector<bool> vad_speech;
+	add_vad_benchmarks(benchmarks, vad_samples, vad_speech);
+	std::vector<int16_t> resampler_samples;
+	add_resampler_benchmarks(benchmarks, resampler_samples);
+	Temporary_recordings recordings;
+	try {
+		add_wav_batch_benchmarks(benchmarks, recordings);
+	} catch (std::runtime_error& e) {
+		std::cerr << aec_style::error << "Error:" << aec::reset << " " << e.what() << "\n";
+		return 1;
+	}
+	Recognized_lines recognized;
+	add_spoken_benchmarks(benchmarks, corpora[1], recognized, visitor);
+	std::vector<std::vector<grammar::Token>> prefix_lines;
+	std::unique_ptr<grammar::Next_word_table> next_words;
+	add_prefix_benchmarks(benchmarks, corpora[1], prefix_lines, next_words);
+	std::vector<std::vector<std::string>> hypotheses;
+	std::unique_ptr<Speculative_preview> preview;
+	add_preview_benchmarks(benchmarks, corpora[1], hypotheses, preview, logger);
+	std::deque<Session_history> sessions;
+	add_session_benchmarks(benchmarks, corpora[1], {100, 10000}, sessions, logger);
+	Temporary_directory compile_directory;
+	std::deque<Compile_scheduler> schedulers;
+	size_t update = 0;
+	try {
+		add_compile_benchmarks(benchmarks, compile_directory, schedulers, update);
+	} catch (std::filesystem::filesystem_error& e) {
+		std::cerr << aec_style::error << "Error:" << aec::reset << " " << e.what() << "\n";
+		return 1;
+	}
+
+	std::vector<Result> results;
+	print_table_header(std::cout);
+	for (const auto& benchmark : benchmarks) {
+		if (benchmark.name.find(filter) == std::string::npos) continue;
+		results.push_back(run(benchmark, min_seconds));
+		print_table_row(std::cout, results.back());
+	}
+
+	if (!json_path.empty()) {
+		std::ofstream json(json_path);
+		if (!json.is_open()) {
+			std::cerr << aec_style::error << "Error:" << aec::reset << " Could not open "
+			          << aec_style::filename << json_path << aec::reset << "\n";
+			return 1;
+		}
+		write_json(json, results, min_seconds);
+	}
+
+	visitor.syntax_tree = Syntax_tree(); // Destroy the last tree on this stack
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	TCLAP::CmdLine cmd("TalkTex compiler - benchmarks", ' ', "1.0");
+
+	try {
+		TCLAP::ValueArg<std::string> json_arg("j", "json", "Also write the results as JSON to this file.", false, "", "string", cmd);
+		TCLAP::ValueArg<std::string> filter_arg("", "filter", "Only run the benchmarks whose name contains this string.", false, "", "string", cmd);
+		TCLAP::ValueArg<double> min_time_arg("m", "min-time", "Minimum time to run each benchmark for, in seconds.", false, 0.5, "seconds", cmd);
+		TCLAP::ValueArg<unsigned int> seed_arg("s", "seed", "Seed for the synthetic corpora.", false, 1, "unsigned integer", cmd);
+		TCLAP::MultiArg<std::string> corpus_arg("c", "corpus", "Also benchmark the lines of this file, e.g. made by compiler_corpus_generator.", false, "string", cmd);
+		TCLAP::ValueArg<size_t> scaling_arg("t", "scaling-tokens", "Benchmark parsing and emitting single lines of 10, 100, ... up to this many tokens (0: none).", false, 10000, "unsigned integer", cmd);
+		cmd.parse(argc, argv);
+
+		int result = 0;
+		// The trees of long lines are deep, and walked and destroyed recursively
+		run_with_stack_size(DEEP_STACK_SIZE, [&] {
+			result = run_benchmarks(
+				corpus_arg.getValue(), scaling_arg.getValue(), seed_arg.getValue(),
+				filter_arg.getValue(), min_time_arg.getValue(), json_arg.getValue()
+			);
+		});
+		return result;
+
+	} catch (TCLAP::ArgException& e) {
+		std::cerr << aec_style::error << "command-line error: " << aec::reset << e.error()
+				  << " for arg " << e.argId() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,67 @@
+/* A minimal microbenchmark harness: timing, allocation counting and JSON output */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace benchmarking {
+
+/**
+ * The number of allocations (and their total size) made through operator new since the start of the
+ * program, on all threads. Counted by the replacement operator new of the benchmark executable.
+ * Memory that C code allocates with malloc (like the strdup calls of the scanner) is not counted.
+ */
+struct Allocation_counts {
+	uint64_t allocations = 0;
+	uint64_t bytes       = 0;
+};
+
+Allocation_counts allocation_counts() noexcept;
+
+struct Benchmark {
+	std::string name;
+
+	/** The number of operations (e.g. lines) that one call of [run] performs */
+	size_t ops_per_run = 1;
+
+	/** The number of input bytes that one call of [run] processes, or 0 to omit the throughput */
+	size_t bytes_per_run = 0;
+
+	std::function<void()> run;
+};
+
+struct Result {
+	std::string name;
+	size_t runs = 0;
+	size_t ops  = 0;
+	double ns_per_op                 = 0;
+	double allocations_per_op        = 0;
+	double allocated_bytes_per_op    = 0;
+	double megabytes_per_second      = 0; // 0 if the benchmark has no input size
+};
+
+/**
+ * Runs [benchmark] once to warm up, and then repeatedly until at least [min_seconds] have passed.
+ * The allocation counts include everything allocated during the measured runs, on all threads.
+ */
+Result run(const Benchmark& benchmark, double min_seconds);
+
+/** Prints [result] as one row of a table that starts with print_table_header */
+void print_table_row(std::ostream& os, const Result& result);
+void print_table_header(std::ostream& os);
+
+/** Writes [results] as a JSON document, together with some information about the build */
+void write_json(std::ostream& os, const std::vector<Result>& results, double min_seconds);
+
+/** Keeps the compiler from optimizing away the computation of [value] */
+template<typename T>
+void do_not_optimize(const T& value) {
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+} // namespace benchmarking
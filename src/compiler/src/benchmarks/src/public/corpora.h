@@ -0,0 +1,39 @@
+/* Inputs to benchmark with */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace benchmarking {
+
+/** Lines of running text, separated by newlines */
+struct Corpus {
+	std::string name;
+	std::string text;
+	size_t lines = 0;
+	size_t tokens = 0; // 0 if not known
+};
+
+/** The sample inputs of the grammar (grammar::SAMPLE_INPUTS), one per line */
+Corpus sample_corpus();
+
+/**
+ * Generates [lines] random valid lines, each a chain of 1 to [max_terms] terms joined by binary
+ * operators. Terms are variables, digits and special symbols, possibly with unary operators,
+ * fractions and parentheses around them. The same [seed] always gives the same corpus.
+ */
+Corpus synthetic_corpus(const std::string& name, size_t lines, size_t max_terms, unsigned int seed);
+
+/** The lines of the file at [path]. Throws std::runtime_error if it can not be read. */
+Corpus file_corpus(const std::string& path);
+
+/**
+ * Generates [lines] lines of about [tokens] tokens each from the productions of compiler.y, with
+ * grammar_tools::Sentence_generator. The lines are repaired until the parser accepts them. Lines of
+ * many tokens make deep syntax trees, so this is best called on a thread with a DEEP_STACK_SIZE
+ * stack. Throws std::runtime_error if the grammar sources can not be read.
+ */
+Corpus generated_corpus(const std::string& name, size_t lines, size_t tokens, unsigned int seed);
+
+} // namespace benchmarking
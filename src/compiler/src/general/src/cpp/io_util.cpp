@@ -25,3 +25,11 @@ bool try_open_output_file(const std::string& path, std::ofstream& out_ofstream)
 	}
 	return true;
 }
+
+bool try_map_input_file(const std::string& path, Mapped_file& out_mapped_file) {
+	if (!out_mapped_file.open(path)) {
+		print_open_file_error_message(path);
+		return false;
+	}
+	return true;
+}
@@ -2,55 +2,378 @@
 This logger file was created in the Compiler Construction project
 by Sebastiaan Alvarez Rodriguez and Mariska IJpelaar
 
-This version is slightly modified
+This version writes the messages on a background thread
 */
 
-#include <ostream>
-#include <string>
-
 #include "logger.h"
 
-NullStream NULL_STREAM;
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "aecpp.h"
+#include "spsc_ring.h"
 
-Logger::Logger(std::ostream& info_stream, std::ostream& warning_stream, std::ostream& error_stream) : info_stream(info_stream), warning_stream(warning_stream), error_stream(error_stream), infos(0), warnings(0), errors(0) {
+Null_sink NULL_SINK;
+Stream_sink STDERR_SINK(std::cerr);
+
+namespace logger_detail {
+	std::atomic<Log_level> min_level{Log_level::INFO};
 }
 
-std::ostream& Logger::info(int line) {
-    ++infos;
-    print_tag(info_stream, aec::blue, "Info: ", line);
-    return info_stream;
+//==================================================================================================
+// Background writer
+//==================================================================================================
+
+namespace {
+
+/** Enough for a burst of errors; more messages go to the spill list of the thread */
+constexpr size_t MESSAGES_PER_THREAD = 1024;
+
+/** A thread that has this many messages waiting wakes up the writer, rather than wait for it */
+constexpr size_t HIGH_WATER_MARK = MESSAGES_PER_THREAD / 2;
+
+/** How often the writer looks for messages if it is not woken up */
+constexpr auto WRITE_INTERVAL = std::chrono::milliseconds(50);
+
+struct Queued_message {
+	Log_sink* sink = nullptr;
+	Log_message message;
+};
+
+/**
+ * The messages of one thread. They stay until they are written, also after the thread finished.
+ *
+ * Messages go to the ring, unless it is full: then they go to the spill list, and so do all
+ * messages after them until the writer took the list, so that they are written in order.
+ */
+struct Thread_queue {
+	Thread_queue() : messages(MESSAGES_PER_THREAD) {}
+
+	/** Whether a message is waiting in the ring or the spill list */
+	bool has_messages() const {
+		return messages.popped() != messages.pushed()
+		    || spill_written.load(std::memory_order_acquire) != spill_pushed.load(std::memory_order_acquire);
+	}
+
+	Spsc_ring<Queued_message> messages;
+	std::atomic<bool> finished{false};
+
+	std::mutex spill_mutex; // Only held to add a message or take the list, never while writing
+	std::vector<Queued_message> spill;
+	std::atomic<bool> spilling{false};         // Whether [spill] has messages
+	std::atomic<uint64_t> spill_pushed{0};     // The numbers of messages spilled so far...
+	std::atomic<uint64_t> spill_written{0};    // ...and of those that were written
+};
+
+/** The thread that writes the messages of all threads to their sinks */
+class Writer {
+public:
+	Writer() : thread([this] { run(); }) {}
+
+	~Writer() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_one();
+		thread.join();
+	}
+
+	void add(std::shared_ptr<Thread_queue> queue) {
+		std::lock_guard<std::mutex> lock(mutex);
+		queues.push_back(std::move(queue));
+	}
+
+	/**
+	 * Wakes up the writer if it is waiting, without waiting for it. Otherwise it writes the messages
+	 * every WRITE_INTERVAL, so this is only needed when a thread has many messages waiting.
+	 */
+	void wake_up() {
+		// Either the writer sees the messages before it sleeps, or we see that it sleeps
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!sleeping.load(std::memory_order_relaxed)) return;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			woken = true;
+		}
+		wake.notify_one();
+	}
+
+	/** Waits until every message that was logged before the call has been written */
+	void flush() {
+		struct Target {
+			std::shared_ptr<Thread_queue> queue;
+			size_t pushed;
+			uint64_t spill_pushed;
+		};
+		std::unique_lock<std::mutex> lock(mutex);
+		std::vector<Target> targets;
+		for (const auto& queue : queues) {
+			if (queue->has_messages()) {
+				targets.push_back({queue, queue->messages.pushed(), queue->spill_pushed.load(std::memory_order_acquire)});
+			}
+		}
+		if (targets.empty()) return;
+
+		flush_requested = true;
+		wake.notify_one();
+		written.wait(lock, [&] {
+			for (const auto& target : targets) {
+				if (target.queue->messages.popped() < target.pushed
+				    || target.queue->spill_written.load(std::memory_order_acquire) < target.spill_pushed) {
+					return false;
+				}
+			}
+			return true;
+		});
+	}
+
+private:
+	void run() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			bool stop = stopping;
+			auto current = queues;
+			std::vector<bool> finished;
+			for (const auto& queue : current) {
+				finished.push_back(queue->finished.load(std::memory_order_acquire));
+			}
+
+			// Write without the lock, so that flushing and new threads do not wait for the sinks
+			lock.unlock();
+			for (const auto& queue : current) {
+				write_messages(*queue);
+			}
+			lock.lock();
+
+			// A queue that was finished before we drained it stays empty
+			for (size_t i = 0; i < current.size(); ++i) {
+				if (finished[i]) queues.erase(std::find(queues.begin(), queues.end(), current[i]));
+			}
+			written.notify_all();
+			if (stop) return;
+
+			sleeping.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			wake.wait_for(lock, WRITE_INTERVAL, [&] {
+				return woken || flush_requested || stopping || has_messages();
+			});
+			sleeping.store(false, std::memory_order_relaxed);
+			woken = false;
+			flush_requested = false;
+		}
+	}
+
+	/** Whether a queue has messages to write. Needs the lock. */
+	bool has_messages() const {
+		for (const auto& queue : queues) {
+			if (queue->has_messages()) return true;
+		}
+		return false;
+	}
+
+	/** Writes the messages of [queue], in the order they were logged */
+	void write_messages(Thread_queue& queue) {
+		if (queue.spilling.load(std::memory_order_acquire)) {
+			size_t older_end;
+			{
+				std::lock_guard<std::mutex> lock(queue.spill_mutex);
+				spilled.swap(queue.spill);
+				// The thread puts no messages in the ring while it spills, so the ones in it now are
+				// older than the spilled ones, and the ones it puts in from now on are newer
+				older_end = queue.messages.pushed();
+				queue.spilling.store(false, std::memory_order_release);
+			}
+			Queued_message queued;
+			while (queue.messages.popped() != older_end && queue.messages.try_pop(queued)) {
+				queued.sink->write(queued.message);
+			}
+			for (const auto& spilled_message : spilled) {
+				spilled_message.sink->write(spilled_message.message);
+			}
+			queue.spill_written.fetch_add(spilled.size(), std::memory_order_release);
+			spilled.clear();
+		}
+		queue.messages.drain([](Queued_message& queued) {
+			queued.sink->write(queued.message);
+		});
+	}
+
+	std::mutex mutex; // Guards all of the below, except [thread] and [sleeping]
+	std::condition_variable wake;
+	std::condition_variable written;
+	std::vector<std::shared_ptr<Thread_queue>> queues;
+	bool woken = false; // By notify or wait_for_room
+	bool flush_requested = false;
+	bool stopping = false;
+	std::atomic<bool> sleeping{false};
+	std::vector<Queued_message> spilled; // Only used by the writer thread
+	std::thread thread;
+};
+
+Writer& writer() {
+	static Writer writer;
+	return writer;
 }
 
-std::ostream& Logger::warn(int line) {
-    ++warnings;
-    print_tag(warning_stream, aec::yellow, "Warning: ", line);
-    return warning_stream;
+/** Owns the queue of its thread, which is only created once the thread logs a message */
+class Thread_registration {
+public:
+	~Thread_registration() {
+		if (queue) queue->finished.store(true, std::memory_order_release);
+	}
+
+	Thread_queue& get() {
+		if (!queue) {
+			queue = std::make_shared<Thread_queue>();
+			writer().add(queue);
+		}
+		return *queue;
+	}
+
+private:
+	std::shared_ptr<Thread_queue> queue;
+};
+
+Thread_queue& thread_queue() {
+	thread_local Thread_registration registration;
+	return registration.get();
 }
 
-std::ostream& Logger::error(int line) {
-    ++errors;
-    print_tag(error_stream, aec::red, "Error: ", line);
-    return error_stream;
+const char* tag(Log_level level) {
+	switch (level) {
+	case Log_level::INFO:    return "Info: ";
+	case Log_level::WARNING: return "Warning: ";
+	default:                 return "Error: ";
+	}
 }
 
-uint64_t Logger::n_infos() const {
-    return infos;
+aec::Color tag_color(Log_level level) {
+	switch (level) {
+	case Log_level::INFO:    return aec::blue;
+	case Log_level::WARNING: return aec::yellow;
+	default:                 return aec::red;
+	}
 }
 
-uint64_t Logger::n_warnings() const {
-    return warnings;
+} // unnamed namespace
+
+//==================================================================================================
+// Levels and formatting
+//==================================================================================================
+
+void set_log_level(Log_level level) {
+	logger_detail::min_level.store(level, std::memory_order_relaxed);
 }
 
-uint64_t Logger::n_errors() const {
-    return errors;
+void format_log_message(const Log_message& message, std::string& out) {
+	out += tag(message.level);
+	if (message.line >= 0) {
+		out += "line " + std::to_string(message.line) + ": ";
+	}
+	out += message.text;
+	out += '\n';
+}
+
+//==================================================================================================
+// Sinks
+//==================================================================================================
+
+void Stream_sink::write(const Log_message& message) {
+	stream << aec::bold + tag_color(message.level) << tag(message.level);
+	if (message.line >= 0) {
+		stream << aec::creset << "line " << message.line << ": ";
+	}
+	stream << aec::reset << message.text << '\n' << std::flush;
+}
+
+void File_sink::write(const Log_message& message) {
+	buffer.clear();
+	format_log_message(message, buffer);
+	file << buffer << std::flush;
+}
+
+void Memory_sink::write(const Log_message& message) {
+	std::lock_guard<std::mutex> lock(mutex);
+	format_log_message(message, text);
+}
+
+std::string Memory_sink::take() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return std::exchange(text, std::string());
+}
+
+std::string Memory_sink::contents() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return text;
 }
 
-void Logger::print_tag(std::ostream& stream, aec::Color color, const std::string& tag, int line) {
-    stream << aec::bold + color << tag;
+std::string Memory_sink::contents_from(size_t offset) {
+	std::lock_guard<std::mutex> lock(mutex);
+	return offset < text.size() ? text.substr(offset) : std::string();
+}
 
-    if (line >= 0) {
-        stream << aec::creset << "line " << line << ": ";
-    }
+size_t Memory_sink::size() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return text.size();
+}
 
-    stream << aec::reset;
+void Memory_sink::append(std::string_view formatted_messages) {
+	std::lock_guard<std::mutex> lock(mutex);
+	text += formatted_messages;
+}
+
+//==================================================================================================
+// Logger
+//==================================================================================================
+
+Logger::~Logger() {
+	if (posted.load(std::memory_order_relaxed)) flush();
+}
+
+void Logger::flush() {
+	writer().flush();
+}
+
+void Logger::post(Log_level level, int line, std::string_view message) {
+	posted.store(true, std::memory_order_relaxed);
+	Queued_message queued;
+	queued.sink = &sink;
+	queued.message.level = level;
+	queued.message.line = line;
+	queued.message.text.assign(message);
+	Thread_queue& queue = thread_queue();
+	// try_push only moves from [queued] if it succeeds
+	if (!queue.spilling.load(std::memory_order_acquire) && queue.messages.try_push(std::move(queued))) {
+		if (queue.messages.pushed() - queue.messages.popped() == HIGH_WATER_MARK) writer().wake_up();
+		return;
+	}
+	// The ring is full, or spilled messages wait to be written before the ones in the ring
+	bool was_spilling;
+	{
+		std::lock_guard<std::mutex> lock(queue.spill_mutex);
+		queue.spill.push_back(std::move(queued));
+		queue.spill_pushed.fetch_add(1, std::memory_order_release);
+		was_spilling = queue.spilling.exchange(true, std::memory_order_acq_rel);
+	}
+	if (!was_spilling) writer().wake_up();
+}
+
+uint64_t Logger::n_infos() const {
+	return counts[static_cast<int>(Log_level::INFO)].load(std::memory_order_relaxed);
+}
+
+uint64_t Logger::n_warnings() const {
+	return counts[static_cast<int>(Log_level::WARNING)].load(std::memory_order_relaxed);
+}
+
+uint64_t Logger::n_errors() const {
+	return counts[static_cast<int>(Log_level::ERROR)].load(std::memory_order_relaxed);
 }
@@ -0,0 +1,82 @@
+#include "mapped_file.h"
+
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Mapped_file::Mapped_file() noexcept : mapping(nullptr), mapping_size(0), opened(false) {}
+
+Mapped_file::Mapped_file(Mapped_file&& other) noexcept
+		: mapping     (std::exchange(other.mapping, nullptr))
+		, mapping_size(std::exchange(other.mapping_size, 0))
+		, opened      (std::exchange(other.opened, false))
+{}
+
+Mapped_file& Mapped_file::operator=(Mapped_file&& other) noexcept {
+	if (this != &other) {
+		close();
+		mapping      = std::exchange(other.mapping, nullptr);
+		mapping_size = std::exchange(other.mapping_size, 0);
+		opened       = std::exchange(other.opened, false);
+	}
+	return *this;
+}
+
+Mapped_file::~Mapped_file() {
+	close();
+}
+
+bool Mapped_file::open(const std::string& path) {
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+
+	// Pipes and devices cannot be mapped (and report size 0), so only accept regular files
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		::close(fd);
+		return false;
+	}
+
+	size_t size = static_cast<size_t>(st.st_size);
+	if (size != 0) {
+		void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (ptr == MAP_FAILED) {
+			::close(fd);
+			return false;
+		}
+		// We read the file front to back in almost all cases
+		madvise(ptr, size, MADV_SEQUENTIAL);
+		mapping = static_cast<char*>(ptr);
+	}
+	::close(fd); // The mapping keeps its own reference to the file
+
+	mapping_size = size;
+	opened = true;
+	return true;
+}
+
+void Mapped_file::close() noexcept {
+	if (mapping != nullptr) {
+		munmap(mapping, mapping_size);
+	}
+	mapping = nullptr;
+	mapping_size = 0;
+	opened = false;
+}
+
+bool Mapped_file::is_open() const noexcept {
+	return opened;
+}
+
+const char* Mapped_file::data() const noexcept {
+	return mapping;
+}
+
+size_t Mapped_file::size() const noexcept {
+	return mapping_size;
+}
@@ -0,0 +1,279 @@
+#include "persistent_cache.h"
+
+#include <atomic>
+#include <cstring>
+#include <ctime>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//==================================================================================================
+// File layout
+//==================================================================================================
+
+namespace {
+
+constexpr char MAGIC[8] = {'T', 'T', 'X', 'C', 'A', 'C', 'H', 'E'};
+constexpr uint32_t VERSION = 1;
+
+/** Takes the first slot of the file. The slots follow it. */
+struct File_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t slot_size;
+	uint64_t slot_count;
+	uint64_t generation;
+};
+
+/** FNV-1a, with the bits mixed at the end, because the low bits select the slot */
+uint64_t hash_of(std::string_view key) {
+	uint64_t hash = 14695981039346656037ull;
+	for (char c : key) {
+		hash ^= static_cast<unsigned char>(c);
+		hash *= 1099511628211ull;
+	}
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+/** The clock of the least recently used eviction; a second is good enough */
+uint64_t current_second() {
+	return static_cast<uint64_t>(std::time(nullptr));
+}
+
+/** Whether the file [fd] has the size and the header of the cache we want to open */
+bool is_valid(int fd, size_t size, size_t slot_count, uint64_t generation) {
+	struct stat st;
+	if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != size) return false;
+	File_header header;
+	if (pread(fd, &header, sizeof(header), 0) != sizeof(header)) return false;
+	return std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0
+		&& header.version == VERSION
+		&& header.slot_size == Persistent_cache::SLOT_SIZE
+		&& header.slot_count == slot_count
+		&& header.generation == generation;
+}
+
+/**
+ * Creates an empty cache at [path], and returns its file descriptor, or -1 on failure. The cache is
+ * built in a file beside it and then renamed, so that processes that still map the old file keep
+ * working with it.
+ */
+int create(const std::string& path, size_t size, size_t slot_count, uint64_t generation) {
+	std::string new_path = path + ".new";
+	int fd = ::open(new_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) return -1;
+
+	File_header header;
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.slot_size = Persistent_cache::SLOT_SIZE;
+	header.slot_count = slot_count;
+	header.generation = generation;
+	// The file is filled with zeros, which make empty slots
+	if (ftruncate(fd, static_cast<off_t>(size)) != 0
+			|| pwrite(fd, &header, sizeof(header), 0) != sizeof(header)
+			|| rename(new_path.c_str(), path.c_str()) != 0) {
+		::close(fd);
+		unlink(new_path.c_str());
+		return -1;
+	}
+	return fd;
+}
+
+} // unnamed namespace
+
+/**
+ * The sequence number is odd while the slot is written. The other fields are read without locking,
+ * and only trusted if the sequence number was even and did not change while they were read.
+ */
+struct Persistent_cache::Slot {
+	std::atomic<uint32_t> sequence;
+	uint16_t key_size;
+	uint16_t value_size;
+	uint64_t hash;
+	std::atomic<uint64_t> last_used; // In seconds since the epoch
+	uint64_t nanoseconds;
+	uint8_t occupied;
+	uint8_t success;
+	uint8_t padding[6];
+	char data[SLOT_SIZE - 40]; // The key, followed by the value
+};
+
+static_assert(sizeof(File_header) <= Persistent_cache::SLOT_SIZE, "The header must fit in a slot");
+static_assert(
+	std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+	"The atomics of the slots are shared between processes, so they must not use locks"
+);
+
+//==================================================================================================
+// Persistent_cache
+//==================================================================================================
+
+Persistent_cache::Persistent_cache() noexcept : mapping(nullptr), mapping_size(0), slot_mask(0) {}
+
+Persistent_cache::Persistent_cache(Persistent_cache&& other) noexcept
+		: mapping     (std::exchange(other.mapping, nullptr))
+		, mapping_size(std::exchange(other.mapping_size, 0))
+		, slot_mask   (std::exchange(other.slot_mask, 0))
+{}
+
+Persistent_cache& Persistent_cache::operator=(Persistent_cache&& other) noexcept {
+	if (this != &other) {
+		close();
+		mapping      = std::exchange(other.mapping, nullptr);
+		mapping_size = std::exchange(other.mapping_size, 0);
+		slot_mask    = std::exchange(other.slot_mask, 0);
+	}
+	return *this;
+}
+
+Persistent_cache::~Persistent_cache() {
+	close();
+}
+
+bool Persistent_cache::open(const std::string& path, size_t max_bytes, uint64_t generation) {
+	close();
+
+	// A power of two of slots, after the one of the header
+	size_t slot_count = PROBE_LENGTH;
+	if (max_bytes / SLOT_SIZE < slot_count + 1) return false;
+	while (slot_count * 2 + 1 <= max_bytes / SLOT_SIZE) slot_count *= 2;
+	size_t size = (slot_count + 1) * SLOT_SIZE;
+
+	// Lock the file while we check it. If another process replaced it meanwhile, start over.
+	int fd;
+	while (true) {
+		fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if (fd < 0) return false;
+		if (flock(fd, LOCK_EX) != 0) {
+			::close(fd);
+			return false;
+		}
+		struct stat opened, current;
+		if (fstat(fd, &opened) == 0 && stat(path.c_str(), &current) == 0
+				&& opened.st_dev == current.st_dev && opened.st_ino == current.st_ino) {
+			break;
+		}
+		::close(fd);
+	}
+	if (!is_valid(fd, size, slot_count, generation)) {
+		int new_fd = create(path, size, slot_count, generation);
+		::close(fd); // Lets the processes that wait for the old file see that it was replaced
+		if (new_fd < 0) return false;
+		fd = new_fd;
+	}
+
+	void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd); // The mapping keeps its own reference to the file
+	if (ptr == MAP_FAILED) return false;
+	madvise(ptr, size, MADV_RANDOM);
+
+	mapping = static_cast<char*>(ptr);
+	mapping_size = size;
+	slot_mask = slot_count - 1;
+	return true;
+}
+
+void Persistent_cache::close() noexcept {
+	if (mapping != nullptr) {
+		munmap(mapping, mapping_size);
+	}
+	mapping = nullptr;
+	mapping_size = 0;
+	slot_mask = 0;
+}
+
+bool Persistent_cache::is_open() const noexcept {
+	return mapping != nullptr;
+}
+
+size_t Persistent_cache::slot_count() const noexcept {
+	return is_open() ? slot_mask + 1 : 0;
+}
+
+Persistent_cache::Slot* Persistent_cache::slot(uint64_t hash, size_t probe) const noexcept {
+	static_assert(sizeof(Slot) == SLOT_SIZE, "Slots must fill SLOT_SIZE");
+	size_t index = (hash + probe) & slot_mask;
+	return reinterpret_cast<Slot*>(mapping + (index + 1) * SLOT_SIZE);
+}
+
+bool Persistent_cache::find(std::string_view key, Entry& out_entry) const {
+	if (!is_open()) return false;
+	uint64_t hash = hash_of(key);
+	for (size_t probe = 0; probe < PROBE_LENGTH; ++probe) {
+		Slot& s = *slot(hash, probe);
+		uint32_t sequence = s.sequence.load(std::memory_order_acquire);
+		if (sequence % 2 != 0 || !s.occupied || s.hash != hash) continue;
+
+		// Copy everything before checking it, since a writer may change it while we read
+		size_t key_size = s.key_size;
+		size_t value_size = s.value_size;
+		if (key_size != key.size() || key_size + value_size > sizeof(s.data)) continue;
+		bool same_key = std::memcmp(s.data, key.data(), key_size) == 0;
+		std::string value(s.data + key_size, value_size);
+		bool success = s.success;
+		uint64_t nanoseconds = s.nanoseconds;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (s.sequence.load(std::memory_order_relaxed) != sequence || !same_key) continue;
+
+		out_entry.success = success;
+		out_entry.nanoseconds = nanoseconds;
+		out_entry.value = std::move(value);
+		// Only write the slot once a second, so that hits on other cores do not contend for it
+		uint64_t now = current_second();
+		if (s.last_used.load(std::memory_order_relaxed) < now) {
+			s.last_used.store(now, std::memory_order_relaxed);
+		}
+		return true;
+	}
+	return false;
+}
+
+bool Persistent_cache::insert(std::string_view key, const Entry& entry) {
+	if (!is_open() || key.size() + entry.value.size() > sizeof(Slot::data)) return false;
+	uint64_t hash = hash_of(key);
+
+	// The slot of [key] if it has one, otherwise an empty slot or the least recently used one
+	Slot* target = nullptr;
+	uint64_t oldest = UINT64_MAX;
+	for (size_t probe = 0; probe < PROBE_LENGTH; ++probe) {
+		Slot* s = slot(hash, probe);
+		if (s->sequence.load(std::memory_order_relaxed) % 2 != 0) continue;
+		if (s->occupied && s->hash == hash && s->key_size == key.size()
+				&& std::memcmp(s->data, key.data(), key.size()) == 0) {
+			target = s;
+			break;
+		}
+		uint64_t used = s->occupied ? s->last_used.load(std::memory_order_relaxed) : 0;
+		if (used < oldest) {
+			oldest = used;
+			target = s;
+		}
+	}
+	if (target == nullptr) return false;
+
+	uint32_t sequence = target->sequence.load(std::memory_order_relaxed);
+	if (sequence % 2 != 0
+			|| !target->sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire)) {
+		return false; // Another writer got there first
+	}
+	std::atomic_thread_fence(std::memory_order_release);
+	target->key_size = static_cast<uint16_t>(key.size());
+	target->value_size = static_cast<uint16_t>(entry.value.size());
+	target->hash = hash;
+	target->nanoseconds = entry.nanoseconds;
+	target->occupied = 1;
+	target->success = entry.success;
+	std::memcpy(target->data, key.data(), key.size());
+	std::memcpy(target->data + key.size(), entry.value.data(), entry.value.size());
+	target->last_used.store(current_second(), std::memory_order_relaxed);
+	target->sequence.store(sequence + 2, std::memory_order_release);
+	return true;
+}
@@ -0,0 +1,228 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace stats {
+
+//==================================================================================================
+// Per-thread counters
+//==================================================================================================
+
+namespace {
+
+/**
+ * The counters of one thread. Only their thread adds to them, so the additions never contend. They
+ * are atomic so that snapshot and reset can read and clear them from other threads.
+ */
+struct Thread_counters {
+	std::atomic<uint64_t> stage_calls[STAGE_COUNT] = {};
+	std::atomic<uint64_t> stage_nanoseconds[STAGE_COUNT] = {};
+	std::atomic<uint64_t> counters[COUNTER_COUNT] = {};
+};
+
+void add_counters(const Thread_counters& counters, Snapshot& snapshot) {
+	for (size_t i = 0; i < STAGE_COUNT; ++i) {
+		snapshot.stage_calls[i] += counters.stage_calls[i].load(std::memory_order_relaxed);
+		snapshot.stage_nanoseconds[i] += counters.stage_nanoseconds[i].load(std::memory_order_relaxed);
+	}
+	for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+		snapshot.counters[i] += counters.counters[i].load(std::memory_order_relaxed);
+	}
+}
+
+/** The counters of all running threads, and the sum of those of the threads that have finished */
+struct Registry {
+	std::mutex mutex;
+	std::vector<Thread_counters*> threads;
+	Snapshot finished_threads;
+};
+
+Registry& registry() {
+	static Registry registry;
+	return registry;
+}
+
+/** Registers the counters of its thread for as long as the thread runs */
+class Thread_registration {
+public:
+	Thread_registration() {
+		Registry& all = registry();
+		std::lock_guard<std::mutex> lock(all.mutex);
+		all.threads.push_back(&counters);
+	}
+
+	~Thread_registration() {
+		Registry& all = registry();
+		std::lock_guard<std::mutex> lock(all.mutex);
+		add_counters(counters, all.finished_threads);
+		all.threads.erase(std::find(all.threads.begin(), all.threads.end(), &counters));
+		destroyed = true;
+	}
+
+	Thread_counters counters;
+
+	/** Set once the counters of this thread are gone. Allocations may still happen after that. */
+	static thread_local bool destroyed;
+};
+
+thread_local bool Thread_registration::destroyed = false;
+
+Thread_counters& thread_counters() {
+	thread_local Thread_registration registration;
+	return registration.counters;
+}
+
+void add(std::atomic<uint64_t>& counter, uint64_t amount) {
+	counter.fetch_add(amount, std::memory_order_relaxed);
+}
+
+/** Set while this thread counts an allocation, which itself allocates when it registers the thread */
+thread_local bool counting_allocation = false;
+
+/** The innermost running Stage_timer of this thread */
+thread_local Stage_timer* current_timer = nullptr;
+
+} // unnamed namespace
+
+namespace detail {
+
+std::atomic<bool> enabled{false};
+
+void add_to_stage(Stage stage, uint64_t nanoseconds) {
+	Thread_counters& counters = thread_counters();
+	add(counters.stage_calls[stage], 1);
+	add(counters.stage_nanoseconds[stage], nanoseconds);
+}
+
+void add_to_counter(Counter counter, uint64_t amount) {
+	add(thread_counters().counters[counter], amount);
+}
+
+void add_allocation(size_t bytes) noexcept {
+	if (counting_allocation || Thread_registration::destroyed) return;
+	counting_allocation = true;
+	try {
+		Thread_counters& counters = thread_counters();
+		add(counters.counters[ALLOCATIONS], 1);
+		add(counters.counters[ALLOCATED_BYTES], bytes);
+	}
+	catch (...) {
+		// Registering the thread failed, so the allocation is not counted
+	}
+	counting_allocation = false;
+}
+
+} // namespace detail
+
+//==================================================================================================
+// Stage_timer
+//==================================================================================================
+
+void Stage_timer::start() noexcept {
+	outer = current_timer;
+	current_timer = this;
+	start_time = trace::now();
+}
+
+void Stage_timer::stop() noexcept {
+	uint64_t nanoseconds = trace::now() - start_time;
+	if (counting) {
+		detail::add_to_stage(stage, nanoseconds - std::min(nanoseconds, nested_nanoseconds));
+	}
+	if (tracing && stage != LEX) {
+		if (stage == PARSE) {
+			trace::record(
+				stage_name(stage), "talktex", start_time, nanoseconds, "lex_us", nested_nanoseconds / 1e3
+			);
+		}
+		else {
+			trace::record(stage_name(stage), "talktex", start_time, nanoseconds);
+		}
+	}
+	if (outer) outer->nested_nanoseconds += nanoseconds;
+	current_timer = outer;
+}
+
+//==================================================================================================
+// Public functions
+//==================================================================================================
+
+const char* stage_name(Stage stage) {
+	switch (stage) {
+	case LEX:              return "lex";
+	case PARSE:            return "parse";
+	case TO_LATEX:         return "to_latex";
+	case TO_DISPLAY_STYLE: return "to_display_style";
+	case COPY_OUT:         return "copy_out";
+	case CACHE:            return "cache";
+	case STAGE_COUNT:      break;
+	}
+	return "unknown";
+}
+
+const char* counter_name(Counter counter) {
+	switch (counter) {
+	case LINES:                    return "lines";
+	case FAILED_LINES:             return "failed_lines";
+	case INPUT_BYTES:              return "input_bytes";
+	case OUTPUT_BYTES:             return "output_bytes";
+	case TREE_NODES:               return "tree_nodes";
+	case ALLOCATIONS:              return "allocations";
+	case ALLOCATED_BYTES:          return "allocated_bytes";
+	case CACHE_HITS:               return "cache_hits";
+	case CACHE_MISSES:             return "cache_misses";
+	case CACHE_SAVED_NANOSECONDS:  return "cache_saved_nanoseconds";
+	case CACHE_EVICTIONS:          return "cache_evictions";
+	case COUNTER_COUNT:            break;
+	}
+	return "unknown";
+}
+
+void set_enabled(bool enabled) {
+	detail::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void reset() {
+	Registry& all = registry();
+	std::lock_guard<std::mutex> lock(all.mutex);
+	for (Thread_counters* counters : all.threads) {
+		for (auto& calls : counters->stage_calls) calls.store(0, std::memory_order_relaxed);
+		for (auto& nanoseconds : counters->stage_nanoseconds) nanoseconds.store(0, std::memory_order_relaxed);
+		for (auto& counter : counters->counters) counter.store(0, std::memory_order_relaxed);
+	}
+	all.finished_threads = Snapshot();
+}
+
+Snapshot snapshot() {
+	Registry& all = registry();
+	std::lock_guard<std::mutex> lock(all.mutex);
+	Snapshot result = all.finished_threads;
+	for (const Thread_counters* counters : all.threads) {
+		add_counters(*counters, result);
+	}
+	return result;
+}
+
+std::string to_json(const Snapshot& snapshot) {
+	std::string json = "{\"enabled\": ";
+	json += (enabled() ? "true" : "false");
+	json += ", \"stages\": {";
+	for (size_t i = 0; i < STAGE_COUNT; ++i) {
+		if (i != 0) json += ", ";
+		json += "\"" + std::string(stage_name(static_cast<Stage>(i))) + "\": {\"calls\": "
+		      + std::to_string(snapshot.stage_calls[i]) + ", \"nanoseconds\": "
+		      + std::to_string(snapshot.stage_nanoseconds[i]) + "}";
+	}
+	json += "}, \"counters\": {";
+	for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+		if (i != 0) json += ", ";
+		json += "\"" + std::string(counter_name(static_cast<Counter>(i))) + "\": "
+		      + std::to_string(snapshot.counters[i]);
+	}
+	json += "}}";
+	return json;
+}
+
+} // namespace stats
@@ -0,0 +1,44 @@
+#include "thread_util.h"
+
+#include <exception>
+#include <system_error>
+
+#include <pthread.h>
+
+namespace {
+	struct Stack_job {
+		const std::function<void()>* function;
+		std::exception_ptr exception;
+	};
+
+	void* run_stack_job(void* argument) {
+		auto job = static_cast<Stack_job*>(argument);
+		try {
+			(*job->function)();
+		} catch (...) {
+			job->exception = std::current_exception();
+		}
+		return nullptr;
+	}
+}
+
+void run_with_stack_size(size_t stack_size, const std::function<void()>& function) {
+	// std::thread can not be given a stack size, so we use pthreads directly
+	pthread_attr_t attributes;
+	pthread_attr_init(&attributes);
+	int error = pthread_attr_setstacksize(&attributes, stack_size);
+	Stack_job job{&function, nullptr};
+	pthread_t thread;
+	if (error == 0) {
+		error = pthread_create(&thread, &attributes, run_stack_job, &job);
+	}
+	pthread_attr_destroy(&attributes);
+	if (error != 0) {
+		throw std::system_error(error, std::generic_category(), "could not create a thread");
+	}
+
+	pthread_join(thread, nullptr);
+	if (job.exception) {
+		std::rethrow_exception(job.exception);
+	}
+}
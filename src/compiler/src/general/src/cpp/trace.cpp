@@ -0,0 +1,306 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "spsc_ring.h"
+
+namespace trace {
+
+//==================================================================================================
+// Recording
+//==================================================================================================
+
+namespace {
+
+constexpr size_t NAME_SIZE = 40;
+constexpr size_t CATEGORY_SIZE = 16;
+
+/** Enough for the events of a busy thread between two flushes */
+constexpr size_t EVENTS_PER_THREAD = size_t(1) << 15;
+
+constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(10);
+
+struct Event {
+	char name[NAME_SIZE];
+	char category[CATEGORY_SIZE];
+	uint64_t start;
+	uint64_t duration;
+	const char* arg_name; // nullptr if the event has no argument
+	double arg;
+};
+
+/** The events of one thread. They stay until they are written, also after the thread finished. */
+struct Thread_buffer {
+	explicit Thread_buffer(long thread_id) : events(EVENTS_PER_THREAD), thread_id(thread_id) {}
+
+	Spsc_ring<Event> events;
+	std::atomic<uint64_t> dropped{0};
+	std::atomic<bool> finished{false};
+	const long thread_id;
+};
+
+/** The state of the trace, and the consumer side of all thread buffers */
+struct Tracer {
+	/** Finishes a trace that was not stopped, so that its flusher is joined before it goes */
+	~Tracer();
+
+	std::mutex mutex; // Guards all of the below
+	std::vector<std::shared_ptr<Thread_buffer>> buffers;
+	std::FILE* file = nullptr;
+	bool first_event = true;
+	bool write_failed = false;
+	uint64_t dropped = 0; // Events dropped since start
+
+	std::thread flusher;
+	std::condition_variable stop_flusher;
+	bool stopping = false;
+};
+
+Tracer& tracer() {
+	static Tracer tracer;
+	return tracer;
+}
+
+/** Owns the buffer of its thread, which is only created once the thread records an event */
+class Thread_registration {
+public:
+	~Thread_registration() {
+		if (buffer) buffer->finished.store(true, std::memory_order_release);
+	}
+
+	Thread_buffer& get() {
+		if (!buffer) {
+			buffer = std::make_shared<Thread_buffer>(syscall(SYS_gettid));
+			Tracer& trace = tracer();
+			std::lock_guard<std::mutex> lock(trace.mutex);
+			trace.buffers.push_back(buffer);
+		}
+		return *buffer;
+	}
+
+private:
+	std::shared_ptr<Thread_buffer> buffer;
+};
+
+Thread_buffer& thread_buffer() {
+	thread_local Thread_registration registration;
+	return registration.get();
+}
+
+void copy_truncated(char* destination, const char* source, size_t size) {
+	std::strncpy(destination, source, size - 1);
+	destination[size - 1] = '\0';
+}
+
+} // unnamed namespace
+
+namespace detail {
+
+std::atomic<bool> enabled{false};
+
+} // namespace detail
+
+uint64_t now() noexcept {
+	timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return static_cast<uint64_t>(time.tv_sec) * 1000000000 + static_cast<uint64_t>(time.tv_nsec);
+}
+
+void record(
+	const char* name, const char* category, uint64_t start, uint64_t duration,
+	const char* arg_name, double arg
+) {
+	if (!enabled()) return;
+	Event event;
+	copy_truncated(event.name, name, NAME_SIZE);
+	copy_truncated(event.category, category, CATEGORY_SIZE);
+	event.start = start;
+	event.duration = duration;
+	event.arg_name = arg_name;
+	event.arg = arg;
+
+	Thread_buffer& buffer = thread_buffer();
+	if (!buffer.events.try_push(event)) {
+		buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+//==================================================================================================
+// Writing
+//==================================================================================================
+
+namespace {
+
+void append_escaped(std::string& json, const char* text) {
+	for (; *text; ++text) {
+		char c = *text;
+		if (c == '"' || c == '\\') {
+			json += '\\';
+			json += c;
+		}
+		else if (static_cast<unsigned char>(c) < 0x20) {
+			char escape[8];
+			std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+			json += escape;
+		}
+		else {
+			json += c;
+		}
+	}
+}
+
+/** Appends [nanoseconds] in microseconds, the unit of trace-event timestamps */
+void append_microseconds(std::string& json, uint64_t nanoseconds) {
+	char number[32];
+	std::snprintf(
+		number, sizeof(number), "%llu.%03u",
+		static_cast<unsigned long long>(nanoseconds / 1000), static_cast<unsigned>(nanoseconds % 1000)
+	);
+	json += number;
+}
+
+void append_separator(Tracer& trace, std::string& json) {
+	json += (trace.first_event ? "\n" : ",\n");
+	trace.first_event = false;
+}
+
+void append_event(Tracer& trace, std::string& json, const Event& event, long thread_id) {
+	append_separator(trace, json);
+	json += "{\"name\": \"";
+	append_escaped(json, event.name);
+	json += "\", \"cat\": \"";
+	append_escaped(json, event.category);
+	json += "\", \"ph\": \"X\", \"ts\": ";
+	append_microseconds(json, event.start);
+	json += ", \"dur\": ";
+	append_microseconds(json, event.duration);
+	json += ", \"pid\": " + std::to_string(getpid()) + ", \"tid\": " + std::to_string(thread_id);
+	if (event.arg_name) {
+		char number[32];
+		std::snprintf(number, sizeof(number), "%.3f", event.arg);
+		json += ", \"args\": {\"";
+		json += event.arg_name;
+		json += "\": ";
+		json += number;
+		json += "}";
+	}
+	json += "}";
+}
+
+/** Writes the events of all buffers to the file. The mutex of [trace] must be held. */
+bool write_events(Tracer& trace) {
+	std::string json;
+	uint64_t dropped = trace.dropped;
+	for (size_t i = 0; i < trace.buffers.size(); ) {
+		Thread_buffer& buffer = *trace.buffers[i];
+		bool finished = buffer.finished.load(std::memory_order_acquire);
+		buffer.events.drain([&](const Event& event) {
+			append_event(trace, json, event, buffer.thread_id);
+		});
+		dropped += buffer.dropped.exchange(0, std::memory_order_relaxed);
+		if (finished) {
+			// It was finished before we drained it, so it stays empty
+			trace.buffers.erase(trace.buffers.begin() + i);
+		}
+		else {
+			++i;
+		}
+	}
+	if (dropped != trace.dropped) {
+		// A counter event, so that the viewer shows when events were lost
+		trace.dropped = dropped;
+		append_separator(trace, json);
+		json += "{\"name\": \"dropped trace events\", \"ph\": \"C\", \"ts\": ";
+		append_microseconds(json, now());
+		json += ", \"pid\": " + std::to_string(getpid()) + ", \"args\": {\"events\": "
+		      + std::to_string(dropped) + "}}";
+	}
+
+	if (std::fwrite(json.data(), 1, json.size(), trace.file) != json.size()
+	    || std::fflush(trace.file) != 0) {
+		trace.write_failed = true;
+	}
+	return !trace.write_failed;
+}
+
+/**
+ * Stops the flusher of the trace and finishes its file. Returns false if there is no trace to stop
+ * or not all of it could be written.
+ */
+bool finish(Tracer& trace) {
+	{
+		std::lock_guard<std::mutex> lock(trace.mutex);
+		if (!trace.file || trace.stopping) return false;
+		detail::enabled.store(false, std::memory_order_relaxed);
+		trace.stopping = true;
+	}
+	trace.stop_flusher.notify_one();
+	trace.flusher.join();
+
+	std::lock_guard<std::mutex> lock(trace.mutex);
+	bool success = write_events(trace);
+	if (std::fputs("\n]\n", trace.file) == EOF) success = false;
+	if (std::fclose(trace.file) != 0) success = false;
+	trace.file = nullptr;
+	return success;
+}
+
+Tracer::~Tracer() {
+	finish(*this);
+}
+
+} // unnamed namespace
+
+bool start(const std::string& path) {
+	Tracer& trace = tracer();
+	std::lock_guard<std::mutex> lock(trace.mutex);
+	if (trace.file) return false;
+	trace.file = std::fopen(path.c_str(), "w");
+	if (!trace.file) return false;
+	// The array format; viewers also accept it without the closing bracket, if we never get to it
+	std::fputs("[", trace.file);
+	trace.first_event = true;
+	trace.write_failed = false;
+	trace.dropped = 0;
+
+	// Discard what was recorded after the previous trace stopped
+	for (auto& buffer : trace.buffers) {
+		buffer->events.drain([](const Event&) {});
+		buffer->dropped.store(0, std::memory_order_relaxed);
+	}
+
+	trace.stopping = false;
+	trace.flusher = std::thread([&trace] {
+		std::unique_lock<std::mutex> lock(trace.mutex);
+		while (!trace.stop_flusher.wait_for(lock, FLUSH_INTERVAL, [&] { return trace.stopping; })) {
+			write_events(trace);
+		}
+	});
+	detail::enabled.store(true, std::memory_order_relaxed);
+	return true;
+}
+
+bool flush() {
+	Tracer& trace = tracer();
+	std::lock_guard<std::mutex> lock(trace.mutex);
+	if (!trace.file) return false;
+	return write_events(trace);
+}
+
+bool stop() {
+	return finish(tracer());
+}
+
+} // namespace trace
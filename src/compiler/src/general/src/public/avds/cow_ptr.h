@@ -0,0 +1,186 @@
+/*
+	cow_ptr - A copy-on-write smart pointer
+
+	Version 0.1.0 (IN DEVELOPMENT)
+
+	cow_ptr owns an object together with all other cow_ptrs it was copied from or
+	to. Copying a cow_ptr is O(1): the copies share the pointee. Only const access
+	is given through the usual pointer interface. Mutable access has to be
+	requested explicitly through get_mutable(), which first gives the cow_ptr its
+	own copy of the pointee if it is shared. T should therefore be
+	copy-constructible.
+
+	================================================================================
+
+	MIT License
+
+	Copyright (c) 2021 Arthur van der Staaij
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace avds {
+
+/**
+ * A smart pointer whose copies share the pointee until one of them requests mutable access
+ * through get_mutable(). At that point, that copy is given its own copy of the pointee (using the
+ * copy constructor of T), unless it was the only owner left.
+ *
+ * The reference count is thread-safe, so copies may be used and destroyed from different threads.
+ * A single cow_ptr object is not safe to modify from multiple threads at once.
+ */
+template<class T>
+class cow_ptr {
+public:
+	using element_type = T;
+	using pointer      = const T*;
+
+	//==============================================================================================
+	// Construction
+	//==============================================================================================
+
+	constexpr cow_ptr() noexcept {}
+	constexpr cow_ptr(std::nullptr_t) noexcept {}
+	explicit cow_ptr(T* p) : ptr(p) {}
+
+	cow_ptr(const cow_ptr&) noexcept = default;
+	cow_ptr(cow_ptr&&) noexcept = default;
+	cow_ptr& operator=(const cow_ptr&) noexcept = default;
+	cow_ptr& operator=(cow_ptr&&) noexcept = default;
+
+	cow_ptr& operator=(std::nullptr_t) noexcept {
+		ptr = nullptr;
+		return *this;
+	}
+
+	friend void swap(cow_ptr& l, cow_ptr& r) noexcept {
+		using std::swap;
+		swap(l.ptr, r.ptr);
+	}
+
+	//==============================================================================================
+	// Copy-on-write
+	//==============================================================================================
+
+	/** Returns whether this is the only owner of the pointee (false if there is no pointee) */
+	bool unique() const noexcept {
+		return ptr.use_count() == 1;
+	}
+
+	/**
+	 * Makes sure this is the only owner of the pointee by copying it if it is shared.
+	 * Returns whether a copy was made.
+	 */
+	bool detach() {
+		if (!ptr || unique()) {
+			return false;
+		}
+		ptr = std::make_shared<T>(*ptr);
+		return true;
+	}
+
+	/** Returns a mutable pointer to the pointee, after detaching it from the other owners */
+	T* get_mutable() {
+		detach();
+		return ptr.get();
+	}
+
+	//==============================================================================================
+	// Pointer interface (const only)
+	//==============================================================================================
+
+	void reset(T* p = nullptr) {
+		ptr.reset(p);
+	}
+
+	pointer get() const noexcept {
+		return ptr.get();
+	}
+
+	explicit operator bool() const noexcept {
+		return bool(ptr);
+	}
+
+	const T& operator*() const {
+		return *ptr;
+	}
+
+	pointer operator->() const noexcept {
+		return ptr.get();
+	}
+
+private:
+	template<class U, class... Args>
+	friend cow_ptr<U> make_cow(Args&&... args);
+
+	explicit cow_ptr(std::shared_ptr<T>&& p) noexcept : ptr(std::move(p)) {}
+
+	std::shared_ptr<T> ptr;
+};
+
+//==================================================================================================
+// Helper functions
+//==================================================================================================
+
+template<class T, class... Args>
+cow_ptr<T> make_cow(Args&&... args) {
+	return cow_ptr<T>(std::make_shared<T>(std::forward<Args>(args)...));
+}
+
+//==================================================================================================
+// Comparison operators
+//==================================================================================================
+
+template<class T1, class T2>
+inline bool operator==(const cow_ptr<T1>& x, const cow_ptr<T2>& y) {
+	return x.get() == y.get();
+}
+
+template<class T1, class T2>
+inline bool operator!=(const cow_ptr<T1>& x, const cow_ptr<T2>& y) {
+	return x.get() != y.get();
+}
+
+template<class T>
+bool operator==(const cow_ptr<T>& x, std::nullptr_t) {
+	return !x;
+}
+
+template<class T>
+bool operator==(std::nullptr_t, const cow_ptr<T>& x) {
+	return !x;
+}
+
+template<class T>
+bool operator!=(const cow_ptr<T>& x, std::nullptr_t) {
+	return (bool)x;
+}
+
+template<class T>
+bool operator!=(std::nullptr_t, const cow_ptr<T>& x) {
+	return (bool)x;
+}
+
+} // namespace avds
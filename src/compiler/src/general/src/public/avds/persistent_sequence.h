@@ -0,0 +1,255 @@
+/*
+	persistent_sequence - An immutable sequence with O(log n) updates
+
+	Version 0.1.0 (IN DEVELOPMENT)
+
+	persistent_sequence is a sequence that is never modified: inserting, erasing
+	or replacing an element returns a new sequence, and leaves the old one as it
+	was. The new sequence shares all of its nodes with the old one, except for the
+	O(log n) nodes on the path to the changed element. Keeping many versions of a
+	sequence therefore costs memory in proportion to the changes between them, not
+	to their sizes. The elements are copied along that path, so T should be cheap
+	to copy, e.g. a std::shared_ptr to the actual data.
+
+	================================================================================
+
+	MIT License
+
+	Copyright (c) 2021 Arthur van der Staaij
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace avds {
+
+/**
+ * An immutable sequence of T. Updates return a new sequence that shares all but O(log n) nodes
+ * with the old one. Copying a sequence is O(1).
+ *
+ * The elements are kept in an AVL tree ordered by position, of which every node knows the size of
+ * its subtree. The nodes are reference counted, and thread-safe in the same way as std::shared_ptr:
+ * sequences that share nodes may be used and destroyed from different threads.
+ */
+template<class T>
+class persistent_sequence {
+public:
+	using value_type = T;
+	using size_type  = size_t;
+
+	/** Constructs an empty sequence */
+	persistent_sequence() noexcept = default;
+
+	//==============================================================================================
+	// Access
+	//==============================================================================================
+
+	size_t size() const noexcept {
+		return size_of(root);
+	}
+
+	bool empty() const noexcept {
+		return !root;
+	}
+
+	/** Returns element [index] in O(log n). [index] must be less than size(). */
+	const T& operator[](size_t index) const {
+		const Node* node = root.get();
+		while (true) {
+			size_t left_size = size_of(node->left);
+			if (index < left_size) {
+				node = node->left.get();
+			}
+			else if (index > left_size) {
+				index -= left_size + 1;
+				node = node->right.get();
+			}
+			else {
+				return node->value;
+			}
+		}
+	}
+
+	/** Returns element [index], or throws std::out_of_range if there is none */
+	const T& at(size_t index) const {
+		if (index >= size()) throw std::out_of_range("persistent_sequence::at: index out of range");
+		return (*this)[index];
+	}
+
+	/** Calls [f](element) on every element in order, in O(n) */
+	template<class F>
+	void for_each(F f) const {
+		std::vector<const Node*> path; // The nodes whose left subtree is being visited
+		const Node* node = root.get();
+		while (node || !path.empty()) {
+			while (node) {
+				path.push_back(node);
+				node = node->left.get();
+			}
+			node = path.back();
+			path.pop_back();
+			f(node->value);
+			node = node->right.get();
+		}
+	}
+
+	/** Returns whether both sequences are the same version, without comparing their elements */
+	bool same_version(const persistent_sequence& other) const noexcept {
+		return root == other.root;
+	}
+
+	//==============================================================================================
+	// Updates, which all return a new sequence in O(log n)
+	//==============================================================================================
+
+	/** Returns this sequence with [value] inserted before element [index] (at the end if size()) */
+	persistent_sequence insert(size_t index, T value) const {
+		if (index > size()) throw std::out_of_range("persistent_sequence::insert: index out of range");
+		return persistent_sequence(insert(root, index, std::move(value)));
+	}
+
+	persistent_sequence push_back(T value) const {
+		return persistent_sequence(insert(root, size(), std::move(value)));
+	}
+
+	/** Returns this sequence without element [index] */
+	persistent_sequence erase(size_t index) const {
+		if (index >= size()) throw std::out_of_range("persistent_sequence::erase: index out of range");
+		return persistent_sequence(erase(root, index));
+	}
+
+	/** Returns this sequence with element [index] replaced by [value] */
+	persistent_sequence set(size_t index, T value) const {
+		if (index >= size()) throw std::out_of_range("persistent_sequence::set: index out of range");
+		return persistent_sequence(set(root, index, std::move(value)));
+	}
+
+private:
+	struct Node;
+	using Link = std::shared_ptr<const Node>;
+
+	struct Node {
+		T value;
+		Link left;
+		Link right;
+		size_t size; // Of the subtree
+		int height;  // Of the subtree; a leaf has height 1
+	};
+
+	explicit persistent_sequence(Link root) noexcept : root(std::move(root)) {}
+
+	static size_t size_of(const Link& node) noexcept {
+		return node ? node->size : 0;
+	}
+
+	static int height_of(const Link& node) noexcept {
+		return node ? node->height : 0;
+	}
+
+	static Link make(T value, Link left, Link right) {
+		size_t size = size_of(left) + size_of(right) + 1;
+		int height = std::max(height_of(left), height_of(right)) + 1;
+		return std::make_shared<const Node>(Node{std::move(value), std::move(left), std::move(right), size, height});
+	}
+
+	/** Makes a node of [value], [left] and [right], whose heights differ by at most 2, balanced */
+	static Link balance(T value, Link left, Link right) {
+		int difference = height_of(left) - height_of(right);
+		if (difference > 1) {
+			// Rotate right, after rotating the left subtree left if its right side is the higher
+			if (height_of(left->left) >= height_of(left->right)) {
+				return make(left->value, left->left, make(std::move(value), left->right, std::move(right)));
+			}
+			const Link& middle = left->right;
+			return make(
+				middle->value,
+				make(left->value, left->left, middle->left),
+				make(std::move(value), middle->right, std::move(right))
+			);
+		}
+		if (difference < -1) {
+			if (height_of(right->right) >= height_of(right->left)) {
+				return make(right->value, make(std::move(value), std::move(left), right->left), right->right);
+			}
+			const Link& middle = right->left;
+			return make(
+				middle->value,
+				make(std::move(value), std::move(left), middle->left),
+				make(right->value, middle->right, right->right)
+			);
+		}
+		return make(std::move(value), std::move(left), std::move(right));
+	}
+
+	static Link insert(const Link& node, size_t index, T value) {
+		if (!node) return make(std::move(value), nullptr, nullptr);
+		size_t left_size = size_of(node->left);
+		if (index <= left_size) {
+			return balance(node->value, insert(node->left, index, std::move(value)), node->right);
+		}
+		return balance(node->value, node->left, insert(node->right, index - left_size - 1, std::move(value)));
+	}
+
+	/** Returns [node] without its first element, which is moved to [out_first] */
+	static Link erase_first(const Link& node, T& out_first) {
+		if (!node->left) {
+			out_first = node->value;
+			return node->right;
+		}
+		return balance(node->value, erase_first(node->left, out_first), node->right);
+	}
+
+	static Link erase(const Link& node, size_t index) {
+		size_t left_size = size_of(node->left);
+		if (index < left_size) {
+			return balance(node->value, erase(node->left, index), node->right);
+		}
+		if (index > left_size) {
+			return balance(node->value, node->left, erase(node->right, index - left_size - 1));
+		}
+		if (!node->left) return node->right;
+		if (!node->right) return node->left;
+		T first = node->value; // Overwritten by the first element of the right subtree
+		Link right = erase_first(node->right, first);
+		return balance(std::move(first), node->left, std::move(right));
+	}
+
+	static Link set(const Link& node, size_t index, T value) {
+		size_t left_size = size_of(node->left);
+		if (index < left_size) {
+			return make(node->value, set(node->left, index, std::move(value)), node->right);
+		}
+		if (index > left_size) {
+			return make(node->value, node->left, set(node->right, index - left_size - 1, std::move(value)));
+		}
+		return make(std::move(value), node->left, node->right);
+	}
+
+	Link root;
+};
+
+} // namespace avds
@@ -6,6 +6,10 @@
 	Tree is a container for storing data in a tree structure. It represents a
 	dynamic tree: tree nodes can have an arbitrary number of child nodes.
 
+	Trees are persistent: copying a tree is O(1), and modifying a tree only
+	copies the nodes on the path from the root to the modified node. All other
+	nodes stay shared with the copies.
+
 	================================================================================
 
 	MIT License
@@ -35,9 +39,10 @@
 
 #include <stdexcept>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
-#include "../deep_ptr.h"
+#include "../cow_ptr.h"
 
 namespace avds::tree {
 
@@ -57,15 +62,35 @@ bool operator==(const Tree<T>&, const Tree<T>&);
 template<typename T>
 bool operator!=(const Tree<T>&, const Tree<T>&);
 
-template<typename T>
-void swap(typename Tree<T>::Node&, typename Tree<T>::Node&) noexcept;
+namespace detail {
+
+/** Whether [Args] is a single argument of type [Self] (so that a constructor call is a copy or move) */
+template<typename Self, typename... Args>
+struct is_self : std::false_type {};
+
+template<typename Self, typename Arg>
+struct is_self<Self, Arg> : std::is_same<Self, std::decay_t<Arg>> {};
+
+template<typename Self, typename... Args>
+inline constexpr bool is_self_v = is_self<Self, Args...>::value;
+
+} // namespace detail
 
 //==================================================================================================
 // Tree class
 //==================================================================================================
 
 /**
- * A container for storing data in a tree structure
+ * A container for storing data in a tree structure.
+ *
+ * Every node owns its children through cow_ptrs, so trees, and subtrees of trees, share their
+ * nodes. Copying a tree, or taking a subtree out of it, is O(1). Modifying a tree gives it its own
+ * copy of every shared node on the path from the root to the modified node (path copying); the
+ * other children of these nodes stay shared. Copying a tree therefore invalidates the traversers
+ * into it (but not the const_traversers): modifications through them could reach the copy.
+ *
+ * Since a node may be shared by several trees, it does not know its parent, and traversers can not
+ * go up the tree.
  */
 template<typename T>
 class Tree {
@@ -88,10 +113,16 @@ public:
 	Tree(T&& root_value);
 
 	/** Constructs a tree with a root element that is constructed in-place using [args] */
-	template<typename... Args>
+	template<
+		typename... Args,
+		typename = std::enable_if_t<
+			!detail::is_self_v<Tree, Args...> &&
+			!detail::is_self_v<traverser, Args...> && !detail::is_self_v<const_traverser, Args...>
+		>
+	>
 	Tree(Args&&... args);
 
-	/** Constructs a copy of the tree pointed to by [t] */
+	/** Constructs a copy of the tree pointed to by [t], which shares its nodes */
 	Tree(const const_traverser& t);
 
 	//----------------------------------------------------------------------------------------------
@@ -101,24 +132,40 @@ public:
 	/** Returns whether the tree is empty */
 	bool empty() const noexcept;
 
-	/** Returns the value at the root of the tree. If the tree is empty, the result is undefined. */
+	/**
+	 * Returns the value at the root of the tree. If the tree is empty, the result is undefined.
+	 * If the root is shared with a copy, this tree first gets its own copy of it.
+	 */
 	T& root();
 	/** Returns the value at the root of the tree. If the tree is empty, the result is undefined. */
 	const T& root() const;
 
 	/**
-	 * Returns a new Tree object containing the subtree at the specified index.
+	 * Returns a new Tree object containing the subtree at the specified index, which shares its
+	 * nodes with this tree.
 	 * If the tree contains no subtree with the specified index, the result is undefined.
 	 */
 	Tree subtree(size_t child_index) const;
 
-	/** Returns a traverser pointing to the root of the tree */
-	traverser entrance() noexcept;
+	/**
+	 * Returns a traverser pointing to the root of the tree.
+	 * A node that is shared with a copy is copied when it is reached through the traverser, or
+	 * through the traversers made from it, so that modifications through them stay in this tree.
+	 */
+	traverser entrance();
 	/** Returns a traverser pointing to the root of the tree */
 	const_traverser entrance() const noexcept;
 	/** Returns a const traverser pointing to the root of the tree */
 	const_traverser centrance() const noexcept;
 
+	/**
+	 * Returns a traverser pointing to the node at [path]: the indices of the children to go to,
+	 * starting at the root. The shared nodes above that node are copied on the way, so that
+	 * modifying the tree through the traverser does not have to search the tree. If [copied] is
+	 * given, it is set to whether any node was copied, which moves the children of that node.
+	 */
+	traverser traverser_at(const std::vector<size_t>& path, bool* copied = nullptr);
+
 	/**
 	 * Ensures that the child capacity of the node pointed at by [t] is at least [n].
 	 * Reallocates storage if the current capacity is less than [n].
@@ -221,6 +268,17 @@ public:
 	template<bool Const>
 	traverser append_child_subtree(const Traverser<Const>& t, Tree&& tree);
 
+	/**
+	 * Moves in [tree] in place of the subtree pointed at by [t], which is destroyed.
+	 * [tree] will be empty after the operation. [t] may not be a past-the-end traverser.
+	 * Returns a traverser pointing to the root of the new subtree, which takes the place of the old
+	 * root. Traversers to nodes outside of the replaced subtree stay valid, unless the nodes of this
+	 * tree were shared with a copy.
+	 * Finding the node that a const_traverser points to takes time linear in the size of the tree.
+	 */
+	template<bool Const>
+	traverser replace_subtree(const Traverser<Const>& t, Tree&& tree);
+
 	friend void swap<T>(Tree& l, Tree& r) noexcept;
 
 	friend bool operator==<T>(const Tree& l, const Tree& r);
@@ -228,30 +286,56 @@ public:
 
 private:
 
-	struct Node {
-		// TODO: constructors taking T&& value and Args&&...
-
-		Node(const T& value, Node* parent, std::vector<Node> children);
-		Node(const T& value, Node* parent = nullptr);
-		Node(const Node& other);
-		Node(Node&& other) noexcept;
+	struct Node;
 
-		Node& operator=(const Node& other);
-		Node& operator=(Node&& other);
+	/** Where a node is owned: the root pointer of a tree, or an element of the children of a node */
+	using Slot = cow_ptr<Node>;
 
-		void set_parent_pointers_of_children();
+	struct Node {
+		explicit Node(const T& value) : value(value) {}
+		explicit Node(T&& value) : value(std::move(value)) {}
 
 		bool operator==(const Node& r) const;
 		bool operator!=(const Node& r) const;
 
 		T value;
-		Node* parent;
-		std::vector<Node> children;
+		std::vector<Slot> children; // Copying a node shares its children
 	};
 
-	friend void swap<T>(Node& l, Node& r) noexcept;
+	/** The position of a slot among the children of its parent */
+	struct Location {
+		Node* parent; // nullptr for the root
+		size_t index;
+	};
+
+	explicit Tree(Slot root);
 
-	Tree(const Node& node);
+	/**
+	 * Gives this tree its own copy of every shared node on the path from the root to [slot], which
+	 * must be a slot of this tree, and returns where the slot is now. Takes time linear in the size
+	 * of the tree, unless [slot] is the root.
+	 */
+	Location path_copy(const Slot* slot);
+
+	/**
+	 * Returns the slot of this tree that owns the node [t] points to, after giving this tree its own
+	 * copy of every shared node above it. The node itself may still be shared.
+	 */
+	template<bool Const>
+	Slot* own_slot(const Traverser<Const>& t);
+
+	/** Takes the root out of this tree. The tree becomes empty. */
+	Slot take_root();
+
+	static Slot make_node(const T& value) {
+		return make_cow<Node>(value);
+	}
+	static Slot make_node(T&& value) {
+		return make_cow<Node>(std::move(value));
+	}
+	static Slot make_node(Slot subtree) {
+		return subtree;
+	}
 
 	[[noreturn]]
 	static void throw_insert_before_root_exception();
@@ -259,13 +343,18 @@ private:
 	[[noreturn]]
 	static void throw_insert_before_past_the_end_traverser_exception();
 
-	template<bool Const, typename... Args>
-	traverser emplace_node(const Traverser<Const>& t, Args&&... args);
+	[[noreturn]]
+	static void throw_foreign_traverser_exception();
 
-	template<bool Const, typename... Args>
-	traverser emplace_back_child_node(const Traverser<Const>& t, Args&&... args);
+	/** Inserts the node that make_node makes from [arg] before the node pointed at by [t] */
+	template<bool Const, typename Arg>
+	traverser emplace_node(const Traverser<Const>& t, Arg&& arg);
 
-	deep_ptr<Node> root_ptr;
+	/** Appends the node that make_node makes from [arg] to the children of the node pointed at by [t] */
+	template<bool Const, typename Arg>
+	traverser emplace_back_child_node(const Traverser<Const>& t, Arg&& arg);
+
+	Slot root_ptr;
 };
 
 //==================================================================================================
@@ -274,10 +363,12 @@ private:
 
 /**
  * Traverser class for Tree, templated over whether it only gives const access.
- * Important note: for performance reasons, the traverser cannot go back to its parent from a
- * past-the-end traverser.
+ * Important note: the traverser cannot go back to its parent (see Tree).
  * Also acts as a sibling iterator. In this sense it is a random access iterator (hence the
  * enormous amount of boilerplate).
+ *
+ * A traverser points to the slot that owns its node. A traverser that is not const gives the tree
+ * its own copy of a shared node when it accesses the node or goes to its children.
  */
 template<typename T> template<bool Const>
 class Tree<T>::Traverser {
@@ -289,32 +380,26 @@ public:
 	using pointer = std::conditional_t<Const, T const*, T*>;
 	using iterator_category = std::random_access_iterator_tag;
 
+	/** Constructs an invalid traverser */
+	Traverser() noexcept : slot_ptr(nullptr) {}
+
 	friend void swap(Traverser& l, Traverser& r) noexcept {
 		using std::swap;
-		swap(l.node_ptr, r.node_ptr);
-		swap(l.parent_ptr, r.parent_ptr);
+		swap(l.slot_ptr, r.slot_ptr);
 	}
 
-	reference operator*() const { return node_ptr->value; }
-	pointer  operator->() const { return &(node_ptr->value); }
+	reference operator*() const { return node()->value; }
+	pointer  operator->() const { return &(node()->value); }
 
 	friend bool operator==(const Traverser& lhs, const Traverser& rhs) {
-		return lhs.node_ptr == rhs.node_ptr;
+		return lhs.slot_ptr == rhs.slot_ptr;
 	}
 	friend bool operator!=(const Traverser& lhs, const Traverser& rhs) {
-		return lhs.node_ptr != rhs.node_ptr;
-	}
-
-	Traverser& to_parent() {
-		node_ptr = node_ptr->parent;
-		return *this;
-	}
-	Traverser parent() const {
-		return Traverser(*this).to_parent();
+		return lhs.slot_ptr != rhs.slot_ptr;
 	}
 
 	Traverser& to_child(size_t child_index) {
-		node_ptr = node_ptr->children.data() + child_index;
+		slot_ptr = children() + child_index;
 		return *this;
 	}
 	Traverser child(size_t child_index) const {
@@ -322,50 +407,50 @@ public:
 	}
 
 	reference operator[](difference_type n) const {
-		return &((node_ptr + n)->value);
+		return *(*this + n);
 	}
 
 	difference_type friend operator-(const Traverser& l,const Traverser& r){
-		return l.node_ptr - r.node_ptr;
+		return l.slot_ptr - r.slot_ptr;
 	}
 
 	friend bool operator<(const Traverser& l, const Traverser& r) {
-		return l.node_ptr < r.node_ptr;
+		return l.slot_ptr < r.slot_ptr;
 	}
 	friend bool operator>(const Traverser& l, const Traverser& r) {
-		return l.node_ptr > r.node_ptr;
+		return l.slot_ptr > r.slot_ptr;
 	}
 	friend bool operator<=(const Traverser& l, const Traverser& r) {
-		return l.node_ptr <= r.node_ptr;
+		return l.slot_ptr <= r.slot_ptr;
 	}
 	friend bool operator>=(const Traverser& l, const Traverser& r) {
-		return l.node_ptr >= r.node_ptr;
+		return l.slot_ptr >= r.slot_ptr;
 	}
 
 	Traverser& operator+=(difference_type n) {
-		node_ptr += n;
+		slot_ptr += n;
 		return *this;
 	}
 	Traverser& operator-=(difference_type n) {
-		node_ptr -= n;
+		slot_ptr -= n;
 		return *this;
 	}
 	Traverser& operator++() {
-		++node_ptr;
+		++slot_ptr;
 		return *this;
 	}
 	Traverser& operator--() {
-		--node_ptr;
+		--slot_ptr;
 		return *this;
 	}
 	Traverser operator++(int) {
 		auto ret = *this;
-		++node_ptr;
+		++slot_ptr;
 		return ret;
 	}
 	Traverser operator--(int) {
 		auto ret = *this;
-		--node_ptr;
+		--slot_ptr;
 		return ret;
 	}
 	friend Traverser operator+(Traverser t, difference_type n) {
@@ -379,7 +464,7 @@ public:
 	}
 
 	Traverser& to_begin() {
-		node_ptr = node_ptr->children.data();
+		slot_ptr = children();
 		return *this;
 	}
 	Traverser begin() const {
@@ -387,7 +472,8 @@ public:
 	}
 
 	Traverser& to_end() {
-		node_ptr = node_ptr->children.data() + node_ptr->children.size();
+		const auto& children = node()->children;
+		slot_ptr = const_cast<Slot*>(children.data() + children.size());
 		return *this;
 	}
 	Traverser end() const {
@@ -395,19 +481,19 @@ public:
 	}
 
 	operator Traverser<true>() {
-		return Traverser<true>(node_ptr);
+		return Traverser<true>(slot_ptr);
 	}
 
 	bool is_leaf() const {
-		return node_ptr->children.empty();
+		return (*slot_ptr)->children.empty();
 	}
 
 	size_t child_count() const {
-		return node_ptr->children.size();
+		return (*slot_ptr)->children.size();
 	}
 
 	bool is_valid() const noexcept {
-		return node_ptr != nullptr;
+		return slot_ptr != nullptr;
 	}
 
 	operator bool() const noexcept {
@@ -415,9 +501,24 @@ public:
 	}
 
 private:
-	Traverser(Node* node_ptr) : node_ptr(node_ptr) {}
+	Traverser(Slot* slot_ptr) : slot_ptr(slot_ptr) {}
+
+	/** Returns the node, which a traverser that is not const first copies if it is shared */
+	std::conditional_t<Const, const Node*, Node*> node() const {
+		if constexpr (Const) {
+			return slot_ptr->get();
+		}
+		else {
+			return slot_ptr->get_mutable();
+		}
+	}
+
+	/** Returns the slots of the children of the node */
+	Slot* children() const {
+		return const_cast<Slot*>(node()->children.data());
+	}
 
-	Node* node_ptr;
+	Slot* slot_ptr;
 };
 
 //==================================================================================================
@@ -429,23 +530,23 @@ Tree<T>::Tree() {}
 
 template<typename T>
 Tree<T>::Tree(const T& root_value) {
-	root_ptr = make_deep<Node>(root_value);
+	root_ptr = make_node(root_value);
 }
 
 template<typename T>
 Tree<T>::Tree(T&& root_value) {
-	root_ptr = make_deep<Node>(root_value);
+	root_ptr = make_node(std::move(root_value));
 }
 
 template<typename T>
-template<typename... Args>
+template<typename... Args, typename>
 Tree<T>::Tree(Args&&... args) {
 	// Not quite true emplacement
-	root_ptr = make_deep<Node>(T{args...});
+	root_ptr = make_node(T{args...});
 }
 
 template<typename T>
-Tree<T>::Tree(const Tree<T>::const_traverser& t) : Tree(*(t.node_ptr)) {}
+Tree<T>::Tree(const Tree<T>::const_traverser& t) : Tree(*t.slot_ptr) {}
 
 template<typename T>
 bool Tree<T>::empty() const noexcept {
@@ -454,7 +555,7 @@ bool Tree<T>::empty() const noexcept {
 
 template<typename T>
 T& Tree<T>::root() {
-	return root_ptr->value;
+	return root_ptr.get_mutable()->value;
 }
 
 template<typename T>
@@ -468,22 +569,37 @@ Tree<T> Tree<T>::subtree(size_t child_index) const {
 }
 
 template<typename T>
-typename Tree<T>::traverser Tree<T>::entrance() noexcept {
-	return traverser(root_ptr.get());
+typename Tree<T>::traverser Tree<T>::entrance() {
+	return traverser(root_ptr ? &root_ptr : nullptr);
 }
+// Traversers store non-const slot pointers; const_traversers only give const access through them.
 template<typename T>
 typename Tree<T>::const_traverser Tree<T>::entrance() const noexcept {
-	return const_traverser(root_ptr.get());
+	return const_traverser(root_ptr ? const_cast<Slot*>(&root_ptr) : nullptr);
 }
 template<typename T>
 typename Tree<T>::const_traverser Tree<T>::centrance() const noexcept {
-	return const_traverser(root_ptr.get());
+	return entrance();
+}
+
+template<typename T>
+typename Tree<T>::traverser Tree<T>::traverser_at(const std::vector<size_t>& path, bool* copied) {
+	bool any_copied = false;
+	Slot* slot_ptr = &root_ptr;
+	for (size_t index : path) {
+		any_copied |= slot_ptr->detach();
+		slot_ptr = &slot_ptr->get_mutable()->children[index];
+	}
+	if (copied) {
+		*copied = any_copied;
+	}
+	return traverser(slot_ptr);
 }
 
 template<typename T>
 template<bool Const>
 void Tree<T>::reserve_children(const Traverser<Const>& t, size_t size) {
-	t.node_ptr->children.reserve(size);
+	own_slot(t)->get_mutable()->children.reserve(size);
 }
 
 template<typename T>
@@ -495,7 +611,7 @@ typename Tree<T>::traverser Tree<T>::insert(const Traverser<Const>& t, const T&
 template<typename T>
 template<bool Const>
 typename Tree<T>::traverser Tree<T>::insert(const Traverser<Const>& t, T&& value) {
-	return emplace_node(t, value);
+	return emplace_node(t, std::move(value));
 }
 
 template<typename T>
@@ -508,7 +624,7 @@ typename Tree<T>::traverser Tree<T>::emplace(const Traverser<Const>& t, Args&&..
 template<typename T>
 template<bool Const, typename Other_traverser>
 typename Tree<T>::traverser Tree<T>::insert_subtree(const Traverser<Const>& t, Other_traverser t2) {
-	return emplace_node(t, *(t2.node_ptr));
+	return emplace_node(t, *t2.slot_ptr);
 }
 
 template<typename T>
@@ -521,7 +637,7 @@ typename Tree<T>::traverser Tree<T>::insert_subtree(const Traverser<Const>& t, c
 template<typename T>
 template<bool Const>
 typename Tree<T>::traverser Tree<T>::insert_subtree(const Traverser<Const>& t, Tree&& tree) {
-	return emplace_node(t, std::move(*tree.root_ptr.release()));
+	return emplace_node(t, tree.take_root());
 }
 
 template<typename T>
@@ -533,7 +649,7 @@ typename Tree<T>::traverser Tree<T>::append_child(const Traverser<Const>& t, con
 template<typename T>
 template<bool Const>
 typename Tree<T>::traverser Tree<T>::append_child(const Traverser<Const>& t, T&& value) {
-	return emplace_back_child_node(t, value);
+	return emplace_back_child_node(t, std::move(value));
 }
 
 template<typename T>
@@ -548,7 +664,7 @@ template<bool Const, typename Other_traverser>
 typename Tree<T>::traverser Tree<T>::append_child_subtree(
 	const Traverser<Const>& t, Other_traverser t2
 ) {
-	return emplace_back_child_node(t, *(t2.node_ptr));
+	return emplace_back_child_node(t, *t2.slot_ptr);
 }
 
 template<typename T>
@@ -564,7 +680,15 @@ template<bool Const>
 typename Tree<T>::traverser Tree<T>::append_child_subtree(
 	const Traverser<Const>& t, Tree&& tree
 ) {
-	return emplace_back_child_node(t, std::move(*tree.root_ptr.release()));
+	return emplace_back_child_node(t, tree.take_root());
+}
+
+template<typename T>
+template<bool Const>
+typename Tree<T>::traverser Tree<T>::replace_subtree(const Traverser<Const>& t, Tree&& tree) {
+	Slot* slot_ptr = own_slot(t);
+	*slot_ptr = tree.take_root();
+	return traverser(slot_ptr);
 }
 
 template<typename T>
@@ -575,6 +699,9 @@ void swap(Tree<T>& l, Tree<T>& r) noexcept {
 
 template<typename T>
 bool operator==(const Tree<T>& l, const Tree<T>& r) {
+	if (l.root_ptr == r.root_ptr) { // Also covers trees sharing their nodes
+		return true;
+	}
 	if (l.root_ptr == nullptr) {
 		return r.root_ptr == nullptr;
 	}
@@ -583,6 +710,9 @@ bool operator==(const Tree<T>& l, const Tree<T>& r) {
 
 template<typename T>
 bool operator!=(const Tree<T>& l, const Tree<T>& r) {
+	if (l.root_ptr == r.root_ptr) {
+		return false;
+	}
 	if (l.root_ptr == nullptr) {
 		return r.root_ptr != nullptr;
 	}
@@ -598,90 +728,90 @@ bool operator!=(const Tree<T>& l, const Tree<T>& r) {
 //--------------------------------------------------------------------------------------------------
 
 template<typename T>
-Tree<T>::Node::Node(const T& value, Node* parent, std::vector<Node> children)
-		: value   (value)
-		, parent  (parent)
-		, children(children)
-{}
-
-template<typename T>
-Tree<T>::Node::Node(const T& value, Node* parent)
-		: value (value)
-		, parent(parent)
-{}
-
-template<typename T>
-Tree<T>::Node::Node(const Node& other)
-		: value   (other.value)
-		, parent  (other.parent)
-		, children(other.children)
-{
-	set_parent_pointers_of_children();
+bool Tree<T>::Node::operator==(const Node& r) const {
+	if (value != r.value || children.size() != r.children.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < children.size(); ++i) {
+		// Shared nodes are equal without looking at them
+		if (children[i] != r.children[i] && *children[i] != *r.children[i]) {
+			return false;
+		}
+	}
+	return true;
 }
 
 template<typename T>
-Tree<T>::Node::Node(Node&& other) noexcept
-		: value   (std::move(other.value))
-		, parent  (std::move(other.parent))
-		, children(std::move(other.children))
-{
-	set_parent_pointers_of_children();
+bool Tree<T>::Node::operator!=(const Node& r) const {
+	return !(*this == r);
 }
 
-template<typename T>
-typename Tree<T>::Node& Tree<T>::Node::operator=(const Node& other) {
-	value    = other.value;
-	parent   = other.parent;
-	children = other.children;
-	set_parent_pointers_of_children();
-	return *this;
-}
+//--------------------------------------------------------------------------------------------------
+// Tree methods
+//--------------------------------------------------------------------------------------------------
 
-template<typename T>
-typename Tree<T>::Node& Tree<T>::Node::operator=(Node&& other) {
-	value    = std::move(other.value);
-	parent   = std::move(other.parent);
-	children = std::move(other.children);
-	set_parent_pointers_of_children();
-	return *this;
-}
+namespace detail {
 
-template<typename T>
-void Tree<T>::Node::set_parent_pointers_of_children() {
-	for (auto& child : children) {
-		child.parent = this;
+/**
+ * If [slot] is in the subtree of [node], appends the indices of the children on the path from
+ * [node] to it to [path] and returns true
+ */
+template<typename Node, typename Slot>
+bool find_path(const Node& node, const Slot* slot, std::vector<size_t>& path) {
+	const Slot* children = node.children.data();
+	if (slot >= children && slot < children + node.children.size()) {
+		path.push_back(static_cast<size_t>(slot - children));
+		return true;
+	}
+	for (size_t i = 0; i < node.children.size(); ++i) {
+		path.push_back(i);
+		if (find_path(*children[i], slot, path)) {
+			return true;
+		}
+		path.pop_back();
 	}
+	return false;
 }
 
+} // namespace detail
+
 template<typename T>
-bool Tree<T>::Node::operator==(const Node& r) const {
-	return value == r.value && children == r.children;
-}
+Tree<T>::Tree(Slot root) : root_ptr(std::move(root)) {}
 
 template<typename T>
-bool Tree<T>::Node::operator!=(const Node& r) const {
-	return value != r.value || children != r.children;
+typename Tree<T>::Location Tree<T>::path_copy(const Slot* slot) {
+	if (slot == &root_ptr) {
+		return Location{nullptr, 0};
+	}
+	std::vector<size_t> path;
+	if (!root_ptr || !detail::find_path(*root_ptr, slot, path)) {
+		throw_foreign_traverser_exception();
+	}
+	// Copying a node copies the slots of its children, so the path goes through the copies
+	Node* parent_ptr = root_ptr.get_mutable();
+	for (size_t i = 0; i + 1 < path.size(); ++i) {
+		parent_ptr = parent_ptr->children[path[i]].get_mutable();
+	}
+	return Location{parent_ptr, path.back()};
 }
 
-//--------------------------------------------------------------------------------------------------
-// Tree methods
-//--------------------------------------------------------------------------------------------------
-
 template<typename T>
-void swap(typename Tree<T>::Node& l, typename Tree<T>::Node& r) noexcept {
-	using std::swap;
-
-	swap(l.value,    r.value);
-	swap(l.parent,   r.parent);
-	swap(l.children, r.children);
-
-	l.set_parent_pointers_of_children();
-	r.set_parent_pointers_of_children();
+template<bool Const>
+typename Tree<T>::Slot* Tree<T>::own_slot(const Traverser<Const>& t) {
+	if constexpr (!Const) {
+		// A traverser that is not const only reaches the slots of nodes that this tree owns alone, so
+		// no search is needed
+		return t.slot_ptr;
+	}
+	else {
+		Location location = path_copy(t.slot_ptr);
+		return (location.parent == nullptr ? &root_ptr : &location.parent->children[location.index]);
+	}
 }
 
 template<typename T>
-Tree<T>::Tree(const Node& node) {
-	root_ptr = make_deep<Node>(node);
+typename Tree<T>::Slot Tree<T>::take_root() {
+	return std::move(root_ptr);
 }
 
 // These throws are wrapped in functions to keep the error messages in a single place.
@@ -702,49 +832,40 @@ template<typename T>
 }
 
 template<typename T>
-template<bool Const, typename... Args>
-typename Tree<T>::traverser Tree<T>::emplace_node(const Traverser<Const>& t, Args&&... args) {
-	Node* new_node_ptr;
+[[noreturn]] void Tree<T>::throw_foreign_traverser_exception() {
+	throw std::logic_error(
+		"Attempted to modify an avds::tree::Tree through a traverser that does not point into it."
+	);
+}
 
+template<typename T>
+template<bool Const, typename Arg>
+typename Tree<T>::traverser Tree<T>::emplace_node(const Traverser<Const>& t, Arg&& arg) {
 	if (!t.is_valid()) {
 		if (root_ptr != nullptr) {
 			throw_insert_before_past_the_end_traverser_exception();
 		}
-		root_ptr = make_deep<Node>(std::forward<Args>(args)...);
-		root_ptr->parent = nullptr;
-		new_node_ptr = root_ptr.get();
-	}
-	else {
-		// This is why inserting before a past-the-end traverser is not supported. The dereferencing
-		// of t.node_ptr would cause a segfault.
-		// The problem here is that we need to know the parent of a traverser even if it's
-		// past-the-end. If we make traversers store and maintain a parent_ptr in addition to their
-		// node_ptr, this will have significant performance costs while traversing.
-		Node* parent_ptr = t.node_ptr->parent;
-
-		if (parent_ptr == nullptr) {
-			throw_insert_before_root_exception();
-		}
-		auto& vec = parent_ptr->children;
-		auto new_it = vec.emplace(
-			vec.begin()+(t.node_ptr-vec.data()), std::forward<Args>(args)...
-		);
-		new_node_ptr = vec.data() + (new_it - vec.begin());
-		new_node_ptr->parent = parent_ptr;
+		root_ptr = make_node(std::forward<Arg>(arg));
+		return traverser(&root_ptr);
 	}
 
-	return traverser(new_node_ptr);
+	// This is why inserting before a past-the-end traverser is not supported: its slot is not among
+	// the children of its parent, so the parent can not be found.
+	Location location = path_copy(t.slot_ptr);
+	if (location.parent == nullptr) {
+		throw_insert_before_root_exception();
+	}
+	auto& vec = location.parent->children;
+	auto new_it = vec.insert(vec.begin() + location.index, make_node(std::forward<Arg>(arg)));
+	return traverser(&*new_it);
 }
 
 template<typename T>
-template<bool Const, typename... Args>
-typename Tree<T>::traverser Tree<T>::emplace_back_child_node(
-	const Traverser<Const>& t, Args&&... args
-) {
-	t.node_ptr->children.emplace_back(std::forward<Args>(args)...);
-	auto new_node_ptr = &(t.node_ptr->children.back());
-	new_node_ptr->parent = t.node_ptr;
-	return traverser(new_node_ptr);
+template<bool Const, typename Arg>
+typename Tree<T>::traverser Tree<T>::emplace_back_child_node(const Traverser<Const>& t, Arg&& arg) {
+	Node* node_ptr = own_slot(t)->get_mutable();
+	node_ptr->children.push_back(make_node(std::forward<Arg>(arg)));
+	return traverser(&node_ptr->children.back());
 }
 
 } //namespace avds::tree
@@ -42,7 +42,7 @@ bool equal_tree_recursive(const Traverser1& t1, const Traverser2& t2) {
 	auto ct1 = t1.begin();
 	auto ct2 = t2.begin();
 	while (ct1 != t1.end()) {
-		if (!equal_subtree_recursive(ct1, ct2)) {
+		if (!equal_tree_recursive(ct1, ct2)) {
 			return false;
 		}
 		++ct1;
@@ -3,6 +3,8 @@
 #include <string>
 #include <fstream>
 
+#include "mapped_file.h"
+
 /**
  * Tries to open the file at [path] in read mode.
  * On success, returns true and sets [out_ifstream] to the created ifsteam.
@@ -16,3 +18,10 @@ bool try_open_input_file(const std::string& path, std::ifstream& out_ifstream);
  * On failure, returns false and logs an error message to stderr.
  */
 bool try_open_output_file(const std::string& path, std::ofstream& out_ofstream);
+
+/**
+ * Tries to map the file at [path] into memory.
+ * On success, returns true and sets [out_mapped_file] to the created mapping.
+ * On failure, returns false and logs an error message to stderr.
+ */
+bool try_map_input_file(const std::string& path, Mapped_file& out_mapped_file);
@@ -1,72 +1,212 @@
 /*
 This logger file was created in the Compiler Construction project
 by Sebastiaan Alvarez Rodriguez and Mariska IJpelaar
+
+This version writes the messages on a background thread
 */
 
 #ifndef COCO_FRAMEWORK_GENERAL_LOGGER
 #define COCO_FRAMEWORK_GENERAL_LOGGER
 
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
 #include <ostream>
-#include <streambuf>
 #include <string>
+#include <string_view>
 
-#include "aecpp.h"
+enum class Log_level : int {
+	INFO,
+	WARNING,
+	ERROR,
+	NONE // Only as a minimum level: log nothing
+};
 
-// Logger class to print errors, warnings and informational messages.
-// It also keeps the number of messages printed in each category.
-class Logger {
-    private:
-    std::ostream& info_stream;
-    std::ostream& warning_stream;
-    std::ostream& error_stream;
-    uint64_t infos, warnings, errors;
+#ifndef LOGGER_MIN_LEVEL
+#define LOGGER_MIN_LEVEL 0
+#endif
+
+/** Messages below this level are compiled out. Set with the log-level option of meson. */
+inline constexpr Log_level COMPILED_MIN_LEVEL = static_cast<Log_level>(LOGGER_MIN_LEVEL);
+
+namespace logger_detail {
+	extern std::atomic<Log_level> min_level;
+}
+
+/** Sets the level below which all loggers drop their messages at runtime. Defaults to INFO. */
+void set_log_level(Log_level level);
+
+inline Log_level log_level() {
+	return logger_detail::min_level.load(std::memory_order_relaxed);
+}
+
+struct Log_message {
+	Log_level level = Log_level::INFO;
+	int line = -1; // Omitted if negative
+	std::string text;
+};
+
+/** Appends [message] to [out] as one line with a tag for its level, e.g. "Error: line 3: oops\n" */
+void format_log_message(const Log_message& message, std::string& out);
+
+//==================================================================================================
+// Sinks
+//==================================================================================================
+
+/**
+ * Where a Logger writes its messages to. All messages are written by the background thread of
+ * the loggers, one at a time, so a sink needs no locking for [write].
+ */
+class Log_sink {
+public:
+	virtual ~Log_sink() = default;
 
-    public:
-    // Logger constructor, where info messages are printed to `info_stream`, warnings to `warning_stream`,
-    // and errors to `error_stream`.
-    Logger(std::ostream& info_stream, std::ostream& warning_stream, std::ostream& error_stream);
+	virtual void write(const Log_message& message) = 0;
 
-    // Print an informational message at `line`. If `line` is negative it is omitted.
-    std::ostream& info(int line);
+	/** True if the sink throws every message away, so that loggers need not even pass them on */
+	virtual bool discards() const {
+		return false;
+	}
+};
 
-    // Print a warning at `line`. If `line` is negative it is omitted.
-    std::ostream& warn(int line);
+/** Throws every message away */
+class Null_sink : public Log_sink {
+public:
+	void write(const Log_message&) override {}
 
-    // Print an error message at `line`. If `line` is negative it is omitted.
-    std::ostream& error(int line);
+	bool discards() const override {
+		return true;
+	}
+};
 
-    // Get the number of informational messages printed.
-    uint64_t n_infos() const;
+/** A global Null_sink, for ease of use */
+extern Null_sink NULL_SINK;
 
-    // Get the number of warnings printed.
-    uint64_t n_warnings() const;
+/** Writes the messages to a stream, with colored tags if it is a terminal */
+class Stream_sink : public Log_sink {
+public:
+	explicit Stream_sink(std::ostream& stream) : stream(stream) {}
 
-    // Get the number of errors printed.
-    uint64_t n_errors() const;
+	void write(const Log_message& message) override;
 
-    private:
-    // Print a generic tag to `stream`, in `color` with message `tag` at `line`. If `line` is negative, it is omitted.
-    static void print_tag(std::ostream& stream, aec::Color, const std::string& tag, int line);
+private:
+	std::ostream& stream;
 };
 
-// A helper class for a streambuf that discards any messages written to it
-class NullBuffer : public std::streambuf {
-    public:
-    int overflow(int c) override {
-        return c;
-    }
+/** A global Stream_sink on std::cerr */
+extern Stream_sink STDERR_SINK;
+
+/** Writes the messages to a file, without colors */
+class File_sink : public Log_sink {
+public:
+	/** Truncates the file at [path]. Check is_open to see whether it could be created. */
+	explicit File_sink(const std::string& path) : file(path) {}
+
+	bool is_open() const {
+		return file.is_open();
+	}
+
+	void write(const Log_message& message) override;
+
+private:
+	std::ofstream file;
+	std::string buffer;
 };
 
-// A helper stream that discards any messages written to it.
-class NullStream : public std::ostream {
-    NullBuffer buf;
+/** Keeps the messages in memory, until they are taken */
+class Memory_sink : public Log_sink {
+public:
+	void write(const Log_message& message) override;
+
+	/**
+	 * Returns the formatted messages written so far and forgets them. Call Logger::flush first to
+	 * make sure the messages of a logger have been written.
+	 */
+	std::string take();
 
-    public:
-    NullStream() : std::ostream(&buf) {
-    }
+	/** Returns the formatted messages written so far, and keeps them */
+	std::string contents();
+
+	/** Returns the formatted messages from character [offset] on (see size), and keeps them */
+	std::string contents_from(size_t offset);
+
+	/** Returns the number of characters of the formatted messages written so far */
+	size_t size();
+
+	/** Adds messages that were formatted before, e.g. taken from another Memory_sink */
+	void append(std::string_view formatted_messages);
+
+private:
+	std::mutex mutex;
+	std::string text;
 };
 
-// Global NullStream, for ease of use.
-extern NullStream NULL_STREAM;
+//==================================================================================================
+// Logger
+//==================================================================================================
+
+/**
+ * Logs errors, warnings and informational messages to a sink, and counts them per level.
+ *
+ * A message is put in a lock-free buffer of the calling thread, which one background thread drains
+ * into the sinks of all loggers. So the messages of a thread are written in order, but not right
+ * away; call flush to wait for them. Logging never waits for the background thread: if the buffer
+ * of the thread is full, the message goes to an unbounded spill list of the thread, which the
+ * background thread drains as well, so no message is ever lost.
+ */
+class Logger {
+public:
+	/** [sink] must outlive the logger */
+	explicit Logger(Log_sink& sink) : sink(sink) {}
+
+	/** Waits for the messages of the logger to be written (see flush), so that its sink may go */
+	~Logger();
+
+	Logger(const Logger&) = delete;
+	Logger& operator=(const Logger&) = delete;
+
+	/** Logs an informational message at [line]. If [line] is negative it is omitted. */
+	void info(int line, std::string_view message) {
+		log<Log_level::INFO>(line, message);
+	}
+
+	/** Logs a warning at [line]. If [line] is negative it is omitted. */
+	void warn(int line, std::string_view message) {
+		log<Log_level::WARNING>(line, message);
+	}
+
+	/** Logs an error message at [line]. If [line] is negative it is omitted. */
+	void error(int line, std::string_view message) {
+		log<Log_level::ERROR>(line, message);
+	}
+
+	/**
+	 * Waits until all messages that were logged before the call, on any thread and through any
+	 * logger, have been written to their sinks. Returns immediately if there are none.
+	 */
+	void flush();
+
+	// Get the number of messages logged in each category, on all threads.
+	uint64_t n_infos() const;
+	uint64_t n_warnings() const;
+	uint64_t n_errors() const;
+
+private:
+	template<Log_level level>
+	void log([[maybe_unused]] int line, [[maybe_unused]] std::string_view message) {
+		if constexpr (level >= COMPILED_MIN_LEVEL) {
+			if (level < log_level()) return;
+			counts[static_cast<int>(level)].fetch_add(1, std::memory_order_relaxed);
+			if (!sink.discards()) post(level, line, message);
+		}
+	}
+
+	void post(Log_level level, int line, std::string_view message);
+
+	Log_sink& sink;
+	std::atomic<uint64_t> counts[3] = {};
+	std::atomic<bool> posted{false}; // Whether a message was ever passed on to the sink
+};
 
 #endif
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/**
+ * A read-only memory mapping of a whole file.
+ * The mapping is released when the object is destroyed. Mapped_file objects can be moved, but not
+ * copied.
+ */
+class Mapped_file {
+public:
+	Mapped_file() noexcept;
+	Mapped_file(Mapped_file&& other) noexcept;
+	Mapped_file& operator=(Mapped_file&& other) noexcept;
+	~Mapped_file();
+
+	Mapped_file(const Mapped_file&) = delete;
+	Mapped_file& operator=(const Mapped_file&) = delete;
+
+	/**
+	 * Maps the file at [path] into memory, replacing any previous mapping.
+	 * Returns false if the file could not be opened or mapped, or if it is not a regular file.
+	 */
+	bool open(const std::string& path);
+
+	/** Releases the mapping, if any */
+	void close() noexcept;
+
+	bool is_open() const noexcept;
+
+	/** Returns the start of the mapped file. Empty files have no mapping and return nullptr. */
+	const char* data() const noexcept;
+
+	/** Returns the size of the mapped file in bytes */
+	size_t size() const noexcept;
+
+private:
+	char* mapping;
+	size_t mapping_size;
+	bool opened;
+};
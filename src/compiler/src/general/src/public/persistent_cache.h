@@ -0,0 +1,80 @@
+/* A string-to-string cache in a memory-mapped file, shared by threads and processes */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * A bounded hash table in a file, which survives the process and can be used by several threads
+ * and processes at once. Keys and values are byte strings, which together must fit in a slot of
+ * SLOT_SIZE bytes; longer entries are not cached.
+ *
+ * The table uses open addressing: an entry lives in one of the PROBE_LENGTH slots after the slot its
+ * hash points to. Inserting into a full window replaces the entry that was used least recently
+ * (with a resolution of a second), so the table never grows beyond the size it was opened with.
+ *
+ * Every slot has a sequence number that is odd while it is written. Readers copy a slot without
+ * locking and retry if the sequence number changed meanwhile, so lookups never wait. A writer
+ * claims a slot by making its number odd, and skips the insertion if another writer has it. If a
+ * process dies while writing, its slot stays unusable until the cache is recreated.
+ *
+ * Persistent_cache objects can be moved, but not copied. The mapping is released when the object
+ * is destroyed.
+ */
+class Persistent_cache {
+public:
+	static constexpr size_t SLOT_SIZE = 512;
+	static constexpr size_t PROBE_LENGTH = 8;
+
+	struct Entry {
+		bool success = true;      // Whether the value was computed without errors
+		uint64_t nanoseconds = 0; // How long it took to compute the value
+		std::string value;
+	};
+
+	Persistent_cache() noexcept;
+	Persistent_cache(Persistent_cache&& other) noexcept;
+	Persistent_cache& operator=(Persistent_cache&& other) noexcept;
+	~Persistent_cache();
+
+	Persistent_cache(const Persistent_cache&) = delete;
+	Persistent_cache& operator=(const Persistent_cache&) = delete;
+
+	/**
+	 * Opens the cache in the file at [path], of at most [max_bytes] bytes, replacing any cache that
+	 * was open. The file is created if it does not exist. It is replaced by an empty cache if it was
+	 * made with another size or another [generation], which should identify everything the values
+	 * depend on, so that values computed by older code are never returned.
+	 * Returns false if the file could not be created or mapped, or [max_bytes] is too small.
+	 */
+	bool open(const std::string& path, size_t max_bytes, uint64_t generation);
+
+	/** Releases the mapping, if any. The entries stay in the file. */
+	void close() noexcept;
+
+	bool is_open() const noexcept;
+
+	/** Returns true, and sets [out_entry], if the cache has an entry for [key] */
+	bool find(std::string_view key, Entry& out_entry) const;
+
+	/**
+	 * Stores [entry] for [key], replacing any entry for [key]. Returns false if the entry is too
+	 * large, or the slots it may go to are being written by others.
+	 */
+	bool insert(std::string_view key, const Entry& entry);
+
+	/** The number of entries the cache can hold */
+	size_t slot_count() const noexcept;
+
+private:
+	struct Slot;
+
+	Slot* slot(uint64_t hash, size_t probe) const noexcept;
+
+	char* mapping;
+	size_t mapping_size;
+	size_t slot_mask;
+};
@@ -0,0 +1,124 @@
+/* A bounded lock-free queue for one producer thread and one consumer thread */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/**
+ * A ring buffer of [capacity] elements that one thread pushes to and another pops from, without
+ * locks. The positions only ever grow; an element lives at its position modulo the capacity. Each
+ * position is written by one thread only, so pushing and popping never wait on each other. The
+ * producer and consumer positions are on separate cache lines, so they do not contend either.
+ */
+template<typename T>
+class Spsc_ring {
+public:
+	/** [capacity] must be a power of two */
+	explicit Spsc_ring(size_t capacity)
+			: elements(new T[capacity])
+			, mask(capacity - 1)
+	{}
+
+	Spsc_ring(const Spsc_ring&) = delete;
+	Spsc_ring& operator=(const Spsc_ring&) = delete;
+
+	/** Producer only. Returns false, and does not push [element], if the ring is full. */
+	template<typename U>
+	bool try_push(U&& element) {
+		size_t position = head.load(std::memory_order_relaxed);
+		if (position - tail_cache == mask + 1) {
+			tail_cache = tail.load(std::memory_order_acquire);
+			if (position - tail_cache == mask + 1) return false;
+		}
+		elements[position & mask] = std::forward<U>(element);
+		head.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Consumer only. Moves the oldest element to [out] and returns true, if there is one. */
+	bool try_pop(T& out) {
+		size_t position = tail.load(std::memory_order_relaxed);
+		if (position == head.load(std::memory_order_acquire)) return false;
+		out = std::move(elements[position & mask]);
+		tail.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Producer only. Pushes the [count] elements at [source], in order, or none of them if they do
+	 * not all fit. Returns whether it pushed them.
+	 */
+	bool try_push_n(const T* source, size_t count) {
+		size_t position = head.load(std::memory_order_relaxed);
+		if (position - tail_cache + count > mask + 1) {
+			tail_cache = tail.load(std::memory_order_acquire);
+			if (position - tail_cache + count > mask + 1) return false;
+		}
+		// The elements may wrap around the end of the array
+		size_t first = std::min(count, mask + 1 - (position & mask));
+		std::copy(source, source + first, &elements[position & mask]);
+		std::copy(source + first, source + count, &elements[0]);
+		head.store(position + count, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Consumer only. Moves the [count] oldest elements to [out], oldest first, if that many were
+	 * pushed; otherwise pops nothing. Returns whether it popped them.
+	 */
+	bool try_pop_n(T* out, size_t count) {
+		size_t position = tail.load(std::memory_order_relaxed);
+		if (head.load(std::memory_order_acquire) - position < count) return false;
+		size_t first = std::min(count, mask + 1 - (position & mask));
+		std::move(&elements[position & mask], &elements[position & mask] + first, out);
+		std::move(&elements[0], &elements[0] + (count - first), out + first);
+		tail.store(position + count, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Consumer only. Calls [consume](T&) for every element that was pushed before the call, oldest
+	 * first, and removes them all at once. Returns the number of elements consumed.
+	 */
+	template<typename Consume>
+	size_t drain(Consume consume) {
+		size_t first = tail.load(std::memory_order_relaxed);
+		size_t end = head.load(std::memory_order_acquire);
+		for (size_t position = first; position != end; ++position) {
+			consume(elements[position & mask]);
+		}
+		tail.store(end, std::memory_order_release);
+		return end - first;
+	}
+
+	/** Only exact while the other thread does not push or pop */
+	bool empty() const {
+		return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire);
+	}
+
+	/** The number of elements pushed so far. May be called from any thread. */
+	size_t pushed() const {
+		return head.load(std::memory_order_acquire);
+	}
+
+	/** The number of elements popped so far. May be called from any thread. */
+	size_t popped() const {
+		return tail.load(std::memory_order_acquire);
+	}
+
+	size_t capacity() const {
+		return mask + 1;
+	}
+
+private:
+	std::unique_ptr<T[]> elements;
+	const size_t mask;
+
+	alignas(64) std::atomic<size_t> head{0}; // Next position to push to
+	size_t tail_cache = 0;                   // The producer's last view of [tail]
+	alignas(64) std::atomic<size_t> tail{0}; // Next position to pop from
+};
@@ -0,0 +1,135 @@
+/* Per-stage latency and counter instrumentation of the conversion pipeline */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "trace.h"
+
+namespace stats {
+
+/** The stages of converting a line. Time spent in a nested stage is not counted for its parent. */
+enum Stage : size_t {
+	LEX,              // Scanning tokens
+	PARSE,            // Running the parser, including the grammar actions that build the tree
+	TO_LATEX,
+	TO_DISPLAY_STYLE,
+	COPY_OUT,         // Copying the result to the buffer of the caller of texify
+	CACHE,            // Looking up and storing lines in the LaTeX caches
+	STAGE_COUNT
+};
+
+enum Counter : size_t {
+	LINES,                    // Non-empty lines given to the parser
+	FAILED_LINES,             // Lines that could not be fully parsed
+	INPUT_BYTES,              // Of the parsed lines
+	OUTPUT_BYTES,             // Of the generated LaTeX
+	TREE_NODES,               // Syntax tree nodes created
+	ALLOCATIONS,              // Calls of operator new, if the executable counts them (see allocation_stats.cpp)
+	ALLOCATED_BYTES,          // Requested by those calls
+	CACHE_HITS,               // Lines whose conversion was found in a LaTeX cache
+	CACHE_MISSES,             // Lines that were looked up in a LaTeX cache, but not found
+	CACHE_SAVED_NANOSECONDS,  // What the conversions of the cache hits took when they were cached
+	CACHE_EVICTIONS,          // Entries removed from the in-memory LaTeX cache to stay in its budget
+	COUNTER_COUNT
+};
+
+const char* stage_name(Stage stage);
+const char* counter_name(Counter counter);
+
+struct Snapshot {
+	uint64_t stage_calls[STAGE_COUNT] = {};
+	uint64_t stage_nanoseconds[STAGE_COUNT] = {};
+	uint64_t counters[COUNTER_COUNT] = {};
+};
+
+namespace detail {
+	extern std::atomic<bool> enabled;
+
+	/** Adds to the counters of the calling thread */
+	void add_to_stage(Stage stage, uint64_t nanoseconds);
+	void add_to_counter(Counter counter, uint64_t amount);
+	void add_allocation(size_t bytes) noexcept;
+}
+
+/**
+ * Whether statistics are collected. Off by default: the instrumentation then costs a relaxed load
+ * and a branch per measuring point, and nothing is counted.
+ */
+inline bool enabled() noexcept {
+	return detail::enabled.load(std::memory_order_relaxed);
+}
+
+void set_enabled(bool enabled);
+
+/** Sets all counters of all threads to 0. Conversions in flight may still add to them. */
+void reset();
+
+/**
+ * Returns the sum of the counters of all threads, including those of threads that have finished.
+ * Counters are updated while threads convert, so a snapshot during conversions is not exact.
+ */
+Snapshot snapshot();
+
+/**
+ * Returns [snapshot] as a JSON object of the form
+ * {"enabled": true, "stages": {"lex": {"calls": 3, "nanoseconds": 1200}, ...}, "counters": {"lines": 1, ...}}
+ */
+std::string to_json(const Snapshot& snapshot);
+
+/** Adds [amount] to [counter] if statistics are enabled */
+inline void count(Counter counter, uint64_t amount = 1) {
+	if (enabled()) detail::add_to_counter(counter, amount);
+}
+
+/**
+ * Counts an allocation of [bytes] in ALLOCATIONS and ALLOCATED_BYTES if statistics are enabled.
+ * Called by the operator new of allocation_stats.cpp; allocations made while counting one, and
+ * those of a thread whose counters were destroyed at its exit, are not counted.
+ */
+inline void count_allocation(size_t bytes) noexcept {
+	if (enabled()) detail::add_allocation(bytes);
+}
+
+/**
+ * Measures the monotonic time from its construction to its destruction as a call of [stage], if
+ * statistics were enabled at construction. Timers on the same thread nest: the time of an inner
+ * timer is subtracted from the outer one, so that every stage gets only its own time.
+ *
+ * If tracing was enabled at construction, the call is also recorded as a trace event, except for
+ * LEX, which is called for every token. The lexing time within a PARSE event is given as its
+ * argument "lex_us" instead.
+ */
+class Stage_timer {
+public:
+	explicit Stage_timer(Stage stage) noexcept
+			: stage(stage)
+			, counting(enabled())
+			, tracing(trace::enabled())
+	{
+		if (counting || tracing) start();
+	}
+
+	~Stage_timer() {
+		if (counting || tracing) stop();
+	}
+
+	Stage_timer(const Stage_timer&) = delete;
+	Stage_timer& operator=(const Stage_timer&) = delete;
+
+private:
+	void start() noexcept;
+	void stop() noexcept;
+
+	Stage stage;
+	bool counting;
+	bool tracing;
+	uint64_t start_time; // trace::now()
+	uint64_t nested_nanoseconds = 0; // Measured by the timers inside this one
+	Stage_timer* outer = nullptr;
+};
+
+} // namespace stats
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+/**
+ * The stack size for work on deeply nested inputs. Syntax trees are walked and destroyed
+ * recursively, and every binary operator of a line nests the rest of it, so lines of many thousands
+ * of words need more than the usual 8 MB of stack. Only the pages that are used get memory.
+ */
+inline constexpr size_t DEEP_STACK_SIZE = size_t(1) << 30;
+
+/**
+ * Runs [function] on a new thread with a stack of [stack_size] bytes and waits for it to finish.
+ * An exception thrown by [function] is rethrown on the calling thread. Throws std::system_error
+ * if the thread can not be created.
+ */
+void run_with_stack_size(size_t stack_size, const std::function<void()>& function);
@@ -0,0 +1,88 @@
+/* Trace events of the conversion pipeline, written as Chrome trace-event JSON */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace trace {
+
+namespace detail {
+	extern std::atomic<bool> enabled;
+}
+
+/**
+ * Whether events are recorded, i.e. between start and stop. Otherwise recording an event costs a
+ * relaxed load and a branch.
+ */
+inline bool enabled() noexcept {
+	return detail::enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * The time in nanoseconds on the monotonic clock that the events are timed with. This is the
+ * CLOCK_MONOTONIC of the system, so other processes (like Python's time.monotonic_ns) can time
+ * events of their own on the same timeline.
+ */
+uint64_t now() noexcept;
+
+/**
+ * Starts recording events and writing them to the file at [path] as a Chrome trace-event JSON
+ * array, which chrome://tracing and Perfetto open. A background thread flushes the recorded events
+ * to the file every few milliseconds. Returns false if tracing was already started or the file
+ * can not be opened.
+ */
+bool start(const std::string& path);
+
+/**
+ * Writes the events recorded so far to the file. Returns false if tracing was not started or
+ * writing failed.
+ */
+bool flush();
+
+/**
+ * Stops recording, writes the remaining events and closes the file. Returns false if tracing was
+ * not started or writing failed. A trace that is still running when the program exits is stopped
+ * then.
+ */
+bool stop();
+
+/**
+ * Records a complete event on the calling thread, if tracing is enabled. [name] and [category] are
+ * copied, truncated to a few dozen characters. [start] and [duration] are in nanoseconds of now().
+ * If [arg_name] is given, the event gets the argument [arg_name] with value [arg]. [arg_name] must
+ * be a string literal.
+ *
+ * Every thread records into a lock-free buffer of its own. If a thread records events faster than
+ * they are flushed, the events that do not fit are dropped and counted in the trace.
+ */
+void record(
+	const char* name, const char* category, uint64_t start, uint64_t duration,
+	const char* arg_name = nullptr, double arg = 0
+);
+
+/** Records the time from its construction to its destruction as an event, if tracing is enabled */
+class Span {
+public:
+	/** [name] and [category] must outlive the span */
+	explicit Span(const char* name, const char* category = "talktex") noexcept
+			: name(name)
+			, category(category)
+			, start(enabled() ? now() : 0)
+	{}
+
+	~Span() {
+		if (start != 0) record(name, category, start, now() - start);
+	}
+
+	Span(const Span&) = delete;
+	Span& operator=(const Span&) = delete;
+
+private:
+	const char* name;
+	const char* category;
+	uint64_t start; // 0 if tracing was disabled
+};
+
+} // namespace trace
@@ -0,0 +1,140 @@
+/* Tests of the sharing of nodes between copies of a tree */
+
+#include <iostream>
+#include <string>
+
+#include "aec_styles.h"
+#include "avds/tree/tree.h"
+
+using Tree = avds::tree::Tree<int>;
+
+namespace {
+
+bool success = true;
+
+void fail(const std::string& test, const std::string& message) {
+	std::cerr << aec_style::error << "Error:" << aec::reset << " " << test << ": " << message << "\n";
+	success = false;
+}
+
+/**
+ * Returns the tree
+ *     0
+ *     ├── 1
+ *     │   ├── 3
+ *     │   └── 4
+ *     └── 2
+ *         └── 5
+ */
+Tree make_tree() {
+	Tree tree(0);
+	auto one = tree.append_child(tree.entrance(), 1);
+	tree.append_child(one, 3);
+	tree.append_child(one, 4);
+	auto two = tree.append_child(tree.entrance(), 2);
+	tree.append_child(two, 5);
+	return tree;
+}
+
+/** Returns the address of the node at [path] from the root of [tree], which is not copied */
+const int* node(const Tree& tree, std::initializer_list<size_t> path) {
+	auto t = tree.centrance();
+	for (size_t index : path) t.to_child(index);
+	return &*t;
+}
+
+void test_copy_shares() {
+	Tree tree = make_tree();
+	Tree copy = tree;
+	if (node(copy, {}) != node(tree, {})) fail("copy", "the root was copied");
+	if (copy != tree) fail("copy", "the copy differs");
+}
+
+void test_path_copy() {
+	const std::string test = "path copy";
+	Tree tree = make_tree();
+	Tree copy = tree;
+	copy.append_child(copy.centrance().child(0).child(1), 6);
+
+	// The nodes on the path to the modified node are copied...
+	if (node(copy, {}) == node(tree, {})) fail(test, "the root is shared");
+	if (node(copy, {0}) == node(tree, {0})) fail(test, "the parent of the modified node is shared");
+	if (node(copy, {0, 1}) == node(tree, {0, 1})) fail(test, "the modified node is shared");
+	// ...the other ones are not
+	if (node(copy, {0, 0}) != node(tree, {0, 0})) fail(test, "the sibling of the modified node was copied");
+	if (node(copy, {1}) != node(tree, {1})) fail(test, "the sibling of its parent was copied");
+	if (node(copy, {1, 0}) != node(tree, {1, 0})) fail(test, "the child of that sibling was copied");
+
+	if (tree != make_tree()) fail(test, "the original changed");
+	if (copy.centrance().child(0).child(1).child_count() != 1 || *copy.centrance().child(0).child(1).child(0) != 6) {
+		fail(test, "the copy was not modified");
+	}
+}
+
+void test_traverser_path_copy() {
+	const std::string test = "traverser path copy";
+	Tree tree = make_tree();
+	Tree copy = tree;
+	*copy.entrance().child(1).child(0) = 7;
+
+	if (node(copy, {1, 0}) == node(tree, {1, 0})) fail(test, "the modified node is shared");
+	if (node(copy, {0}) != node(tree, {0})) fail(test, "the sibling of its parent was copied");
+	if (*tree.centrance().child(1).child(0) != 5) fail(test, "the original changed");
+	if (*copy.centrance().child(1).child(0) != 7) fail(test, "the copy was not modified");
+}
+
+void test_replace_subtree() {
+	const std::string test = "replace subtree";
+	Tree tree = make_tree();
+	Tree copy = tree;
+	copy.replace_subtree(copy.centrance().child(1).child(0), Tree(8));
+
+	if (node(copy, {0}) != node(tree, {0})) fail(test, "the sibling of its parent was copied");
+	if (*tree.centrance().child(1).child(0) != 5) fail(test, "the original changed");
+	if (*copy.centrance().child(1).child(0) != 8) fail(test, "the subtree was not replaced");
+}
+
+void test_traverser_at() {
+	const std::string test = "traverser_at";
+	Tree tree = make_tree();
+	Tree copy = tree;
+	bool copied = false;
+	copy.replace_subtree(copy.traverser_at({1, 0}, &copied), Tree(8));
+	if (!copied) fail(test, "copying the path of a shared tree is not reported");
+	if (node(copy, {0}) != node(tree, {0})) fail(test, "the sibling of its parent was copied");
+	if (*tree.centrance().child(1).child(0) != 5) fail(test, "the original changed");
+	if (*copy.centrance().child(1).child(0) != 8) fail(test, "the subtree was not replaced");
+
+	copy.replace_subtree(copy.traverser_at({0, 0}, &copied), Tree(9));
+	if (!copied) fail(test, "copying the shared parent of the node is not reported");
+	Tree::const_traverser sibling = copy.centrance().child(0).child(1);
+	copy.replace_subtree(copy.traverser_at({0, 0}, &copied), Tree(10));
+	if (copied) fail(test, "a copy is reported for a path that the tree owns alone");
+	if (copy.centrance().child(0).child(1) != sibling) fail(test, "the sibling moved although nothing was copied");
+	if (*copy.centrance().child(0).child(0) != 10) fail(test, "the subtree was not replaced");
+}
+
+void test_subtree_shares() {
+	const std::string test = "subtree";
+	Tree tree = make_tree();
+	Tree subtree = tree.subtree(0);
+	Tree from_traverser(tree.centrance().child(1));
+	if (node(subtree, {}) != node(tree, {0})) fail(test, "subtree() copied the nodes");
+	if (node(from_traverser, {}) != node(tree, {1})) fail(test, "Tree(const_traverser) copied the nodes");
+
+	subtree.append_child(subtree.centrance(), 9);
+	if (node(subtree, {0}) != node(tree, {0, 0})) fail(test, "an untouched child of the subtree was copied");
+	if (tree != make_tree()) fail(test, "the original changed");
+}
+
+} // unnamed namespace
+
+int main() {
+	test_copy_shares();
+	test_path_copy();
+	test_traverser_path_copy();
+	test_replace_subtree();
+	test_traverser_at();
+	test_subtree_shares();
+	return (success ? 0 : 1);
+}
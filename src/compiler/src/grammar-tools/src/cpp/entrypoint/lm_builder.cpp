@@ -0,0 +1,86 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <tclap/CmdLine.h>
+
+#include "aec_styles.h"
+#include "grammar_description.h"
+#include "io_util.h"
+#include "ngram_model.h"
+
+using namespace grammar_tools;
+
+// =================================================================================================
+// Command-line interface
+// =================================================================================================
+
+void print_statistics(const Ngram_counts& counts, double seconds) {
+	std::cerr << "Sentences:          " << counts.sentences() << "\n"
+	          << "Words:              " << counts.words() << "\n";
+	for (size_t n = 1; n <= counts.order(); ++n) {
+		std::cerr << n << "-grams:            " << counts.ngrams(n) << "\n";
+	}
+	std::cerr << "Seconds:            " << seconds << "\n";
+}
+
+int main(int argc, char** argv) {
+	TCLAP::CmdLine cmd("TalkTex compiler - n-gram language model of the grammar, for the scorer", ' ', "1.0");
+
+	try {
+		TCLAP::ValueArg<size_t> sentences_arg("n", "sentences", "Number of sentences to generate and count.", false, 100000, "unsigned integer", cmd);
+		TCLAP::ValueArg<size_t> order_arg("N", "order", "The longest sequences of words in the model.", false, 5, "unsigned integer", cmd);
+		TCLAP::ValueArg<size_t> tokens_arg("t", "tokens", "Number of tokens to aim for per sentence.", false, 2, "unsigned integer", cmd);
+		TCLAP::ValueArg<size_t> max_tokens_arg("T", "max-tokens", "Aim for a number of tokens between --tokens and this one per sentence.", false, 20, "unsigned integer", cmd);
+		TCLAP::MultiArg<std::string> weight_arg("w", "weight", "Weight of a grammar symbol, e.g. B_PLUS=5 or FRACTION=0 (default 1).", false, "SYMBOL=WEIGHT", cmd);
+		TCLAP::ValueArg<unsigned int> seed_arg("s", "seed", "Seed of the random generators.", false, 1, "unsigned integer", cmd);
+		TCLAP::ValueArg<unsigned int> threads_arg("j", "threads", "Number of threads that generate sentences (0: one per processor).", false, 0, "unsigned integer", cmd);
+		TCLAP::SwitchArg no_check_switch("", "no-check", "Do not check the sentences with the real parser.", cmd, false);
+		TCLAP::ValueArg<std::string> output_arg("o", "output", "Write the ARPA model to this file instead of stdout.", false, "", "string", cmd);
+		TCLAP::ValueArg<std::string> vocabulary_arg("", "vocabulary", "Write the words of the model to this file, for generate_scorer_package.", false, "", "string", cmd);
+		TCLAP::ValueArg<std::string> bison_arg("", "bison", "Bison source of the grammar (default: the compiler.y this program was built with).", false, "", "string", cmd);
+		TCLAP::ValueArg<std::string> flex_arg("", "flex", "Flex source of the vocabulary (default: the compiler.l this program was built with).", false, "", "string", cmd);
+		cmd.parse(argc, argv);
+
+		Ngram_options options;
+		options.order = order_arg.getValue();
+		options.sentences = sentences_arg.getValue();
+		options.threads = threads_arg.getValue();
+		options.check = !no_check_switch.getValue();
+		options.generator.min_tokens = tokens_arg.getValue();
+		options.generator.max_tokens = std::max(max_tokens_arg.getValue(), options.generator.min_tokens);
+		options.generator.seed = seed_arg.getValue();
+
+		std::ofstream file;
+		if (output_arg.isSet() && !try_open_output_file(output_arg.getValue(), file)) return 1;
+		std::ostream& output = output_arg.isSet() ? file : std::cout;
+		std::ofstream vocabulary_file;
+		if (vocabulary_arg.isSet() && !try_open_output_file(vocabulary_arg.getValue(), vocabulary_file)) return 1;
+
+		try {
+			for (const std::string& assignment : weight_arg.getValue()) {
+				add_weight(options.generator, assignment);
+			}
+			Grammar_description grammar = read_grammar_files(bison_arg.getValue(), flex_arg.getValue());
+			Word_numbers words(grammar);
+
+			auto start = std::chrono::steady_clock::now();
+			Ngram_counts counts = count_sentences(grammar, words, options);
+			counts.write_arpa(output);
+			output.flush();
+			if (vocabulary_arg.isSet()) counts.write_vocabulary(vocabulary_file);
+			std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+			print_statistics(counts, seconds.count());
+		} catch (std::runtime_error& e) {
+			std::cerr << aec_style::error << "Error:" << aec::reset << " " << e.what() << "\n";
+			return 1;
+		}
+		return 0;
+
+	} catch (TCLAP::ArgException& e) {
+		std::cerr << aec_style::error << "command-line error: " << aec::reset << e.error()
+		          << " for arg " << e.argId() << std::endl;
+		return 1;
+	}
+}
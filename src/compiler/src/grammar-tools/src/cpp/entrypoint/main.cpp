@@ -0,0 +1,179 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <tclap/CmdLine.h>
+
+#include "aec_styles.h"
+#include "grammar_description.h"
+#include "io_util.h"
+#include "logger.h"
+#include "next_words.h"
+#include "sentence_check.h"
+#include "sentence_generator.h"
+#include "syntax_visitor.h"
+#include "thread_util.h"
+
+using namespace grammar_tools;
+
+// =================================================================================================
+// Generation
+// =================================================================================================
+
+struct Corpus_statistics {
+	size_t lines = 0;
+	size_t tokens = 0;
+	size_t dropped_lines = 0;
+};
+
+/**
+ * Writes [lines] lines of generated sentences to [os]. If [check] is set, the sentences are
+ * repaired until the real scanner and parser accept them, before invalid tokens are put in.
+ */
+Corpus_statistics generate(
+	Sentence_generator& generator, size_t lines, size_t max_tokens, bool check, std::ostream& os
+) {
+	Logger logger(NULL_SINK);
+	Syntax_visitor visitor(logger);
+	Corpus_statistics stats;
+	size_t max_repairs = 100 + max_tokens / 10;
+	std::string line;
+	for (size_t l = 0; l < lines; ++l) {
+		Derivation derivation;
+		if (check) {
+			if (!generate_valid_sentence(generator, visitor, max_repairs, derivation, line)) {
+				++stats.dropped_lines;
+				continue;
+			}
+		}
+		else {
+			derivation = generator.generate_sentence();
+		}
+		generator.inject_invalid_tokens(derivation.tokens);
+		line.clear();
+		generator.spell(derivation.tokens, line);
+		os << line << '\n';
+		++stats.lines;
+		stats.tokens += derivation.tokens.size();
+	}
+	visitor.syntax_tree = Syntax_tree(); // Destroy the last tree on the big stack as well
+	return stats;
+}
+
+void print_statistics(
+	const Corpus_statistics& corpus, const Generator_statistics& generator, double seconds
+) {
+	std::cerr << "Lines:              " << corpus.lines << "\n"
+	          << "Tokens:             " << corpus.tokens << " ("
+	          << (corpus.lines == 0 ? 0 : corpus.tokens / corpus.lines) << " per line)\n"
+	          << "Invalid tokens:     " << generator.invalid_tokens << "\n"
+	          << "Repaired subtrees:  " << generator.rederived_subtrees << "\n"
+	          << "Maximal depth:      " << generator.max_depth << "\n"
+	          << "Seconds:            " << seconds << "\n";
+	if (corpus.dropped_lines != 0) {
+		std::cerr << aec::yellow << "Warning:" << aec::reset << " Left out " << corpus.dropped_lines
+		          << " lines that could not be repaired\n";
+	}
+}
+
+// =================================================================================================
+// Next words
+// =================================================================================================
+
+/**
+ * Writes to [os] the words of the vocabulary of [description] that the parser may accept next (see
+ * grammar::Next_word_table), for every state in which it asks for a token: a line with the number
+ * of the state and the words, separated by tabs.
+ */
+void print_next_words(const Grammar_description& description, std::ostream& os) {
+	grammar::Next_word_table table(description.spellings());
+	std::vector<int> path;
+	std::vector<size_t> words;
+	size_t states = 0;
+	size_t total = 0;
+	for (int state = 0; state < grammar::Parser_tracker::state_count(); ++state) {
+		if (!grammar::Parser_tracker::path_to(state, path)) continue;
+		table.allowed(state, words);
+		os << state;
+		for (size_t word : words) {
+			os << '\t' << table.word(word);
+		}
+		os << '\n';
+		++states;
+		total += words.size();
+	}
+	std::cerr << "Words:              " << table.size() << "\n"
+	          << "States:             " << states << "\n"
+	          << "Words per state:    " << (states == 0 ? 0 : total / states) << "\n";
+}
+
+// =================================================================================================
+// Command-line interface
+// =================================================================================================
+
+int main(int argc, char** argv) {
+	TCLAP::CmdLine cmd("TalkTex compiler - random sentences of the grammar", ' ', "1.0");
+
+	try {
+		TCLAP::ValueArg<size_t> lines_arg("n", "lines", "Number of lines to generate.", false, 100, "unsigned integer", cmd);
+		TCLAP::ValueArg<size_t> tokens_arg("t", "tokens", "Number of tokens to aim for per line.", false, 20, "unsigned integer", cmd);
+		TCLAP::ValueArg<size_t> max_tokens_arg("T", "max-tokens", "Aim for a number of tokens between --tokens and this one per line.", false, 0, "unsigned integer", cmd);
+		TCLAP::ValueArg<size_t> depth_arg("d", "max-depth", "Maximal depth of the derivation tree of a line (0: no maximum).", false, 0, "unsigned integer", cmd);
+		TCLAP::MultiArg<std::string> weight_arg("w", "weight", "Weight of a grammar symbol, e.g. B_PLUS=5 or FRACTION=0 (default 1).", false, "SYMBOL=WEIGHT", cmd);
+		TCLAP::ValueArg<double> invalid_arg("e", "invalid-rate", "Fraction of the tokens to replace by other tokens of the vocabulary.", false, 0, "fraction", cmd);
+		TCLAP::ValueArg<unsigned int> seed_arg("s", "seed", "Seed of the random generator.", false, 1, "unsigned integer", cmd);
+		TCLAP::SwitchArg no_check_switch("", "no-check", "Do not check the sentences with the real parser.", cmd, false);
+		TCLAP::SwitchArg next_words_switch("", "next-words", "Instead of generating lines, write the words of the vocabulary that may come next in every state of the parser.", cmd, false);
+		TCLAP::ValueArg<std::string> output_arg("o", "output", "Write the lines to this file instead of stdout.", false, "", "string", cmd);
+		TCLAP::ValueArg<std::string> bison_arg("", "bison", "Bison source of the grammar (default: the compiler.y this program was built with).", false, "", "string", cmd);
+		TCLAP::ValueArg<std::string> flex_arg("", "flex", "Flex source of the vocabulary (default: the compiler.l this program was built with).", false, "", "string", cmd);
+		cmd.parse(argc, argv);
+
+		Generator_options options;
+		options.min_tokens = tokens_arg.getValue();
+		options.max_tokens = max_tokens_arg.isSet() ? max_tokens_arg.getValue() : options.min_tokens;
+		options.max_depth = depth_arg.getValue();
+		options.invalid_rate = invalid_arg.getValue();
+		options.seed = seed_arg.getValue();
+
+		std::ofstream file;
+		if (output_arg.isSet() && !try_open_output_file(output_arg.getValue(), file)) return 1;
+		std::ostream& output = output_arg.isSet() ? file : std::cout;
+
+		int result = 0;
+		// Checking long lines builds and destroys deep syntax trees
+		run_with_stack_size(DEEP_STACK_SIZE, [&] {
+			try {
+				if (next_words_switch.getValue()) {
+					print_next_words(read_grammar_files(bison_arg.getValue(), flex_arg.getValue()), output);
+					return;
+				}
+				for (const auto& assignment : weight_arg.getValue()) {
+					add_weight(options, assignment);
+				}
+				Sentence_generator generator(
+					read_grammar_files(bison_arg.getValue(), flex_arg.getValue()), options
+				);
+
+				auto start = std::chrono::steady_clock::now();
+				Corpus_statistics stats = generate(
+					generator, lines_arg.getValue(), options.max_tokens, !no_check_switch.getValue(), output
+				);
+				output.flush();
+				std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+				print_statistics(stats, generator.statistics(), seconds.count());
+			} catch (std::runtime_error& e) {
+				std::cerr << aec_style::error << "Error:" << aec::reset << " " << e.what() << "\n";
+				result = 1;
+			}
+		});
+		return result;
+
+	} catch (TCLAP::ArgException& e) {
+		std::cerr << aec_style::error << "command-line error: " << aec::reset << e.error()
+		          << " for arg " << e.argId() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,545 @@
+#include "grammar_description.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+namespace grammar_tools {
+
+// Defined in embedded_grammar.cpp, which meson generates from the grammar sources
+extern const char* const EMBEDDED_BISON_SOURCE;
+extern const char* const EMBEDDED_FLEX_SOURCE;
+
+//==================================================================================================
+// Helper functions
+//==================================================================================================
+
+namespace {
+
+/** Splits [source] at the lines that consist of "%%", like bison and flex do */
+std::vector<std::string> split_sections(const std::string& source) {
+	std::vector<std::string> sections(1);
+	std::istringstream lines(source);
+	std::string line;
+	while (std::getline(lines, line)) {
+		size_t end = line.find_last_not_of(" \t\r");
+		if (end == 1 && line.compare(0, 2, "%%") == 0) {
+			sections.emplace_back();
+		}
+		else {
+			sections.back() += line;
+			sections.back() += '\n';
+		}
+	}
+	return sections;
+}
+
+std::string read_all(std::istream& is, const char* what) {
+	std::ostringstream contents;
+	contents << is.rdbuf();
+	if (is.bad()) {
+		throw std::runtime_error(std::string("could not read the ") + what + " source");
+	}
+	return contents.str();
+}
+
+bool is_identifier_char(char c) {
+	return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.' || c == '-';
+}
+
+//==================================================================================================
+// Bison
+//==================================================================================================
+
+/** The parts of a bison source that make up its grammar, without code and comments */
+struct Bison_item {
+	enum class Kind { Identifier, Literal, Directive, Colon, Bar, Semicolon, Other };
+
+	Kind kind;
+	std::string text;
+};
+
+/** Returns the position after the comment, string or braced code that starts at [pos] in [text] */
+size_t skip_code(const std::string& text, size_t pos) {
+	if (text.compare(pos, 2, "/*") == 0) {
+		size_t end = text.find("*/", pos + 2);
+		if (end == std::string::npos) throw std::runtime_error("unterminated comment in the bison source");
+		return end + 2;
+	}
+	if (text.compare(pos, 2, "//") == 0) {
+		size_t end = text.find('\n', pos);
+		return end == std::string::npos ? text.size() : end + 1;
+	}
+	if (text[pos] == '"' || text[pos] == '\'') {
+		char quote = text[pos];
+		for (size_t i = pos + 1; i < text.size(); ++i) {
+			if (text[i] == '\\') ++i;
+			else if (text[i] == quote) return i + 1;
+		}
+		throw std::runtime_error("unterminated string in the bison source");
+	}
+	// Braced code
+	int depth = 0;
+	size_t i = pos;
+	while (i < text.size()) {
+		char c = text[i];
+		if (c == '{') {
+			++depth;
+			++i;
+		}
+		else if (c == '}') {
+			++i;
+			if (--depth == 0) return i;
+		}
+		else if (c == '"' || c == '\'' || text.compare(i, 2, "/*") == 0 || text.compare(i, 2, "//") == 0) {
+			i = skip_code(text, i);
+		}
+		else {
+			++i;
+		}
+	}
+	throw std::runtime_error("unterminated braces in the bison source");
+}
+
+std::vector<Bison_item> bison_items(const std::string& text) {
+	using Kind = Bison_item::Kind;
+	std::vector<Bison_item> items;
+	size_t i = 0;
+	while (i < text.size()) {
+		char c = text[i];
+		if (std::isspace(static_cast<unsigned char>(c))) {
+			++i;
+		}
+		else if (text.compare(i, 2, "/*") == 0 || text.compare(i, 2, "//") == 0 || c == '{') {
+			i = skip_code(text, i);
+		}
+		else if (text.compare(i, 2, "%{") == 0) {
+			size_t end = text.find("%}", i);
+			if (end == std::string::npos) throw std::runtime_error("unterminated %{ in the bison source");
+			i = end + 2;
+		}
+		else if (c == '"' || c == '\'') {
+			size_t end = skip_code(text, i);
+			items.push_back({Kind::Literal, text.substr(i, end - i)});
+			i = end;
+		}
+		else if (c == '%' || is_identifier_char(c)) {
+			size_t end = i + 1;
+			while (end < text.size() && is_identifier_char(text[end])) ++end;
+			bool number = std::isdigit(static_cast<unsigned char>(c));
+			items.push_back({c == '%' ? Kind::Directive : number ? Kind::Other : Kind::Identifier, text.substr(i, end - i)});
+			i = end;
+		}
+		else if (c == '<') {
+			// A type tag
+			size_t end = text.find('>', i);
+			if (end == std::string::npos) throw std::runtime_error("unterminated <tag> in the bison source");
+			i = end + 1;
+		}
+		else {
+			Kind kind = c == ':' ? Kind::Colon : c == '|' ? Kind::Bar : c == ';' ? Kind::Semicolon : Kind::Other;
+			items.push_back({kind, std::string(1, c)});
+			++i;
+		}
+	}
+	return items;
+}
+
+/** A production by symbol names, as it appears in the bison source */
+struct Named_production {
+	std::string lhs;
+	std::vector<std::string> rhs;
+};
+
+std::vector<Named_production> read_rules(const std::string& rules) {
+	using Kind = Bison_item::Kind;
+	std::vector<Bison_item> items = bison_items(rules);
+	std::vector<Named_production> productions;
+	for (size_t i = 0; i < items.size(); ++i) {
+		const Bison_item& item = items[i];
+		bool starts_rule = item.kind == Kind::Identifier && i + 1 < items.size() && items[i + 1].kind == Kind::Colon;
+		if (starts_rule) {
+			productions.push_back({item.text, {}});
+			++i; // The colon
+		}
+		else if (productions.empty()) {
+			throw std::runtime_error("expected a rule instead of '" + item.text + "' in the bison source");
+		}
+		else if (item.kind == Kind::Identifier || item.kind == Kind::Literal) {
+			productions.back().rhs.push_back(item.text);
+		}
+		else if (item.kind == Kind::Bar) {
+			productions.push_back({productions.back().lhs, {}});
+		}
+		else if (item.kind == Kind::Directive && item.text == "%prec") {
+			++i; // Precedence only matters for conflict resolution
+		}
+		else if (!(item.kind == Kind::Semicolon || (item.kind == Kind::Directive && item.text == "%empty"))) {
+			throw std::runtime_error("unsupported '" + item.text + "' in the rules of the bison source");
+		}
+	}
+	if (productions.empty()) {
+		throw std::runtime_error("the bison source has no rules");
+	}
+	return productions;
+}
+
+/** Returns the symbol named by %start in [declarations], or an empty string */
+std::string read_start_symbol(const std::string& declarations) {
+	using Kind = Bison_item::Kind;
+	std::vector<Bison_item> items = bison_items(declarations);
+	for (size_t i = 0; i + 1 < items.size(); ++i) {
+		if (items[i].kind == Kind::Directive && items[i].text == "%start") {
+			return items[i + 1].text;
+		}
+	}
+	return "";
+}
+
+//==================================================================================================
+// Flex
+//==================================================================================================
+
+/**
+ * Expands flex patterns into all the texts they match. Supports strings, character classes,
+ * definitions, groups and alternations, which is all that a scanner for a fixed vocabulary needs.
+ */
+class Pattern_expander {
+public:
+	explicit Pattern_expander(const std::map<std::string, std::string>& definitions)
+		: definitions(definitions) {}
+
+	std::vector<std::string> expand(const std::string& pattern) {
+		const std::string* outer_pattern = this->pattern;
+		size_t outer_pos = pos;
+		this->pattern = &pattern;
+		pos = 0;
+		std::vector<std::string> result = alternation();
+		if (pos != pattern.size()) fail("unexpected ')'");
+		this->pattern = outer_pattern;
+		pos = outer_pos;
+		return result;
+	}
+
+private:
+	static constexpr size_t MAX_EXPANSIONS = 100000;
+
+	std::vector<std::string> alternation() {
+		std::vector<std::string> result = concatenation();
+		while (pos < pattern->size() && (*pattern)[pos] == '|') {
+			++pos;
+			std::vector<std::string> alternative = concatenation();
+			result.insert(result.end(), alternative.begin(), alternative.end());
+		}
+		return result;
+	}
+
+	std::vector<std::string> concatenation() {
+		std::vector<std::string> result{""};
+		while (pos < pattern->size() && (*pattern)[pos] != '|' && (*pattern)[pos] != ')') {
+			std::vector<std::string> part = atom();
+			if (pos < pattern->size()) {
+				char quantifier = (*pattern)[pos];
+				if (quantifier == '?' || quantifier == '*' || quantifier == '+') {
+					++pos;
+					if (quantifier != '+') part.insert(part.begin(), "");
+				}
+			}
+			if (result.size() * part.size() > MAX_EXPANSIONS) fail("matches too many texts");
+			std::vector<std::string> product;
+			product.reserve(result.size() * part.size());
+			for (const auto& prefix : result) {
+				for (const auto& suffix : part) {
+					product.push_back(prefix + suffix);
+				}
+			}
+			result = std::move(product);
+		}
+		return result;
+	}
+
+	std::vector<std::string> atom() {
+		char c = (*pattern)[pos++];
+		switch (c) {
+		case '"': {
+			std::string text;
+			while (pos < pattern->size() && (*pattern)[pos] != '"') {
+				text += (*pattern)[pos] == '\\' ? escaped() : (*pattern)[pos++];
+			}
+			if (pos++ == pattern->size()) fail("unterminated string");
+			return {text};
+		}
+		case '[':
+			return character_class();
+		case '(': {
+			std::vector<std::string> result = alternation();
+			if (pos == pattern->size() || (*pattern)[pos++] != ')') fail("unterminated group");
+			return result;
+		}
+		case '{': {
+			size_t end = pattern->find('}', pos);
+			if (end == std::string::npos) fail("unterminated {");
+			std::string name = pattern->substr(pos, end - pos);
+			pos = end + 1;
+			auto definition = definitions.find(name);
+			if (definition == definitions.end()) fail("unknown definition {" + name + "}");
+			return expand(definition->second);
+		}
+		case '\\':
+			--pos;
+			return {std::string(1, escaped())};
+		case '.': case '^': case '$': case '/': case '<':
+			fail(std::string("unsupported '") + c + "'");
+		}
+		return {std::string(1, c)};
+	}
+
+	std::vector<std::string> character_class() {
+		if (pos < pattern->size() && (*pattern)[pos] == '^') fail("unsupported negated character class");
+		std::vector<std::string> result;
+		while (pos < pattern->size() && (*pattern)[pos] != ']') {
+			char first = (*pattern)[pos] == '\\' ? escaped() : (*pattern)[pos++];
+			char last = first;
+			if (pos + 1 < pattern->size() && (*pattern)[pos] == '-' && (*pattern)[pos + 1] != ']') {
+				++pos;
+				last = (*pattern)[pos] == '\\' ? escaped() : (*pattern)[pos++];
+			}
+			for (int c = first; c <= last; ++c) {
+				result.emplace_back(1, static_cast<char>(c));
+			}
+		}
+		if (pos++ == pattern->size()) fail("unterminated character class");
+		return result;
+	}
+
+	/** Reads the escape sequence at [pos] */
+	char escaped() {
+		++pos; // The backslash
+		if (pos == pattern->size()) fail("trailing backslash");
+		char c = (*pattern)[pos++];
+		switch (c) {
+		case 'n': return '\n';
+		case 't': return '\t';
+		case 'r': return '\r';
+		default:  return c;
+		}
+	}
+
+	[[noreturn]] void fail(const std::string& message) const {
+		throw std::runtime_error("flex pattern " + *pattern + ": " + message);
+	}
+
+	const std::map<std::string, std::string>& definitions;
+	const std::string* pattern = nullptr;
+	size_t pos = 0;
+};
+
+/** Returns the length of the pattern at the start of [line], which ends at unquoted whitespace */
+size_t pattern_length(const std::string& line) {
+	bool in_string = false;
+	bool in_class = false;
+	for (size_t i = 0; i < line.size(); ++i) {
+		char c = line[i];
+		if (c == '\\') {
+			++i;
+		}
+		else if (in_string) {
+			in_string = c != '"';
+		}
+		else if (in_class) {
+			in_class = c != ']';
+		}
+		else if (c == '"') {
+			in_string = true;
+		}
+		else if (c == '[') {
+			in_class = true;
+		}
+		else if (std::isspace(static_cast<unsigned char>(c))) {
+			return i;
+		}
+	}
+	return line.size();
+}
+
+/** Returns the token that [action] returns, or an empty string if it does not return one */
+std::string returned_token(const std::string& action) {
+	size_t pos = 0;
+	while ((pos = action.find("return", pos)) != std::string::npos) {
+		bool word_start = pos == 0 || !is_identifier_char(action[pos - 1]);
+		pos += 6;
+		if (!word_start || pos == action.size() || is_identifier_char(action[pos])) continue;
+		while (pos < action.size() && std::isspace(static_cast<unsigned char>(action[pos]))) ++pos;
+		size_t end = pos;
+		while (end < action.size() && is_identifier_char(action[end])) ++end;
+		return action.substr(pos, end - pos);
+	}
+	return "";
+}
+
+/**
+ * Calls [on_line](line) for the lines of a flex section that start with a pattern or definition
+ * name. Skips %{ %} blocks, comments, options and indented lines, which are all copied into the
+ * scanner as code.
+ */
+template<typename Line_callback>
+void for_each_flex_line(const std::string& section, Line_callback on_line) {
+	std::istringstream lines(section);
+	std::string line;
+	const char* skip_until = nullptr;
+	while (std::getline(lines, line)) {
+		if (skip_until) {
+			if (line.find(skip_until) != std::string::npos) skip_until = nullptr;
+		}
+		else if (line.compare(0, 2, "%{") == 0) {
+			skip_until = "%}";
+		}
+		else if (line.compare(0, 2, "/*") == 0) {
+			if (line.find("*/", 2) == std::string::npos) skip_until = "*/";
+		}
+		else if (!line.empty() && line[0] != '%' && !std::isspace(static_cast<unsigned char>(line[0]))) {
+			on_line(line);
+		}
+	}
+}
+
+/** Maps every token that the rules of [flex_source] return to its spellings */
+std::map<std::string, std::vector<std::string>> read_vocabulary(const std::string& flex_source) {
+	std::vector<std::string> sections = split_sections(flex_source);
+	if (sections.size() < 2) {
+		throw std::runtime_error("the flex source has no rules section");
+	}
+
+	std::map<std::string, std::string> definitions;
+	for_each_flex_line(sections[0], [&](const std::string& line) {
+		size_t name_end = 0;
+		while (name_end < line.size() && is_identifier_char(line[name_end])) ++name_end;
+		size_t pattern_start = line.find_first_not_of(" \t", name_end);
+		if (name_end == 0 || pattern_start == std::string::npos) {
+			throw std::runtime_error("unsupported definition in the flex source: " + line);
+		}
+		std::string pattern = line.substr(pattern_start);
+		definitions[line.substr(0, name_end)] = pattern.substr(0, pattern_length(pattern));
+	});
+
+	Pattern_expander expander(definitions);
+	std::map<std::string, std::vector<std::string>> vocabulary;
+	for_each_flex_line(sections[1], [&](const std::string& line) {
+		if (line[0] == '<') return; // Start conditions and <<EOF>> are not words
+		size_t length = pattern_length(line);
+		std::string token = returned_token(line.substr(length));
+		if (token.empty()) return;
+		std::vector<std::string>& spellings = vocabulary[token];
+		for (auto& spelling : expander.expand(line.substr(0, length))) {
+			spellings.push_back(std::move(spelling));
+		}
+	});
+	return vocabulary;
+}
+
+} // unnamed namespace
+
+//==================================================================================================
+// Grammar description
+//==================================================================================================
+
+size_t Grammar_description::find_symbol(const std::string& name) const {
+	for (size_t i = 0; i < symbols.size(); ++i) {
+		if (symbols[i].name == name) return i;
+	}
+	return NO_SYMBOL;
+}
+
+std::vector<std::string> Grammar_description::spellings() const {
+	std::vector<std::string> result;
+	for (const Symbol& symbol : symbols) {
+		for (const std::string& spelling : symbol.spellings) {
+			if (std::find(result.begin(), result.end(), spelling) == result.end()) result.push_back(spelling);
+		}
+	}
+	return result;
+}
+
+Grammar_description read_grammar(std::istream& bison, std::istream& flex) {
+	std::vector<std::string> sections = split_sections(read_all(bison, "bison"));
+	if (sections.size() < 2) {
+		throw std::runtime_error("the bison source has no rules section");
+	}
+	std::vector<Named_production> named_productions = read_rules(sections[1]);
+	std::map<std::string, std::vector<std::string>> vocabulary = read_vocabulary(read_all(flex, "flex"));
+
+	Grammar_description grammar;
+	std::map<std::string, size_t> indices;
+	auto add_symbol = [&](const std::string& name, bool terminal) {
+		auto found = indices.find(name);
+		if (found != indices.end()) return found->second;
+		Symbol symbol;
+		symbol.name = name;
+		symbol.terminal = terminal;
+		if (terminal) {
+			if (name[0] == '\'' || name[0] == '"') {
+				symbol.spellings.push_back(name.substr(1, name.size() - 2));
+			}
+			else {
+				auto spellings = vocabulary.find(name);
+				if (spellings == vocabulary.end()) {
+					throw std::runtime_error("token " + name + " has no spelling in the flex source");
+				}
+				symbol.spellings = spellings->second;
+			}
+		}
+		indices[name] = grammar.symbols.size();
+		grammar.symbols.push_back(std::move(symbol));
+		return grammar.symbols.size() - 1;
+	};
+
+	// Nonterminals first, so that every symbol that is not the left-hand side of a rule is a terminal
+	for (const auto& named : named_productions) {
+		add_symbol(named.lhs, false);
+	}
+	for (const auto& named : named_productions) {
+		Production production;
+		production.lhs = indices[named.lhs];
+		for (const auto& name : named.rhs) {
+			production.rhs.push_back(add_symbol(name, true));
+		}
+		grammar.productions.push_back(std::move(production));
+	}
+
+	std::string start = read_start_symbol(sections[0]);
+	grammar.start = start.empty() ? grammar.productions[0].lhs : grammar.find_symbol(start);
+	if (grammar.start == Grammar_description::NO_SYMBOL || grammar.symbols[grammar.start].terminal) {
+		throw std::runtime_error("the start symbol " + start + " has no rules");
+	}
+	return grammar;
+}
+
+Grammar_description read_grammar_files(const std::string& bison_path, const std::string& flex_path) {
+	std::ifstream bison_file;
+	std::istringstream bison_source;
+	if (bison_path.empty()) bison_source.str(EMBEDDED_BISON_SOURCE);
+	else {
+		bison_file.open(bison_path);
+		if (!bison_file.is_open()) throw std::runtime_error("could not open " + bison_path);
+	}
+	std::ifstream flex_file;
+	std::istringstream flex_source;
+	if (flex_path.empty()) flex_source.str(EMBEDDED_FLEX_SOURCE);
+	else {
+		flex_file.open(flex_path);
+		if (!flex_file.is_open()) throw std::runtime_error("could not open " + flex_path);
+	}
+	return read_grammar(
+		bison_path.empty() ? static_cast<std::istream&>(bison_source) : bison_file,
+		flex_path.empty() ? static_cast<std::istream&>(flex_source) : flex_file
+	);
+}
+
+Grammar_description built_in_grammar() {
+	return read_grammar_files("", "");
+}
+
+} // namespace grammar_tools
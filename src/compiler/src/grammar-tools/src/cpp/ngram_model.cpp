@@ -0,0 +1,294 @@
+#include "ngram_model.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iterator>
+#include <iomanip>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+#include "logger.h"
+#include "sentence_check.h"
+#include "syntax_visitor.h"
+
+namespace grammar_tools {
+
+namespace {
+
+/** The discount of an order when there are too few sequences that occur once or twice to estimate it */
+constexpr double FALLBACK_DISCOUNT = 0.5;
+
+/** What ARPA files give as the logarithm of the probability of <s>, which is never predicted */
+constexpr double NEVER = -99;
+
+using Count = Ngram_counts::Count;
+
+/** Adds the sorted [added] to the sorted [counts] */
+void add_counts(std::vector<Count>& counts, const std::vector<Count>& added) {
+	std::vector<Count> merged;
+	merged.reserve(counts.size() + added.size());
+	std::merge(counts.begin(), counts.end(), added.begin(), added.end(), std::back_inserter(merged), [](const Count& a, const Count& b) {
+		return a.key < b.key;
+	});
+	counts.clear();
+	for (const Count& count : merged) {
+		if (!counts.empty() && counts.back().key == count.key) counts.back().count += count.count;
+		else counts.push_back(count);
+	}
+}
+
+/** Counts the sequences [keys], and adds them to the sorted [counts]. Leaves [keys] empty. */
+void add_sorted(std::vector<uint64_t>& keys, std::vector<Count>& counts) {
+	if (keys.empty()) return;
+	std::sort(keys.begin(), keys.end());
+	std::vector<Count> added;
+	for (uint64_t key : keys) {
+		if (added.empty() || added.back().key != key) added.push_back({key, 0});
+		++added.back().count;
+	}
+	keys.clear();
+	if (counts.empty()) counts.swap(added);
+	else add_counts(counts, added);
+}
+
+/** The index of the sequence [key] in the sorted [counts], which has it */
+size_t find(const std::vector<Count>& counts, uint64_t key) {
+	return std::lower_bound(counts.begin(), counts.end(), key, [](const Count& count, uint64_t key) {
+		return count.key < key;
+	}) - counts.begin();
+}
+
+} // unnamed namespace
+
+//==================================================================================================
+// Word_numbers
+//==================================================================================================
+
+Word_numbers::Word_numbers(const Grammar_description& grammar) : words{"<unk>", "<s>", "</s>"} {
+	for (const std::string& spelling : grammar.spellings()) {
+		for (size_t begin = 0; begin < spelling.size();) {
+			size_t end = std::min(spelling.find(' ', begin), spelling.size());
+			if (end > begin) words.emplace_back(spelling, begin, end - begin);
+			begin = end + 1;
+		}
+	}
+	std::sort(words.begin() + END + 1, words.end());
+	words.erase(std::unique(words.begin() + END + 1, words.end()), words.end());
+}
+
+uint32_t Word_numbers::number(std::string_view word) const {
+	auto found = std::lower_bound(words.begin() + END + 1, words.end(), word);
+	return found != words.end() && *found == word ? static_cast<uint32_t>(found - words.begin()) : UNKNOWN;
+}
+
+//==================================================================================================
+// Ngram_counts
+//==================================================================================================
+
+Ngram_counts::Ngram_counts(const Word_numbers& words, size_t order) : vocabulary(words), bits(1), counts(order), pending(order) {
+	while ((size_t(1) << bits) < words.size()) ++bits;
+	if (order == 0 || order * bits > 64) {
+		throw std::runtime_error(
+			"sequences of " + std::to_string(order) + " words of a vocabulary of " +
+			std::to_string(words.size()) + " words do not fit in 64 bits"
+		);
+	}
+}
+
+void Ngram_counts::add_sentence(std::string_view sentence) {
+	sentence_words.assign(1, Word_numbers::BEGIN);
+	for (size_t begin = 0; begin < sentence.size();) {
+		size_t end = std::min(sentence.find(' ', begin), sentence.size());
+		if (end > begin) sentence_words.push_back(vocabulary.number(sentence.substr(begin, end - begin)));
+		begin = end + 1;
+	}
+	sentence_words.push_back(Word_numbers::END);
+	++sentence_count;
+	word_count += sentence_words.size() - 2;
+
+	// Every sequence that ends at word i, from the shortest to the longest
+	for (size_t i = 0; i < sentence_words.size(); ++i) {
+		uint64_t key = 0;
+		for (size_t n = 1; n <= order() && n <= i + 1; ++n) {
+			key |= uint64_t(sentence_words[i + 1 - n]) << (bits * (n - 1));
+			pending[n - 1].push_back(key);
+		}
+	}
+	if (pending.back().size() >= FLUSH_SIZE) flush();
+}
+
+void Ngram_counts::flush() {
+	for (size_t n = 0; n < order(); ++n) add_sorted(pending[n], counts[n]);
+}
+
+void Ngram_counts::merge(const Ngram_counts& other) {
+	for (size_t n = 0; n < order(); ++n) add_counts(counts[n], other.counts[n]);
+	sentence_count += other.sentence_count;
+	word_count += other.word_count;
+}
+
+void Ngram_counts::write_arpa(std::ostream& os) const {
+	size_t order = this->order();
+
+	// Kneser-Ney counts: the longest sequences are counted as they are. A shorter one is counted as
+	// the number of different words before it, unless it begins the sentence, as it stands in for
+	// the longer ones when those did not occur.
+	std::vector<std::vector<Count>> adjusted(order);
+	adjusted[order - 1] = counts[order - 1];
+	std::vector<uint64_t> suffixes;
+	for (size_t n = order - 1; n >= 1; --n) {
+		for (const Count& count : counts[n]) suffixes.push_back(suffix(count.key, n + 1));
+		add_sorted(suffixes, adjusted[n - 1]);
+		std::vector<Count> beginning;
+		for (const Count& count : counts[n - 1]) {
+			if ((count.key >> (bits * (n - 1))) == Word_numbers::BEGIN) beginning.push_back(count);
+		}
+		// No sequence before one that begins a sentence, so there is nothing to add up
+		std::vector<Count> merged;
+		std::merge(adjusted[n - 1].begin(), adjusted[n - 1].end(), beginning.begin(), beginning.end(), std::back_inserter(merged), [](const Count& a, const Count& b) {
+			return a.key < b.key;
+		});
+		adjusted[n - 1].swap(merged);
+	}
+
+	std::vector<double> discounts(order);
+	for (size_t n = 0; n < order; ++n) {
+		uint64_t once = 0;
+		uint64_t twice = 0;
+		for (const Count& count : adjusted[n]) {
+			once += count.count == 1;
+			twice += count.count == 2;
+		}
+		double discount = once == 0 || twice == 0 ? FALLBACK_DISCOUNT : double(once) / (once + 2 * twice);
+		discounts[n] = discount > 0 && discount < 1 ? discount : FALLBACK_DISCOUNT;
+	}
+
+	// Unigrams interpolate with the uniform distribution over the words that can be predicted and <unk>
+	std::vector<std::vector<double>> probabilities(order);
+	std::vector<std::vector<double>> backoffs(order);
+	uint64_t unigram_total = 0;
+	uint64_t unigram_types = 0;
+	for (const Count& count : adjusted[0]) {
+		if (count.key == Word_numbers::BEGIN) continue;
+		unigram_total += count.count;
+		++unigram_types;
+	}
+	bool has_unknown = !adjusted[0].empty() && adjusted[0][0].key == Word_numbers::UNKNOWN;
+	double uniform = 1.0 / (unigram_types + !has_unknown);
+	double unigram_backoff = unigram_total == 0 ? 1 : discounts[0] * unigram_types / unigram_total;
+	for (const Count& count : adjusted[0]) {
+		double discounted = std::max(count.count - discounts[0], 0.0);
+		probabilities[0].push_back(count.key == Word_numbers::BEGIN ? 0 : discounted / unigram_total + unigram_backoff * uniform);
+	}
+
+	// The longer sequences, from the shortest to the longest. The sequences with the same context
+	// are next to each other, as the context is in the highest bits.
+	for (size_t n = 2; n <= order; ++n) {
+		const std::vector<Count>& level = adjusted[n - 1];
+		const std::vector<Count>& lower = adjusted[n - 2];
+		probabilities[n - 1].resize(level.size());
+		backoffs[n - 2].assign(lower.size(), 1.0);
+		for (size_t first = 0, last; first < level.size(); first = last) {
+			uint64_t total = 0;
+			for (last = first; last < level.size() && context(level[last].key) == context(level[first].key); ++last) {
+				total += level[last].count;
+			}
+			double backoff = discounts[n - 1] * (last - first) / total;
+			backoffs[n - 2][find(lower, context(level[first].key))] = backoff;
+			for (size_t i = first; i < last; ++i) {
+				double discounted = std::max(level[i].count - discounts[n - 1], 0.0);
+				double lower_probability = probabilities[n - 2][find(lower, suffix(level[i].key, n))];
+				probabilities[n - 1][i] = discounted / total + backoff * lower_probability;
+			}
+		}
+	}
+	backoffs[order - 1].assign(adjusted[order - 1].size(), 1.0);
+
+	os << "\\data\\\n";
+	for (size_t n = 1; n <= order; ++n) {
+		os << "ngram " << n << "=" << adjusted[n - 1].size() + (n == 1 && !has_unknown) << "\n";
+	}
+	os << std::setprecision(7);
+	for (size_t n = 1; n <= order; ++n) {
+		os << "\n\\" << n << "-grams:\n";
+		if (n == 1 && !has_unknown) {
+			os << std::log10(unigram_backoff * uniform) << '\t' << vocabulary.word(Word_numbers::UNKNOWN) << '\n';
+		}
+		for (size_t i = 0; i < adjusted[n - 1].size(); ++i) {
+			double probability = probabilities[n - 1][i];
+			os << (probability > 0 ? std::log10(probability) : NEVER) << '\t';
+			uint64_t key = adjusted[n - 1][i].key;
+			for (size_t word = n; word-- > 0;) {
+				os << vocabulary.word((key >> (bits * word)) & ((uint64_t(1) << bits) - 1)) << (word > 0 ? " " : "");
+			}
+			if (backoffs[n - 1][i] != 1.0) os << '\t' << std::log10(backoffs[n - 1][i]);
+			os << '\n';
+		}
+	}
+	os << "\n\\end\\\n";
+}
+
+void Ngram_counts::write_vocabulary(std::ostream& os) const {
+	std::vector<std::pair<uint64_t, uint64_t>> words; // Minus the count, and the number
+	for (const Count& count : counts[0]) {
+		if (count.key > Word_numbers::END) words.emplace_back(0 - count.count, count.key);
+	}
+	std::sort(words.begin(), words.end());
+	for (const auto& [count, key] : words) {
+		os << vocabulary.word(static_cast<uint32_t>(key)) << '\n';
+	}
+}
+
+//==================================================================================================
+// Functions
+//==================================================================================================
+
+Ngram_counts count_sentences(const Grammar_description& grammar, const Word_numbers& words, const Ngram_options& options) {
+	Sentence_generator validated(grammar, options.generator); // Throws if the options are invalid
+	Ngram_counts result(words, options.order);
+
+	size_t chunks = (options.sentences + Ngram_options::CHUNK_SENTENCES - 1) / Ngram_options::CHUNK_SENTENCES;
+	unsigned int thread_count = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+	thread_count = static_cast<unsigned int>(std::min<size_t>(thread_count, std::max<size_t>(chunks, 1)));
+	std::atomic<size_t> next_chunk{0};
+	std::vector<Ngram_counts> thread_counts(thread_count, Ngram_counts(words, options.order));
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < thread_count; ++t) {
+		threads.emplace_back([&, t] {
+			Logger logger(NULL_SINK);
+			Syntax_visitor visitor(logger);
+			size_t max_repairs = 100 + options.generator.max_tokens / 10;
+			Derivation derivation;
+			std::string line;
+			for (size_t chunk; (chunk = next_chunk.fetch_add(1)) < chunks;) {
+				Generator_options chunk_options = options.generator;
+				std::seed_seq seeds{options.generator.seed, static_cast<unsigned int>(chunk)};
+				seeds.generate(&chunk_options.seed, &chunk_options.seed + 1);
+				Sentence_generator generator(grammar, chunk_options);
+
+				size_t first = chunk * Ngram_options::CHUNK_SENTENCES;
+				size_t last = std::min(first + Ngram_options::CHUNK_SENTENCES, options.sentences);
+				for (size_t sentence = first; sentence < last; ++sentence) {
+					if (options.check) {
+						if (!generate_valid_sentence(generator, visitor, max_repairs, derivation, line)) continue;
+					}
+					else {
+						derivation = generator.generate_sentence();
+						line.clear();
+						generator.spell(derivation.tokens, line);
+					}
+					thread_counts[t].add_sentence(line);
+				}
+			}
+			thread_counts[t].flush();
+			visitor.syntax_tree = Syntax_tree();
+		});
+	}
+	for (std::thread& thread : threads) thread.join();
+	for (const Ngram_counts& counts : thread_counts) result.merge(counts);
+	return result;
+}
+
+} // namespace grammar_tools
@@ -0,0 +1,70 @@
+#include "sentence_check.h"
+
+#include <algorithm>
+
+#include "grammar.h"
+
+namespace grammar_tools {
+
+namespace {
+	/** How often a subtree around the same error is derived again before trying its parent */
+	const size_t REPAIRS_PER_LEVEL = 4;
+}
+
+size_t find_error(
+	const Grammar_description& grammar, const std::vector<size_t>& tokens, const std::string& line,
+	const std::vector<size_t>& token_offsets, Syntax_visitor& visitor
+) {
+	std::string text = ::grammar::padded_copy(line);
+	const char* text_end = text.data() + text.size();
+
+	std::vector<int> scanned;
+	scanned.reserve(tokens.size());
+	::grammar::tokenize(text.data(), line.size(), text_end, scanned);
+	size_t common = std::min(scanned.size(), tokens.size());
+	for (size_t i = 0; i < common; ++i) {
+		if (grammar.symbols[tokens[i]].name != ::grammar::token_name(scanned[i])) return i;
+	}
+	if (scanned.size() != tokens.size()) return common;
+
+	visitor.syntax_tree = Syntax_tree();
+	if (::grammar::generate_from_buffer(text.data(), line.size(), text_end, visitor) == 0) {
+		return NO_ERROR;
+	}
+	if (visitor.error_offset >= line.size() || token_offsets.empty()) return tokens.size();
+	// The last token that starts at or before the error
+	auto next = std::upper_bound(token_offsets.begin(), token_offsets.end(), visitor.error_offset);
+	return next == token_offsets.begin() ? 0 : static_cast<size_t>(next - token_offsets.begin()) - 1;
+}
+
+bool generate_valid_sentence(
+	Sentence_generator& generator, Syntax_visitor& visitor, size_t max_repairs,
+	Derivation& out_derivation, std::string& line
+) {
+	out_derivation = generator.generate_sentence();
+	std::vector<size_t> offsets;
+	size_t last_error = NO_ERROR;
+	size_t repairs_here = 0;
+	for (size_t repairs = 0; ; ++repairs) {
+		const auto& tokens = out_derivation.tokens;
+		line.clear();
+		generator.spell(tokens, line, &offsets);
+		size_t error = find_error(generator.grammar(), tokens, line, offsets, visitor);
+		if (error == NO_ERROR) return true;
+		if (repairs == max_repairs) return false;
+
+		repairs_here = error == last_error ? repairs_here + 1 : 0;
+		last_error = error;
+
+		// The error shows at a token, but is often caused by the tokens just before it
+		size_t first = error == 0 ? 0 : error - 1;
+		size_t end = std::min(error + 1, tokens.size());
+		size_t node = out_derivation.deepest_node_deriving(first, end);
+		for (size_t level = 0; level < repairs_here / REPAIRS_PER_LEVEL; ++level) {
+			node = out_derivation.parent(node);
+		}
+		generator.rederive(out_derivation, node);
+	}
+}
+
+} // namespace grammar_tools
@@ -0,0 +1,388 @@
+#include "sentence_generator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+
+namespace grammar_tools {
+
+namespace {
+	constexpr size_t INFINITE = std::numeric_limits<size_t>::max();
+
+	size_t saturating_add(size_t a, size_t b) {
+		return a > INFINITE - b ? INFINITE : a + b;
+	}
+}
+
+//==================================================================================================
+// Analysis of the grammar
+//==================================================================================================
+
+Sentence_generator::Sentence_generator(const Grammar_description& grammar, const Generator_options& options)
+	: description(grammar), options(options), random(options.seed) {
+	const auto& symbols = description.symbols;
+	const auto& productions = description.productions;
+	size_t symbol_count = symbols.size();
+
+	if (options.max_tokens > UINT32_MAX / 2) {
+		throw std::runtime_error("the maximal number of tokens is too large");
+	}
+	if (options.min_tokens > options.max_tokens) {
+		throw std::runtime_error("the minimal number of tokens is larger than the maximal number");
+	}
+	if (options.invalid_rate < 0 || options.invalid_rate > 1 || !(options.overshoot >= 0)) {
+		throw std::runtime_error("rates must lie between 0 and 1");
+	}
+
+	productions_of.resize(symbol_count);
+	for (size_t p = 0; p < productions.size(); ++p) {
+		productions_of[productions[p].lhs].push_back(p);
+	}
+	for (size_t s = 0; s < symbol_count; ++s) {
+		if (symbols[s].terminal) terminals.push_back(s);
+	}
+
+	// Minimal sentence lengths and derivation heights, by iterating to a fixed point
+	min_length.assign(symbol_count, INFINITE);
+	min_height.assign(symbol_count, INFINITE);
+	production_min_length.assign(productions.size(), INFINITE);
+	production_min_height.assign(productions.size(), INFINITE);
+	for (size_t s : terminals) {
+		min_length[s] = 1;
+		min_height[s] = 0;
+	}
+	for (bool changed = true; changed; ) {
+		changed = false;
+		for (size_t p = 0; p < productions.size(); ++p) {
+			size_t length = 0;
+			size_t height = 0;
+			for (size_t s : productions[p].rhs) {
+				length = saturating_add(length, min_length[s]);
+				height = std::max(height, min_height[s]);
+			}
+			production_min_length[p] = length;
+			production_min_height[p] = saturating_add(height, 1);
+			size_t lhs = productions[p].lhs;
+			if (length < min_length[lhs] || production_min_height[p] < min_height[lhs]) {
+				min_length[lhs] = std::min(min_length[lhs], length);
+				min_height[lhs] = std::min(min_height[lhs], production_min_height[p]);
+				changed = true;
+			}
+		}
+	}
+	for (size_t s = 0; s < symbol_count; ++s) {
+		if (min_length[s] == INFINITE) {
+			throw std::runtime_error("symbol " + symbols[s].name + " does not derive any sentence");
+		}
+	}
+	if (options.max_depth != 0 && min_height[description.start] > options.max_depth) {
+		throw std::runtime_error(
+			"the maximal depth must be at least " + std::to_string(min_height[description.start])
+		);
+	}
+
+	// Which nonterminals derive which, to find the recursive ones
+	std::vector<std::vector<bool>> reaches(symbol_count, std::vector<bool>(symbol_count, false));
+	for (size_t s = 0; s < symbol_count; ++s) {
+		std::vector<size_t> todo{s};
+		while (!todo.empty()) {
+			size_t current = todo.back();
+			todo.pop_back();
+			for (size_t p : productions_of[current]) {
+				for (size_t child : productions[p].rhs) {
+					if (symbols[child].terminal || reaches[s][child]) continue;
+					reaches[s][child] = true;
+					todo.push_back(child);
+				}
+			}
+		}
+	}
+	component.resize(symbol_count);
+	recursive.assign(symbol_count, false);
+	growable.assign(symbol_count, false);
+	for (size_t s = 0; s < symbol_count; ++s) {
+		component[s] = s;
+		recursive[s] = reaches[s][s];
+		for (size_t other = 0; other < symbol_count; ++other) {
+			if (reaches[s][other] && reaches[other][s]) {
+				component[s] = std::min(component[s], other);
+			}
+			if ((other == s || reaches[s][other]) && reaches[other][other]) {
+				growable[s] = true;
+			}
+		}
+	}
+
+	weight.assign(productions.size(), 1.0);
+	for (const auto& [name, symbol_weight] : options.weights) {
+		size_t symbol = description.find_symbol(name);
+		if (symbol == Grammar_description::NO_SYMBOL) {
+			throw std::runtime_error("the grammar has no symbol " + name);
+		}
+		if (!(symbol_weight >= 0)) {
+			throw std::runtime_error("the weight of " + name + " is negative");
+		}
+		for (size_t p = 0; p < productions.size(); ++p) {
+			for (size_t s : productions[p].rhs) {
+				if (s == symbol) weight[p] *= symbol_weight;
+			}
+		}
+	}
+}
+
+//==================================================================================================
+// Options
+//==================================================================================================
+
+void add_weight(Generator_options& options, const std::string& assignment) {
+	size_t equals = assignment.find('=');
+	std::size_t parsed = 0;
+	double weight = -1;
+	if (equals != std::string::npos) {
+		try {
+			weight = std::stod(assignment.substr(equals + 1), &parsed);
+		} catch (std::logic_error&) {
+		}
+	}
+	if (equals == std::string::npos || parsed == 0 || parsed != assignment.size() - equals - 1) {
+		throw std::runtime_error("weight " + assignment + " is not of the form SYMBOL=WEIGHT");
+	}
+	options.weights[assignment.substr(0, equals)] = weight;
+}
+
+//==================================================================================================
+// Generation
+//==================================================================================================
+
+/**
+ * Picks a production for [frame] (see the class documentation). Falls back on the shortest
+ * productions if the weights rule out all of them.
+ */
+size_t Sentence_generator::choose_production(const Frame& frame) {
+	const std::vector<size_t>& candidates = productions_of[frame.symbol];
+	const auto& productions = description.productions;
+
+	auto allowed = [&](size_t p) {
+		return options.max_depth == 0 || frame.depth - 1 + production_min_height[p] <= options.max_depth;
+	};
+	auto has_child = [&](size_t p, auto predicate) {
+		for (size_t child : productions[p].rhs) {
+			if (!description.symbols[child].terminal && predicate(child)) return true;
+		}
+		return false;
+	};
+	auto continues = [&](size_t p) {
+		return recursive[frame.symbol]
+			&& has_child(p, [&](size_t child) { return component[child] == component[frame.symbol]; });
+	};
+	auto grows = [&](size_t p) {
+		return has_child(p, [&](size_t child) { return growable[child]; });
+	};
+
+	candidate_weights.assign(candidates.size(), 0.0);
+	auto pick = [&]() -> size_t {
+		double total = 0;
+		for (double w : candidate_weights) total += w;
+		if (total <= 0) return candidates.size();
+		double point = std::uniform_real_distribution<double>(0, total)(random);
+		for (size_t i = 0; i < candidates.size(); ++i) {
+			if (point < candidate_weights[i]) return i;
+			point -= candidate_weights[i];
+		}
+		for (size_t i = candidates.size(); i-- > 0; ) {
+			if (candidate_weights[i] > 0) return i;
+		}
+		return candidates.size();
+	};
+
+	if (frame.budget > min_length[frame.symbol]) {
+		// Spend the budget: continue the recursion of this symbol, or else start a new one
+		for (int attempt = 0; attempt < 2; ++attempt) {
+			for (size_t i = 0; i < candidates.size(); ++i) {
+				size_t p = candidates[i];
+				bool fits = production_min_length[p] <= frame.budget;
+				bool wanted = attempt == 0 ? continues(p) : grows(p);
+				candidate_weights[i] = allowed(p) && fits && wanted ? weight[p] : 0.0;
+			}
+			size_t chosen = pick();
+			if (chosen != candidates.size()) return candidates[chosen];
+		}
+	}
+
+	candidate_weights.assign(candidates.size(), 0.0);
+	for (size_t i = 0; i < candidates.size(); ++i) {
+		size_t p = candidates[i];
+		if (!allowed(p)) continue;
+		size_t excess = production_min_length[p] > frame.budget ? production_min_length[p] - frame.budget : 0;
+		candidate_weights[i] = weight[p] * std::pow(options.overshoot, static_cast<double>(excess));
+	}
+	size_t chosen = pick();
+	if (chosen != candidates.size()) return candidates[chosen];
+
+	size_t best = candidates.size();
+	for (size_t i = 0; i < candidates.size(); ++i) {
+		size_t p = candidates[i];
+		if (allowed(p) && (best == candidates.size() || production_min_length[p] < production_min_length[candidates[best]])) {
+			best = i;
+		}
+	}
+	return candidates[best];
+}
+
+void Sentence_generator::derive(size_t symbol, size_t budget, size_t depth, Derivation& out) {
+	const auto& productions = description.productions;
+	std::vector<size_t> receivers;
+	std::vector<size_t> cuts;
+
+	stack.clear();
+	stack.push_back({symbol, std::max(budget, min_length[symbol]), depth, 0});
+	while (!stack.empty()) {
+		Frame frame = stack.back();
+		stack.pop_back();
+		if (frame.symbol == FINISH_NODE) {
+			Derivation::Node& node = out.nodes[frame.node];
+			node.end_token = static_cast<uint32_t>(out.tokens.size());
+			node.end_node = static_cast<uint32_t>(out.nodes.size());
+			continue;
+		}
+		if (description.symbols[frame.symbol].terminal) {
+			out.tokens.push_back(frame.symbol);
+			continue;
+		}
+		stats.max_depth = std::max(stats.max_depth, frame.depth);
+
+		size_t node = out.nodes.size();
+		out.nodes.push_back({
+			static_cast<uint32_t>(frame.symbol), static_cast<uint32_t>(frame.depth),
+			static_cast<uint32_t>(frame.budget), static_cast<uint32_t>(out.tokens.size()), 0, 0
+		});
+		stack.push_back({FINISH_NODE, 0, 0, node});
+
+		size_t p = choose_production(frame);
+		const std::vector<size_t>& rhs = productions[p].rhs;
+
+		// Divide what is left of the budget over the children that continue the recursion, or else
+		// over the children that can grow at all
+		size_t leftover = frame.budget > production_min_length[p] ? frame.budget - production_min_length[p] : 0;
+		receivers.clear();
+		for (int attempt = 0; attempt < 2 && receivers.empty() && leftover != 0; ++attempt) {
+			for (size_t i = 0; i < rhs.size(); ++i) {
+				size_t child = rhs[i];
+				if (description.symbols[child].terminal) continue;
+				bool same_recursion = recursive[child] && component[child] == component[frame.symbol];
+				if (attempt == 0 ? same_recursion : bool(growable[child])) receivers.push_back(i);
+			}
+		}
+		cuts.clear();
+		for (size_t i = 1; i < receivers.size(); ++i) cuts.push_back(uniform(0, leftover));
+		cuts.push_back(0);
+		cuts.push_back(leftover);
+		std::sort(cuts.begin(), cuts.end());
+
+		size_t first = stack.size();
+		for (size_t i = 0; i < rhs.size(); ++i) {
+			stack.push_back({rhs[i], min_length[rhs[i]], frame.depth + 1, 0});
+		}
+		for (size_t r = 0; r < receivers.size(); ++r) {
+			stack[first + receivers[r]].budget += cuts[r + 1] - cuts[r];
+		}
+		// The leftmost child has to come out first
+		std::reverse(stack.begin() + first, stack.end());
+	}
+}
+
+Derivation Sentence_generator::generate_sentence() {
+	Derivation derivation;
+	derive(description.start, uniform(options.min_tokens, options.max_tokens), 1, derivation);
+	++stats.sentences;
+	return derivation;
+}
+
+void Sentence_generator::rederive(Derivation& derivation, size_t node) {
+	Derivation::Node old = derivation.nodes[node];
+	Derivation part;
+	derive(old.symbol, old.budget, old.depth, part);
+	++stats.rederived_subtrees;
+
+	for (auto& part_node : part.nodes) {
+		part_node.first_token += old.first_token;
+		part_node.end_token += old.first_token;
+		part_node.end_node += static_cast<uint32_t>(node);
+	}
+	// Unsigned arithmetic wraps around, which makes negative differences work out as well
+	uint32_t token_shift = static_cast<uint32_t>(part.tokens.size()) - (old.end_token - old.first_token);
+	uint32_t node_shift = static_cast<uint32_t>(part.nodes.size()) - (old.end_node - static_cast<uint32_t>(node));
+	for (size_t i = 0; i < node; ++i) {
+		Derivation::Node& ancestor = derivation.nodes[i];
+		if (ancestor.end_node > node) {
+			ancestor.end_token += token_shift;
+			ancestor.end_node += node_shift;
+		}
+	}
+	for (size_t i = old.end_node; i < derivation.nodes.size(); ++i) {
+		Derivation::Node& after = derivation.nodes[i];
+		after.first_token += token_shift;
+		after.end_token += token_shift;
+		after.end_node += node_shift;
+	}
+
+	auto& tokens = derivation.tokens;
+	tokens.erase(tokens.begin() + old.first_token, tokens.begin() + old.end_token);
+	tokens.insert(tokens.begin() + old.first_token, part.tokens.begin(), part.tokens.end());
+	auto& nodes = derivation.nodes;
+	nodes.erase(nodes.begin() + node, nodes.begin() + old.end_node);
+	nodes.insert(nodes.begin() + node, part.nodes.begin(), part.nodes.end());
+}
+
+void Sentence_generator::inject_invalid_tokens(std::vector<size_t>& tokens) {
+	if (options.invalid_rate == 0 || terminals.size() < 2) return;
+	std::bernoulli_distribution invalid(options.invalid_rate);
+	for (size_t& token : tokens) {
+		if (!invalid(random)) continue;
+		size_t replacement = token;
+		while (replacement == token) replacement = terminals[uniform(0, terminals.size() - 1)];
+		token = replacement;
+		++stats.invalid_tokens;
+	}
+}
+
+void Sentence_generator::spell(
+	const std::vector<size_t>& tokens, std::string& out, std::vector<size_t>* out_offsets
+) {
+	if (out_offsets) out_offsets->clear();
+	for (size_t i = 0; i < tokens.size(); ++i) {
+		const std::vector<std::string>& spellings = description.symbols[tokens[i]].spellings;
+		if (i != 0) out += ' ';
+		if (out_offsets) out_offsets->push_back(out.size());
+		out += spellings[uniform(0, spellings.size() - 1)];
+	}
+}
+
+//==================================================================================================
+// Derivation
+//==================================================================================================
+
+size_t Derivation::deepest_node_deriving(size_t first, size_t end) const {
+	// The nodes that derive the tokens form a path from the root, in preorder
+	size_t deepest = 0;
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		if (nodes[i].first_token <= first && end <= nodes[i].end_token) {
+			deepest = i;
+		}
+		else if (nodes[i].first_token > first) {
+			break;
+		}
+	}
+	return deepest;
+}
+
+size_t Derivation::parent(size_t node) const {
+	for (size_t i = node; i-- > 0; ) {
+		if (nodes[i].end_node > node) return i;
+	}
+	return node;
+}
+
+} // namespace grammar_tools
@@ -0,0 +1,62 @@
+/* The productions of compiler.y and the vocabulary of compiler.l, read from their sources */
+
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace grammar_tools {
+
+struct Symbol {
+	std::string name;
+	bool terminal = false;
+
+	/** The texts the scanner turns into this terminal, e.g. "less equal" for B_LE */
+	std::vector<std::string> spellings;
+};
+
+struct Production {
+	size_t lhs = 0;
+	std::vector<size_t> rhs; // Indices into Grammar_description::symbols
+};
+
+struct Grammar_description {
+	std::vector<Symbol> symbols;
+	std::vector<Production> productions;
+	size_t start = 0;
+
+	static constexpr size_t NO_SYMBOL = static_cast<size_t>(-1);
+
+	/** Returns the index of the symbol called [name], or NO_SYMBOL if there is none */
+	size_t find_symbol(const std::string& name) const;
+
+	/** The spellings of all terminals, in the order of the symbols, each once: the vocabulary */
+	std::vector<std::string> spellings() const;
+};
+
+/**
+ * Reads the grammar rules of the bison source [bison] and the token spellings of the flex source
+ * [flex]. Actions, comments and %prec annotations are ignored, so the result is the context-free
+ * grammar without its conflict resolution.
+ *
+ * A token can have several spellings, from several rules or from patterns like [a-z] and
+ * alternations. Repetitions in patterns (+ and *) are expanded once. Rules without a return
+ * statement, like the one for whitespace, are not part of the vocabulary.
+ *
+ * Throws std::runtime_error if a source can not be read, or if a terminal of the grammar has no
+ * spelling.
+ */
+Grammar_description read_grammar(std::istream& bison, std::istream& flex);
+
+/**
+ * Like read_grammar, reading from the files at [bison_path] and [flex_path]. An empty path stands
+ * for the source that this program was built with.
+ */
+Grammar_description read_grammar_files(const std::string& bison_path, const std::string& flex_path);
+
+/** Like read_grammar, reading the compiler.y and compiler.l that this program was built with */
+Grammar_description built_in_grammar();
+
+} // namespace grammar_tools
@@ -0,0 +1,152 @@
+/* N-gram language models of the words of the grammar, for the scorer of the speech recognizer */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "grammar_description.h"
+#include "sentence_generator.h"
+
+namespace grammar_tools {
+
+/**
+ * The words of a vocabulary, numbered: <unk>, <s> and </s>, followed by the words of the spellings
+ * of the terminals of a grammar (a spelling like "less equal" has two words), in alphabetical order.
+ */
+class Word_numbers {
+public:
+	static constexpr uint32_t UNKNOWN = 0;
+	static constexpr uint32_t BEGIN = 1; // <s>, before every sentence
+	static constexpr uint32_t END = 2;   // </s>, after every sentence
+
+	explicit Word_numbers(const Grammar_description& grammar);
+
+	size_t size() const {
+		return words.size();
+	}
+
+	const std::string& word(uint32_t number) const {
+		return words[number];
+	}
+
+	/** The number of [word]; UNKNOWN if it is not in the vocabulary */
+	uint32_t number(std::string_view word) const;
+
+private:
+	std::vector<std::string> words; // The ones after END are sorted
+};
+
+/**
+ * The number of times that every sequence of up to [order] words occurs in a set of sentences, with
+ * <s> before and </s> after every sentence. A sequence is kept as the numbers of its words packed
+ * into 64 bits, the first word in the highest bits. The sequences of the last sentences are buffered,
+ * up to FLUSH_SIZE of every length, and then sorted and merged into sorted counts, like lmplz does, so
+ * the memory grows with the number of different sequences, not with the sentences.
+ */
+class Ngram_counts {
+public:
+	static constexpr size_t FLUSH_SIZE = size_t(1) << 20;
+
+	/** Throws std::runtime_error if sequences of [order] words of [words] do not fit in 64 bits */
+	Ngram_counts(const Word_numbers& words, size_t order);
+
+	/** Counts the sequences of the words of [sentence], which are separated by spaces */
+	void add_sentence(std::string_view sentence);
+
+	/**
+	 * Merges the buffered sequences into the counts. Only the counts are seen by merge, ngrams,
+	 * write_arpa and write_vocabulary.
+	 */
+	void flush();
+
+	/** Adds the counts of [other], of the same words and order */
+	void merge(const Ngram_counts& other);
+
+	size_t order() const {
+		return counts.size();
+	}
+
+	size_t sentences() const {
+		return sentence_count;
+	}
+
+	size_t words() const {
+		return word_count;
+	}
+
+	/** The number of different sequences of [n] words */
+	size_t ngrams(size_t n) const {
+		return counts[n - 1].size();
+	}
+
+	/**
+	 * Writes the language model of the counts to [os] in the ARPA format that KenLM's build_binary
+	 * reads: interpolated Kneser-Ney with one discount per order, estimated from the number of
+	 * sequences that occur once and twice, like lmplz does with --discount_fallback when there are
+	 * too few to estimate three. The sequences of every order are in the order of their numbers, so
+	 * the output depends only on the counts.
+	 */
+	void write_arpa(std::ostream& os) const;
+
+	/** Writes the words that occur, most frequent first, one per line, for generate_scorer_package */
+	void write_vocabulary(std::ostream& os) const;
+
+	/** A sequence of words and how often it occurs */
+	struct Count {
+		uint64_t key;
+		uint64_t count;
+	};
+
+private:
+	/** The sequence [key] of [length] words without its first word */
+	uint64_t suffix(uint64_t key, size_t length) const {
+		return key & ((uint64_t(1) << (bits * (length - 1))) - 1);
+	}
+
+	/** The sequence [key] without its last word */
+	uint64_t context(uint64_t key) const {
+		return key >> bits;
+	}
+
+	const Word_numbers& vocabulary;
+	unsigned int bits; // Per word
+	std::vector<std::vector<Count>> counts;     // [n - 1]: of sequences of n words, in increasing order
+	std::vector<std::vector<uint64_t>> pending; // [n - 1]: sequences of n words that are not counted yet
+	std::vector<uint32_t> sentence_words;       // Reused between sentences
+	size_t sentence_count = 0;
+	size_t word_count = 0;
+};
+
+struct Ngram_options {
+	size_t order = 5;
+	size_t sentences = 100000;
+
+	/** The number of threads that generate and count sentences. 0 means one per hardware thread. */
+	unsigned int threads = 0;
+
+	/** Whether the sentences are checked with the real parser (see generate_valid_sentence) */
+	bool check = true;
+
+	/**
+	 * The options of the sentence generators. Every CHUNK_SENTENCES sentences have a generator of
+	 * their own, seeded with the seed of these options and the number of the chunk, so the counts do
+	 * not depend on the number of threads.
+	 */
+	Generator_options generator;
+
+	static constexpr size_t CHUNK_SENTENCES = 4096;
+};
+
+/**
+ * Generates [options].sentences random sentences of [grammar] and counts their words, on several
+ * threads. Only the counts are kept, so the memory does not grow with the number of sentences.
+ * Throws std::runtime_error if [options] are invalid for [grammar].
+ */
+Ngram_counts count_sentences(const Grammar_description& grammar, const Word_numbers& words, const Ngram_options& options);
+
+} // namespace grammar_tools
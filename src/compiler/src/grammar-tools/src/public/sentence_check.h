@@ -0,0 +1,42 @@
+/* Checks generated sentences with the real scanner and parser */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "grammar_description.h"
+#include "sentence_generator.h"
+#include "syntax_visitor.h"
+
+namespace grammar_tools {
+
+inline constexpr size_t NO_ERROR = static_cast<size_t>(-1);
+
+/**
+ * Scans and parses [line], the spelling of [tokens] (symbol indices of [grammar]) with a token at
+ * every offset of [token_offsets], using the scanner and parser of the grammar library. Returns the
+ * index of the first token that the scanner splits differently or at which the parser finds a
+ * syntax error (tokens.size() for the end of the line), or NO_ERROR if the line is accepted.
+ * The syntax tree of an accepted line is left in [visitor].
+ */
+size_t find_error(
+	const Grammar_description& grammar, const std::vector<size_t>& tokens, const std::string& line,
+	const std::vector<size_t>& token_offsets, Syntax_visitor& visitor
+);
+
+/**
+ * Generates a sentence with [generator] that the real scanner and parser accept, and sets [line]
+ * to its spelling. Where they reject the sentence, the smallest subtree of the derivation around
+ * the error is derived again. If that keeps failing, larger subtrees are. Every repair parses the
+ * whole line again, so a line of n tokens with k errors costs O(k * n).
+ *
+ * Returns false if the sentence still is not accepted after [max_repairs] repairs.
+ */
+bool generate_valid_sentence(
+	Sentence_generator& generator, Syntax_visitor& visitor, size_t max_repairs,
+	Derivation& out_derivation, std::string& line
+);
+
+} // namespace grammar_tools
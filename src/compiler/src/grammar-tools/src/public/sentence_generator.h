@@ -0,0 +1,167 @@
+/* Random sentences of a grammar, for stress tests and scaling measurements */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "grammar_description.h"
+
+namespace grammar_tools {
+
+struct Generator_options {
+	/** Every line aims for a number of tokens drawn uniformly from [min_tokens, max_tokens] */
+	size_t min_tokens = 20;
+	size_t max_tokens = 20;
+
+	/** The maximal depth of the derivation tree of a line, or 0 for no maximum */
+	size_t max_depth = 0;
+
+	/**
+	 * Weights of symbols by name (default 1). A production is picked with a probability proportional
+	 * to the product of the weights of the symbols on its right-hand side, so e.g. {"B_PLUS", 5}
+	 * makes additions five times as likely as other binary operators, and {"FRACTION", 0} leaves out
+	 * fractions wherever the grammar has an alternative.
+	 */
+	std::map<std::string, double> weights;
+
+	/**
+	 * How readily a production that does not fit in the remaining token budget is picked anyway:
+	 * its weight is multiplied by [overshoot] for every token it needs more. This gives accents,
+	 * typesettings and the like a chance in otherwise minimal subexpressions.
+	 */
+	double overshoot = 0.25;
+
+	/** The probability with which every token is replaced by another token of the vocabulary */
+	double invalid_rate = 0;
+
+	unsigned int seed = 1;
+};
+
+/**
+ * Parses [assignment], of the form "SYMBOL=WEIGHT", into the weights of [options]. Throws
+ * std::runtime_error if it is not of that form.
+ */
+void add_weight(Generator_options& options, const std::string& assignment);
+
+struct Generator_statistics {
+	size_t sentences = 0;
+	size_t rederived_subtrees = 0;
+	size_t invalid_tokens = 0; // Replaced by inject_invalid_tokens
+	size_t max_depth = 0;      // Of the derivation trees
+};
+
+/** A sentence together with its derivation tree, so that parts of it can be derived again */
+struct Derivation {
+	struct Node {
+		uint32_t symbol;
+		uint32_t depth;       // 1 for the root
+		uint32_t budget;      // The number of tokens it aimed for
+		uint32_t first_token; // It derives the tokens from [first_token] up to [end_token]
+		uint32_t end_token;
+		uint32_t end_node;    // Its descendants are the nodes up to this one
+	};
+
+	std::vector<size_t> tokens; // Symbol indices
+	std::vector<Node> nodes;    // In preorder, so nodes[0] is the root
+
+	/** Returns the index of the deepest node that derives all tokens from [first] up to [end] */
+	size_t deepest_node_deriving(size_t first, size_t end) const;
+
+	/** Returns the index of the parent of nodes[node], or [node] itself for the root */
+	size_t parent(size_t node) const;
+};
+
+/**
+ * Generates random sentences of a grammar by walking its productions from the start symbol.
+ *
+ * Every nonterminal gets a budget of tokens. While there is budget left, the generator picks
+ * productions that continue the recursion of the nonterminal (like nested expressions or longer
+ * chains of binary operators) and divides the remaining budget randomly over their recursive
+ * symbols. Once the budget is spent, it picks productions of minimal length. Derivations are done
+ * with an explicit stack, so lines of millions of tokens do not need a deep call stack.
+ *
+ * The sentences are sentences of the context-free grammar. The precedence rules of compiler.y
+ * resolve its conflicts by preferring one of the parses, which makes some of them unparseable.
+ * generate_valid_sentence (sentence_check.h) repairs those with the real parser.
+ */
+class Sentence_generator {
+public:
+	/** Throws std::runtime_error if [options] are invalid for [grammar] */
+	Sentence_generator(const Grammar_description& grammar, const Generator_options& options);
+
+	Derivation generate_sentence();
+
+	/**
+	 * Replaces the subtree of [derivation] at nodes[node] by a new derivation of the same symbol
+	 * with the same budget. The tokens and nodes after it move accordingly.
+	 */
+	void rederive(Derivation& derivation, size_t node);
+
+	/**
+	 * Replaces every token of [tokens] with another terminal of the grammar with probability
+	 * Generator_options::invalid_rate.
+	 */
+	void inject_invalid_tokens(std::vector<size_t>& tokens);
+
+	/**
+	 * Appends a random spelling of every token of [tokens] to [out], separated by spaces. If
+	 * [out_offsets] is given, it is set to the offset in [out] of every token.
+	 */
+	void spell(const std::vector<size_t>& tokens, std::string& out, std::vector<size_t>* out_offsets = nullptr);
+
+	const Generator_statistics& statistics() const {
+		return stats;
+	}
+
+	const Grammar_description& grammar() const {
+		return description;
+	}
+
+private:
+	static constexpr size_t FINISH_NODE = Grammar_description::NO_SYMBOL;
+
+	struct Frame {
+		size_t symbol; // FINISH_NODE after the children of [node]
+		size_t budget;
+		size_t depth;
+		size_t node;
+	};
+
+	size_t choose_production(const Frame& frame);
+
+	/** Derives [symbol] into the empty [out] */
+	void derive(size_t symbol, size_t budget, size_t depth, Derivation& out);
+
+	size_t uniform(size_t min, size_t max) {
+		return std::uniform_int_distribution<size_t>(min, max)(random);
+	}
+
+	Grammar_description description;
+	Generator_options options;
+	std::mt19937_64 random;
+	Generator_statistics stats;
+
+	// Per symbol
+	std::vector<std::vector<size_t>> productions_of;
+	std::vector<size_t> min_length;       // Of the sentences it derives
+	std::vector<size_t> min_height;       // Of the derivation trees
+	std::vector<size_t> component;        // Strongly connected component of the "derives" graph
+	std::vector<bool> recursive;          // Derives itself
+	std::vector<bool> growable;           // Derives sentences of any length
+
+	// Per production
+	std::vector<double> weight;
+	std::vector<size_t> production_min_length;
+	std::vector<size_t> production_min_height;
+
+	std::vector<size_t> terminals;
+	std::vector<Frame> stack;             // Reused between derivations
+	std::vector<double> candidate_weights;
+};
+
+} // namespace grammar_tools
@@ -1,12 +1,18 @@
 #include <iostream>
+#include <iterator>
+#include <optional>
 #include <string>
-#include <sstream>
+#include <string_view>
+#include <vector>
 
 #include <tclap/CmdLine.h>
 
 #include "avds/tree/tree_output.h"
 #include "grammar.h"
+#include "prefix_oracle.h"
+#include "sample_inputs.h"
 #include "syntax_tree.h"
+#include "syntax_tree_serialization.h"
 #include "syntax_visitor.h"
 #include "aec_styles.h"
 #include "io_util.h"
@@ -17,36 +23,101 @@
 
 const std::string SEPARATOR = "\n" + std::string(140, '=') + "\n\n";
 
-const char* tests[] = {
-	"b", "calligraphic b", "b tilde", "bold b hat", "capital a", "bold capital a hat",
-	"alpha", "alpha tilde", "four", "empty set", "infinity", "fraction alpha over beta",
-	"sin of capital d", "for all alpha tilde", "minus x", "function capital f from capital a to capital b",
-	"function capital f from capital a to capital b maps alpha to beta", "a plus b", "sin of cos of a",
-	"function f from capital a to capital b maps for all x to sin of fraction x over alpha",
-	"fraction b over c plus d", "fraction b over c end plus d", "a not equal b",
-	"sum from x equal zero to infinity x power two", "open parenthesis x plus two close parenthesis"
-};
-
-bool parse_and_print(Syntax_visitor& visitor, std::istream& is) {
+/**
+ * Parses and prints every line of [text], which must be followed by grammar::SCAN_PADDING writable
+ * bytes (see grammar::padded_copy). The lines are scanned in place.
+ */
+bool parse_and_print(
+	Syntax_visitor& visitor, std::string& text, serialization::Archive_writer* archive_writer
+) {
 	bool success = true;
-	std::string line;
-	while (std::getline(is, line)) {
-		std::cerr << "Input: " << aec_style::input << line << aec::reset << "\n";
-
-		auto code = grammar::generate_from_string(line, visitor);
+	size_t text_size = text.size() - grammar::SCAN_PADDING;
+	const char* text_end = text.data() + text.size();
+	grammar::for_each_line(text.data(), text_size, [&](char* line, size_t length) {
+		std::cerr << "Input: " << aec_style::input << std::string_view(line, length)
+		          << aec::reset << "\n";
+
+		visitor.syntax_tree = Syntax_tree(); // Don't keep the tree of the previous line on failure
+		auto code = grammar::generate_from_buffer(line, length, text_end, visitor);
 		if (code != 0) success = false;
+		visitor.logger.flush(); // Print the errors of this line with it
+
+		if (archive_writer) archive_writer->write(visitor.syntax_tree);
 
 		std::cerr << "Parse tree:\n\n";
 		avds::tree::print_horizontal(std::cout, visitor.syntax_tree.entrance());
 
 		std::cerr << SEPARATOR;
-	}
+	});
 	return success;
 }
 
-bool parse_and_print(Syntax_visitor& visitor, const std::string& str) {
-	std::stringstream ss(str);
-	return parse_and_print(visitor, ss);
+bool parse_and_print(
+	Syntax_visitor& visitor, std::istream& is, serialization::Archive_writer* archive_writer
+) {
+	std::string text{std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()};
+	text.append(grammar::SCAN_PADDING, '\0');
+	return parse_and_print(visitor, text, archive_writer);
+}
+
+/** Prints every tree in the syntax tree archive at [path] */
+bool print_archive(const std::string& path) {
+	Mapped_file file;
+	if (!try_map_input_file(path, file)) {
+		std::cerr << SEPARATOR;
+		return false;
+	}
+
+	serialization::Archive_reader reader(file.data(), file.size());
+	if (!reader.is_valid()) {
+		std::cerr << aec_style::error << "Error:" << aec::reset << " "
+		          << aec_style::filename << path << aec::reset << " is not a syntax tree archive\n";
+		return false;
+	}
+
+	try {
+		while (reader.has_next()) {
+			auto root = reader.next();
+			std::cerr << "Parse tree:\n\n";
+			if (root) {
+				auto tree = serialization::to_syntax_tree(*root);
+				avds::tree::print_horizontal(std::cout, tree.entrance());
+			}
+			std::cerr << SEPARATOR;
+		}
+	} catch (std::runtime_error& e) {
+		std::cerr << aec_style::error << "Error:" << aec::reset << " " << e.what() << "\n";
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Prints, for every token of [words], whether the tokens up to it can still become a line, and
+ * then the tokens that can come next
+ */
+bool print_prefix(const std::string& words) {
+	std::string text = grammar::padded_copy(words);
+	std::vector<grammar::Token> tokens;
+	grammar::scan_tokens(text.data(), words.size(), text.data() + text.size(), tokens);
+	std::cerr << "Input: " << aec_style::input << words << aec::reset << "\n";
+
+	grammar::Prefix_oracle oracle;
+	for (const grammar::Token& token : tokens) {
+		oracle.push(token.kind);
+		std::cout << std::string_view(words).substr(token.begin, token.end - token.begin) << "\t"
+		          << grammar::to_string(oracle.status()) << "\n";
+		if (oracle.status() == grammar::Prefix_status::DEAD) break;
+	}
+	std::vector<int> next;
+	oracle.next_kinds(next);
+	std::cout << "Next:";
+	for (int kind : next) {
+		std::cout << " " << (kind == 0 ? "end of input" : grammar::token_name(kind));
+	}
+	std::cout << "\n";
+	std::cerr << SEPARATOR;
+	return oracle.status() != grammar::Prefix_status::DEAD;
 }
 
 int main(int argc, char** argv) {
@@ -58,34 +129,50 @@ int main(int argc, char** argv) {
 		TCLAP::ValueArg<std::string> input_file_path_arg("f", "file", "Path to source file.", false, "", "string");
 		TCLAP::ValueArg<std::string> input_arg("i", "input", "Input string to parse.", false, "", "string");
 		TCLAP::SwitchArg test_switch("t", "tests", "Perform tests", false);
+		TCLAP::ValueArg<std::string> archive_input_arg("a", "archive", "Path to a syntax tree archive to print.", false, "", "string");
+		TCLAP::ValueArg<std::string> prefix_arg("p", "prefix", "Tell token by token whether the start of a line can still become a line, and which tokens can come next.", false, "", "string");
+		TCLAP::ValueArg<std::string> archive_output_arg("o", "output-archive", "Also write the parse trees to a syntax tree archive at this path.", false, "", "string", cmd);
 
 		TCLAP::OneOf inputs;
-		inputs.add(input_file_path_arg).add(input_arg).add(test_switch);
+		inputs.add(input_file_path_arg).add(input_arg).add(test_switch).add(archive_input_arg).add(prefix_arg);
 		cmd.add(inputs);
 		cmd.parse(argc, argv);
 
-		Logger logger(std::cerr, std::cerr, std::cerr);
+		Logger logger(STDERR_SINK);
 		Syntax_visitor vis(logger);
 
+		std::ofstream archive_file;
+		std::optional<serialization::Archive_writer> archive_writer;
+		if (archive_output_arg.isSet()) {
+			if (!try_open_output_file(archive_output_arg.getValue(), archive_file)) return 1;
+			archive_writer.emplace(archive_file);
+		}
+		auto writer = (archive_writer ? &*archive_writer : nullptr);
+
 		std::cerr << SEPARATOR;
 
 		if (test_switch.isSet()) {
-			for (const char* test : tests) {
-				if (!parse_and_print(vis, test)) success = false;
+			for (const char* test : grammar::SAMPLE_INPUTS) {
+				std::string text = grammar::padded_copy(test);
+				if (!parse_and_print(vis, text, writer)) success = false;
 			}
 		}
 		else if (input_file_path_arg.isSet()) {
 			const std::string& path = input_file_path_arg.getValue();
 			std::ifstream file;
 			if (try_open_input_file(path, file)) {
-				if (!parse_and_print(vis, file)) success = false;
+				if (!parse_and_print(vis, file, writer)) success = false;
 			}
 			else {
 				std::cerr << SEPARATOR;
 			}
 		} else if (input_arg.isSet()) {
-			const std::string& input = input_arg.getValue();
-			if (!parse_and_print(vis, input)) success = false;
+			std::string text = grammar::padded_copy(input_arg.getValue());
+			if (!parse_and_print(vis, text, writer)) success = false;
+		} else if (archive_input_arg.isSet()) {
+			if (!print_archive(archive_input_arg.getValue())) success = false;
+		} else if (prefix_arg.isSet()) {
+			if (!print_prefix(prefix_arg.getValue())) success = false;
 		}
 
 	} catch (TCLAP::ArgException& e) {
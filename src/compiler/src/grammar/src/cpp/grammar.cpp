@@ -1,16 +1,148 @@
 #include "grammar.h"
 
-int yyparse(Syntax_visitor& syntax_visitor);
-int yy_scan_string(const char* str);
-int yylex_destroy();
+#include <cstdlib>
+#include <cstring>
 
-extern FILE* yyin;
+#include "bison.compiler.h" // Token numbers, YYSTYPE and yyparse. Defines yyscan_t.
+#include "stats.h"
+
+struct yy_buffer_state;
+
+int scan_token(YYSTYPE* yylval_param, yyscan_t yyscanner); // yylex of compiler.l
+int yylex_init(yyscan_t* scanner);
+int yylex_destroy(yyscan_t scanner);
+char* yyget_text(yyscan_t scanner);
+int yyget_leng(yyscan_t scanner);
+yy_buffer_state* yy_scan_buffer(char* base, size_t size, yyscan_t scanner);
+void yy_delete_buffer(yy_buffer_state* buffer, yyscan_t scanner);
+
+namespace {
+	/**
+	 * A flex scanner that lives as long as its thread. Creating a scanner allocates its buffer
+	 * stack, so we keep one around instead of creating one per line. Every thread gets its own, so
+	 * that threads can parse concurrently.
+	 */
+	class Thread_scanner {
+	public:
+		Thread_scanner() {
+			yylex_init(&scanner);
+		}
+
+		~Thread_scanner() {
+			yylex_destroy(scanner);
+		}
+
+		Thread_scanner(const Thread_scanner&) = delete;
+		Thread_scanner& operator=(const Thread_scanner&) = delete;
+
+		yyscan_t get() const {
+			return scanner;
+		}
+
+	private:
+		yyscan_t scanner;
+	};
+
+	yyscan_t thread_scanner() {
+		thread_local Thread_scanner scanner;
+		return scanner.get();
+	}
+
+	/**
+	 * Points the scanner of this thread at the [length] characters at [text] and returns
+	 * [scan](scanner, scanned_text), where [scanned_text] is [text] or a padded copy of it. See
+	 * generate_from_buffer for the requirements on [text] and [buffer_end].
+	 */
+	template<typename Scan>
+	int scan_in_place(char* text, size_t length, const char* buffer_end, Scan scan) {
+		char* padding = text + length;
+		if (buffer_end - padding < static_cast<std::ptrdiff_t>(grammar::SCAN_PADDING)) {
+			// No room to pad in place, so we copy. Only happens for the tail of a buffer.
+			std::string copy(text, length);
+			copy.append(grammar::SCAN_PADDING, '\0');
+			return scan_in_place(copy.data(), length, copy.data() + copy.size(), scan);
+		}
+
+		char saved[grammar::SCAN_PADDING];
+		std::memcpy(saved, padding, grammar::SCAN_PADDING);
+		std::memset(padding, '\0', grammar::SCAN_PADDING);
+
+		yyscan_t scanner = thread_scanner();
+		yy_buffer_state* buffer = yy_scan_buffer(text, length + grammar::SCAN_PADDING, scanner);
+		int result = scan(scanner, text);
+		yy_delete_buffer(buffer, scanner); // does not free [text]
+
+		std::memcpy(padding, saved, grammar::SCAN_PADDING);
+		return result;
+	}
+}
 
 int grammar::generate_from_string(
 	const std::string& input, Syntax_visitor& syntax_visitor
 ) {
-	yy_scan_string(input.c_str());
-	int parsed = yyparse(syntax_visitor);
-	yylex_destroy(); // memory management
-	return parsed;
+	std::string text = padded_copy(input);
+	return generate_from_buffer(text.data(), input.size(), text.data() + text.size(), syntax_visitor);
+}
+
+int grammar::generate_from_buffer(
+	char* text, size_t length, const char* buffer_end, Syntax_visitor& syntax_visitor
+) {
+	stats::count(stats::LINES);
+	stats::count(stats::INPUT_BYTES, length);
+	return scan_in_place(text, length, buffer_end, [&](yyscan_t scanner, const char* scanned_text) {
+		int result;
+		{
+			stats::Stage_timer timer(stats::PARSE);
+			result = yyparse(scanner, nullptr, syntax_visitor);
+		}
+		if (result != 0) {
+			stats::count(stats::FAILED_LINES);
+			// The scanner stops at the token that the parser could not handle
+			syntax_visitor.error_offset = static_cast<size_t>(yyget_text(scanner) - scanned_text);
+		}
+		return result;
+	});
+}
+
+int grammar::parse_tokens(Token_reader& reader, Syntax_visitor& syntax_visitor) {
+	stats::Stage_timer timer(stats::PARSE);
+	return yyparse(nullptr, &reader, syntax_visitor);
+}
+
+void grammar::tokenize(
+	char* text, size_t length, const char* buffer_end, std::vector<int>& out_tokens
+) {
+	scan_in_place(text, length, buffer_end, [&](yyscan_t scanner, const char*) {
+		YYSTYPE value;
+		for (int token; (token = scan_token(&value, scanner)) != ENDFILE; ) {
+			out_tokens.push_back(token);
+			if (token == DIGIT || token == GREEK) {
+				std::free(value.phrase); // strdup'ed by the scanner for the parser
+			}
+		}
+		return 0;
+	});
+}
+
+void grammar::scan_tokens(
+	char* text, size_t length, const char* buffer_end, std::vector<Token>& out_tokens
+) {
+	scan_in_place(text, length, buffer_end, [&](yyscan_t scanner, const char* scanned_text) {
+		stats::Stage_timer timer(stats::LEX);
+		YYSTYPE value;
+		for (int kind; (kind = scan_token(&value, scanner)) != ENDFILE; ) {
+			Token& token = out_tokens.emplace_back();
+			token.kind = kind;
+			if (kind == LETTER) {
+				token.letter = value.letter;
+			}
+			else if (kind == DIGIT || kind == GREEK) {
+				token.phrase = value.phrase;
+				std::free(value.phrase);
+			}
+			token.begin = static_cast<uint32_t>(yyget_text(scanner) - scanned_text);
+			token.end = token.begin + static_cast<uint32_t>(yyget_leng(scanner));
+		}
+		return 0;
+	});
 }
@@ -0,0 +1,434 @@
+#include "incremental_parse.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "stats.h"
+#include "syntax_visitor.h"
+
+namespace grammar {
+
+namespace {
+
+/** The token that Token_readers give at the end of their input */
+const Token END_OF_INPUT;
+
+/**
+ * The number of expressions around an edit that are tried before the line is parsed from scratch.
+ * Every try reparses a larger part of the line, so trying them all could cost more than that.
+ */
+constexpr size_t MAX_REPARSE_TRIES = 4;
+
+/** Reads all tokens of a line, and follows the parser through them to find its expressions */
+class Line_reader : public Token_reader {
+public:
+	explicit Line_reader(const std::vector<Token>& tokens) : tokens(tokens) {}
+
+	const Token& next() override {
+		size_t position = tracker.position();
+		const Token& token = position < tokens.size() ? tokens[position] : END_OF_INPUT;
+		tracker.push(token.kind);
+		return token;
+	}
+
+	bool on_expression(Syntax_tree&) override {
+		return false;
+	}
+
+	Parser_tracker tracker;
+
+private:
+	const std::vector<Token>& tokens;
+};
+
+/**
+ * Reads the tokens of a single expression of a line, to reparse it on its own. First come tokens
+ * that bring the parser to the state it was in before the expression, then the tokens of the
+ * expression, and then the token after it. The parse stops as soon as the parser completes the
+ * expression, or as soon as it is clear that it would not complete the same expression in the line.
+ */
+class Expression_reader : public Token_reader {
+public:
+	/**
+	 * Reads tokens [begin, end) of [tokens], after [prefix_kinds], which should bring the parser
+	 * to [state]. The expression is an openexpr if [open], otherwise an anyexpr.
+	 */
+	Expression_reader(
+		const std::vector<int>& prefix_kinds, const std::vector<Token>& tokens,
+		size_t begin, size_t end, int state, bool open
+	) : tokens(tokens), begin(begin), end(end), state(state), open(open) {
+		for (int kind : prefix_kinds) {
+			Token& token = prefix.emplace_back();
+			token.kind = kind;
+			token.letter = 'x';
+			token.phrase = "zero"; // Valid for both DIGIT and GREEK, as the parser never checks it
+		}
+	}
+
+	const Token& next() override {
+		size_t position = tracker.position();
+		if (position < prefix.size()) {
+			tracker.push(prefix[position].kind);
+			return prefix[position];
+		}
+		if (failed || found) {
+			return END_OF_INPUT;
+		}
+
+		size_t index = begin + (position - prefix.size());
+		if (index == begin) {
+			failed = tracker.state() != state;
+			tracker.watch(prefix.size());
+		}
+		if (index == end) {
+			next_state = tracker.state();
+		}
+		const Token& token = index < tokens.size() ? tokens[index] : END_OF_INPUT;
+		failed = failed || !tracker.push(token.kind);
+
+		// The expression has to begin right after the prefix, and end at [end], without the parser
+		// having reduced anything of the prefix before
+		const auto& expressions = tracker.expressions();
+		for (; !failed && !found && checked < expressions.size(); ++checked) {
+			if (expressions[checked].begin == prefix.size() && expressions[checked].open == open) {
+				found = true;
+				target = checked;
+				failed = checked >= tracker.expressions_before_watched()
+					|| expressions[checked].end != prefix.size() + (end - begin);
+			}
+		}
+		failed = failed || (!found && index >= end);
+		return token;
+	}
+
+	bool on_expression(Syntax_tree& completed) override {
+		size_t index = reported++;
+		if (failed) return true;
+		if (found && index == target) {
+			expression = std::move(completed);
+			succeeded = true;
+			return true;
+		}
+		return false;
+	}
+
+	bool log_errors() const override {
+		return false;
+	}
+
+	/** The completed expressions, of which the expression is the last */
+	std::vector<Parser_tracker::Expression> expressions() const {
+		const auto& all = tracker.expressions();
+		return std::vector<Parser_tracker::Expression>(all.begin(), all.begin() + target + 1);
+	}
+
+	size_t prefix_size() const {
+		return prefix.size();
+	}
+
+	bool succeeded = false;
+	Syntax_tree expression;
+	int next_state = -1; // The state in which the parser asked for token [end], if it did
+
+private:
+	Parser_tracker tracker;
+	std::vector<Token> prefix;
+	const std::vector<Token>& tokens;
+	size_t begin;
+	size_t end;
+	int state;
+	bool open;
+	bool failed = false;
+	bool found = false;
+	size_t checked = 0;  // The expressions of the tracker that were checked for being the target
+	size_t target = 0;   // The index of the expression among those of the tracker, once found
+	size_t reported = 0; // The number of expressions the parser reported
+};
+
+/**
+ * Appends the expressions [first, last), which the parser completed innermost first, to [out] in
+ * pre-order, with [offset] added to their tokens
+ */
+template<typename Iterator>
+void append_in_pre_order(
+	Iterator first, Iterator last, std::ptrdiff_t offset, std::vector<Incremental_parse::Expression>& out
+) {
+	size_t appended = out.size();
+	while (last != first) {
+		--last;
+		uint32_t begin = static_cast<uint32_t>(last->begin + offset);
+		uint32_t end = static_cast<uint32_t>(last->end + offset);
+		out.push_back({begin, end, last->state, last->open, {}});
+	}
+	// Outer expressions were completed later, so they stay before the inner ones they begin with
+	std::stable_sort(out.begin() + appended, out.end(), [](const auto& l, const auto& r) {
+		return l.begin < r.begin;
+	});
+}
+
+bool same_tokens(const Incremental_parse::Expression& l, const Incremental_parse::Expression& r) {
+	return l.begin == r.begin && l.end == r.end;
+}
+
+} // unnamed namespace
+
+bool is_expression_child(Syntax_tree::const_traverser parent, size_t index) {
+	switch (parent->type) {
+	case Construction::Type::Expr_binop:       // openexpr binop anyexpr, range_op range anyexpr
+		return index == 2 || (index == 0 && parent.child(0)->type != Construction::Type::Rangeop);
+	case Construction::Type::Expr_frac:        // FRACTION openexpr OVER anyexpr
+	case Construction::Type::Mapsto:           // MAPS openexpr TO anyexpr
+	case Construction::Type::Range:            // FROM openexpr TO anyexpr
+		return index <= 1;
+	case Construction::Type::Expr_parentheses: // OPEN PARENTHESIS openexpr CLOSE PARENTHESIS
+		return index == 0;
+	case Construction::Type::Expr_of:          // unop OF openexpr
+		return index == 1;
+	default:
+		return false;
+	}
+}
+
+namespace {
+
+/**
+ * Appends the indices of the children on the way down from [from] to [to] to [path], if [to] is in
+ * the subtree of [from] without an expression in between, and returns whether it is
+ */
+bool append_path(Syntax_tree::const_traverser from, Syntax_tree::const_traverser to, std::vector<size_t>& path) {
+	for (size_t i = 0; i < from.child_count(); ++i) {
+		Syntax_tree::const_traverser child = from.child(i);
+		if (child == to) {
+			path.push_back(i);
+			return true;
+		}
+		if (!is_expression_child(from, i)) {
+			path.push_back(i);
+			if (append_path(child, to, path)) return true;
+			path.pop_back();
+		}
+	}
+	return false;
+}
+
+} // unnamed namespace
+
+Incremental_parse::Incremental_parse(Logger& logger) : logger(logger) {}
+
+int Incremental_parse::parse(std::string_view line) {
+	text.assign(line);
+	line_tokens.clear();
+	std::string padded = padded_copy(text);
+	scan_tokens(padded.data(), text.size(), padded.data() + padded.size(), line_tokens);
+	return parse_from_scratch();
+}
+
+int Incremental_parse::edit(size_t first, size_t last, std::string_view replacement) {
+	if (first > last || last > line_tokens.size()) {
+		throw std::out_of_range("Incremental_parse::edit: invalid token range");
+	}
+
+	// Replace the characters of the tokens, with spaces to keep the replacement apart from its neighbours
+	size_t cut_begin = first < line_tokens.size() ? line_tokens[first].begin : text.size();
+	size_t cut_end = first < last ? line_tokens[last - 1].end : cut_begin;
+	std::string inserted;
+	inserted.reserve(replacement.size() + 2);
+	if (cut_begin > 0 && text[cut_begin - 1] != ' ' && text[cut_begin - 1] != '\t') inserted += ' ';
+	inserted.append(replacement);
+	if (cut_end < text.size() && text[cut_end] != ' ' && text[cut_end] != '\t') inserted += ' ';
+	text.replace(cut_begin, cut_end - cut_begin, inserted);
+	std::ptrdiff_t shift = static_cast<std::ptrdiff_t>(inserted.size()) - (cut_end - cut_begin);
+
+	// Rescan from the token before the edit up to the token after it, since they may join the
+	// replacement (e.g. "less" and "equal"). Scanning after them goes on as before, as long as the
+	// rescan ends with the same token.
+	size_t scan_first = first > 0 ? first - 1 : 0;
+	size_t scan_last = last < line_tokens.size() ? last + 1 : last;
+	size_t scan_begin = first > 0 ? line_tokens[first - 1].begin : 0;
+	size_t scan_end = last < line_tokens.size() ? line_tokens[last].end + shift : text.size();
+	std::vector<Token> scanned;
+	std::string padded = padded_copy(std::string_view(text).substr(scan_begin, scan_end - scan_begin));
+	scan_tokens(padded.data(), scan_end - scan_begin, padded.data() + padded.size(), scanned);
+	for (Token& token : scanned) {
+		token.begin += static_cast<uint32_t>(scan_begin);
+		token.end += static_cast<uint32_t>(scan_begin);
+	}
+	if (last < line_tokens.size() && (scanned.empty() || !scanned.back().same_as(line_tokens[last])
+			|| scanned.back().end != line_tokens[last].end + shift)) {
+		std::string line = std::move(text);
+		return parse(line);
+	}
+
+	// Only the tokens that differ from before are edited
+	size_t old_count = scan_last - scan_first;
+	size_t same_before = 0;
+	while (same_before < std::min(scanned.size(), old_count)
+			&& scanned[same_before].same_as(line_tokens[scan_first + same_before])) {
+		++same_before;
+	}
+	size_t same_after = 0;
+	while (same_after < std::min(scanned.size(), old_count) - same_before
+			&& scanned[scanned.size() - 1 - same_after].same_as(line_tokens[scan_last - 1 - same_after])) {
+		++same_after;
+	}
+
+	for (size_t i = scan_last; i < line_tokens.size(); ++i) {
+		line_tokens[i].begin += static_cast<uint32_t>(shift);
+		line_tokens[i].end += static_cast<uint32_t>(shift);
+	}
+	line_tokens.erase(line_tokens.begin() + scan_first, line_tokens.begin() + scan_last);
+	line_tokens.insert(line_tokens.begin() + scan_first, scanned.begin(), scanned.end());
+
+	size_t edit_first = scan_first + same_before;
+	size_t old_last = scan_last - same_after;
+	size_t new_last = scan_first + scanned.size() - same_after;
+	if (edit_first == old_last && old_last == new_last) {
+		change = Change{false, 0, 0, 0};
+		return parsed ? 0 : 1;
+	}
+	return reparse(edit_first, old_last, new_last);
+}
+
+int Incremental_parse::parse_from_scratch() {
+	stats::count(stats::LINES);
+	stats::count(stats::INPUT_BYTES, text.size());
+	Line_reader reader(line_tokens);
+	Syntax_visitor visitor(logger);
+	int result = grammar::parse_tokens(reader, visitor);
+
+	change = Change();
+	line_expressions.clear();
+	parsed = result == 0;
+	if (!parsed) {
+		stats::count(stats::FAILED_LINES);
+		tree = Syntax_tree();
+		// The parser stops at the token it could not handle
+		size_t read = reader.tracker.position();
+		failure_offset = read > 0 && read <= line_tokens.size() ? line_tokens[read - 1].begin : text.size();
+		return result;
+	}
+
+	tree = std::move(visitor.syntax_tree);
+	const auto& completed = reader.tracker.expressions();
+	append_in_pre_order(completed.begin(), completed.end(), 0, line_expressions);
+	find_nodes(tree.entrance(), 0);
+	change.added = line_expressions.size();
+	return 0;
+}
+
+int Incremental_parse::reparse(size_t first, size_t old_last, size_t new_last) {
+	if (!parsed) return parse_from_scratch();
+
+	// The expressions that contain the edit, innermost first. The whole line (expression 0) is
+	// parsed from scratch, which also logs the syntax errors.
+	std::ptrdiff_t delta = static_cast<std::ptrdiff_t>(new_last) - static_cast<std::ptrdiff_t>(old_last);
+	auto after = std::upper_bound(
+		line_expressions.begin(), line_expressions.end(), first,
+		[](size_t position, const Expression& expression) { return position < expression.begin; }
+	);
+	size_t tries = 0;
+	for (size_t index = after - line_expressions.begin(); index-- > 1 && tries < MAX_REPARSE_TRIES; ) {
+		const Expression& expression = line_expressions[index];
+		if (expression.end < old_last || expression.state < 0) continue;
+		++tries;
+		if (reparse_expression(index, delta)) return 0;
+	}
+	return parse_from_scratch();
+}
+
+bool Incremental_parse::reparse_expression(size_t index, std::ptrdiff_t delta) {
+	Expression old = line_expressions[index];
+	size_t new_end = old.end + delta;
+	std::vector<int> prefix;
+	if (new_end <= old.begin || !Parser_tracker::path_to(old.state, prefix)) return false;
+
+	Expression_reader reader(prefix, line_tokens, old.begin, new_end, old.state, old.open);
+	Syntax_visitor visitor(logger);
+	grammar::parse_tokens(reader, visitor);
+	if (!reader.succeeded) return false;
+	std::vector<size_t> path = node_path(index); // Before the expressions change
+
+	// Its old expressions are the ones after it that begin before its end
+	size_t old_subtree_end = index + 1;
+	while (old_subtree_end < line_expressions.size() && line_expressions[old_subtree_end].begin < old.end) {
+		++old_subtree_end;
+	}
+	// The expressions of the prefix were completed before the ones of the expression
+	std::vector<Parser_tracker::Expression> completed = reader.expressions();
+	auto first_reparsed = std::find_if(completed.begin(), completed.end(), [&](const auto& expression) {
+		return expression.begin >= reader.prefix_size();
+	});
+	std::vector<Expression> reparsed;
+	std::ptrdiff_t offset = static_cast<std::ptrdiff_t>(old.begin) - static_cast<std::ptrdiff_t>(reader.prefix_size());
+	append_in_pre_order(first_reparsed, completed.end(), offset, reparsed);
+
+	// Its ancestors grow by [delta], the expressions after it move by [delta]
+	for (size_t i = 0; i < index; ++i) {
+		if (line_expressions[i].end >= old.end) line_expressions[i].end += static_cast<uint32_t>(delta);
+	}
+	for (size_t i = old_subtree_end; i < line_expressions.size(); ++i) {
+		line_expressions[i].begin += static_cast<uint32_t>(delta);
+		line_expressions[i].end += static_cast<uint32_t>(delta);
+		// An expression right after it begins with the token the parser looked ahead at
+		if (line_expressions[i].begin == new_end) line_expressions[i].state = reader.next_state;
+	}
+	line_expressions.erase(line_expressions.begin() + index, line_expressions.begin() + old_subtree_end);
+	line_expressions.insert(line_expressions.begin() + index, reparsed.begin(), reparsed.end());
+
+	// Replacing the subtree copies the nodes above it that the tree shares with a copy, which moves
+	// their children. Then all nodes are found again.
+	bool copied = false;
+	Syntax_tree::const_traverser node = tree.replace_subtree(path, std::move(reader.expression), copied);
+	if (copied) {
+		find_nodes(tree.entrance(), 0);
+	}
+	else {
+		find_nodes(node, index);
+	}
+	change = Change{false, index, old_subtree_end - index, reparsed.size()};
+	return true;
+}
+
+std::vector<size_t> Incremental_parse::node_path(size_t index) const {
+	// The expressions around expression [index] come before it, and contain its tokens
+	std::vector<size_t> enclosing{index};
+	for (size_t i = index; i-- > 0; ) {
+		const Expression& inner = line_expressions[enclosing.back()];
+		const Expression& expression = line_expressions[i];
+		if (expression.begin <= inner.begin && expression.end >= inner.end && expression.node != inner.node) {
+			enclosing.push_back(i);
+		}
+	}
+	// Expression 0 is the whole line, at the root
+	std::vector<size_t> path;
+	for (size_t i = enclosing.size() - 1; i-- > 0; ) {
+		if (!append_path(line_expressions[enclosing[i + 1]].node, line_expressions[enclosing[i]].node, path)) {
+			throw std::logic_error("Incremental_parse: an expression is not in the syntax tree");
+		}
+	}
+	return path;
+}
+
+size_t Incremental_parse::find_nodes(Syntax_tree::const_traverser root, size_t first) {
+	// Iteratively, since lines of many operators make deep trees
+	std::vector<std::pair<Syntax_tree::const_traverser, bool>> pending{{root, true}};
+	size_t index = first;
+	while (!pending.empty()) {
+		auto [node, is_expression] = pending.back();
+		pending.pop_back();
+		if (is_expression && index < line_expressions.size()) {
+			line_expressions[index++].node = node;
+			// An anyexpr that is an openexpr is followed by that openexpr
+			if (index < line_expressions.size() && same_tokens(line_expressions[index - 1], line_expressions[index])) {
+				line_expressions[index++].node = node;
+			}
+		}
+		for (size_t i = node.child_count(); i-- > 0; ) {
+			pending.emplace_back(node.child(i), is_expression_child(node, i));
+		}
+	}
+	return index;
+}
+
+} // namespace grammar
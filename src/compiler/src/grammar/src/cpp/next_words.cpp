@@ -0,0 +1,44 @@
+#include "next_words.h"
+
+#include <algorithm>
+
+namespace grammar {
+
+Next_word_table::Next_word_table(std::vector<std::string> words)
+		: vocabulary(std::move(words))
+		, first_kinds(vocabulary.size(), -1)
+		, states(Parser_tracker::state_count())
+		, blocks((vocabulary.size() + BLOCK_BITS - 1) / BLOCK_BITS)
+		, bits((states + 1) * blocks, 0)
+{
+	std::vector<Token> tokens;
+	for (size_t i = 0; i < vocabulary.size(); ++i) {
+		std::string padded = padded_copy(vocabulary[i]);
+		tokens.clear();
+		scan_tokens(padded.data(), vocabulary[i].size(), padded.data() + padded.size(), tokens);
+		if (!tokens.empty()) first_kinds[i] = tokens.front().kind;
+	}
+
+	std::vector<int> kinds;
+	for (int state = 0; state < states; ++state) {
+		Parser_tracker::possible_kinds(state, kinds);
+		Block* state_row = &bits[state * blocks];
+		for (size_t i = 0; i < vocabulary.size(); ++i) {
+			if (first_kinds[i] >= 0 && std::binary_search(kinds.begin(), kinds.end(), first_kinds[i])) {
+				state_row[i / BLOCK_BITS] |= Block(1) << (i % BLOCK_BITS);
+			}
+		}
+	}
+}
+
+void Next_word_table::allowed(int state, std::vector<size_t>& out_indices) const {
+	out_indices.clear();
+	const Block* state_row = row(state);
+	for (size_t block = 0; block < blocks; ++block) {
+		for (Block rest = state_row[block]; rest != 0; rest &= rest - 1) {
+			out_indices.push_back(block * BLOCK_BITS + __builtin_ctzll(rest));
+		}
+	}
+}
+
+} // namespace grammar
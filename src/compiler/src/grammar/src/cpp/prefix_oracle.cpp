@@ -0,0 +1,61 @@
+#include "prefix_oracle.h"
+
+namespace grammar {
+
+const char* to_string(Prefix_status status) {
+	switch (status) {
+		case Prefix_status::VIABLE:   return "viable";
+		case Prefix_status::COMPLETE: return "complete";
+		case Prefix_status::DEAD:     return "dead";
+	}
+	return "unknown";
+}
+
+//==================================================================================================
+// Prefix_oracle
+//==================================================================================================
+
+Prefix_oracle::Prefix_oracle() {
+	reset();
+}
+
+void Prefix_oracle::reset() {
+	tracker = Parser_tracker().only_states();
+	current = tracker.accepts() ? Prefix_status::COMPLETE : Prefix_status::VIABLE;
+	pushed = 0;
+	dead_token = SIZE_MAX;
+}
+
+Prefix_status Prefix_oracle::push(int kind) {
+	++pushed;
+	if (current == Prefix_status::DEAD) return current;
+	// Checked first, because a push that fails leaves the tracker halfway
+	if (!tracker.can_push(kind)) {
+		dead_token = pushed - 1;
+		current = Prefix_status::DEAD;
+		return current;
+	}
+	tracker.push(kind);
+	current = tracker.accepts() ? Prefix_status::COMPLETE : Prefix_status::VIABLE;
+	return current;
+}
+
+void Prefix_oracle::next_kinds(std::vector<int>& out_kinds) const {
+	if (current == Prefix_status::DEAD) out_kinds.clear();
+	else tracker.next_kinds(out_kinds);
+}
+
+//==================================================================================================
+// Functions
+//==================================================================================================
+
+Prefix_status check_prefix(const Token* tokens, size_t count, std::vector<int>* out_next_kinds) {
+	Prefix_oracle oracle;
+	for (size_t i = 0; i < count && oracle.status() != Prefix_status::DEAD; ++i) {
+		oracle.push(tokens[i].kind);
+	}
+	if (out_next_kinds) oracle.next_kinds(*out_next_kinds);
+	return oracle.status();
+}
+
+} // namespace grammar
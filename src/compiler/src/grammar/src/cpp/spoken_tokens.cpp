@@ -0,0 +1,124 @@
+#include "spoken_tokens.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <string_view>
+
+#include "stats.h"
+
+namespace grammar {
+
+namespace {
+
+/** The token that Token_readers give at the end of their input */
+const Token END_OF_INPUT;
+
+/** The shortest pause whose logarithm is taken, in seconds; recognizers give times in steps of 20 ms */
+constexpr double MIN_PAUSE = 0.001;
+
+/** The word that a break stands for */
+constexpr const char* BREAK_WORD = "end";
+
+/** Gives the parser a list of tokens, and remembers how many it read */
+class List_reader : public Token_reader {
+public:
+	List_reader(const Token* tokens, size_t count) : tokens(tokens), count(count) {}
+
+	const Token& next() override {
+		const Token& token = read < count ? tokens[read] : END_OF_INPUT;
+		++read;
+		return token;
+	}
+
+	bool on_expression(Syntax_tree&) override {
+		return false;
+	}
+
+	size_t read = 0; // Including the end of the input
+
+private:
+	const Token* tokens;
+	size_t count;
+};
+
+} // unnamed namespace
+
+//==================================================================================================
+// Pause_model
+//==================================================================================================
+
+Pause_model::Pause_model(double initial_threshold)
+		: min_threshold(std::log(std::max(initial_threshold, MIN_PAUSE) / RANGE))
+		, max_threshold(std::log(std::max(initial_threshold, MIN_PAUSE) * RANGE))
+		, log_threshold(std::log(std::max(initial_threshold, MIN_PAUSE)))
+		, mean(log_threshold - DEVIATIONS * PRIOR_DEVIATION)
+		, variance(PRIOR_DEVIATION * PRIOR_DEVIATION)
+{}
+
+bool Pause_model::is_break(double seconds) {
+	double x = std::log(std::max(seconds, MIN_PAUSE));
+	if (x > log_threshold) return true;
+
+	// Weighs the pauses equally, with the prior ones, until there are RATE_WINDOW of them
+	++count;
+	double rate = 1 / std::min(PRIOR_PAUSES + count, RATE_WINDOW);
+	double difference = x - mean;
+	mean += rate * difference;
+	variance = (1 - rate) * (variance + rate * difference * difference);
+
+	double deviations = std::max(DEVIATIONS * std::sqrt(variance), std::log(MIN_RATIO));
+	log_threshold = std::clamp(mean + deviations, min_threshold, max_threshold);
+	return false;
+}
+
+double Pause_model::threshold() const {
+	return std::exp(log_threshold);
+}
+
+//==================================================================================================
+// Spoken lines
+//==================================================================================================
+
+void read_spoken_line(
+	const Recognized_token* tokens, size_t count, Pause_model& pauses, Spoken_line& out_line
+) {
+	out_line.text.clear();
+	out_line.tokens.clear();
+	out_line.breaks = 0;
+
+	double last_time = 0;
+	for (size_t i = 0; i < count; ++i) {
+		std::string_view text = tokens[i].text;
+		out_line.text += text;
+		if (text == " " && pauses.is_break(tokens[i].start_time - last_time)) {
+			out_line.text += BREAK_WORD;
+			out_line.text += ' ';
+			++out_line.breaks;
+		}
+		last_time = tokens[i].start_time;
+	}
+
+	// Scanned in place, once: the break words become END tokens like spoken ones
+	size_t length = out_line.text.size();
+	out_line.text.append(SCAN_PADDING, '\0');
+	scan_tokens(out_line.text.data(), length, out_line.text.data() + out_line.text.size(), out_line.tokens);
+	out_line.text.resize(length);
+}
+
+int parse_token_list(const Token* tokens, size_t count, Syntax_visitor& syntax_visitor) {
+	stats::count(stats::LINES);
+	List_reader reader(tokens, count);
+	int result = parse_tokens(reader, syntax_visitor);
+	if (result != 0) {
+		stats::count(stats::FAILED_LINES);
+		// The parser stops at the token it could not handle, which is relative to the first
+		size_t read = reader.read;
+		if (read > 0 && read <= count) syntax_visitor.error_offset = tokens[read - 1].begin - tokens[0].begin;
+		else if (count > 0) syntax_visitor.error_offset = tokens[count - 1].end - tokens[0].begin;
+		else syntax_visitor.error_offset = 0;
+	}
+	return result;
+}
+
+} // namespace grammar
@@ -1,11 +1,19 @@
 #include "syntax_tree.h"
 
 Syntax_tree::Syntax_tree() {}
-Syntax_tree::Syntax_tree(const Construction& construction) : tree(construction) {}
+Syntax_tree::Syntax_tree(const Construction& construction) : tree(construction) {
+	stats::count(stats::TREE_NODES);
+}
 
 Syntax_tree::const_traverser Syntax_tree::append_subtree(Syntax_tree&& subtree) {
 	return tree.append_child_subtree(tree.entrance(), std::move(subtree.tree));
 }
 
+Syntax_tree::const_traverser Syntax_tree::replace_subtree(
+	const std::vector<size_t>& path, Syntax_tree&& subtree, bool& copied
+) {
+	return tree.replace_subtree(tree.traverser_at(path, &copied), std::move(subtree.tree));
+}
+
 Syntax_tree::const_traverser Syntax_tree::entrance()  const noexcept { return tree.entrance(); }
 Syntax_tree::const_traverser Syntax_tree::centrance() const noexcept { return tree.entrance(); }
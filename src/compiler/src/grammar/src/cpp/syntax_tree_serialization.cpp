@@ -0,0 +1,330 @@
+#include "syntax_tree_serialization.h"
+
+#include <stdexcept>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+namespace serialization {
+
+//==================================================================================================
+// Helper functions
+//==================================================================================================
+
+namespace {
+
+constexpr unsigned int TYPE_SHIFT = 4;
+constexpr uint8_t DATA_KIND_MASK = (1u << TYPE_SHIFT) - 1;
+constexpr uint8_t NO_DATA = 0;
+
+// Data kinds are the index of the Construction::Data alternative plus one
+constexpr uint8_t STRING_DATA = 7;
+constexpr uint8_t CHAR_DATA   = 8;
+
+static_assert(std::variant_size_v<Construction::Data> == CHAR_DATA);
+static_assert(std::is_same_v<std::variant_alternative_t<STRING_DATA-1, Construction::Data>, std::string>);
+static_assert(std::is_same_v<std::variant_alternative_t<CHAR_DATA-1, Construction::Data>, char>);
+
+[[noreturn]] void throw_malformed_exception() {
+	throw std::runtime_error("Malformed syntax tree encoding.");
+}
+
+size_t varint_size(uint64_t value) {
+	size_t size = 1;
+	while (value >= 0x80) {
+		value >>= 7;
+		++size;
+	}
+	return size;
+}
+
+void put_varint(std::string& out, uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	out.push_back(static_cast<char>(value));
+}
+
+uint64_t get_varint(const char*& pos, const char* end) {
+	uint64_t value = 0;
+	for (unsigned int shift = 0; shift < 64; shift += 7) {
+		if (pos == end) throw_malformed_exception();
+		auto byte = static_cast<uint8_t>(*pos++);
+		value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) return value;
+	}
+	throw_malformed_exception();
+}
+
+uint8_t data_kind(const Construction& construction) {
+	if (!construction.data.has_value()) return NO_DATA;
+	return static_cast<uint8_t>(construction.data->index() + 1);
+}
+
+/** The value stored in the payload varint (for strings: their length) */
+uint64_t payload_value(const Construction::Data& data) {
+	return std::visit([](const auto& value) -> uint64_t {
+		using V = std::decay_t<decltype(value)>;
+		if constexpr (std::is_same_v<V, std::string>) {
+			return value.size();
+		}
+		else {
+			return static_cast<uint64_t>(value);
+		}
+	}, data);
+}
+
+size_t node_header_size(const Construction& construction) {
+	size_t size = varint_size(
+		(static_cast<uint64_t>(construction.type) << TYPE_SHIFT) | data_kind(construction)
+	);
+	if (construction.data.has_value()) {
+		auto kind = data_kind(construction);
+		if (kind == CHAR_DATA) {
+			size += 1;
+		}
+		else {
+			uint64_t value = payload_value(*construction.data);
+			size += varint_size(value) + (kind == STRING_DATA ? value : 0);
+		}
+	}
+	return size;
+}
+
+/**
+ * Computes the size of the children of every node in the tree that [t] points to, in preorder.
+ * Returns the encoded size of the whole tree.
+ */
+size_t compute_children_sizes(Syntax_tree::const_traverser t, std::vector<size_t>& sizes) {
+	size_t index = sizes.size();
+	sizes.push_back(0);
+
+	size_t children_size = 0;
+	for (auto ct = t.begin(); ct != t.end(); ++ct) {
+		children_size += compute_children_sizes(ct, sizes);
+	}
+	sizes[index] = children_size;
+
+	return node_header_size(*t)
+		+ varint_size(t.child_count())
+		+ varint_size(children_size)
+		+ children_size;
+}
+
+void encode_node(
+	Syntax_tree::const_traverser t, const std::vector<size_t>& sizes, size_t& index, std::string& out
+) {
+	const Construction& construction = *t;
+	auto kind = data_kind(construction);
+
+	put_varint(out, (static_cast<uint64_t>(construction.type) << TYPE_SHIFT) | kind);
+	if (kind == CHAR_DATA) {
+		out.push_back(std::get<char>(*construction.data));
+	}
+	else if (kind != NO_DATA) {
+		put_varint(out, payload_value(*construction.data));
+		if (kind == STRING_DATA) {
+			out += std::get<std::string>(*construction.data);
+		}
+	}
+	put_varint(out, t.child_count());
+	put_varint(out, sizes[index++]);
+
+	for (auto ct = t.begin(); ct != t.end(); ++ct) {
+		encode_node(ct, sizes, index, out);
+	}
+}
+
+void encode_tree(Syntax_tree::const_traverser t, std::string& out, bool prefix_size) {
+	std::vector<size_t> sizes;
+	size_t total_size = compute_children_sizes(t, sizes);
+	if (prefix_size) put_varint(out, total_size);
+	out.reserve(out.size() + total_size);
+
+	size_t index = 0;
+	encode_node(t, sizes, index, out);
+}
+
+/**
+ * Returns [value] as an [Enum]. Throws std::runtime_error if it is not one of its values, which
+ * end at Enum::Last.
+ */
+template<typename Enum>
+Enum to_enum(uint64_t value) {
+	if (value > static_cast<uint64_t>(Enum::Last)) throw_malformed_exception();
+	return static_cast<Enum>(value);
+}
+
+/** [str] is only used for string data */
+Construction::Data make_data(uint8_t kind, uint64_t value, std::string_view str) {
+	switch (kind) {
+	// Enum alternatives, in the order of Construction::Data
+	case 1: return to_enum<Typesetting_type>(value);
+	case 2: return to_enum<Accent_type>(value);
+	case 3: return to_enum<Special_symbol_type>(value);
+	case 4: return to_enum<Unop_type>(value);
+	case 5: return to_enum<Binop_type>(value);
+	case 6: return to_enum<Rangeop_type>(value);
+	case STRING_DATA: return std::string(str);
+	case CHAR_DATA: return static_cast<char>(value);
+	}
+	throw_malformed_exception();
+}
+
+} // unnamed namespace
+
+//==================================================================================================
+// Writing
+//==================================================================================================
+
+void encode_tree(Syntax_tree::const_traverser t, std::string& out) {
+	encode_tree(t, out, false);
+}
+
+void encode_record(const Syntax_tree& tree, std::string& out) {
+	auto t = tree.centrance();
+	if (!t.is_valid()) {
+		put_varint(out, 0);
+		return;
+	}
+	encode_tree(t, out, true);
+}
+
+Archive_writer::Archive_writer(std::ostream& os) : os(os) {
+	os.write(ARCHIVE_MAGIC.data(), ARCHIVE_MAGIC.size());
+}
+
+void Archive_writer::write(const Syntax_tree& tree) {
+	buffer.clear();
+	encode_record(tree, buffer);
+	os.write(buffer.data(), buffer.size());
+}
+
+//==================================================================================================
+// Reading
+//==================================================================================================
+
+Node_view::Node_view(const char* begin, const char* end) {
+	const char* pos = begin;
+
+	uint64_t tag = get_varint(pos, end);
+	data_kind = static_cast<uint8_t>(tag & DATA_KIND_MASK);
+	node_type = to_enum<Construction::Type>(tag >> TYPE_SHIFT);
+	if (data_kind > CHAR_DATA) throw_malformed_exception();
+
+	payload_value = 0;
+	if (data_kind == CHAR_DATA) {
+		if (pos == end) throw_malformed_exception();
+		payload_value = static_cast<unsigned char>(*pos++);
+	}
+	else if (data_kind != NO_DATA) {
+		payload_value = get_varint(pos, end);
+		if (data_kind != STRING_DATA) make_data(data_kind, payload_value, {}); // Checks the enum value
+	}
+	payload = pos;
+	if (data_kind == STRING_DATA) {
+		if (payload_value > static_cast<uint64_t>(end - pos)) throw_malformed_exception();
+		pos += payload_value;
+	}
+
+	children = get_varint(pos, end);
+	uint64_t children_size = get_varint(pos, end);
+	if (children_size > static_cast<uint64_t>(end - pos)) throw_malformed_exception();
+	if (children != 0 && children_size == 0) throw_malformed_exception();
+
+	children_begin = pos;
+	children_end = pos + children_size;
+}
+
+Construction::Type Node_view::type() const noexcept {
+	return node_type;
+}
+
+bool Node_view::has_data() const noexcept {
+	return data_kind != NO_DATA;
+}
+
+std::string_view Node_view::string_data() const {
+	if (data_kind != STRING_DATA) {
+		throw std::logic_error("Requested string data from a syntax tree node without it.");
+	}
+	return std::string_view(payload, payload_value);
+}
+
+Construction Node_view::construction() const {
+	if (data_kind == NO_DATA) {
+		return Construction(node_type);
+	}
+	auto str = (data_kind == STRING_DATA ? string_data() : std::string_view());
+	return Construction(node_type, make_data(data_kind, payload_value, str));
+}
+
+size_t Node_view::child_count() const noexcept {
+	return children;
+}
+
+bool Node_view::is_leaf() const noexcept {
+	return children == 0;
+}
+
+Node_view Node_view::first_child() const {
+	return Node_view(children_begin, children_end);
+}
+
+Node_view Node_view::next_sibling(const Node_view& parent) const {
+	return Node_view(subtree_end(), parent.children_end);
+}
+
+Node_view Node_view::child(size_t child_index) const {
+	Node_view result = first_child();
+	for (size_t i = 0; i < child_index; ++i) {
+		result = result.next_sibling(*this);
+	}
+	return result;
+}
+
+const char* Node_view::subtree_end() const noexcept {
+	return children_end;
+}
+
+Archive_reader::Archive_reader(const char* data, size_t size)
+		: pos  (data)
+		, end  (data + size)
+		, valid(size >= ARCHIVE_MAGIC.size()
+		        && std::string_view(data, ARCHIVE_MAGIC.size()) == ARCHIVE_MAGIC)
+{
+	if (valid) pos += ARCHIVE_MAGIC.size();
+}
+
+bool Archive_reader::is_valid() const noexcept {
+	return valid;
+}
+
+bool Archive_reader::has_next() const noexcept {
+	return valid && pos != end;
+}
+
+std::optional<Node_view> Archive_reader::next() {
+	uint64_t record_size = get_varint(pos, end);
+	if (record_size > static_cast<uint64_t>(end - pos)) throw_malformed_exception();
+
+	const char* record_begin = pos;
+	pos += record_size;
+	if (record_size == 0) return std::nullopt;
+	return Node_view(record_begin, pos);
+}
+
+Syntax_tree to_syntax_tree(const Node_view& node) {
+	Syntax_tree tree(node.construction());
+	if (node.is_leaf()) return tree;
+
+	Node_view child = node.first_child();
+	for (size_t i = 0; i < node.child_count(); ++i) {
+		if (i != 0) child = child.next_sibling(node);
+		tree.append_subtree(to_syntax_tree(child));
+	}
+	return tree;
+}
+
+} // namespace serialization
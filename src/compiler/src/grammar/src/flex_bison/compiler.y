@@ -3,21 +3,18 @@
 
 #include <iostream>
 #include <cstring>
+#include <algorithm>
 
+#include "grammar.h"
+#include "incremental_parse.h"
+#include "stats.h"
 #include "syntax_tree.h"
 #include "syntax_visitor.h"
 
-/* Import from comp.l*/
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-int yylex();   /* Lexer function*/
-int yywrap(void);
-
-#ifdef __cplusplus
-}
-#endif
+// Every binary operator nests the rest of the line, so the parser stack grows with the length of the
+// line. The default limit of 10000 entries rejects lines of about that many words as
+// "memory exhausted". The stack is allocated on the heap and only grows as needed.
+#define YYMAXDEPTH 10000000
 
 // Shorthand for the grammar actions
 using Con = Construction;
@@ -35,13 +32,51 @@ std::string move_to_string(char* c_string) {
 	return ret;
 }
 
-static void yyerror(Syntax_visitor&, const char*);
-
 %}
 
+/* Shared with the scanner generated from compiler.l */
+%code requires {
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void* yyscan_t;
+#endif
+
+namespace grammar {
+	class Token_reader;
+}
+}
+
+%code {
+/* Import from compiler.l */
+int scan_token(YYSTYPE* yylval_param, yyscan_t yyscanner);
+
+static int read_token(YYSTYPE* yylval_param, grammar::Token_reader& reader);
+
+/* Scans the next token, measured as the lexing stage when statistics are enabled. If there is a
+   reader, the token was scanned before, and is read from it instead. */
+static int yylex(YYSTYPE* yylval_param, yyscan_t yyscanner, grammar::Token_reader* reader) {
+	if (reader != nullptr) return read_token(yylval_param, *reader);
+	stats::Stage_timer timer(stats::LEX);
+	return scan_token(yylval_param, yyscanner);
+}
+
+static void yyerror(yyscan_t, grammar::Token_reader*, Syntax_visitor&, const char*);
+
+/* Shows the reader, if any, the expression [tree] that was just completed, and stops the parse if
+   the reader asks for it. The parser does not free the symbols of the rule that stops it. */
+#define REPORT_EXPRESSION(tree) \
+	if (reader != nullptr && reader->on_expression(*(tree))) { \
+		delete (tree); \
+		YYACCEPT; \
+	}
+}
+
 /* Provides more useful error messages */
 %define parse.error verbose
 
+/* A reentrant parser, so that lines can be parsed on several threads at once */
+%define api.pure full
+
 /* Types to pass between lexer, rules and actions.
    Note: bison has a variant option, which would alleviate the need to allocate and deallocate
    c-strings and Syntax_tree objects all the time. Can't get it to work though. */
@@ -57,6 +92,13 @@ static void yyerror(Syntax_visitor&, const char*);
 	Rangeop_type r_type;
 }
 
+/* The symbols whose values are allocated, so that bison can free the values it discards when it
+   runs into a syntax error. The actions use explicit $<tree>-style types throughout. */
+%type <tree> anyexpr openexpr closedexpr expr simpleexpr symbol variable typed_variable letter
+%type <tree> func openfunc mapsto unop binop range
+%destructor { delete $$; } <tree>
+%destructor { free($$); } <phrase>
+
 /* TODO?: Start symbol */
 /* Note: if no start symbol is provided,
  	bison takes the first rule as start */
@@ -64,7 +106,8 @@ static void yyerror(Syntax_visitor&, const char*);
 
 /* Tokens */
 /* symbol */
-%token LETTER GREEK DIGIT
+%token <letter> LETTER
+%token <phrase> GREEK DIGIT
 /* keywords */
 %token OF FROM TO FUNCTION FRACTION OVER MAPS OPEN CLOSE PARENTHESIS END
 /* operators */
@@ -90,7 +133,8 @@ static void yyerror(Syntax_visitor&, const char*);
 /*  If the token’s precedence is higher, the choice is to shift. If the rule’s precedence is higher, the choice is to reduce. If they have equal precedence, the choice is made based on the associativity of that precedence level. Each rule gets its precedence from the last terminal symbol mentioned in the components */
 %right OF NOT B_PLUS B_TIMES B_POWER B_DIV B_MID B_EQ B_ISO B_LT B_GT B_LE B_GE B_AND B_OR B_IMPL B_EQUIV B_CUP B_CAP B_SMINUS B_SUBSET B_IN MINUS
 
-%parse-param {Syntax_visitor& syntax_visitor}
+%lex-param {yyscan_t scanner} {grammar::Token_reader* reader}
+%parse-param {yyscan_t scanner} {grammar::Token_reader* reader} {Syntax_visitor& syntax_visitor}
 
 %%
 
@@ -101,12 +145,15 @@ start 			: anyexpr {
 				};
 anyexpr 		: openexpr %prec NOEND {
 					$<tree>$ = $<tree>1;
+					REPORT_EXPRESSION($<tree>$);
 				}
 				| closedexpr %prec END {
 					$<tree>$ = $<tree>1;
+					REPORT_EXPRESSION($<tree>$);
 				}
 openexpr		: expr %prec NOEND {
 					$<tree>$ = $<tree>1;
+					REPORT_EXPRESSION($<tree>$);
 				}
 closedexpr 		: expr END {
 					$<tree>$ = $<tree>1;
@@ -351,10 +398,341 @@ range_op 		: R_SUM {
 				};
 %%
 
-static void yyerror(Syntax_visitor& vis, const char* s) {
-    (&vis)->logger.error(-1) << s << '\n';
+static void yyerror(yyscan_t, grammar::Token_reader* reader, Syntax_visitor& vis, const char* s) {
+	if (reader == nullptr || reader->log_errors()) {
+		vis.logger.error(-1, s);
+	}
+}
+
+static int read_token(YYSTYPE* yylval_param, grammar::Token_reader& reader) {
+	const grammar::Token& token = reader.next();
+	if (token.kind == LETTER) {
+		yylval_param->letter = token.letter;
+	}
+	else if (token.kind == DIGIT || token.kind == GREEK) {
+		yylval_param->phrase = strdup(token.phrase.c_str()); // Freed like the scanner's
+	}
+	return token.kind;
+}
+
+const char* grammar::token_name(int token) {
+	return yytname[YYTRANSLATE(token)];
+}
+
+//==================================================================================================
+// Parser_tracker: follows the parser through its tables, the way yyparse does
+//==================================================================================================
+
+namespace {
+
+/** The number of the symbol named [name] */
+int symbol_number(const char* name) {
+	for (int i = 0; i < YYNTOKENS + YYNNTS; ++i) {
+		if (std::strcmp(yytname[i], name) == 0) return i;
+	}
+	return -1;
+}
+
+const int ANYEXPR = symbol_number("anyexpr");
+const int OPENEXPR = symbol_number("openexpr");
+
+/**
+ * What the parser does in [state] with the symbol [symbol] as the next token: the state it shifts it
+ * to, minus the rule it reduces, or 0 for a syntax error
+ */
+int action(int state, int symbol) {
+	int n = yypact[state];
+	if (yypact_value_is_default(n) || (n += symbol) < 0 || YYLAST < n || yycheck[n] != symbol) {
+		return -yydefact[state];
+	}
+	if (yytable_value_is_error(yytable[n])) return 0;
+	return yytable[n]; // Negative for a reduction, like the result
+}
+
+/** The state the parser goes to from state [below] after it reduces a rule to the nonterminal [symbol] */
+int goto_state(int below, int symbol) {
+	int n = yypgoto[symbol - YYNTOKENS] + below;
+	return 0 <= n && n <= YYLAST && yycheck[n] == below ? yytable[n] : yydefgoto[symbol - YYNTOKENS];
+}
+
+} // unnamed namespace
+
+grammar::Parser_tracker::Parser_tracker() {
+	stack.push_back({0, 0});
+	settle();
+}
+
+bool grammar::Parser_tracker::push(int kind) {
+	if (!states_only) token_states.push_back(state());
+	int symbol = YYTRANSLATE(kind);
+	while (true) {
+		int state = stack.back().state;
+		int n = yypact[state];
+		int rule;
+		if (yypact_value_is_default(n) || (n += symbol) < 0 || YYLAST < n || yycheck[n] != symbol) {
+			rule = yydefact[state];
+		}
+		else if (yytable[n] > 0) {
+			stack.push_back({yytable[n], static_cast<uint32_t>(token_states.size() - 1)});
+			break;
+		}
+		else if (yytable_value_is_error(yytable[n])) {
+			return false;
+		}
+		else {
+			rule = -yytable[n];
+		}
+		if (rule == 0) return false;
+		reduce(rule, token_states.size() - 1); // Before the token
+	}
+	return settle();
+}
+
+bool grammar::Parser_tracker::settle() {
+	while (state() != YYFINAL && yypact_value_is_default(yypact[state()])) {
+		int rule = yydefact[state()];
+		if (rule == 0) return false;
+		reduce(rule, token_states.size());
+	}
+	return true;
+}
+
+void grammar::Parser_tracker::reduce(int rule, size_t position) {
+	size_t length = yyr2[rule];
+	uint32_t end = static_cast<uint32_t>(position);
+	uint32_t begin = length > 0 ? stack[stack.size() - length].begin : end;
+	if (begin < watched_position && watched_expressions == SIZE_MAX) {
+		watched_expressions = completed.size();
+	}
+	stack.resize(stack.size() - length);
+
+	int state = goto_state(stack.back().state, yyr1[rule]);
+	stack.push_back({state, begin});
+	if (!states_only && (yyr1[rule] == ANYEXPR || yyr1[rule] == OPENEXPR)) {
+		completed.push_back({begin, end, begin < end ? token_states[begin] : state, yyr1[rule] == OPENEXPR});
+	}
+}
+
+int grammar::Parser_tracker::state() const {
+	return stack.back().state;
+}
+
+int grammar::Parser_tracker::state_count() {
+	return YYNSTATES;
+}
+
+size_t grammar::Parser_tracker::position() const {
+	return token_states.size();
+}
+
+void grammar::Parser_tracker::watch(size_t position) {
+	watched_position = position;
+	watched_expressions = SIZE_MAX;
 }
 
-int yywrap() {
-    return 1;
+bool grammar::Parser_tracker::path_to(int state, std::vector<int>& out_kinds) {
+	// Breadth-first over the states in which the parser asks for tokens, once
+	static const std::vector<std::vector<int>> paths = [] {
+		std::vector<std::vector<int>> paths(YYNSTATES);
+		std::vector<bool> found(YYNSTATES, false);
+		std::vector<std::pair<Parser_tracker, std::vector<int>>> queue;
+		queue.emplace_back(Parser_tracker(), std::vector<int>());
+		found[queue.front().first.state()] = true;
+		for (size_t i = 0; i < queue.size(); ++i) {
+			// Symbols 0 to 2 are the end of the input, "error" and the numbers that are no token
+			for (int kind = 1; kind <= YYMAXUTOK; ++kind) {
+				if (YYTRANSLATE(kind) <= 2) continue;
+				Parser_tracker next = queue[i].first;
+				if (!next.push(kind) || found[next.state()]) continue;
+				found[next.state()] = true;
+				std::vector<int> path = queue[i].second;
+				path.push_back(kind);
+				paths[next.state()] = path;
+				queue.emplace_back(std::move(next), std::move(path));
+			}
+		}
+		return paths;
+	}();
+	if (state < 0 || state >= YYNSTATES || (state != 0 && paths[state].empty())) return false;
+	out_kinds = paths[state];
+	return true;
+}
+
+bool grammar::Parser_tracker::can_push(int kind) const {
+	// Does what push does on a view of the stack, its first [depth] entries followed by [overlay],
+	// without changing or copying it. Every rule has symbols, so a reduction never makes the view
+	// longer, and the overlay holds the state of a reduction and the shifted one. Rules without
+	// symbols could make it grow; then this falls back to a copy.
+	constexpr size_t OVERLAY_SIZE = 8;
+	int overlay[OVERLAY_SIZE];
+	size_t size = 0;
+	size_t depth = stack.size();
+	auto top = [&] {
+		return size > 0 ? overlay[size - 1] : stack[depth - 1].state;
+	};
+
+	int symbol = YYTRANSLATE(kind);
+	bool shifted = false;
+	while (size < OVERLAY_SIZE) {
+		int state = top();
+		int rule;
+		if (shifted) {
+			// The reductions that push does in settle, before it asks for the next token
+			if (state == YYFINAL || !yypact_value_is_default(yypact[state])) return true;
+			rule = yydefact[state];
+		}
+		else {
+			int n = yypact[state];
+			if (yypact_value_is_default(n) || (n += symbol) < 0 || YYLAST < n || yycheck[n] != symbol) {
+				rule = yydefact[state];
+			}
+			else if (yytable[n] > 0) {
+				overlay[size++] = yytable[n];
+				shifted = true;
+				continue;
+			}
+			else if (yytable_value_is_error(yytable[n])) {
+				return false;
+			}
+			else {
+				rule = -yytable[n];
+			}
+		}
+		if (rule == 0) return false;
+
+		size_t length = yyr2[rule];
+		size_t from_overlay = std::min(length, size);
+		size -= from_overlay;
+		depth -= length - from_overlay;
+		overlay[size++] = goto_state(top(), yyr1[rule]);
+	}
+	Parser_tracker copy = only_states();
+	return copy.push(kind);
+}
+
+bool grammar::Parser_tracker::accepts() const {
+	// Only the state in which the parser has the whole line shifts the end of the input
+	return can_push(ENDFILE);
+}
+
+void grammar::Parser_tracker::next_kinds(std::vector<int>& out_kinds) const {
+	out_kinds.clear();
+	if (accepts()) out_kinds.push_back(ENDFILE);
+	// Symbols 0 to 2 are the end of the input, "error" and the numbers that are no token
+	for (int kind = 1; kind <= YYMAXUTOK; ++kind) {
+		if (YYTRANSLATE(kind) > 2 && can_push(kind)) out_kinds.push_back(kind);
+	}
+}
+
+void grammar::Parser_tracker::possible_kinds(int state, std::vector<int>& out_kinds) {
+	// The symbols that the parser shifts in a state are possible there. A symbol that it reduces a
+	// rule on is possible if it is possible in the state that the reduction leads to from one of the
+	// states that can lie as many entries below on the stack as the rule has symbols. Repeated until
+	// nothing changes, once.
+	static const std::vector<std::vector<int>> kinds = [] {
+		// The states a state can lie on: the ones with a transition to it on its accessing symbol.
+		// A state without a goto on a nonterminal seems to have the default one, which only makes
+		// the result larger.
+		std::vector<std::vector<int>> below(YYNSTATES);
+		for (int state = 0; state < YYNSTATES; ++state) {
+			for (int to = 0; to < YYNSTATES; ++to) {
+				int symbol = yystos[to];
+				if (to != 0 && (symbol < YYNTOKENS ? action(state, symbol) == to : goto_state(state, symbol) == to)) {
+					below[to].push_back(state);
+				}
+			}
+		}
+
+		std::vector<std::vector<bool>> possible(YYNSTATES, std::vector<bool>(YYNTOKENS, false));
+		for (int state = 0; state < YYNSTATES; ++state) {
+			for (int symbol = 0; symbol < YYNTOKENS; ++symbol) {
+				possible[state][symbol] = action(state, symbol) > 0;
+			}
+		}
+		std::vector<bool> deeper(YYNSTATES);
+		for (bool changed = true; changed;) {
+			changed = false;
+			for (int state = 0; state < YYNSTATES; ++state) {
+				for (int symbol = 0; symbol < YYNTOKENS; ++symbol) {
+					int rule = -action(state, symbol);
+					if (possible[state][symbol] || rule <= 0) continue;
+					std::vector<bool> depth(YYNSTATES, false);
+					depth[state] = true;
+					for (int i = 0; i < yyr2[rule]; ++i) {
+						deeper.assign(YYNSTATES, false);
+						for (int from = 0; from < YYNSTATES; ++from) {
+							if (!depth[from]) continue;
+							for (int to : below[from]) deeper[to] = true;
+						}
+						depth.swap(deeper);
+					}
+					for (int from = 0; from < YYNSTATES && !possible[state][symbol]; ++from) {
+						if (depth[from] && possible[goto_state(from, yyr1[rule])][symbol]) {
+							possible[state][symbol] = changed = true;
+						}
+					}
+				}
+			}
+		}
+
+		std::vector<std::vector<int>> kinds(YYNSTATES);
+		for (int state = 0; state < YYNSTATES; ++state) {
+			if (possible[state][YYTRANSLATE(ENDFILE)]) kinds[state].push_back(ENDFILE);
+			// Symbols 0 to 2 are the end of the input, "error" and the numbers that are no token
+			for (int kind = 1; kind <= YYMAXUTOK; ++kind) {
+				if (YYTRANSLATE(kind) > 2 && possible[state][YYTRANSLATE(kind)]) kinds[state].push_back(kind);
+			}
+		}
+		return kinds;
+	}();
+	if (state < 0 || state >= YYNSTATES) out_kinds.clear();
+	else out_kinds = kinds[state];
+}
+
+grammar::Parser_tracker grammar::Parser_tracker::only_states() const {
+	Parser_tracker result;
+	result.stack = stack;
+	result.states_only = true;
+	return result;
+}
+
+bool grammar::Parser_tracker::completion(size_t max_tokens, std::vector<int>& out_kinds) const {
+	static constexpr int COMPLETING_KINDS[] = {LETTER, END, OVER, OF, TO, FROM, CLOSE, PARENTHESIS};
+	struct Node {
+		Parser_tracker tracker;
+		size_t parent; // The node it was pushed after
+		int kind;      // The token pushed
+		size_t length; // The number of tokens pushed
+	};
+
+	// Breadth-first, so the first sequence found is a shortest one. What the parser does next
+	// depends only on the states on its stack, so every stack is expanded once.
+	auto same_states = [](const Parser_tracker& a, const Parser_tracker& b) {
+		return std::equal(a.stack.begin(), a.stack.end(), b.stack.begin(), b.stack.end(), [](const Entry& x, const Entry& y) {
+			return x.state == y.state;
+		});
+	};
+	std::vector<Node> queue;
+	queue.reserve(32);
+	queue.push_back({only_states(), 0, 0, 0});
+	for (size_t i = 0; i < queue.size(); ++i) {
+		if (queue[i].tracker.accepts()) {
+			out_kinds.resize(queue[i].length);
+			for (size_t node = i; node != 0; node = queue[node].parent) {
+				out_kinds[queue[node].length - 1] = queue[node].kind;
+			}
+			return true;
+		}
+		if (queue[i].length == max_tokens) continue;
+		for (int kind : COMPLETING_KINDS) {
+			if (!queue[i].tracker.can_push(kind)) continue;
+			Parser_tracker next = queue[i].tracker;
+			if (!next.push(kind)) continue;
+			bool seen = std::any_of(queue.begin(), queue.end(), [&](const Node& node) {
+				return same_states(node.tracker, next);
+			});
+			if (!seen) queue.push_back({std::move(next), i, kind, queue[i].length + 1});
+		}
+	}
+	return false;
 }
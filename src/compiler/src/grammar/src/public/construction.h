@@ -9,21 +9,27 @@
 // Data enums
 //==================================================================================================
 
+// Every enum of a construction ends with Last, which the serialization of syntax trees uses to
+// reject unknown values. Keep it at the end when adding a value.
+
 enum class Typesetting_type {
 	Bold,
 	Calligraphic,
-	Fraktur
+	Fraktur,
+	Last = Fraktur
 };
 
 enum class Accent_type {
 	Tilde,
 	Hat,
-	Bar
+	Bar,
+	Last = Bar
 };
 
 enum class Special_symbol_type {
 	Empty_set,
-	Infinity
+	Infinity,
+	Last = Infinity
 };
 
 enum class Unop_type {
@@ -36,7 +42,8 @@ enum class Unop_type {
 	Negate,
 	For_all,
 	Exists, 
-	Minus
+	Minus,
+	Last = Minus
 };
 
 enum class Binop_type {
@@ -60,13 +67,15 @@ enum class Binop_type {
 	Intersection,
 	Set_minus,
 	Subset,
-	In
+	In,
+	Last = In
 };
 
 enum class Rangeop_type {
 	Sum,
 	Product,
-	Integral
+	Integral,
+	Last = Integral
 };
 
 //==================================================================================================
@@ -102,7 +111,8 @@ struct Construction {
 		Typesetting,
 		Letter,
 		Greek_symbol,
-		Digit
+		Digit,
+		Last = Digit
 	};
 	using Data = std::variant<
 		Typesetting_type,
@@ -119,6 +129,14 @@ struct Construction {
 	std::optional<Data> data;
 	Construction(Type type = Type::Digit) : type(type) {}
 	Construction(Type type, const Data& data) : type(type), data(data) {}
+
+	friend bool operator==(const Construction& l, const Construction& r) {
+		return l.type == r.type && l.data == r.data;
+	}
+
+	friend bool operator!=(const Construction& l, const Construction& r) {
+		return !(l == r);
+	}
 };
 
 //==================================================================================================
@@ -3,11 +3,23 @@
 #ifndef GRAMMAR_H
 #define GRAMMAR_H
 
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <syntax_tree.h>
 #include <syntax_visitor.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace grammar {
+	/** The number of NUL bytes the scanner needs after the text it scans in place */
+	inline constexpr size_t SCAN_PADDING = 2;
+
 	/**
 	 * Generates [SyntaxTree] from an input string
 	 * @param input the inputstring
@@ -16,6 +28,132 @@ namespace grammar {
 	int generate_from_string(
 		const std::string& input, Syntax_visitor& syntax_visitor
 	);
+
+	/**
+	 * Generates [SyntaxTree] from the [length] characters at [text], scanning them in place.
+	 * [text] must lie in a writable buffer that ends at [buffer_end]. The SCAN_PADDING bytes after
+	 * the text are overwritten with NUL bytes during the parse and restored afterwards. Only if the
+	 * buffer ends before those bytes, the text is copied into a padded buffer instead.
+	 * @return the returncode
+	 */
+	int generate_from_buffer(
+		char* text, size_t length, const char* buffer_end, Syntax_visitor& syntax_visitor
+	);
+
+	/**
+	 * Scans the [length] characters at [text] in place, like generate_from_buffer, without parsing
+	 * them. Appends the bison token number of every token to [out_tokens], not including the token
+	 * for the end of the input.
+	 */
+	void tokenize(
+		char* text, size_t length, const char* buffer_end, std::vector<int>& out_tokens
+	);
+
+	/** A token of a line, with its value and its place in the line */
+	struct Token {
+		int kind = 0;        // Its bison token number, as tokenize gives; 0 for the end of the input
+		char letter = '\0';  // The letter of a LETTER, e.g. 'A' for "capital a"
+		std::string phrase;  // The word of a GREEK or DIGIT, e.g. "alpha"
+		uint32_t begin = 0;  // Its characters in the line are [begin, end)
+		uint32_t end = 0;
+
+		/** Whether the parser sees [other] as the same token, wherever it is */
+		bool same_as(const Token& other) const {
+			return kind == other.kind && letter == other.letter && phrase == other.phrase;
+		}
+	};
+
+	/**
+	 * Scans the [length] characters at [text] in place, like tokenize, but appends the tokens with
+	 * their values and places to [out_tokens]. The places are relative to [text].
+	 */
+	void scan_tokens(
+		char* text, size_t length, const char* buffer_end, std::vector<Token>& out_tokens
+	);
+
+	/** Gives the parser tokens that were scanned before, instead of the scanner (see parse_tokens) */
+	class Token_reader {
+	public:
+		virtual ~Token_reader() = default;
+
+		/** Returns the next token of the input, and a token of kind 0 at its end */
+		virtual const Token& next() = 0;
+
+		/**
+		 * Called with every expression (anyexpr or openexpr in compiler.y) that the parser
+		 * completes, innermost first. If it returns true, the parse stops right away and succeeds,
+		 * without a syntax tree. [expression] may then be moved from.
+		 */
+		virtual bool on_expression(Syntax_tree& expression) = 0;
+
+		/** Whether syntax errors are logged to the logger of the Syntax_visitor */
+		virtual bool log_errors() const {
+			return true;
+		}
+	};
+
+	/**
+	 * Generates [SyntaxTree] from the tokens of [reader], like generate_from_buffer does from text,
+	 * except that the error_offset of [syntax_visitor] is not set.
+	 * @return the returncode
+	 */
+	int parse_tokens(Token_reader& reader, Syntax_visitor& syntax_visitor);
+
+	/**
+	 * Returns the name of bison token number [token] as it is declared in compiler.y, e.g. "B_PLUS"
+	 * for the numbers that tokenize gives.
+	 */
+	const char* token_name(int token);
+
+	/**
+	 * Returns a copy of [input] followed by SCAN_PADDING NUL bytes, so that all of its lines can be
+	 * scanned in place with generate_from_buffer.
+	 */
+	inline std::string padded_copy(std::string_view input) {
+		std::string result;
+		result.reserve(input.size() + SCAN_PADDING);
+		result.append(input);
+		result.append(SCAN_PADDING, '\0');
+		return result;
+	}
+
+	/**
+	 * Calls [on_line](char* line, size_t length) for every line of the [size] characters at [text],
+	 * without the line terminator. A final line without terminator is included if it is non-empty.
+	 * Nothing is copied. [on_line] may temporarily modify the text after the line it is given, as
+	 * generate_from_buffer does, as long as it restores it before returning.
+	 *
+	 * Newlines are searched for 16 bytes at a time with SSE2 where available, which is faster than
+	 * calling memchr per line for the short lines we usually get. The tail is searched with memchr.
+	 */
+	template<typename Line_callback>
+	void for_each_line(char* text, size_t size, Line_callback on_line) {
+		char* end = text + size;
+		char* line = text; // Start of the current line
+		char* pos = text;  // Everything before [pos] has been searched
+#ifdef __SSE2__
+		const __m128i newlines = _mm_set1_epi8('\n');
+		for (; end - pos >= 16; pos += 16) {
+			__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+			auto mask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newlines)));
+			while (mask != 0) {
+				char* newline = pos + __builtin_ctz(mask);
+				on_line(line, static_cast<size_t>(newline - line));
+				line = newline + 1;
+				mask &= mask - 1;
+			}
+		}
+#endif
+		while (pos != end) {
+			auto newline = static_cast<char*>(std::memchr(pos, '\n', end - pos));
+			if (!newline) break;
+			on_line(line, static_cast<size_t>(newline - line));
+			line = pos = newline + 1;
+		}
+		if (line != end) {
+			on_line(line, static_cast<size_t>(end - line));
+		}
+	}
 }
 
 #endif
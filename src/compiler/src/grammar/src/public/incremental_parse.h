@@ -0,0 +1,258 @@
+/* Reparsing of lines after token edits, reusing the parts of the syntax tree the edit leaves alone */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "grammar.h"
+#include "logger.h"
+#include "syntax_tree.h"
+
+namespace grammar {
+
+/**
+ * Whether child [index] of the node [parent] is an expression (anyexpr or openexpr in compiler.y).
+ * The expressions of a tree are its root and these children, at any depth.
+ */
+bool is_expression_child(Syntax_tree::const_traverser parent, size_t index);
+
+/**
+ * Follows the parser of compiler.y through a sequence of tokens, state by state, without building
+ * anything. It records where the parser completes expressions (anyexpr and openexpr in compiler.y),
+ * and in which state the parser was when it asked for their first token.
+ *
+ * The parser is deterministic: from the same state, the same tokens make it build the same
+ * expression, as long as it does not reduce a rule that begins before that expression. This is what
+ * makes reparsing a single expression of a line possible.
+ */
+class Parser_tracker {
+public:
+	/** An expression that the parser completed */
+	struct Expression {
+		uint32_t begin; // The expression consists of the tokens [begin, end)
+		uint32_t end;
+		int state;      // The state of the parser when it asked for token [begin]
+		bool open;      // Whether it is an openexpr rather than an anyexpr
+	};
+
+	/** Starts before the first token of a line */
+	Parser_tracker();
+
+	/**
+	 * Gives the next token, of bison token number [kind], to the parser: performs the reductions it
+	 * triggers, shifts it, and performs the reductions the parser does before it asks for the next
+	 * token. Returns false if the parser finds a syntax error.
+	 */
+	bool push(int kind);
+
+	/** The state in which the parser asks for the next token */
+	int state() const;
+
+	/** The number of states of the parser; every state() is less */
+	static int state_count();
+
+	/** The number of tokens pushed */
+	size_t position() const;
+
+	/** The expressions that the parser completed, in the order it completed them */
+	const std::vector<Expression>& expressions() const {
+		return completed;
+	}
+
+	/**
+	 * From now on, notes when the parser first reduces a rule that begins before token [position].
+	 * What the parser does from then on depends on the tokens before [position].
+	 */
+	void watch(size_t position);
+
+	/** The number of expressions that were completed when that happened; SIZE_MAX if it did not */
+	size_t expressions_before_watched() const {
+		return watched_expressions;
+	}
+
+	/**
+	 * Sets [out_kinds] to the shortest sequence of tokens after which the parser asks for the next
+	 * token in [state]. Returns false if there is none.
+	 */
+	static bool path_to(int state, std::vector<int>& out_kinds);
+
+	/**
+	 * Sets [out_kinds] to a shortest sequence of tokens after which the parser accepts the line, if
+	 * the input ends there. Only tokens that close a construction (like OVER, CLOSE PARENTHESIS and
+	 * END) and LETTER, for a missing operand, are tried. Returns false if there is no such sequence of
+	 * at most [max_tokens] tokens.
+	 */
+	bool completion(size_t max_tokens, std::vector<int>& out_kinds) const;
+
+	/**
+	 * Whether push(kind) would succeed, without changing or copying the tracker. Because the
+	 * parser finds a syntax error at the first token that no line can continue with, this is whether
+	 * the tokens pushed and [kind] can still become a line.
+	 */
+	bool can_push(int kind) const;
+
+	/** Whether the parser accepts the line if the input ends after the tokens pushed */
+	bool accepts() const;
+
+	/**
+	 * Sets [out_kinds] to the bison token numbers of the tokens that the parser accepts next, in
+	 * increasing order, starting with 0 if it accepts the end of the input.
+	 */
+	void next_kinds(std::vector<int>& out_kinds) const;
+
+	/**
+	 * Sets [out_kinds] to the bison token numbers of the tokens that the parser may accept next when
+	 * it asks for a token in [state], after some tokens, in increasing order like next_kinds. The
+	 * parser reduces some rules whatever the next token is, so what it accepts depends on the states
+	 * below [state] as well; this is every token that it accepts for some stack, and possibly a few
+	 * more. Computed for all states once, from the tables of the parser.
+	 */
+	static void possible_kinds(int state, std::vector<int>& out_kinds);
+
+	/**
+	 * A copy that follows only the states of the parser, which is cheaper to copy and push tokens
+	 * to. It records neither the tokens nor the expressions, so its position() stays 0.
+	 */
+	Parser_tracker only_states() const;
+
+private:
+	struct Entry {
+		int state;
+		uint32_t begin; // The first token of the symbol that led to [state]
+	};
+
+	/** Performs the reductions the parser does without looking at the next token */
+	bool settle();
+
+	/** Reduces [rule], whose last token is the one before token [position] */
+	void reduce(int rule, size_t position);
+
+	std::vector<Entry> stack;
+	std::vector<int> token_states; // The state in which the parser asked for each token
+	std::vector<Expression> completed;
+	size_t watched_position = 0;
+	size_t watched_expressions = SIZE_MAX;
+	bool states_only = false;
+};
+
+/**
+ * A line together with its tokens and its syntax tree, which can be edited token by token.
+ *
+ * An edit scans only the edited text and its neighbouring tokens, and reparses only the innermost
+ * expression around the edited tokens that the parser can reparse on its own: one that it starts
+ * from the same state, and completes before the same next token. The rest of the syntax tree is
+ * kept as it is. The result is the same as parsing the edited line from scratch.
+ */
+class Incremental_parse {
+public:
+	/**
+	 * An expression of the line (anyexpr or openexpr in compiler.y). An anyexpr that is an openexpr
+	 * comes right before that openexpr, with the same tokens and node.
+	 */
+	struct Expression {
+		uint32_t begin; // The expression consists of the tokens [begin, end)
+		uint32_t end;
+		int state;      // The state of the parser when it asked for token [begin]; -1 if unknown
+		bool open;      // Whether it is an openexpr rather than an anyexpr
+		Syntax_tree::const_traverser node; // The root of the expression in the syntax tree
+	};
+
+	/** Which expressions the last parse or edit replaced */
+	struct Change {
+		bool whole_line = true; // Whether the line was parsed from scratch
+		size_t first = 0;       // Expressions [first, first + removed) were replaced...
+		size_t removed = 0;
+		size_t added = 0;       // ...by [first, first + added)
+	};
+
+	/** Logs syntax errors to [logger] */
+	explicit Incremental_parse(Logger& logger);
+
+	Incremental_parse(const Incremental_parse&) = delete;
+	Incremental_parse& operator=(const Incremental_parse&) = delete;
+
+	/**
+	 * Scans and parses [line] from scratch.
+	 * @return the returncode, like generate_from_string
+	 */
+	int parse(std::string_view line);
+
+	/**
+	 * Replaces the tokens [first, last) of the line by the text [replacement], which may contain any
+	 * number of tokens, and parses the result. [first] == [last] inserts before token [first].
+	 * @return the returncode, like generate_from_string
+	 */
+	int edit(size_t first, size_t last, std::string_view replacement);
+
+	const std::string& line() const {
+		return text;
+	}
+
+	const std::vector<Token>& tokens() const {
+		return line_tokens;
+	}
+
+	/** Whether the line parses */
+	bool success() const {
+		return parsed;
+	}
+
+	/** Empty if the line does not parse */
+	const Syntax_tree& syntax_tree() const {
+		return tree;
+	}
+
+	/** The expressions of the syntax tree, in pre-order: outer ones first. Empty on failure. */
+	const std::vector<Expression>& expressions() const {
+		return line_expressions;
+	}
+
+	const Change& last_change() const {
+		return change;
+	}
+
+	/** Where the parser found a syntax error, as an offset in characters; only set on failure */
+	size_t error_offset() const {
+		return failure_offset;
+	}
+
+private:
+	/** Parses the tokens of the line from scratch */
+	int parse_from_scratch();
+
+	/**
+	 * Parses the line after the tokens [first, old_last) were replaced by [first, new_last),
+	 * reparsing as little as possible
+	 */
+	int reparse(size_t first, size_t old_last, size_t new_last);
+
+	/**
+	 * Tries to reparse only expression [index], which spans [delta] tokens more than before. Returns
+	 * false if the parser would not reparse it on its own.
+	 */
+	bool reparse_expression(size_t index, std::ptrdiff_t delta);
+
+	/** Returns the indices of the children to go to from the root to the node of expression [index] */
+	std::vector<size_t> node_path(size_t index) const;
+
+	/**
+	 * Sets the nodes of the expressions from [first] on to the expressions in the subtree at
+	 * [root], in pre-order. Returns the index after the last one.
+	 */
+	size_t find_nodes(Syntax_tree::const_traverser root, size_t first);
+
+	Logger& logger;
+	std::string text;
+	std::vector<Token> line_tokens;
+	bool parsed = false;
+	Syntax_tree tree;
+	std::vector<Expression> line_expressions;
+	Change change;
+	size_t failure_offset = 0;
+};
+
+} // namespace grammar
@@ -0,0 +1,81 @@
+/* The words of a speech recognizer that the parser may accept next, in each of its states */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "grammar.h"
+#include "incremental_parse.h"
+
+namespace grammar {
+
+/**
+ * For every state of the parser of compiler.y, the words of a vocabulary that it may accept next,
+ * as a row of bits, so that a speech recognizer can drop or lower the hypotheses that the grammar
+ * rules out while it decodes.
+ *
+ * A word is any text the scanner turns into tokens, typically a spelling of a token in compiler.l
+ * like "x", "capital a" or "less equal". The parser may accept it next in a state if it may accept
+ * its first token there (see Parser_tracker::possible_kinds). This depends only on the state, so the
+ * rows are computed once, and a lookup takes constant time. The rows are exact for the words that
+ * the parser accepts in one state after every line that leads to it, and have the others too: a word
+ * that is in the row may still make the line dead, which Prefix_oracle tells exactly.
+ */
+class Next_word_table {
+public:
+	/** A part of a row, with the bits of BLOCK_BITS words */
+	using Block = uint64_t;
+	static constexpr size_t BLOCK_BITS = 64;
+
+	/** Scans each of [words] into its tokens, and computes the rows of all states */
+	explicit Next_word_table(std::vector<std::string> words);
+
+	/** The number of words */
+	size_t size() const {
+		return vocabulary.size();
+	}
+
+	const std::string& word(size_t index) const {
+		return vocabulary[index];
+	}
+
+	/** The bison token number of the first token of word [index]; -1 if it has none */
+	int kind(size_t index) const {
+		return first_kinds[index];
+	}
+
+	/** The number of blocks in a row */
+	size_t row_size() const {
+		return blocks;
+	}
+
+	/**
+	 * The row of [state], as in Parser_tracker::state(): bit i % BLOCK_BITS of block i / BLOCK_BITS
+	 * is set if the parser may accept word i next. All bits are clear for -1, the state of a dead
+	 * prefix (see Prefix_oracle::state), and for other numbers that are no state.
+	 */
+	const Block* row(int state) const {
+		size_t index = state >= 0 && state < states ? static_cast<size_t>(state) : static_cast<size_t>(states);
+		return &bits[index * blocks];
+	}
+
+	/** Whether the parser may accept word [index] next in [state] */
+	bool allows(int state, size_t index) const {
+		return (row(state)[index / BLOCK_BITS] >> (index % BLOCK_BITS)) & 1;
+	}
+
+	/** Sets [out_indices] to the indices of the words that the parser may accept next in [state] */
+	void allowed(int state, std::vector<size_t>& out_indices) const;
+
+private:
+	std::vector<std::string> vocabulary;
+	std::vector<int> first_kinds;
+	int states;
+	size_t blocks;
+	std::vector<Block> bits; // The rows of the states, and a clear one for the rest
+};
+
+} // namespace grammar
@@ -0,0 +1,82 @@
+/* Whether the tokens of a line so far can still become a line, as they arrive */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "grammar.h"
+#include "incremental_parse.h"
+
+namespace grammar {
+
+/** What the tokens of a line so far are to the parser */
+enum class Prefix_status {
+	VIABLE,   // Not a line yet, but more tokens can make one of it
+	COMPLETE, // A line; more tokens may still extend it
+	DEAD      // No tokens can make a line of it
+};
+
+/** The name of [status], e.g. "viable" */
+const char* to_string(Prefix_status status);
+
+/**
+ * Tells, token by token, whether the tokens of a line so far can still become a line, using the
+ * tables of the parser of compiler.y (see Parser_tracker). The parser finds a syntax error at the
+ * first token that no line can continue with, so every prefix it takes without error is viable. A
+ * token takes amortized constant time, so a prefix takes time linear in its length.
+ *
+ * A speech front end can end an utterance as soon as it is complete, instead of waiting for the
+ * silence after it, and drop one that is dead.
+ */
+class Prefix_oracle {
+public:
+	/** Starts before the first token of a line */
+	Prefix_oracle();
+
+	/** Gives the next token, of bison token number [kind]. Returns the status after it. */
+	Prefix_status push(int kind);
+
+	Prefix_status status() const {
+		return current;
+	}
+
+	/** The state in which the parser asks for the next token (see Parser_tracker); -1 if dead */
+	int state() const {
+		return current == Prefix_status::DEAD ? -1 : tracker.state();
+	}
+
+	/** The number of tokens pushed */
+	size_t position() const {
+		return pushed;
+	}
+
+	/** The index of the token that made the prefix dead; SIZE_MAX if it is not dead */
+	size_t dead_at() const {
+		return dead_token;
+	}
+
+	/**
+	 * Sets [out_kinds] to the bison token numbers of the tokens that keep the prefix viable, in
+	 * increasing order, starting with 0 (the end of the input) if it is complete. Empty if it is dead.
+	 */
+	void next_kinds(std::vector<int>& out_kinds) const;
+
+	/** Starts over, before the first token of a line */
+	void reset();
+
+private:
+	Parser_tracker tracker; // Of the tokens before the dead one
+	Prefix_status current;
+	size_t pushed = 0;
+	size_t dead_token = SIZE_MAX;
+};
+
+/**
+ * Returns the status of the [count] tokens at [tokens] as the start of a line (see Prefix_oracle),
+ * and sets [out_next_kinds], if given, to the kinds of the tokens that keep it viable.
+ */
+Prefix_status check_prefix(const Token* tokens, size_t count, std::vector<int>* out_next_kinds = nullptr);
+
+} // namespace grammar
@@ -0,0 +1,15 @@
+/* Example inputs that together cover most of the grammar, for tests and benchmarks */
+
+#pragma once
+
+namespace grammar {
+	inline constexpr const char* SAMPLE_INPUTS[] = {
+		"b", "calligraphic b", "b tilde", "bold b hat", "capital a", "bold capital a hat",
+		"alpha", "alpha tilde", "four", "empty set", "infinity", "fraction alpha over beta",
+		"sin of capital d", "for all alpha tilde", "minus x", "function capital f from capital a to capital b",
+		"function capital f from capital a to capital b maps alpha to beta", "a plus b", "sin of cos of a",
+		"function f from capital a to capital b maps for all x to sin of fraction x over alpha",
+		"fraction b over c plus d", "fraction b over c end plus d", "a not equal b",
+		"sum from x equal zero to infinity x power two", "open parenthesis x plus two close parenthesis"
+	};
+}
@@ -0,0 +1,94 @@
+/* Parsing of the tokens of a speech recognizer, with breaks where the speaker pauses */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "grammar.h"
+#include "syntax_visitor.h"
+
+namespace grammar {
+
+/** A token of a speech recognizer and when it was spoken, like the TokenMetadata of DeepSpeech */
+struct Recognized_token {
+	const char* text;  // A character or a word; " " separates words
+	double start_time; // In seconds from the start of the utterance
+};
+
+/**
+ * Decides which pauses of a speaker between words are breaks, that end an expression like the word
+ * "end" does.
+ *
+ * A pause is the time from the last token before a space to the space, as talktex.py measures it.
+ * Some speakers pause longer between words than others, so a fixed threshold either misses the
+ * breaks of fast speakers or breaks up the expressions of slow ones. The model keeps an
+ * exponentially weighted mean and variance of the logarithm of the pauses that were not breaks,
+ * over about the last RATE_WINDOW of them, and takes a pause for a break if it is more than
+ * DEVIATIONS standard deviations, and MIN_RATIO times, longer than a typical one. It starts as if it
+ * had seen PRIOR_PAUSES pauses that make the initial threshold, so that a few pauses do not move it
+ * much, and it stays within a factor of RANGE of the initial threshold.
+ */
+class Pause_model {
+public:
+	static constexpr double PRIOR_PAUSES = 8;
+	static constexpr double PRIOR_DEVIATION = 0.5; // Of the logarithm of the pauses
+	static constexpr double RATE_WINDOW = 32;
+	static constexpr double DEVIATIONS = 3;
+	static constexpr double MIN_RATIO = 2;
+	static constexpr double RANGE = 4;
+
+	/** Starts with pauses of more than [initial_threshold] seconds as breaks */
+	explicit Pause_model(double initial_threshold = 1.0);
+
+	/** Whether a pause of [seconds] is a break. Learns from it if it is not. */
+	bool is_break(double seconds);
+
+	/** Pauses of more than this many seconds are breaks */
+	double threshold() const;
+
+	/** The number of pauses that were not breaks */
+	size_t pauses() const {
+		return count;
+	}
+
+private:
+	// All in logarithms of seconds, so that a pause takes one logarithm and one square root
+	double min_threshold;
+	double max_threshold;
+	double log_threshold;
+	double mean;
+	double variance;
+	size_t count = 0;
+};
+
+/** An utterance of a speech recognizer, scanned into the tokens of the parser */
+struct Spoken_line {
+	/** Its words, with the word "end" at every break, like talktex.py makes them */
+	std::string text;
+
+	/** The tokens of [text] for the parser; every break is an END token */
+	std::vector<Token> tokens;
+
+	/** The number of breaks */
+	size_t breaks = 0;
+};
+
+/**
+ * Sets [out_line] to the [count] recognized tokens at [tokens], with breaks at the pauses that
+ * [pauses] takes for breaks. Its text is scanned once, into the tokens that the parser gets.
+ */
+void read_spoken_line(
+	const Recognized_token* tokens, size_t count, Pause_model& pauses, Spoken_line& out_line
+);
+
+/**
+ * Generates [SyntaxTree] from the [count] tokens at [tokens], e.g. a part of the tokens of a
+ * Spoken_line, like generate_from_buffer does from their text. The error_offset of [syntax_visitor]
+ * is set to the place of the token the parser could not handle.
+ * @return the returncode
+ */
+int parse_token_list(const Token* tokens, size_t count, Syntax_visitor& syntax_visitor);
+
+} // namespace grammar
@@ -1,9 +1,16 @@
 #pragma once
 
+#include <type_traits>
 #include <utility>
+#include <vector>
 #include "avds/tree/tree.h"
 #include "construction.h"
+#include "stats.h"
 
+/**
+ * A tree of Constructions. Copying a Syntax_tree is O(1): copies share their nodes, and modifying
+ * one only copies the nodes on the path to the modified node.
+ */
 class Syntax_tree {
 public:
 	using const_traverser = avds::tree::Tree<Construction>::const_traverser;
@@ -12,12 +19,23 @@ public:
 	Syntax_tree(const Construction& construction);
 
 	/** Constructs the root Construction object in-place using [args] */
-	template<typename... Args>
+	template<
+		typename... Args,
+		typename = std::enable_if_t<!avds::tree::detail::is_self_v<Syntax_tree, Args...>>
+	>
 	Syntax_tree(Args&&... args);
 
 	/** The tree may not be empty */
 	const_traverser append_subtree(Syntax_tree&& subtree);
 
+	/**
+	 * Puts [subtree] in place of the subtree at [path], the indices of the children to go to from
+	 * the root, and returns a traverser to it. Only the nodes on the path are visited. Traversers
+	 * to the other nodes stay valid, unless this tree shared nodes on the path with a copy, in
+	 * which case [copied] is set (see avds::tree::Tree::traverser_at).
+	 */
+	const_traverser replace_subtree(const std::vector<size_t>& path, Syntax_tree&& subtree, bool& copied);
+
 	const_traverser entrance()  const noexcept;
 	const_traverser centrance() const noexcept;
 
@@ -25,5 +43,7 @@ private:
 	avds::tree::Tree<Construction> tree;
 };
 
-template<typename... Args>
-Syntax_tree::Syntax_tree(Args&&... args) : tree(std::forward<Args>(args)...) {}
+template<typename... Args, typename>
+Syntax_tree::Syntax_tree(Args&&... args) : tree(std::forward<Args>(args)...) {
+	stats::count(stats::TREE_NODES);
+}
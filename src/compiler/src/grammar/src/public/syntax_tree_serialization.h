@@ -0,0 +1,144 @@
+/* Compact binary encoding of syntax trees, readable in place (e.g. from a memory-mapped file) */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "construction.h"
+#include "syntax_tree.h"
+
+/*
+	Encoding
+
+	All integers are unsigned LEB128 varints. A node is encoded in preorder as
+
+		tag             (type << 4) | data kind, where data kind 0 means "no data" and data kind
+		                k > 0 means alternative k-1 of Construction::Data
+		payload         only present if the node has data: a varint for the enum alternatives,
+		                a varint length followed by the bytes for std::string, one byte for char
+		child count
+		children size   the total number of bytes of the encoded children, so that readers can
+		                skip a subtree without looking at it
+		children        the encoded children, in order
+
+	An archive is the 8 byte ARCHIVE_MAGIC followed by any number of records. Each record is a
+	varint byte length followed by one encoded tree (zero bytes for an empty tree).
+*/
+
+namespace serialization {
+
+/** The first bytes of every syntax tree archive. The last byte is the format version. */
+inline constexpr std::string_view ARCHIVE_MAGIC{"TTXTREE\x01", 8};
+
+//==================================================================================================
+// Writing
+//==================================================================================================
+
+/** Appends the encoding of the tree that [t] points to to [out]. [t] must be valid. */
+void encode_tree(Syntax_tree::const_traverser t, std::string& out);
+
+/** Appends one archive record containing [tree] to [out]. The tree may be empty. */
+void encode_record(const Syntax_tree& tree, std::string& out);
+
+/** Writes a syntax tree archive to a stream: the magic on construction, then one record per tree */
+class Archive_writer {
+public:
+	explicit Archive_writer(std::ostream& os);
+
+	void write(const Syntax_tree& tree);
+
+private:
+	std::ostream& os;
+	std::string buffer; // Reused between writes
+};
+
+//==================================================================================================
+// Reading
+//==================================================================================================
+
+/**
+ * A view of one encoded node and, through it, of its whole subtree. Reading a node only decodes
+ * its header; nothing is copied out of the underlying buffer unless asked for.
+ * Node_view objects are only valid as long as the underlying buffer is.
+ *
+ * Malformed input causes std::runtime_error to be thrown.
+ */
+class Node_view {
+public:
+	/** Decodes the node header at [begin]. The node and its subtree must lie before [end]. */
+	Node_view(const char* begin, const char* end);
+
+	Construction::Type type() const noexcept;
+
+	bool has_data() const noexcept;
+
+	/** Returns the string payload without copying it. The node must have std::string data. */
+	std::string_view string_data() const;
+
+	/** Returns the Construction stored in this node (but not its subtree) */
+	Construction construction() const;
+
+	size_t child_count() const noexcept;
+
+	bool is_leaf() const noexcept;
+
+	/** Returns the first child. The node may not be a leaf. */
+	Node_view first_child() const;
+
+	/**
+	 * Returns the next sibling of this node. [parent] must be the parent of this node and this node
+	 * may not be its last child.
+	 */
+	Node_view next_sibling(const Node_view& parent) const;
+
+	/** Returns the child with the given index, skipping over the subtrees of its older siblings */
+	Node_view child(size_t child_index) const;
+
+	/** Returns a pointer one past the last byte of this node's subtree */
+	const char* subtree_end() const noexcept;
+
+private:
+	const char* payload;
+	const char* children_begin;
+	const char* children_end;
+	Construction::Type node_type;
+	uint8_t data_kind;
+	uint64_t payload_value; // Enum value, string length or char, depending on data_kind
+	size_t children;
+};
+
+/** Reads records from a syntax tree archive in place */
+class Archive_reader {
+public:
+	/**
+	 * Creates a reader for the archive of [size] bytes at [data].
+	 * If the archive does not start with ARCHIVE_MAGIC, is_valid() returns false.
+	 */
+	Archive_reader(const char* data, size_t size);
+
+	bool is_valid() const noexcept;
+
+	/** Returns whether there are more records to read */
+	bool has_next() const noexcept;
+
+	/**
+	 * Reads the next record and returns the root of its tree, or an empty optional if the tree is
+	 * empty. There must be a next record.
+	 */
+	std::optional<Node_view> next();
+
+private:
+	const char* pos;
+	const char* end;
+	bool valid;
+};
+
+/** Copies the subtree that [node] points to into a Syntax_tree */
+Syntax_tree to_syntax_tree(const Node_view& node);
+
+} // namespace serialization
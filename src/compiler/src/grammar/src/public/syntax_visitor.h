@@ -3,6 +3,8 @@
 #ifndef SYNTAXVISITOR_H
 #define SYNTAXVISITOR_H
 
+#include <cstddef>
+
 #include <logger.h>
 #include <syntax_tree.h>
 
@@ -15,6 +17,10 @@ public:
 	Logger& logger;
 
 	Syntax_tree syntax_tree;
+
+	// Where the parser found a syntax error in its input, as an offset in characters
+	// Only set when parsing fails
+	size_t error_offset = 0;
 };
 
 #endif
@@ -0,0 +1,113 @@
+/* Tests of the decoding of syntax tree archives, in particular of corrupted ones */
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "aec_styles.h"
+#include "syntax_tree_serialization.h"
+
+using namespace serialization;
+
+namespace {
+
+bool success = true;
+
+void fail(const std::string& test, const std::string& message) {
+	std::cerr << aec_style::error << "Error:" << aec::reset << " " << test << ": " << message << "\n";
+	success = false;
+}
+
+void put_varint(std::string& out, uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	out.push_back(static_cast<char>(value));
+}
+
+/** Returns the encoding of a leaf with tag [tag] and, unless it is negative, payload [payload] */
+std::string leaf(uint64_t tag, int64_t payload = -1) {
+	std::string node;
+	put_varint(node, tag);
+	if (payload >= 0) put_varint(node, static_cast<uint64_t>(payload));
+	put_varint(node, 0); // Child count
+	put_varint(node, 0); // Children size
+	return node;
+}
+
+/** Returns an archive of one record that holds the encoded tree [node] */
+std::string archive(const std::string& node) {
+	std::string out(ARCHIVE_MAGIC);
+	put_varint(out, node.size());
+	return out + node;
+}
+
+/** Decodes the only tree of [archive_bytes] and returns it as a Syntax_tree */
+Syntax_tree decode(const std::string& archive_bytes) {
+	Archive_reader reader(archive_bytes.data(), archive_bytes.size());
+	if (!reader.is_valid() || !reader.has_next()) throw std::logic_error("not an archive of one record");
+	auto root = reader.next();
+	if (!root) throw std::logic_error("the tree is empty");
+	return to_syntax_tree(*root);
+}
+
+void expect_malformed(const std::string& test, const std::string& archive_bytes) {
+	try {
+		decode(archive_bytes);
+		fail(test, "was decoded");
+	} catch (std::runtime_error&) {
+		// As it should
+	}
+}
+
+constexpr uint64_t type_tag(Construction::Type type, uint64_t data_kind) {
+	return static_cast<uint64_t>(type) << 4 | data_kind;
+}
+
+constexpr uint64_t BINOP_DATA = 5; // Binop_type is alternative 4 of Construction::Data
+
+void test_round_trip() {
+	Syntax_tree tree(Construction::Type::Expr_binop);
+	tree.append_subtree(Syntax_tree(Construction::Type::Letter, 'a'));
+	tree.append_subtree(Syntax_tree(Construction::Type::Binop, Binop_type::In));
+	tree.append_subtree(Syntax_tree(Construction::Type::Greek_symbol, std::string("alpha")));
+
+	std::string encoded(ARCHIVE_MAGIC);
+	encode_record(tree, encoded);
+	std::string decoded(ARCHIVE_MAGIC);
+	encode_record(decode(encoded), decoded);
+	if (decoded != encoded) fail("round trip", "the decoded tree differs");
+}
+
+void test_valid_leaf() {
+	auto tree = decode(archive(leaf(type_tag(Construction::Type::Binop, BINOP_DATA), static_cast<int64_t>(Binop_type::In))));
+	if (*tree.centrance() != Construction(Construction::Type::Binop, Binop_type::In)) {
+		fail("valid leaf", "decoded the wrong construction");
+	}
+}
+
+void test_corrupted() {
+	auto last_type = static_cast<uint64_t>(Construction::Type::Last);
+	expect_malformed("node type out of range", archive(leaf((last_type + 1) << 4)));
+	expect_malformed("huge node type", archive(leaf((last_type + 1000) << 4)));
+	expect_malformed("Binop_type out of range",
+		archive(leaf(type_tag(Construction::Type::Binop, BINOP_DATA), static_cast<int64_t>(Binop_type::Last) + 1)));
+	expect_malformed("Typesetting_type out of range",
+		archive(leaf(type_tag(Construction::Type::Typesetting, 1), static_cast<int64_t>(Typesetting_type::Last) + 1)));
+	expect_malformed("Accent_type out of range", archive(leaf(type_tag(Construction::Type::Accent, 2), 3)));
+	expect_malformed("Special_symbol_type out of range", archive(leaf(type_tag(Construction::Type::Symbol_special, 3), 2)));
+	expect_malformed("Unop_type out of range", archive(leaf(type_tag(Construction::Type::Unop, 4), 10)));
+	expect_malformed("Rangeop_type out of range", archive(leaf(type_tag(Construction::Type::Rangeop, 6), 3)));
+	expect_malformed("unknown data kind", archive(leaf(type_tag(Construction::Type::Letter, 9), 0)));
+	expect_malformed("truncated node", archive(leaf(type_tag(Construction::Type::Binop, BINOP_DATA), 0).substr(0, 2)));
+}
+
+} // unnamed namespace
+
+int main() {
+	test_round_trip();
+	test_valid_leaf();
+	test_corrupted();
+	return (success ? 0 : 1);
+}
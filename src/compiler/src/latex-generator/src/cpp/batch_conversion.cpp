@@ -0,0 +1,304 @@
+#include "batch_conversion.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <climits>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "aec_styles.h"
+#include "grammar.h"
+#include "latex_generation.h"
+#include "logger.h"
+#include "stats.h"
+#include "syntax_visitor.h"
+
+namespace batch {
+
+//==================================================================================================
+// Helper functions
+//==================================================================================================
+
+namespace {
+
+/** How many chunks per worker may be converted ahead of the chunk that is being written */
+constexpr size_t CHUNKS_AHEAD_PER_THREAD = 4;
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start) {
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct Chunk {
+	const char* begin;
+	const char* end;
+	std::string output;
+	Line_counts counts;
+	double copy_seconds = 0;
+	bool done = false; // Guarded by Pipeline::mutex
+};
+
+/** Splits [data] into chunks of about [chunk_size] bytes that end right after a newline */
+std::vector<Chunk> split_into_chunks(const char* data, size_t size, size_t chunk_size) {
+	std::vector<Chunk> chunks;
+	const char* end = data + size;
+	const char* pos = data;
+	while (pos != end) {
+		const char* chunk_end = end;
+		if (static_cast<size_t>(end - pos) > chunk_size) {
+			auto newline = static_cast<const char*>(
+				std::memchr(pos + chunk_size, '\n', end - (pos + chunk_size))
+			);
+			if (newline) chunk_end = newline + 1;
+		}
+		Chunk chunk;
+		chunk.begin = pos;
+		chunk.end = chunk_end;
+		chunks.push_back(std::move(chunk));
+		pos = chunk_end;
+	}
+	return chunks;
+}
+
+/**
+ * Converts all lines of [chunk] into its output. The chunk is copied into [scratch] first, because
+ * the scanner needs writable, padded text and the input may be a read-only mapping. Copying a chunk
+ * that fits in the cache is far cheaper than the copy-on-write page faults of writing to a private
+ * mapping.
+ */
+void convert_chunk(Chunk& chunk, Syntax_visitor& visitor, bool create_document, std::string& scratch) {
+	auto start = Clock::now();
+	size_t size = static_cast<size_t>(chunk.end - chunk.begin);
+	scratch.assign(chunk.begin, size);
+	scratch.append(grammar::SCAN_PADDING, '\0');
+	chunk.copy_seconds = seconds_since(start);
+
+	chunk.counts = convert_lines(
+		scratch.data(), size, scratch.data() + scratch.size(), visitor, create_document, chunk.output
+	);
+}
+
+/** Writes all of [iovs] to [fd], retrying on partial writes. Returns false on errors. */
+bool write_all(int fd, std::vector<iovec>& iovs) {
+	size_t first = 0;
+	while (first != iovs.size()) {
+		int count = static_cast<int>(std::min<size_t>(iovs.size() - first, IOV_MAX));
+		ssize_t written = writev(fd, iovs.data() + first, count);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		// Skip the buffers that were written completely and advance into a partially written one
+		auto remaining = static_cast<size_t>(written);
+		while (first != iovs.size() && remaining >= iovs[first].iov_len) {
+			remaining -= iovs[first].iov_len;
+			++first;
+		}
+		if (remaining != 0) {
+			iovs[first].iov_base = static_cast<char*>(iovs[first].iov_base) + remaining;
+			iovs[first].iov_len -= remaining;
+		}
+	}
+	return true;
+}
+
+/**
+ * Hands out chunks to worker threads and lets the calling thread write their output in order.
+ * Workers stay at most CHUNKS_AHEAD_PER_THREAD chunks per thread ahead of the writer.
+ */
+class Pipeline {
+public:
+	Pipeline(std::vector<Chunk>& chunks, size_t threads)
+			: chunks(chunks)
+			, max_ahead(threads * CHUNKS_AHEAD_PER_THREAD)
+	{}
+
+	/** Returns the index of the next chunk to convert, or chunks.size() if there are none left */
+	size_t take_chunk() {
+		std::unique_lock<std::mutex> lock(mutex);
+		slot_free.wait(lock, [&] {
+			return next_chunk == chunks.size() || next_chunk < written_chunks + max_ahead;
+		});
+		if (next_chunk == chunks.size()) return next_chunk;
+		return next_chunk++;
+	}
+
+	void finish_chunk(size_t index) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			chunks[index].done = true;
+		}
+		chunk_done.notify_one();
+	}
+
+	/**
+	 * Writes the output of all chunks to [fd] in order, as soon as they are done. Adds the time it
+	 * spent writing to [write_seconds].
+	 */
+	bool write_output(int fd, double& write_seconds) {
+		bool success = true;
+		std::vector<iovec> iovs;
+		while (written_chunks != chunks.size()) {
+			size_t first = written_chunks;
+			size_t last = first;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				chunk_done.wait(lock, [&] { return chunks[first].done; });
+				while (last != chunks.size() && chunks[last].done) ++last;
+			}
+
+			// Write every chunk that is done in one go
+			iovs.clear();
+			for (size_t i = first; i != last; ++i) {
+				auto& output = chunks[i].output;
+				if (!output.empty()) iovs.push_back(iovec{output.data(), output.size()});
+			}
+			auto start = Clock::now();
+			bool written = success && write_all(fd, iovs);
+			write_seconds += seconds_since(start);
+			if (success && !written) {
+				std::cerr << aec_style::error << "Error:" << aec::reset << " Could not write output: "
+				          << std::strerror(errno) << "\n";
+				success = false; // Keep going, so that the workers can finish
+			}
+			for (size_t i = first; i != last; ++i) {
+				std::string().swap(chunks[i].output);
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				written_chunks = last;
+			}
+			slot_free.notify_all();
+		}
+		return success;
+	}
+
+private:
+	std::vector<Chunk>& chunks;
+	const size_t max_ahead;
+
+	std::mutex mutex;
+	std::condition_variable chunk_done;
+	std::condition_variable slot_free;
+	size_t next_chunk = 0;
+	size_t written_chunks = 0;
+};
+
+} // unnamed namespace
+
+//==================================================================================================
+// Report
+//==================================================================================================
+
+double Report::megabytes_per_second() const {
+	return (seconds > 0 ? bytes / 1e6 / seconds : 0);
+}
+
+double Report::lines_per_second() const {
+	return (seconds > 0 ? lines / seconds : 0);
+}
+
+//==================================================================================================
+// Conversion
+//==================================================================================================
+
+Line_counts convert_lines(
+	char* text, size_t size, const char* buffer_end, Syntax_visitor& visitor, bool create_document,
+	std::string& output
+) {
+	Line_counts counts;
+	grammar::for_each_line(text, size, [&](char* line, size_t length) {
+		if (length == 0) return; // Ignore empty lines
+		++counts.lines;
+
+		auto start = Clock::now();
+		visitor.syntax_tree = Syntax_tree(); // Don't print the tree of the previous line on failure
+		if (grammar::generate_from_buffer(line, length, buffer_end, visitor) != 0) {
+			++counts.failed_lines;
+		}
+		auto parsed = Clock::now();
+		counts.parse_seconds += std::chrono::duration<double>(parsed - start).count();
+		if (visitor.syntax_tree.entrance().is_valid()) {
+			size_t output_size = output.size();
+			std::string latex;
+			{
+				stats::Stage_timer timer(stats::TO_LATEX);
+				latex = generation::to_latex(visitor.syntax_tree.entrance());
+			}
+			if (create_document) {
+				stats::Stage_timer timer(stats::TO_DISPLAY_STYLE);
+				output += generation::to_display_style(latex);
+			}
+			else {
+				output += latex;
+			}
+			output += '\n';
+			stats::count(stats::OUTPUT_BYTES, output.size() - output_size);
+			counts.generate_seconds += seconds_since(parsed);
+		}
+	});
+	return counts;
+}
+
+bool convert(
+	const char* data, size_t size, int output_fd, const Options& options, Report& report
+) {
+	auto start = Clock::now();
+
+	std::vector<Chunk> chunks = split_into_chunks(data, size, std::max<size_t>(options.chunk_size, 1));
+	double split_seconds = seconds_since(start);
+
+	size_t threads = options.threads;
+	if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = std::max<size_t>(1, std::min(threads, chunks.size()));
+
+	Pipeline pipeline(chunks, threads);
+	std::vector<std::thread> workers;
+	workers.reserve(threads);
+	for (size_t i = 0; i < threads; ++i) {
+		workers.emplace_back([&] {
+			Logger logger(*options.log_sink);
+			Syntax_visitor visitor(logger);
+			std::string scratch;
+			for (size_t index; (index = pipeline.take_chunk()) != chunks.size(); ) {
+				convert_chunk(chunks[index], visitor, options.create_document, scratch);
+				pipeline.finish_chunk(index);
+			}
+		});
+	}
+	double write_seconds = 0;
+	bool success = pipeline.write_output(output_fd, write_seconds);
+	for (auto& worker : workers) {
+		worker.join();
+	}
+
+	report = Report();
+	report.bytes = size;
+	report.threads = (chunks.empty() ? 0 : threads);
+	report.read_seconds = split_seconds;
+	report.write_seconds = write_seconds;
+	for (const auto& chunk : chunks) {
+		report.lines += chunk.counts.lines;
+		report.failed_lines += chunk.counts.failed_lines;
+		report.read_seconds += chunk.copy_seconds;
+		report.parse_seconds += chunk.counts.parse_seconds;
+		report.generate_seconds += chunk.counts.generate_seconds;
+	}
+	report.seconds = seconds_since(start);
+
+	return success && report.failed_lines == 0;
+}
+
+} // namespace batch
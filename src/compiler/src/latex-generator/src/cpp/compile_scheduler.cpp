@@ -0,0 +1,366 @@
+#include "compile_scheduler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "latex_generation.h"
+#include "trace.h"
+
+extern char** environ;
+
+namespace {
+
+/** Returns the count, mean, percentiles and maximum of [durations], which it sorts */
+Latency_summary summarize(std::vector<double>& durations) {
+	Latency_summary summary;
+	if (durations.empty()) return summary;
+	std::sort(durations.begin(), durations.end());
+	auto percentile = [&](double p) {
+		size_t rank = static_cast<size_t>(std::ceil(p * durations.size()));
+		return durations[std::max<size_t>(rank, 1) - 1];
+	};
+	summary.count = durations.size();
+	summary.mean = std::accumulate(durations.begin(), durations.end(), 0.0) / durations.size();
+	summary.p50 = percentile(0.50);
+	summary.p95 = percentile(0.95);
+	summary.max = durations.back();
+	return summary;
+}
+
+/** Writes [text] to the file at [path] through a temporary file. Returns false on failure. */
+bool write_atomically(const std::string& path, const std::string& text) {
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		if (!file.write(text.data(), text.size()).flush()) {
+			std::remove(temporary.c_str());
+			return false;
+		}
+	}
+	if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+		std::remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+/** Reads the file at [path] into [out_text]. Returns false if it can not be read. */
+bool read_file(const std::string& path, std::string& out_text) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) return false;
+	out_text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return !file.bad();
+}
+
+/** Returns [path] with the extension of its file name, if any, replaced by [extension] */
+std::string replace_extension(const std::string& path, const std::string& extension) {
+	size_t slash = path.rfind('/');
+	size_t dot = path.rfind('.');
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) dot = path.size();
+	return path.substr(0, dot) + extension;
+}
+
+/**
+ * Returns the number of the line of [document] at which its body begins, with \begin{document}, or
+ * 0 if it has none
+ */
+size_t body_line(const std::string& document) {
+	size_t begin = document.find("\\begin{document}");
+	if (begin == std::string::npos) return 0;
+	return 1 + std::count(document.begin(), document.begin() + begin, '\n');
+}
+
+/**
+ * Returns the number of the line of the first error in the TeX [log], as TeX gives it in the
+ * "l.12 ..." line after the "! ..." line of the error, or 0 if there is none
+ */
+size_t error_line(const std::string& log) {
+	size_t error = (log.compare(0, 2, "! ") == 0 ? 0 : log.find("\n! "));
+	if (error == std::string::npos) return 0;
+	size_t line = log.find("\nl.", error);
+	if (line == std::string::npos) return 0;
+	return std::strtoul(log.c_str() + line + 3, nullptr, 10);
+}
+
+/** Returns the directory of the file at [path] */
+std::string directory_of(const std::string& path) {
+	size_t slash = path.rfind('/');
+	if (slash == std::string::npos) return ".";
+	return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+/**
+ * Returns the environment of this process with [directories] in front of the TeX search path
+ * [variable] (like TEXINPUTS), followed by the rest of the path, or by the default path if there
+ * is none (the empty entry after the last colon).
+ */
+void prepend_search_path(std::vector<std::string>& environment, const std::string& variable, const std::string& directories) {
+	std::string prefix = variable + "=";
+	for (std::string& entry : environment) {
+		if (entry.compare(0, prefix.size(), prefix) == 0) {
+			entry = prefix + directories + ":" + entry.substr(prefix.size());
+			return;
+		}
+	}
+	environment.push_back(prefix + directories + ":");
+}
+
+/**
+ * Runs [arguments] with its standard streams on /dev/null, like compiler.py did, and waits for it.
+ * It gets [environment] if it is not empty, and the environment of this process otherwise.
+ * Returns whether it started and exited with 0.
+ */
+bool run_silently(const std::vector<std::string>& arguments, const std::vector<std::string>& environment) {
+	std::vector<char*> argv;
+	for (const std::string& argument : arguments) argv.push_back(const_cast<char*>(argument.c_str()));
+	argv.push_back(nullptr);
+	std::vector<char*> envp;
+	for (const std::string& entry : environment) envp.push_back(const_cast<char*>(entry.c_str()));
+	envp.push_back(nullptr);
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+	posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+	posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+	pid_t pid;
+	int error = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environment.empty() ? environ : envp.data());
+	posix_spawn_file_actions_destroy(&actions);
+	if (error != 0) return false;
+
+	int status;
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) return false;
+	}
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+} // unnamed namespace
+
+Compile_scheduler::Compile_scheduler(Compile_options options)
+		: options(std::move(options))
+{
+	path = this->options.output_directory + "/" + this->options.tex_name;
+	log_path = replace_extension(path, ".log");
+	if (this->options.command.empty()) {
+		this->options.command = {"latexmk", "-pdf", "-output-directory=" + this->options.output_directory};
+	}
+	if (this->options.precompile_preamble) {
+		const std::string& directory = this->options.output_directory;
+		if (this->options.style_path.empty()) {
+			this->options.style_path = directory + "/talktex.sty";
+		}
+		if (this->options.format_command.empty()) {
+			// "&pdflatex" loads the format of LaTeX before the preamble, which ends with \dump
+			this->options.format_command = {
+				"pdflatex", "-ini", "-interaction=batchmode", "-halt-on-error",
+				"-output-directory=" + directory, "-jobname=" + this->options.format_name, "&pdflatex"
+			};
+		}
+		// pdflatex looks for the format, and the format build for talktex.sty, in these directories
+		for (char** entry = environ; *entry != nullptr; ++entry) environment.push_back(*entry);
+		prepend_search_path(environment, "TEXFORMATS", directory);
+		prepend_search_path(environment, "TEXINPUTS", directory_of(this->options.style_path));
+	}
+	worker = std::thread(&Compile_scheduler::run, this);
+}
+
+Compile_scheduler::~Compile_scheduler() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	changed.notify_all();
+	worker.join();
+}
+
+void Compile_scheduler::submit(std::string document) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (has_pending) ++counts.coalesced;
+		++counts.submitted;
+		pending = std::move(document);
+		has_pending = true;
+		last_submit = Clock::now();
+		submit_times.push_back(last_submit);
+	}
+	changed.notify_all();
+}
+
+bool Compile_scheduler::compile_now(std::string document) {
+	std::unique_lock<std::mutex> lock(mutex);
+	if (has_pending) ++counts.coalesced;
+	size_t number = ++counts.submitted;
+	pending = std::move(document);
+	has_pending = true;
+	urgent = true;
+	last_submit = Clock::now();
+	submit_times.push_back(last_submit);
+	changed.notify_all();
+	changed.wait(lock, [&] { return compiled >= number; });
+	return last_succeeded;
+}
+
+void Compile_scheduler::wait_idle() {
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [&] { return !has_pending && !compiling; });
+}
+
+Compile_report Compile_scheduler::report() const {
+	std::vector<double> sorted_latencies, sorted_durations;
+	Compile_report report;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		report = counts;
+		sorted_latencies = latencies;
+		sorted_durations = durations;
+	}
+	report.latency = summarize(sorted_latencies);
+	report.compile = summarize(sorted_durations);
+	return report;
+}
+
+void Compile_scheduler::run() {
+	auto debounce = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.debounce_seconds));
+	auto max_delay = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.max_delay_seconds));
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		changed.wait(lock, [&] { return has_pending || stopping; });
+		if (!has_pending) return;
+
+		// Wait for the burst of submissions to end, but not for ever
+		while (has_pending && !urgent && !stopping) {
+			Clock::time_point deadline = std::min(last_submit + debounce, submit_times.front() + max_delay);
+			if (Clock::now() >= deadline) break;
+			changed.wait_until(lock, deadline);
+		}
+
+		std::string document = std::move(pending);
+		std::vector<Clock::time_point> shown = std::move(submit_times);
+		size_t number = counts.submitted;
+		pending.clear();
+		submit_times.clear();
+		has_pending = false;
+		urgent = false;
+		compiling = true;
+		lock.unlock();
+
+		bool succeeded = compile(document);
+		Clock::time_point end = Clock::now();
+
+		lock.lock();
+		for (Clock::time_point submitted : shown) {
+			latencies.push_back(std::chrono::duration<double>(end - submitted).count());
+		}
+		compiling = false;
+		compiled = number;
+		last_succeeded = succeeded;
+		changed.notify_all();
+	}
+}
+
+bool Compile_scheduler::compile(const std::string& document) {
+	// Load the preamble from its format instead of processing it again
+	std::string loading_document;
+	if (options.precompile_preamble && prepare_format()) {
+		static const std::string header = generation::talktex_header();
+		if (document.compare(0, header.size(), header) == 0) {
+			loading_document = generation::talktex_format_header(options.format_name);
+			loading_document.append(document, header.size(), std::string::npos);
+		}
+	}
+	if (loading_document.empty()) return write_and_run(document);
+	std::remove(log_path.c_str()); // So that the log of an earlier compile is not taken for this one's
+	if (write_and_run(loading_document)) return true;
+
+	// The format may not load, e.g. if it was made by another version of pdflatex, so we compile
+	// with the preamble. If that works, the format was to blame, and we stop using it. An error in
+	// the body fails with the preamble as well, so then we do not compile again.
+	std::string log;
+	if (read_file(log_path, log) && error_line(log) > body_line(loading_document)) {
+		std::lock_guard<std::mutex> lock(mutex);
+		++counts.body_errors;
+		return false;
+	}
+	bool succeeded = write_and_run(document);
+	if (succeeded) {
+		format_ready = false;
+		std::remove((options.output_directory + "/" + options.format_name + ".inputs").c_str());
+		std::lock_guard<std::mutex> lock(mutex);
+		++counts.format_fallbacks;
+	}
+	return succeeded;
+}
+
+bool Compile_scheduler::write_and_run(const std::string& document) {
+	if (!write_atomically(path, document)) {
+		std::lock_guard<std::mutex> lock(mutex);
+		++counts.write_errors;
+		return false;
+	}
+
+	std::vector<std::string> arguments = options.command;
+	arguments.push_back(path);
+	auto start = Clock::now();
+	bool succeeded;
+	{
+		trace::Span span("latexmk");
+		succeeded = run_silently(arguments, environment);
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	++counts.compiles;
+	if (!succeeded) ++counts.failed;
+	durations.push_back(seconds);
+	return succeeded;
+}
+
+bool Compile_scheduler::prepare_format() {
+	// The format is built from these, so it is only rebuilt when one of them changes
+	std::string inputs = generation::talktex_preamble();
+	std::string style;
+	if (!read_file(options.style_path, style)) style.clear();
+	inputs += style;
+	for (const std::string& argument : options.format_command) inputs += argument + '\n';
+	if (inputs == format_inputs) return format_ready;
+	format_inputs = inputs;
+
+	// Which are kept beside the format, so the next run can reuse it
+	std::string base_path = options.output_directory + "/" + options.format_name;
+	std::string stamp_path = base_path + ".inputs";
+	std::string stamp;
+	if (read_file(stamp_path, stamp) && stamp == inputs && access((base_path + ".fmt").c_str(), R_OK) == 0) {
+		format_ready = true;
+		return true;
+	}
+
+	std::remove(stamp_path.c_str());
+	std::vector<std::string> arguments = options.format_command;
+	arguments.push_back(base_path + ".tex");
+	bool succeeded = write_atomically(arguments.back(), generation::talktex_preamble() + "\\dump\n");
+	if (succeeded) {
+		trace::Span span("format");
+		succeeded = run_silently(arguments, environment);
+	}
+	succeeded = succeeded && write_atomically(stamp_path, inputs);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++counts.format_builds;
+		if (!succeeded) ++counts.format_failed;
+	}
+	format_ready = succeeded;
+	return succeeded;
+}
@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <tclap/CmdLine.h>
+
+#include "aec_styles.h"
+#include "service.h"
+
+/*
+	A thin client for a conversion server (compiler_latex_generator --serve). It behaves like
+	compiler_latex_generator -i/-f, without paying for loading the conversion libraries and setting
+	up a parser in every process.
+*/
+
+/** Idle timeout of the servers that we start ourselves, in seconds */
+const char* STARTED_SERVER_IDLE_TIMEOUT = "600";
+
+/** Size of the line cache of the servers that we start ourselves, in megabytes */
+const char* STARTED_SERVER_CACHE_SIZE = "64";
+
+void print_error_message(const std::string& message) {
+	std::cerr << aec_style::error << "Error:" << aec::reset << " " << message << "\n";
+}
+
+/** Runs [argv] with its standard in, out and error redirected to /dev/null */
+pid_t spawn_silently(const std::vector<const char*>& argv, bool new_session) {
+	pid_t pid = fork();
+	if (pid == 0) {
+		if (new_session) setsid(); // Don't get killed together with our terminal
+		int null_fd = open("/dev/null", O_RDWR);
+		dup2(null_fd, STDIN_FILENO);
+		dup2(null_fd, STDOUT_FILENO);
+		dup2(null_fd, STDERR_FILENO);
+		execv(argv[0], const_cast<char* const*>(argv.data()));
+		_exit(127);
+	}
+	return pid;
+}
+
+/**
+ * Starts the server executable at [server_path] on [socket_path] and connects [client] to it.
+ * Returns false if the server did not start listening within a few seconds.
+ */
+bool start_server_and_connect(
+	const std::string& server_path, const std::string& socket_path, service::Client& client
+) {
+	std::vector<const char*> argv{
+		server_path.c_str(), "--serve", socket_path.c_str(),
+		"--idle-timeout", STARTED_SERVER_IDLE_TIMEOUT, "--cache-size", STARTED_SERVER_CACHE_SIZE, nullptr
+	};
+	if (spawn_silently(argv, true) < 0) return false;
+
+	for (int attempt = 0; attempt < 500; ++attempt) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		if (client.connect(socket_path)) return true;
+	}
+	return false;
+}
+
+//==================================================================================================
+// Latency measurement
+//==================================================================================================
+
+/** Prints the median and 99th percentile of [latencies] (in seconds), which gets sorted */
+void print_latencies(const std::string& name, std::vector<double>& latencies) {
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&](double p) {
+		size_t rank = static_cast<size_t>(std::ceil(p * latencies.size()));
+		return latencies[std::max<size_t>(rank, 1) - 1] * 1e6;
+	};
+	std::cout << std::left << std::setw(22) << name << std::right << std::fixed << std::setprecision(1)
+	          << "p50 " << std::setw(9) << percentile(0.50) << " us   "
+	          << "p99 " << std::setw(9) << percentile(0.99) << " us   "
+	          << "(" << latencies.size() << " requests)\n";
+}
+
+/**
+ * Sends [request] [count] times through [client] and, if [server_path] is not empty, converts the
+ * same text [count] times by starting a new server process with -i, as the scripts used to.
+ */
+bool measure_latency(
+	service::Client& client, const service::Request& request, size_t count,
+	const std::string& server_path
+) {
+	using Clock = std::chrono::steady_clock;
+	auto seconds_since = [](Clock::time_point start) {
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	};
+
+	std::vector<double> latencies;
+	service::Response response;
+	for (size_t i = 0; i < count; ++i) {
+		auto start = Clock::now();
+		if (!client.convert(request, response)) {
+			print_error_message("Lost the connection to the server");
+			return false;
+		}
+		latencies.push_back(seconds_since(start));
+	}
+	print_latencies("server request:", latencies);
+	if (server_path.empty()) return true;
+
+	std::vector<const char*> argv{server_path.c_str(), "-i", request.text.c_str()};
+	if (request.create_document) argv.push_back("-d");
+	argv.push_back(nullptr);
+
+	double server_median = latencies[latencies.size() / 2];
+	latencies.clear();
+	for (size_t i = 0; i < count; ++i) {
+		auto start = Clock::now();
+		pid_t pid = spawn_silently(argv, false);
+		int status;
+		if (pid < 0 || waitpid(pid, &status, 0) < 0) {
+			print_error_message("Could not start " + server_path);
+			return false;
+		}
+		latencies.push_back(seconds_since(start));
+	}
+	print_latencies("process per request:", latencies);
+	std::cout << "median speedup: " << std::setprecision(1)
+	          << latencies[latencies.size() / 2] / server_median << "x\n";
+	return true;
+}
+
+//==================================================================================================
+// Command-line interface
+//==================================================================================================
+
+int main(int argc, char** argv) {
+	TCLAP::CmdLine cmd("TalkTex compiler - LaTeX generator client", ' ', "1.0");
+
+	try {
+		TCLAP::ValueArg<std::string> input_file_path_arg("f", "file", "Path to source file. Defaults to standard in.", false, "", "string");
+		TCLAP::ValueArg<std::string> input_arg("i", "input", "Input string to parse.", false, "", "string");
+		TCLAP::EitherOf inputs;
+		inputs.add(input_file_path_arg).add(input_arg);
+		cmd.add(inputs);
+
+		TCLAP::SwitchArg create_document_switch("d", "create-document", "Create a full LaTeX document.", cmd, false);
+		TCLAP::ValueArg<std::string> socket_arg("s", "socket", "Path of the server socket. Defaults to $TALKTEX_SOCKET, or a per-user socket in $XDG_RUNTIME_DIR or /tmp.", false, "", "string", cmd);
+		TCLAP::ValueArg<std::string> server_arg("", "server", "Path of compiler_latex_generator, to start a server with if none is listening.", false, "", "string", cmd);
+		TCLAP::ValueArg<size_t> benchmark_arg("b", "benchmark", "Instead of printing the output, measure the latency of this many requests, and compare it to starting the --server executable per request.", false, 0, "unsigned integer", cmd);
+		cmd.parse(argc, argv);
+
+		service::Request request;
+		request.create_document = create_document_switch.getValue();
+		if (input_arg.isSet()) {
+			request.text = input_arg.getValue();
+		}
+		else if (input_file_path_arg.isSet()) {
+			std::ifstream file(input_file_path_arg.getValue());
+			if (!file.is_open()) {
+				print_error_message("Could not open " + input_file_path_arg.getValue());
+				return 1;
+			}
+			request.text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		}
+		else {
+			request.text.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+		}
+
+		std::string socket_path = (socket_arg.isSet() ? socket_arg.getValue() : service::default_socket_path());
+		const std::string& server_path = server_arg.getValue();
+
+		service::Client client;
+		if (!client.connect(socket_path)) {
+			if (server_path.empty()) {
+				print_error_message("No server is listening on " + socket_path + " (see --server)");
+				return 1;
+			}
+			if (!start_server_and_connect(server_path, socket_path, client)) {
+				print_error_message("Could not start a server on " + socket_path + " with " + server_path);
+				return 1;
+			}
+		}
+
+		if (benchmark_arg.getValue() != 0) {
+			return (measure_latency(client, request, benchmark_arg.getValue(), server_path) ? 0 : 1);
+		}
+
+		service::Response response;
+		if (!client.convert(request, response)) {
+			print_error_message("Lost the connection to the server");
+			return 1;
+		}
+		std::cerr << response.diagnostics;
+		std::cout << response.output;
+		return (response.success ? 0 : 1);
+
+	} catch (TCLAP::ArgException& e) {
+		std::cerr << aec_style::error << "command-line error: " << aec::reset << e.error()
+				  << " for arg " << e.argId() << std::endl;
+		return 1;
+	}
+}
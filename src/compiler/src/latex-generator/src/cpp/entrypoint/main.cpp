@@ -1,19 +1,46 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include <tclap/CmdLine.h>
+#include <unistd.h>
 
 #include "grammar.h"
+#include "sample_inputs.h"
 #include "syntax_tree.h"
 #include "syntax_visitor.h"
 #include "aec_styles.h"
+#include "batch_conversion.h"
+#include "compile_scheduler.h"
+#include "latex_cache.h"
 #include "latex_generation.h"
 #include "io_util.h"
+#include "mapped_file.h"
+#include "next_words.h"
+#include "prefix_oracle.h"
+#include "resampler.h"
+#include "service_server.h"
+#include "session_history.h"
+#include "speculative_preview.h"
+#include "stats.h"
+#include "trace.h"
+#include "wav_batch.h"
 
 // =================================================================================================
 // C library API
 // =================================================================================================
 
+/** The diagnostics of the last texify call on each thread (see talktex_diagnostics) */
+thread_local Memory_sink texify_diagnostics;
+
 /**
  * Converts one or more lines of running text to corresponding LaTeX code, which can be used in
  * LaTeX text mode. One output line is generated for each input line. Empty lines are ignored
@@ -24,28 +51,77 @@
  * Returns false if one of the lines could not be fully parsed, or if the the output character
  * is greater than [output_size]. Otherwise, returns true.
  * If any of the lines could not be parsed, their partial texifications, and the texifications of
- * the lines after them, are still included in the output.
+ * the lines after them, are still included in the output. The parse errors can be read with
+ * talktex_diagnostics.
  */
 extern "C" bool texify(const char* input, char* output, size_t output_size) {
+	trace::Span span("texify");
 	bool success = true;
-	Logger logger(std::cerr, std::cerr, std::cerr);
+	texify_diagnostics.take(); // Forget those of the previous call
+	size_t diagnostics_size = 0; // Of the lines converted so far, once the logger is flushed
+	// Flushed when it goes, so the diagnostics are complete when we return
+	Logger logger(texify_diagnostics);
 	Syntax_visitor visitor(logger);
-	std::stringstream ss(input);
-	std::string line;
+	// The only copy of the input; its lines are scanned in place
+	std::string text = grammar::padded_copy(input);
+	size_t text_size = text.size() - grammar::SCAN_PADDING;
+	const char* text_end = text.data() + text.size();
 	std::string output_string;
-	while (std::getline(ss, line)) {
-		if (line == "") continue; // Ignore empty lines
-		auto code = grammar::generate_from_string(line, visitor);
+	bool use_cache = latex_cache::is_open();
+	Persistent_cache::Entry entry;
+	grammar::for_each_line(text.data(), text_size, [&](char* line, size_t length) {
+		if (length == 0) return; // Ignore empty lines
+		// A cached line has its LaTeX, or its diagnostics if it could not be parsed
+		std::string_view utterance = latex_cache::normalize(std::string_view(line, length));
+		if (use_cache && latex_cache::find(utterance, entry)) {
+			if (entry.success) {
+				output_string += entry.value;
+			}
+			else {
+				success = false;
+				texify_diagnostics.append(entry.value);
+				diagnostics_size += entry.value.size();
+			}
+			return;
+		}
+		uint64_t start = use_cache ? trace::now() : 0;
+
+		auto code = grammar::generate_from_buffer(line, length, text_end, visitor);
 		if (code != 0) {
 			success = false;
-			continue; // ignore invalid lines
+			if (use_cache) {
+				logger.flush();
+				// Only the diagnostics of this line, without copying those of the lines before it
+				entry.success = false;
+				entry.value = texify_diagnostics.contents_from(diagnostics_size);
+				entry.nanoseconds = trace::now() - start;
+				latex_cache::insert(utterance, entry);
+				diagnostics_size += entry.value.size();
+			}
+			return; // ignore invalid lines
 		}
-		auto latex = generation::to_latex(visitor.syntax_tree.entrance());
-		output_string += generation::to_display_style(latex) + "\n";
-	}
+		std::string latex;
+		{
+			stats::Stage_timer timer(stats::TO_LATEX);
+			latex = generation::to_latex(visitor.syntax_tree.entrance());
+		}
+		{
+			stats::Stage_timer timer(stats::TO_DISPLAY_STYLE);
+			latex = generation::to_display_style(latex) + "\n";
+		}
+		output_string += latex;
+		if (use_cache) {
+			entry.success = true;
+			entry.value = std::move(latex);
+			entry.nanoseconds = trace::now() - start;
+			latex_cache::insert(utterance, entry);
+		}
+	});
 	if (output_string.size() + 1 > output_size) {
 		return false;
 	}
+	stats::count(stats::OUTPUT_BYTES, output_string.size());
+	stats::Stage_timer timer(stats::COPY_OUT);
 	strcpy(output, output_string.c_str());
 	return success;
 }
@@ -78,51 +154,674 @@ extern "C" bool talktex_footer(char* buf, size_t buf_size) {
 	return true;
 }
 
+/**
+ * Writes the errors and warnings of the last texify call on the calling thread to [buf], one per
+ * line, if their character length is less than or equal to [buf_size]. They are kept until the
+ * next texify call on the thread.
+ * Returns true if the diagnostics were succesfully written to [buf], and false otherwise.
+ */
+extern "C" bool talktex_diagnostics(char* buf, size_t buf_size) {
+	std::string diagnostics = texify_diagnostics.contents();
+	if (diagnostics.size() + 1 > buf_size) {
+		return false;
+	}
+	strcpy(buf, diagnostics.c_str());
+	return true;
+}
+
+/** Returns a new, empty dictation session (see Session_history), to be freed with talktex_session_free */
+extern "C" void* talktex_session_new() {
+	return new Session_history();
+}
+
+extern "C" void talktex_session_free(void* session) {
+	delete static_cast<Session_history*>(session);
+}
+
+/**
+ * Carries out [utterance] in [session]: a spoken command like "undo", "scratch that" or "replace
+ * line two with x squared", or else a line to add (see Session_history::dictate).
+ * Returns false if the line could not be parsed or the command could not be carried out; the
+ * session is then unchanged. The parse errors can be read with talktex_diagnostics.
+ */
+extern "C" bool talktex_session_dictate(void* session, const char* utterance) {
+	trace::Span span("talktex_session_dictate");
+	texify_diagnostics.take(); // Forget those of the previous call
+	Logger logger(texify_diagnostics);
+	return static_cast<Session_history*>(session)->dictate(utterance, logger);
+}
+
+/**
+ * Returns a new model of when a speaker pauses for a break, starting with breaks at pauses of more
+ * than [initial_threshold] seconds (see grammar::Pause_model), to be freed with talktex_speaker_free
+ */
+extern "C" void* talktex_speaker_new(double initial_threshold) {
+	return new grammar::Pause_model(initial_threshold);
+}
+
+extern "C" void talktex_speaker_free(void* speaker) {
+	delete static_cast<grammar::Pause_model*>(speaker);
+}
+
+/** Returns the number of seconds that [speaker] pauses for a break, as it is estimated now */
+extern "C" double talktex_speaker_threshold(const void* speaker) {
+	return static_cast<const grammar::Pause_model*>(speaker)->threshold();
+}
+
+/**
+ * Carries out in [session] the utterance of the [count] tokens of a speech recognizer with the texts
+ * [texts] and the start times [start_times], in seconds, like talktex_session_dictate does for its
+ * text. The pauses that [speaker] takes for breaks are breaks, like the word "end", and teach
+ * [speaker] how long the speaker pauses between words. The line is parsed from the tokens, without
+ * joining them into text that is scanned again.
+ * Returns false if the line could not be parsed or the command could not be carried out; the
+ * session is then unchanged. The parse errors can be read with talktex_diagnostics.
+ */
+extern "C" bool talktex_session_dictate_tokens(
+	void* session, void* speaker, const char* const* texts, const double* start_times, size_t count
+) {
+	trace::Span span("talktex_session_dictate_tokens");
+	texify_diagnostics.take(); // Forget those of the previous call
+	std::vector<grammar::Recognized_token> tokens(count);
+	for (size_t i = 0; i < count; ++i) {
+		tokens[i] = grammar::Recognized_token{texts[i], start_times[i]};
+	}
+	grammar::Spoken_line line;
+	grammar::read_spoken_line(tokens.data(), count, *static_cast<grammar::Pause_model*>(speaker), line);
+	Logger logger(texify_diagnostics);
+	return static_cast<Session_history*>(session)->dictate(line, logger);
+}
+
+/**
+ * Returns whether [words], the start of a line, can still become a line (see
+ * grammar::Prefix_oracle): 0 if it is not a line yet but can become one, 1 if it is a line, and 2
+ * if no words can make it one. If [next_tokens] is not null, writes the names of the tokens that can
+ * come next to it, separated by spaces, e.g. "END B_PLUS", with "ENDFILE" for the end of the input,
+ * if they fit in [next_tokens_size] characters; otherwise writes the empty string, if that fits.
+ */
+extern "C" int talktex_check_prefix(const char* words, char* next_tokens, size_t next_tokens_size) {
+	std::string_view text(words);
+	std::string padded = grammar::padded_copy(text);
+	std::vector<grammar::Token> tokens;
+	grammar::scan_tokens(padded.data(), text.size(), padded.data() + padded.size(), tokens);
+	std::vector<int> kinds;
+	grammar::Prefix_status status = grammar::check_prefix(tokens.data(), tokens.size(), &kinds);
+	if (next_tokens) {
+		std::string names;
+		for (int kind : kinds) {
+			if (!names.empty()) names += ' ';
+			names += grammar::token_name(kind);
+		}
+		if (names.size() + 1 <= next_tokens_size) strcpy(next_tokens, names.c_str());
+		else if (next_tokens_size > 0) next_tokens[0] = '\0';
+	}
+	return static_cast<int>(status);
+}
+
+/**
+ * Returns the state in which the parser asks for the token after [words], the start of a line, for
+ * talktex_next_words_row; -1 if no words can make [words] a line.
+ */
+extern "C" int talktex_parser_state(const char* words) {
+	std::string_view text(words);
+	std::string padded = grammar::padded_copy(text);
+	std::vector<grammar::Token> tokens;
+	grammar::scan_tokens(padded.data(), text.size(), padded.data() + padded.size(), tokens);
+	grammar::Prefix_oracle oracle;
+	for (size_t i = 0; i < tokens.size() && oracle.status() != grammar::Prefix_status::DEAD; ++i) {
+		oracle.push(tokens[i].kind);
+	}
+	return oracle.state();
+}
+
+/**
+ * Returns the table of the words that the parser may accept next in each of its states (see
+ * grammar::Next_word_table), for the [count] words at [words], e.g. the vocabulary of a speech
+ * recognizer. To be freed with talktex_next_words_free.
+ */
+extern "C" void* talktex_next_words_new(const char* const* words, size_t count) {
+	return new grammar::Next_word_table(std::vector<std::string>(words, words + count));
+}
+
+extern "C" void talktex_next_words_free(void* table) {
+	delete static_cast<grammar::Next_word_table*>(table);
+}
+
+/** Returns the number of 64-bit blocks in a row of [table] */
+extern "C" size_t talktex_next_words_row_size(const void* table) {
+	return static_cast<const grammar::Next_word_table*>(table)->row_size();
+}
+
+/**
+ * Returns the row of [state] (see talktex_parser_state) in [table], in constant time: bit i % 64 of
+ * block i / 64 is set if the parser may accept word i next. All bits are clear for -1.
+ */
+extern "C" const uint64_t* talktex_next_words_row(const void* table, int state) {
+	return static_cast<const grammar::Next_word_table*>(table)->row(state);
+}
+
+/** A Speculative_preview with the logger it needs, which drops the errors: a preview always parses */
+struct Preview_stream {
+	Preview_stream() : logger(NULL_SINK), preview(logger) {}
+
+	Logger logger;
+	Speculative_preview preview;
+};
+
+/**
+ * Returns a new preview of the utterances of a speech recognizer while they are spoken (see
+ * Speculative_preview), to be freed with talktex_preview_free
+ */
+extern "C" void* talktex_preview_new() {
+	return new Preview_stream();
+}
+
+extern "C" void talktex_preview_free(void* preview) {
+	delete static_cast<Preview_stream*>(preview);
+}
+
+/**
+ * Updates [preview] to [hypothesis], the words of the utterance recognized so far, and writes its
+ * provisional LaTeX, in display style like texify gives it, to [buf] if its character length is less
+ * than or equal to [buf_size]. Parts that were not spoken yet are shown as \ldots.
+ * Returns false if there is no preview or it does not fit; [buf] is then the empty string, if it
+ * has room for that.
+ */
+extern "C" bool talktex_preview_update(void* preview, const char* hypothesis, char* buf, size_t buf_size) {
+	trace::Span span("talktex_preview_update");
+	auto stream = static_cast<Preview_stream*>(preview);
+	bool previewed = stream->preview.update(hypothesis);
+	const std::string& latex = stream->preview.line().latex;
+	if (!previewed || latex.size() + 1 > buf_size) {
+		if (buf_size > 0) buf[0] = '\0';
+		return false;
+	}
+	strcpy(buf, latex.c_str());
+	return true;
+}
+
+/** Discards the preview of [preview], for the next utterance */
+extern "C" void talktex_preview_reset(void* preview) {
+	static_cast<Preview_stream*>(preview)->preview.reset();
+}
+
+/**
+ * Carries out the final words [utterance] of the utterance of [preview] in [session], like
+ * talktex_session_dictate. If the last preview confirms them, its LaTeX is used without parsing them
+ * again. Starts [preview] over for the next utterance.
+ * Returns false if the line could not be parsed or the command could not be carried out; the
+ * session is then unchanged. The parse errors can be read with talktex_diagnostics.
+ */
+extern "C" bool talktex_preview_finish(void* preview, void* session, const char* utterance) {
+	trace::Span span("talktex_preview_finish");
+	texify_diagnostics.take(); // Forget those of the previous call
+	Logger logger(texify_diagnostics);
+	return static_cast<Preview_stream*>(preview)->preview.finish(
+		utterance, *static_cast<Session_history*>(session), logger
+	);
+}
+
+/** Undoes the last edit of [session]. Returns false if there is none. */
+extern "C" bool talktex_session_undo(void* session) {
+	return static_cast<Session_history*>(session)->undo();
+}
+
+/** Redoes the last undone edit of [session]. Returns false if there is none. */
+extern "C" bool talktex_session_redo(void* session) {
+	return static_cast<Session_history*>(session)->redo();
+}
+
+/** Returns the number of lines of [session] */
+extern "C" size_t talktex_session_lines(const void* session) {
+	return static_cast<const Session_history*>(session)->size();
+}
+
+/**
+ * Writes the LaTeX of the lines of [session] to [buf], like texify does for their text, if its
+ * character length is less than or equal to [buf_size].
+ * Returns true if the LaTeX was succesfully written to [buf], and false otherwise.
+ */
+extern "C" bool talktex_session_latex(const void* session, char* buf, size_t buf_size) {
+	std::string latex = static_cast<const Session_history*>(session)->latex();
+	if (latex.size() + 1 > buf_size) {
+		return false;
+	}
+	strcpy(buf, latex.c_str());
+	return true;
+}
+
+/** A Resampler with the output that did not fit in the buffer of the caller yet */
+struct Resampler_stream {
+	audio::Resampler resampler;
+	std::vector<int16_t> pending;
+};
+
+/**
+ * Returns a new resampler of 16-bit audio from [input_rate] to [output_rate] (see audio::Resampler),
+ * to be freed with talktex_resampler_free
+ */
+extern "C" void* talktex_resampler_new(uint32_t input_rate, uint32_t output_rate) {
+	if (input_rate == 0 || output_rate == 0) return nullptr;
+	return new Resampler_stream{audio::Resampler(input_rate, output_rate), {}};
+}
+
+extern "C" void talktex_resampler_free(void* resampler) {
+	delete static_cast<Resampler_stream*>(resampler);
+}
+
+/**
+ * Resamples the next [count] samples at [input] of the stream of [resampler], and writes at most
+ * [output_size] output samples to [output]. Output that does not fit is kept for the next call; a
+ * buffer of count * output_rate / input_rate + 1 samples always has room for all of it.
+ * Returns the number of samples written.
+ */
+extern "C" size_t talktex_resampler_process(
+	void* resampler, const int16_t* input, size_t count, int16_t* output, size_t output_size
+) {
+	auto stream = static_cast<Resampler_stream*>(resampler);
+	stream->resampler.process(input, count, stream->pending);
+	size_t written = std::min(output_size, stream->pending.size());
+	std::copy(stream->pending.begin(), stream->pending.begin() + written, output);
+	stream->pending.erase(stream->pending.begin(), stream->pending.begin() + written);
+	return written;
+}
+
+/**
+ * A speech recognizer of the caller: writes the words spoken in the [count] samples of 16 kHz mono
+ * audio at [samples] to [words] as a null-terminated string of at most [words_size] characters, and
+ * returns whether it recognized them. It is called on several threads at once.
+ */
+typedef bool (*Talktex_recognize)(const int16_t* samples, size_t count, char* words, size_t words_size, void* context);
+
+/**
+ * A speech recognizer of the caller that gives the tokens of the words, with their times: adds the
+ * tokens spoken in the [count] samples of 16 kHz mono audio at [samples] to [tokens] with
+ * talktex_tokens_add, and returns whether it recognized them. It is called on several threads at
+ * once.
+ */
+typedef bool (*Talktex_recognize_tokens)(const int16_t* samples, size_t count, void* tokens, void* context);
+
+/**
+ * Adds a token with the text [text], a character or a word, that starts [start_time] seconds into
+ * the utterance to [tokens], which a Talktex_recognize_tokens function got
+ */
+extern "C" void talktex_tokens_add(void* tokens, const char* text, double start_time) {
+	static_cast<std::vector<batch::Timed_token>*>(tokens)->push_back(batch::Timed_token{text, start_time});
+}
+
+/** The largest number of characters a Talktex_recognize function may write */
+constexpr size_t RECOGNIZED_WORDS_SIZE = 65536;
+
+/** A batch::Recognizer that calls a Talktex_recognize or a Talktex_recognize_tokens function */
+class Callback_recognizer : public batch::Recognizer {
+public:
+	Callback_recognizer(Talktex_recognize recognize, Talktex_recognize_tokens recognize_tokens, void* context)
+			: function(recognize)
+			, tokens_function(recognize_tokens)
+			, context(context)
+			, buffer(RECOGNIZED_WORDS_SIZE)
+	{}
+
+	bool recognize(const int16_t* samples, size_t count, std::string& out_words) override {
+		buffer[0] = '\0';
+		if (!function(samples, count, buffer.data(), buffer.size(), context)) return false;
+		buffer.back() = '\0';
+		out_words = buffer.data();
+		return true;
+	}
+
+	bool gives_timed_tokens() const override {
+		return tokens_function != nullptr;
+	}
+
+	bool recognize_tokens(const int16_t* samples, size_t count, std::vector<batch::Timed_token>& out_tokens) override {
+		return tokens_function(samples, count, &out_tokens, context);
+	}
+
+private:
+	Talktex_recognize function;
+	Talktex_recognize_tokens tokens_function;
+	void* context;
+	std::vector<char> buffer;
+};
+
+/**
+ * Transcribes the [count] WAV files at [paths] to LaTeX on [threads] threads (0 for one per
+ * hardware thread), recognizing their utterances with [recognize_tokens], or with [recognize] if
+ * that is null, which get [context] (see batch::transcribe). With [recognize_tokens], the pauses of
+ * more than [initial_break_threshold] seconds are breaks until the pauses of the speaker of a
+ * recording are learned, like with talktex_session_dictate_tokens. The LaTeX of every recording is
+ * written to a .tex file with its name in [output_directory], or next to it if that is null or
+ * empty, as a full document if [create_document] is set. Sets [out_audio_seconds] and
+ * [out_seconds], if they are not null, to the length of the audio transcribed and the wall-clock
+ * time it took.
+ * Returns false if a recording could not be transcribed completely; the errors are written to stderr.
+ */
+extern "C" bool talktex_transcribe_wavs(
+	const char* const* paths, size_t count, const char* output_directory, unsigned int threads,
+	bool create_document, Talktex_recognize recognize, Talktex_recognize_tokens recognize_tokens,
+	double initial_break_threshold, void* context, double* out_audio_seconds, double* out_seconds
+) {
+	batch::Wav_options options;
+	options.threads = threads;
+	options.create_document = create_document;
+	options.initial_break_threshold = initial_break_threshold;
+	if (output_directory) options.output_directory = output_directory;
+	batch::Wav_report report;
+	bool success = batch::transcribe(
+		std::vector<std::string>(paths, paths + count),
+		[&] { return std::make_unique<Callback_recognizer>(recognize, recognize_tokens, context); },
+		options, report
+	);
+	if (out_audio_seconds) *out_audio_seconds = report.audio_seconds;
+	if (out_seconds) *out_seconds = report.seconds;
+	return success;
+}
+
+/**
+ * Sets the level below which log messages are dropped: 0 for info, 1 for warnings, 2 for errors
+ * and 3 for none. Messages below the level set with the log-level option of meson are never
+ * logged. Returns false, and changes nothing, if [level] is not one of these.
+ */
+extern "C" bool talktex_set_log_level(int level) {
+	if (level < 0 || level > static_cast<int>(Log_level::NONE)) return false;
+	set_log_level(static_cast<Log_level>(level));
+	return true;
+}
+
+/**
+ * Makes texify look up every line in the persistent cache in the file at [path], of at most
+ * [max_bytes] bytes, before parsing it, and store the lines it converts there. The cache is kept
+ * across runs and may be shared by several processes. It is emptied when the grammar or LaTeX
+ * generation is rebuilt. Lines are compared without the spaces around them; lines whose LaTeX does
+ * not fit in a slot of the cache (Persistent_cache::SLOT_SIZE bytes) are not cached.
+ * Returns false, and uses no cache, if the file could not be created or opened.
+ */
+extern "C" bool talktex_cache_open(const char* path, size_t max_bytes) {
+	return latex_cache::open(path, max_bytes);
+}
+
+/** Stops using the persistent cache. Its entries stay in its file. */
+extern "C" void talktex_cache_close() {
+	latex_cache::close();
+}
+
+/**
+ * Enables or disables the collection of statistics on the conversion stages. They are disabled by
+ * default, and then cost next to nothing.
+ */
+extern "C" void talktex_enable_stats(bool enable) {
+	stats::set_enabled(enable);
+}
+
+/** Sets all statistics to 0 */
+extern "C" void talktex_reset_stats() {
+	stats::reset();
+}
+
+/**
+ * Writes the statistics collected since they were enabled or last reset to [buf] as a JSON object,
+ * if its character length is less than or equal to [buf_size]. The object has the time and number
+ * of calls of every conversion stage, and counters of lines, bytes, syntax tree nodes, allocations
+ * (zero if built with -Dallocation-stats=false) and cache hits. The time the conversions of the
+ * cache hits took when they were cached is given as the cache_saved_nanoseconds counter; the time
+ * of the lookups as the cache stage:
+ *   {"enabled": true, "stages": {"lex": {"calls": 3, "nanoseconds": 1200}, ...},
+ *    "counters": {"lines": 1, "failed_lines": 0, ...}}
+ * Returns true if the statistics were succesfully written to [buf], and false otherwise.
+ */
+extern "C" bool talktex_stats(char* buf, size_t buf_size) {
+	auto json = stats::to_json(stats::snapshot());
+	if (json.size() + 1 > buf_size) {
+		return false;
+	}
+	strcpy(buf, json.c_str());
+	return true;
+}
+
+/**
+ * Starts recording trace events of the conversions and writing them to the file at [path] in the
+ * Chrome trace-event format, which chrome://tracing and Perfetto open. Every texify call and every
+ * parse, to_latex and to_display_style of a line is recorded on the thread that ran it.
+ * Returns false if tracing was already started or the file could not be created.
+ */
+extern "C" bool talktex_trace_start(const char* path) {
+	return trace::start(path);
+}
+
+/** Writes the events recorded so far to the trace file. Returns false on failure. */
+extern "C" bool talktex_trace_flush() {
+	return trace::flush();
+}
+
+/**
+ * Stops recording trace events and completes the trace file.
+ * Returns false if tracing was not started or the file could not be written.
+ */
+extern "C" bool talktex_trace_stop() {
+	return trace::stop();
+}
+
+/**
+ * Returns the current time in nanoseconds on the clock of the trace events, which is the
+ * CLOCK_MONOTONIC of the system, like Python's time.monotonic_ns().
+ */
+extern "C" uint64_t talktex_trace_clock() {
+	return trace::now();
+}
+
+/**
+ * Records an event named [name] in [category] that started at [start_ns] and ended at [end_ns]
+ * (see talktex_trace_clock) on the calling thread, if tracing is started. This lets callers put
+ * their own work, like recognizing speech or compiling LaTeX, on the same timeline.
+ */
+extern "C" void talktex_trace_span(
+	const char* name, const char* category, uint64_t start_ns, uint64_t end_ns
+) {
+	trace::record(name, category, start_ns, end_ns > start_ns ? end_ns - start_ns : 0);
+}
+
+/**
+ * Returns a new scheduler of the compiles of the documents of a dictation to PDF in
+ * [output_directory] (see Compile_scheduler), to be freed with talktex_compiler_free. A document is
+ * compiled once no newer one was submitted for [debounce_seconds], or once it waited
+ * [max_delay_seconds], and after the compile before it. If [precompile_preamble], the preamble is
+ * dumped into a LaTeX format in [output_directory] once, with the talktex.sty there, and the
+ * documents load it (see Compile_options::precompile_preamble).
+ */
+extern "C" void* talktex_compiler_new(
+	const char* output_directory, double debounce_seconds, double max_delay_seconds, bool precompile_preamble
+) {
+	Compile_options options;
+	options.output_directory = output_directory;
+	options.debounce_seconds = debounce_seconds;
+	options.max_delay_seconds = max_delay_seconds;
+	options.precompile_preamble = precompile_preamble;
+	return new Compile_scheduler(std::move(options));
+}
+
+/** Compiles the document that waits, if any, waits for the compiles to end and frees [compiler] */
+extern "C" void talktex_compiler_free(void* compiler) {
+	delete static_cast<Compile_scheduler*>(compiler);
+}
+
+/** Makes [document] the next one that [compiler] compiles, and returns right away */
+extern "C" void talktex_compiler_submit(void* compiler, const char* document) {
+	static_cast<Compile_scheduler*>(compiler)->submit(document);
+}
+
+/** Waits until [compiler] has compiled every document that was submitted */
+extern "C" void talktex_compiler_wait(void* compiler) {
+	static_cast<Compile_scheduler*>(compiler)->wait_idle();
+}
+
+/** Compiles [document] with [compiler] right away and waits for it. Returns false if it failed. */
+extern "C" bool talktex_compiler_compile(void* compiler, const char* document) {
+	return static_cast<Compile_scheduler*>(compiler)->compile_now(document);
+}
+
+/**
+ * Writes the statistics of the compiles of [compiler] to [buf] as a JSON object, if its character
+ * length is less than or equal to [buf_size]. The latencies are from the submission of a document
+ * to the end of the compile that shows it; the compile durations are of the runs of latexmk:
+ *   {"submitted": 12, "compiles": 4, "failed": 0, "coalesced": 8, "write_errors": 0,
+ *    "format_builds": 1, "format_failed": 0, "format_fallbacks": 0, "body_errors": 0,
+ *    "latency": {"count": 12, "mean": 1.2, "p50": 1.1, "p95": 1.9, "max": 2.0}, "compile": {...}}
+ * Returns true if the statistics were succesfully written to [buf], and false otherwise.
+ */
+extern "C" bool talktex_compiler_statistics(const void* compiler, char* buf, size_t buf_size) {
+	Compile_report report = static_cast<const Compile_scheduler*>(compiler)->report();
+	auto summary = [](const Latency_summary& latencies) {
+		std::ostringstream json;
+		json << "{\"count\": " << latencies.count << ", \"mean\": " << latencies.mean
+		     << ", \"p50\": " << latencies.p50 << ", \"p95\": " << latencies.p95
+		     << ", \"max\": " << latencies.max << "}";
+		return json.str();
+	};
+	std::ostringstream json;
+	json << "{\"submitted\": " << report.submitted << ", \"compiles\": " << report.compiles
+	     << ", \"failed\": " << report.failed << ", \"coalesced\": " << report.coalesced
+	     << ", \"write_errors\": " << report.write_errors
+	     << ", \"format_builds\": " << report.format_builds << ", \"format_failed\": " << report.format_failed
+	     << ", \"format_fallbacks\": " << report.format_fallbacks << ", \"body_errors\": " << report.body_errors
+	     << ", \"latency\": " << summary(report.latency) << ", \"compile\": " << summary(report.compile) << "}";
+	std::string text = json.str();
+	if (text.size() + 1 > buf_size) {
+		return false;
+	}
+	strcpy(buf, text.c_str());
+	return true;
+}
+
 // =================================================================================================
 // Command-line interface
 // =================================================================================================
 
 const std::string SEPARATOR = "\n" + std::string(100, '=') + "\n\n";
 
-const char* tests[] = {
-	"b", "calligraphic b", "b tilde", "bold b hat", "capital a", "bold capital a hat",
-	"alpha", "alpha tilde", "four", "empty set", "infinity", "fraction alpha over beta",
-	"sin of capital d", "for all alpha tilde", "minus x", "function capital f from capital a to capital b",
-	"function capital f from capital a to capital b maps alpha to beta", "a plus b", "sin of cos of a",
-	"function f from capital a to capital b maps for all x to sin of fraction x over alpha",
-	"fraction b over c plus d", "fraction b over c end plus d", "a not equal b",
-	"sum from x equal zero to infinity x power two", "open parenthesis x plus two close parenthesis"
-};
-
+/**
+ * Converts and prints every line of [text], which must be followed by grammar::SCAN_PADDING
+ * writable bytes (see grammar::padded_copy). The lines are scanned in place. If [out_counts] is
+ * given, the lines and the time spent parsing and generating them are counted in it.
+ */
 bool convert_and_print(
-	Syntax_visitor& visitor, std::istream& is, bool create_document, bool verbose
+	Syntax_visitor& visitor, std::string& text, bool create_document, bool verbose,
+	batch::Line_counts* out_counts = nullptr
 ) {
 	bool success = true;
-	std::string line;
-	while (std::getline(is, line)) {
-		if (line == "") continue; // Ignore empty lines
+	size_t text_size = text.size() - grammar::SCAN_PADDING;
+	const char* text_end = text.data() + text.size();
+	grammar::for_each_line(text.data(), text_size, [&](char* line, size_t length) {
+		if (length == 0) return; // Ignore empty lines
 
-		if (verbose) std::cerr << "Input: " << aec_style::input << line << aec::reset << "\n";
+		if (verbose) {
+			std::cerr << "Input: " << aec_style::input << std::string_view(line, length)
+			          << aec::reset << "\n";
+		}
 
-		auto code = grammar::generate_from_string(line, visitor);
+		auto start = std::chrono::steady_clock::now();
+		visitor.syntax_tree = Syntax_tree(); // Don't print the tree of the previous line on failure
+		auto code = grammar::generate_from_buffer(line, length, text_end, visitor);
+		auto parsed = std::chrono::steady_clock::now();
 		if (code != 0) success = false;
+		if (out_counts) {
+			++out_counts->lines;
+			if (code != 0) ++out_counts->failed_lines;
+			out_counts->parse_seconds += std::chrono::duration<double>(parsed - start).count();
+		}
+		// Write the errors of the line before what follows it on stderr
+		if (verbose || code != 0) visitor.logger.flush();
 
 		if (verbose) std::cerr << "LaTeX: ";
-		auto latex = generation::to_latex(visitor.syntax_tree.entrance());
-		std::cout << (create_document ? generation::to_display_style(latex) : latex ) << "\n";
+		if (visitor.syntax_tree.entrance().is_valid()) {
+			std::string latex;
+			{
+				stats::Stage_timer timer(stats::TO_LATEX);
+				latex = generation::to_latex(visitor.syntax_tree.entrance());
+			}
+			if (create_document) {
+				stats::Stage_timer timer(stats::TO_DISPLAY_STYLE);
+				latex = generation::to_display_style(latex);
+			}
+			stats::count(stats::OUTPUT_BYTES, latex.size() + 1);
+			if (out_counts) {
+				out_counts->generate_seconds += std::chrono::duration<double>(
+					std::chrono::steady_clock::now() - parsed
+				).count();
+			}
+			std::cout << latex << "\n";
+		}
 
 		if (verbose) {
 			std::cerr << SEPARATOR;
 		}
-	}
+	});
 	return success;
 }
 
-bool  convert_and_print(
-	Syntax_visitor& visitor, const std::string& str, bool create_document, bool verbose
+/**
+ * Converts and prints every line of [is] on this thread, like the lines of a string. If [out_report]
+ * is given, it gets the throughput figures, like those of batch::convert.
+ */
+bool convert_and_print(
+	Syntax_visitor& visitor, std::istream& is, bool create_document, bool verbose,
+	batch::Report* out_report = nullptr
 ) {
-	std::stringstream ss(str);
-	return convert_and_print(visitor, ss, create_document, verbose);
+	auto start = std::chrono::steady_clock::now();
+	std::string text{std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()};
+	size_t bytes = text.size();
+	text.append(grammar::SCAN_PADDING, '\0');
+	auto read = std::chrono::steady_clock::now();
+	batch::Line_counts counts;
+	bool success = convert_and_print(visitor, text, create_document, verbose, &counts);
+	if (out_report) {
+		auto converted = std::chrono::steady_clock::now();
+		std::cout.flush(); // Writing the output is part of the conversion, as in batch::convert
+		out_report->bytes = bytes;
+		out_report->lines = counts.lines;
+		out_report->failed_lines = counts.failed_lines;
+		out_report->threads = 1;
+		out_report->read_seconds = std::chrono::duration<double>(read - start).count();
+		out_report->parse_seconds = counts.parse_seconds;
+		out_report->generate_seconds = counts.generate_seconds;
+		// The output is written as it is generated, so only the flush that remains is measured
+		out_report->write_seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - converted
+		).count();
+		out_report->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	return success;
+}
+
+/** Prints the throughput figures of a batch conversion to stderr */
+void print_report(const batch::Report& report) {
+	std::cerr << std::fixed << std::setprecision(2)
+	          << "Converted " << report.lines << " lines (" << report.failed_lines << " failed, "
+	          << report.bytes / 1e6 << " MB) in " << report.seconds << " s on " << report.threads
+	          << " threads: " << report.megabytes_per_second() << " MB/s, "
+	          << std::setprecision(0) << report.lines_per_second() << " lines/s\n"
+	          << std::setprecision(2) << "Thread time: reading " << report.read_seconds
+	          << " s, parsing " << report.parse_seconds << " s, generating " << report.generate_seconds
+	          << " s, writing " << report.write_seconds << " s\n";
+}
+
+/** Prints the throughput figures of a batch transcription, and the time of every stage, to stderr */
+void print_report(const batch::Wav_report& report) {
+	std::cerr << std::fixed << std::setprecision(2)
+	          << "Transcribed " << report.recordings << " recordings (" << report.failed_recordings
+	          << " failed, " << report.audio_seconds << " s of audio) in " << report.seconds << " s on "
+	          << report.threads << " threads: " << report.realtime_factor() << " audio seconds per second\n"
+	          << report.utterances << " utterances: " << report.unrecognized << " not recognized, "
+	          << report.failed_utterances << " failed to parse\n"
+	          << "Thread time: decoding " << report.decode_seconds << " s, segmentation "
+	          << report.segment_seconds << " s, recognition " << report.recognize_seconds
+	          << " s, conversion " << report.convert_seconds << " s\n";
+	if (report.previewed > 0) {
+		std::cerr << report.previewed << " utterances previewed (" << report.confirmed_previews
+		          << " confirmed) in " << report.preview_seconds << " s: first preview after "
+		          << report.first_preview_audio / report.previewed << " s of audio on average, final LaTeX after "
+		          << report.final_audio / report.previewed << " s\n";
+	}
 }
 
 int main(int argc, char** argv) {
@@ -134,15 +833,91 @@ int main(int argc, char** argv) {
 		TCLAP::ValueArg<std::string> input_file_path_arg("f", "file", "Path to source file.", false, "", "string");
 		TCLAP::ValueArg<std::string> input_arg("i", "input", "Input string to parse.", false, "", "string");
 		TCLAP::SwitchArg test_switch("t", "tests", "Perform tests", false);
+		TCLAP::ValueArg<std::string> serve_arg("s", "serve", "Serve conversion requests on the Unix socket at this path, or on standard in and out if the path is '-'.", false, "", "string");
+		TCLAP::MultiArg<std::string> wav_arg("w", "wav", "Transcribe this WAV recording to LaTeX in a .tex file next to it, recognizing its utterances as the lines of the transcript next to it (.txt). May be given several times; the recordings are transcribed in parallel.", false, "path");
 		TCLAP::SwitchArg create_document_switch("d", "create-document", "Create a full LaTeX document.", cmd, false);
 		TCLAP::SwitchArg verbose_switch("v", "verbose", "Show verbose output", cmd, false);
+		TCLAP::ValueArg<unsigned int> threads_arg("j", "threads", "Number of threads to convert a file (-f) or transcribe recordings (-w) with. Defaults to the number of hardware threads.", false, 0, "unsigned integer", cmd);
+		TCLAP::SwitchArg report_switch("r", "report", "Report the throughput of converting a file (-f) or transcribing recordings (-w) to stderr.", cmd, false);
+		TCLAP::ValueArg<std::string> output_directory_arg("", "output-directory", "Write the .tex files of the recordings (-w) to this directory.", false, "", "string", cmd);
+		TCLAP::ValueArg<unsigned int> preview_arg("", "preview-ms", "Preview the words recognized so far of every utterance of the recordings (-w) this often, and use the preview if the final words confirm it. Defaults to never.", false, 0, "unsigned integer", cmd);
+		TCLAP::ValueArg<unsigned int> idle_timeout_arg("", "idle-timeout", "Stop serving (-s) after this many seconds without connections. Defaults to never.", false, 0, "unsigned integer", cmd);
+		TCLAP::ValueArg<unsigned int> cache_size_arg("", "cache-size", "Keep the conversions of recent lines in a cache of this many megabytes, shared by all connections, when serving (-s).", false, 0, "unsigned integer", cmd);
+		TCLAP::ValueArg<std::string> trace_arg("", "trace", "Record the time spent in every conversion stage of every line as Chrome trace-event JSON in this file.", false, "", "string", cmd);
+		TCLAP::SwitchArg stats_switch("", "stats", "Measure the time spent in every conversion stage and print it, with counts of lines, bytes, syntax tree nodes, allocations and cache hits, as JSON to stderr at the end.", cmd, false);
+		TCLAP::ValueArg<std::string> log_arg("", "log", "Write the errors and warnings to this file instead of stderr.", false, "", "string", cmd);
+		std::vector<std::string> log_levels{"info", "warning", "error", "none"};
+		TCLAP::ValuesConstraint<std::string> log_level_constraint(log_levels);
+		TCLAP::ValueArg<std::string> log_level_arg("", "log-level", "Do not log messages below this level.", false, "info", &log_level_constraint, cmd);
 
 		TCLAP::OneOf inputs;
-		inputs.add(input_file_path_arg).add(input_arg).add(test_switch);
+		inputs.add(input_file_path_arg).add(input_arg).add(test_switch).add(serve_arg).add(wav_arg);
 		cmd.add(inputs);
 		cmd.parse(argc, argv);
 
-		Logger logger(std::cerr, std::cerr, std::cerr);
+		for (size_t level = 0; level < log_levels.size(); ++level) {
+			if (log_levels[level] == log_level_arg.getValue()) set_log_level(static_cast<Log_level>(level));
+		}
+		Log_sink* log_sink = &STDERR_SINK;
+		std::unique_ptr<File_sink> log_file;
+		if (log_arg.isSet()) {
+			log_file = std::make_unique<File_sink>(log_arg.getValue());
+			if (!log_file->is_open()) {
+				std::cerr << aec_style::error << "Error:" << aec::reset << " Could not create log file "
+				          << log_arg.getValue() << "\n";
+				return 1;
+			}
+			log_sink = log_file.get();
+		}
+
+		if (stats_switch.getValue()) stats::set_enabled(true);
+		if (trace_arg.isSet() && !trace::start(trace_arg.getValue())) {
+			std::cerr << aec_style::error << "Error:" << aec::reset << " Could not create trace file "
+			          << trace_arg.getValue() << "\n";
+			return 1;
+		}
+		// Reports the statistics and completes the trace however we return
+		struct Instrumentation_finisher {
+			~Instrumentation_finisher() {
+				if (trace::enabled() && !trace::stop()) {
+					std::cerr << aec_style::error << "Error:" << aec::reset << " Could not write trace file\n";
+				}
+				if (stats::enabled()) std::cerr << stats::to_json(stats::snapshot()) << std::endl;
+			}
+		} instrumentation_finisher;
+
+		if (serve_arg.isSet()) {
+			std::unique_ptr<Line_cache> cache;
+			if (cache_size_arg.getValue() != 0) {
+				cache = std::make_unique<Line_cache>(size_t(cache_size_arg.getValue()) << 20);
+			}
+			const std::string& socket_path = serve_arg.getValue();
+			if (socket_path == "-") {
+				return (service::serve_connection(STDIN_FILENO, STDOUT_FILENO, cache.get()) ? 0 : 1);
+			}
+			service::Server_options options;
+			options.idle_timeout = idle_timeout_arg.getValue();
+			options.cache = cache.get();
+			return (service::serve(socket_path, options) ? 0 : 1);
+		}
+
+		if (wav_arg.isSet()) {
+			batch::Wav_options options;
+			options.threads = threads_arg.getValue();
+			options.create_document = create_document_switch.getValue();
+			options.output_directory = output_directory_arg.getValue();
+			options.log_sink = log_sink;
+			options.preview_ms = preview_arg.getValue();
+			batch::Wav_report report;
+			bool transcribed = batch::transcribe(
+				wav_arg.getValue(), [] { return std::make_unique<batch::Transcript_recognizer>(); },
+				options, report
+			);
+			if (report_switch.getValue()) print_report(report);
+			return (transcribed ? 0 : 1);
+		}
+
+		Logger logger(*log_sink);
 		Syntax_visitor vis(logger);
 
 		bool create_document = create_document_switch.getValue();
@@ -162,21 +937,42 @@ int main(int argc, char** argv) {
 		}
 
 		if (test_switch.isSet()) {
-			for (const char* test : tests) {
-				if (!convert_and_print(vis, test, create_document, verbose)) success = false;
+			for (const char* test : grammar::SAMPLE_INPUTS) {
+				std::string text = grammar::padded_copy(test);
+				if (!convert_and_print(vis, text, create_document, verbose)) success = false;
 			}
 		} else if (input_file_path_arg.isSet()) {
 			const std::string& path = input_file_path_arg.getValue();
+			Mapped_file mapped_file;
 			std::ifstream file;
-			if (try_open_input_file(path, file)) {
-				if (!convert_and_print(vis, file, create_document, verbose)) success = false;
+			// Regular files are mapped and converted on several threads, unless we are asked to
+			// show the conversion line by line
+			if (!verbose && mapped_file.open(path)) {
+				batch::Options options;
+				options.create_document = create_document;
+				options.threads = threads_arg.getValue();
+				options.log_sink = log_sink;
+				batch::Report report;
+
+				std::cout.flush(); // The batch output is written directly to the file descriptor
+				if (!batch::convert(mapped_file.data(), mapped_file.size(), STDOUT_FILENO, options, report)) {
+					success = false;
+				}
+				if (report_switch.getValue()) print_report(report);
+			}
+			else if (try_open_input_file(path, file)) {
+				// Pipes, and verbose conversions, are converted on this thread as they are read
+				batch::Report report;
+				if (!convert_and_print(vis, file, create_document, verbose, &report)) success = false;
+				vis.logger.flush(); // Before the report
+				if (report_switch.getValue()) print_report(report);
 			}
 			else if (verbose) {
 				std::cerr << SEPARATOR;
 			}
 		} else if (input_arg.isSet()) {
-			const std::string& input = input_arg.getValue();
-			if (!convert_and_print(vis, input, create_document, verbose)) success = false;
+			std::string text = grammar::padded_copy(input_arg.getValue());
+			if (!convert_and_print(vis, text, create_document, verbose)) success = false;
 		}
 
 		if (create_document) {
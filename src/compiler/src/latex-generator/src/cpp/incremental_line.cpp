@@ -0,0 +1,77 @@
+#include "incremental_line.h"
+
+#include "stats.h"
+
+Incremental_line::Incremental_line(Logger& logger) : parse(logger) {}
+
+int Incremental_line::convert(std::string_view line) {
+	int result = parse.parse(line);
+	update();
+	return result;
+}
+
+int Incremental_line::edit(size_t first, size_t last, std::string_view replacement) {
+	int result = parse.edit(first, last, replacement);
+	update();
+	return result;
+}
+
+void Incremental_line::expression_ranges(
+	const std::vector<generation::Latex_range>& node_ranges, size_t first, size_t count,
+	std::vector<generation::Latex_range>& out_ranges
+) const {
+	const auto& expressions = parse.expressions();
+	size_t next = 0;
+	for (size_t i = first; i < first + count; ++i) {
+		if (i > first && expressions[i].node == expressions[i - 1].node) {
+			out_ranges.push_back(out_ranges.back());
+		}
+		else {
+			out_ranges.push_back(node_ranges[next++]);
+		}
+	}
+}
+
+void Incremental_line::update() {
+	stats::Stage_timer timer(stats::TO_LATEX);
+	const grammar::Incremental_parse::Change& change = parse.last_change();
+	if (!parse.success()) {
+		output.clear();
+		ranges.clear();
+		return;
+	}
+	if (change.whole_line) {
+		output.clear();
+		ranges.clear();
+		std::vector<generation::Latex_range> node_ranges;
+		generation::append_latex(parse.syntax_tree().entrance(), output, node_ranges);
+		expression_ranges(node_ranges, 0, parse.expressions().size(), ranges);
+		return;
+	}
+	if (change.removed == 0 && change.added == 0) return;
+
+	// Regenerate the replaced expression, which is the first of the replaced ones
+	generation::Latex_range old = ranges[change.first];
+	std::string latex;
+	std::vector<generation::Latex_range> node_ranges;
+	generation::append_latex(parse.expressions()[change.first].node, latex, node_ranges);
+	std::vector<generation::Latex_range> new_ranges;
+	expression_ranges(node_ranges, change.first, change.added, new_ranges);
+	output.replace(old.begin, old.end - old.begin, latex);
+
+	// The expressions before it that end after it contain it
+	std::ptrdiff_t delta = static_cast<std::ptrdiff_t>(latex.size()) - (old.end - old.begin);
+	for (size_t i = 0; i < change.first; ++i) {
+		if (ranges[i].end >= old.end) ranges[i].end += delta;
+	}
+	for (size_t i = change.first + change.removed; i < ranges.size(); ++i) {
+		ranges[i].begin += delta;
+		ranges[i].end += delta;
+	}
+	for (generation::Latex_range& range : new_ranges) {
+		range.begin += old.begin;
+		range.end += old.begin;
+	}
+	ranges.erase(ranges.begin() + change.first, ranges.begin() + change.first + change.removed);
+	ranges.insert(ranges.begin() + change.first, new_ranges.begin(), new_ranges.end());
+}
@@ -0,0 +1,97 @@
+#include "latex_cache.h"
+
+#include <atomic>
+#include <ctime>
+#include <mutex>
+#include <shared_mutex>
+
+#include <dlfcn.h>
+#include <sys/stat.h>
+
+#include "grammar.h"
+#include "latex_generation.h"
+#include "stats.h"
+
+namespace latex_cache {
+
+namespace {
+
+Persistent_cache cache;
+std::shared_mutex cache_mutex;     // Shared while the cache is used, exclusive to open or close it
+std::atomic<bool> opened{false};   // So that texify need not lock if there is no cache
+
+/** Adds the path, size and modification time of the library (or executable) with [code] to [hash] */
+void hash_library(const void* code, uint64_t& hash) {
+	auto mix = [&](uint64_t value) {
+		hash ^= value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+	};
+	Dl_info info;
+	struct stat st;
+	if (dladdr(code, &info) == 0 || info.dli_fname == nullptr || stat(info.dli_fname, &st) != 0) {
+		// We can't tell which build this is, so make sure no one else's entries match
+		mix(static_cast<uint64_t>(std::time(nullptr)));
+		mix(reinterpret_cast<uintptr_t>(&hash));
+		return;
+	}
+	for (const char* c = info.dli_fname; *c != '\0'; ++c) mix(static_cast<unsigned char>(*c));
+	mix(static_cast<uint64_t>(st.st_size));
+	mix(static_cast<uint64_t>(st.st_mtim.tv_sec));
+	mix(static_cast<uint64_t>(st.st_mtim.tv_nsec));
+}
+
+/** Identifies the builds of the parser and the LaTeX generation, which the entries depend on */
+uint64_t build_generation() {
+	uint64_t hash = 0;
+	hash_library(reinterpret_cast<const void*>(&grammar::generate_from_buffer), hash);
+	hash_library(reinterpret_cast<const void*>(&generation::to_latex), hash);
+	return hash;
+}
+
+} // unnamed namespace
+
+bool open(const std::string& path, size_t max_bytes) {
+	uint64_t generation = build_generation();
+	std::unique_lock<std::shared_mutex> lock(cache_mutex);
+	bool success = cache.open(path, max_bytes, generation);
+	opened.store(success, std::memory_order_release);
+	return success;
+}
+
+void close() {
+	std::unique_lock<std::shared_mutex> lock(cache_mutex);
+	opened.store(false, std::memory_order_release);
+	cache.close();
+}
+
+bool is_open() {
+	return opened.load(std::memory_order_acquire);
+}
+
+std::string_view normalize(std::string_view line) {
+	size_t begin = line.find_first_not_of(" \t");
+	if (begin == std::string_view::npos) return line.substr(line.size());
+	size_t end = line.find_last_not_of(" \t");
+	return line.substr(begin, end + 1 - begin);
+}
+
+bool find(std::string_view utterance, Persistent_cache::Entry& out_entry) {
+	if (!is_open()) return false;
+	stats::Stage_timer timer(stats::CACHE);
+	std::shared_lock<std::shared_mutex> lock(cache_mutex);
+	if (!cache.find(utterance, out_entry)) {
+		stats::count(stats::CACHE_MISSES);
+		return false;
+	}
+	stats::count(stats::CACHE_HITS);
+	stats::count(stats::CACHE_SAVED_NANOSECONDS, out_entry.nanoseconds);
+	return true;
+}
+
+void insert(std::string_view utterance, const Persistent_cache::Entry& entry) {
+	if (!is_open()) return;
+	stats::Stage_timer timer(stats::CACHE);
+	std::shared_lock<std::shared_mutex> lock(cache_mutex);
+	cache.insert(utterance, entry);
+}
+
+} // namespace latex_cache
@@ -2,6 +2,8 @@
 
 #include <map>
 
+#include "incremental_parse.h"
+
 //==================================================================================================
 // Helper functions and constants
 //==================================================================================================
@@ -15,15 +17,7 @@ std::string command(const std::string& name) {
 const std::string ERROR_TARGET =
 	command(" ") + command("text{Internal TalkTeX Error}") + command(" ");
 
-std::string parenthesize(const std::string& inner) {
-	return command("left(") + inner + command("right)");
-}
-
-std::string brace(const std::string& inner) {
-	return "{" + inner + "}";
-}
-
-std::string texify_rangeop(Rangeop_type type) {
+const std::string& texify_rangeop(Rangeop_type type) {
 	static const std::map<Rangeop_type, std::string> map{
 		{Rangeop_type::Sum,             command("sum")},
 		{Rangeop_type::Product,         command("prod")},
@@ -34,7 +28,7 @@ std::string texify_rangeop(Rangeop_type type) {
 	return ERROR_TARGET;
 }
 
-std::string texify_binop(Binop_type type) {
+const std::string& texify_binop(Binop_type type) {
 	static const std::map<Binop_type, std::string> map{
 		{Binop_type::Plus,          "+"},
 		{Binop_type::Minus,         "-"},
@@ -63,7 +57,7 @@ std::string texify_binop(Binop_type type) {
 	return ERROR_TARGET;
 }
 
-std::string texify_unop(Unop_type type) {
+const std::string& texify_unop(Unop_type type) {
 	static const std::map<Unop_type, std::string> map{
 		{Unop_type::Square_root, command("sqrt ")},
 		{Unop_type::Sin,         command("sin ")},
@@ -81,7 +75,7 @@ std::string texify_unop(Unop_type type) {
 	return ERROR_TARGET;
 }
 
-std::string texify_special_symbol(Special_symbol_type type) {
+const std::string& texify_special_symbol(Special_symbol_type type) {
 	static const std::map<Special_symbol_type, std::string> map{
 		{Special_symbol_type::Empty_set, command("emptyset")},
 		{Special_symbol_type::Infinity,  command("infty")}
@@ -91,7 +85,7 @@ std::string texify_special_symbol(Special_symbol_type type) {
 	return ERROR_TARGET;
 }
 
-std::string texify_accent(Accent_type type) {
+const std::string& texify_accent(Accent_type type) {
 	static const std::map<Accent_type, std::string> map{
 		{Accent_type::Tilde, command("tilde")},
 		{Accent_type::Hat,   command("hat")},
@@ -102,7 +96,7 @@ std::string texify_accent(Accent_type type) {
 	return ERROR_TARGET;
 }
 
-std::string texify_typesetting(Typesetting_type type) {
+const std::string& texify_typesetting(Typesetting_type type) {
 	static const std::map<Typesetting_type, std::string> map{
 		{Typesetting_type::Bold,         command("mathbb")},
 		{Typesetting_type::Calligraphic, command("mathcal")},
@@ -113,11 +107,7 @@ std::string texify_typesetting(Typesetting_type type) {
 	return ERROR_TARGET;
 }
 
-std::string texify_greek_symbol(const std::string& str) {
-	return command(str); // I'm pretty sure this always holds
-}
-
-std::string texify_digit(const std::string& str) {
+const std::string& texify_digit(const std::string& str) {
 	static const std::map<std::string, std::string> map{
 		{"zero",  "0"},
 		{"one",   "1"},
@@ -135,6 +125,136 @@ std::string texify_digit(const std::string& str) {
 	return ERROR_TARGET;
 }
 
+/**
+ * Appends the LaTeX of trees to a string. Optionally notes where the LaTeX of each expression
+ * (anyexpr in compiler.y) begins and ends.
+ */
+class Latex_writer {
+public:
+	Latex_writer(std::string& out, std::vector<generation::Latex_range>* out_ranges)
+		: out(out), ranges(out_ranges) {}
+
+	void write(Syntax_tree::const_traverser t, bool is_expression) {
+		size_t range = 0;
+		if (ranges != nullptr && is_expression) {
+			range = ranges->size();
+			ranges->push_back({out.size(), out.size()});
+		}
+		write_node(t);
+		if (ranges != nullptr && is_expression) {
+			(*ranges)[range].end = out.size();
+		}
+	}
+
+private:
+	void write_node(Syntax_tree::const_traverser t) {
+		/// Shorthand to convert a child subtree to latex, since it's used so much.
+		auto child              = [&](size_t index){write(t.child(index), grammar::is_expression_child(t, index));};
+
+		// Shorthands to get a specific type of data from the node that t is pointing at:
+
+		auto get_typesetting    = [&](){return std::get<Typesetting_type>   (*t->data);};
+		auto get_accent         = [&](){return std::get<Accent_type>        (*t->data);};
+		auto get_special_symbol = [&](){return std::get<Special_symbol_type>(*t->data);};
+		auto get_unary          = [&](){return std::get<Unop_type>          (*t->data);};
+		auto get_binary         = [&](){return std::get<Binop_type>         (*t->data);};
+		auto get_range          = [&](){return std::get<Rangeop_type>       (*t->data);};
+		auto get_string         = [&](){return std::get<std::string>        (*t->data);};
+		auto get_char           = [&](){return std::get<char>               (*t->data);};
+
+		switch (t->type) {
+		case Construction::Type::Expr_parentheses:
+			out += "\\left("; child(0); out += "\\right)";
+			return;
+		case Construction::Type::Expr_range:
+			child(0); child(1); child(2);
+			return;
+		case Construction::Type::Expr_binop:
+			child(0); child(1); child(2);
+			return;
+		case Construction::Type::Expr_unop:
+			child(0); child(1);
+			return;
+		case Construction::Type::Expr_of:
+			child(0); out += "\\left("; child(1); out += "\\right)";
+			return;
+		case Construction::Type::Expr_func:
+			child(0);
+			return;
+		case Construction::Type::Expr_frac:
+			out += "\\frac{"; child(0); out += "}{"; child(1); out += "}";
+			return;
+		case Construction::Type::Expr_symbol:
+			child(0);
+			return;
+		case Construction::Type::Func:
+			child(0);
+			return;
+		case Construction::Type::Func_mapsto:
+			child(0); out += ", "; child(1);
+			return;
+		case Construction::Type::Mapsto:
+			child(0); out += " \\mapsto "; child(1);
+			return;
+		case Construction::Type::Openfunc:
+			child(0); out += ": "; child(1); out += " \\to "; child(2);
+			return;
+		case Construction::Type::Range:
+			out += "_{"; child(0); out += "}^{"; child(1); out += "}";
+			return;
+		case Construction::Type::Rangeop:
+			out += texify_rangeop(get_range());
+			return;
+		case Construction::Type::Binop:
+			out += texify_binop(get_binary());
+			return;
+		case Construction::Type::Binop_negated:
+			out += "\\not "; child(0);
+			return;
+		case Construction::Type::Unop:
+			out += texify_unop(get_unary());
+			return;
+		case Construction::Type::Symbol_variable:
+			child(0);
+			return;
+		case Construction::Type::Symbol_digit:
+			child(0);
+			return;
+		case Construction::Type::Symbol_special:
+			out += texify_special_symbol(get_special_symbol());
+			return;
+		case Construction::Type::Variable_accent:
+			child(1); out += "{"; child(0); out += "}";
+			return;
+		case Construction::Type::Variable_typesetting:
+			child(0); out += "{"; child(1); out += "}";
+			return;
+		case Construction::Type::Variable_letter:
+			child(0);
+			return;
+		case Construction::Type::Accent:
+			out += texify_accent(get_accent());
+			return;
+		case Construction::Type::Typesetting:
+			out += texify_typesetting(get_typesetting());
+			return;
+		case Construction::Type::Letter:
+			out += get_char();
+			return;
+		case Construction::Type::Greek_symbol:
+			out += "\\"; out += get_string(); // I'm pretty sure this always holds
+			return;
+		case Construction::Type::Digit:
+			out += texify_digit(get_string());
+			return;
+		}
+		out += ERROR_TARGET; // Invalid type, should never happen
+	}
+
+	std::string& out;
+	std::vector<generation::Latex_range>* ranges;
+};
+
 } // unnamed namespace
 
 //==================================================================================================
@@ -144,96 +264,36 @@ std::string texify_digit(const std::string& str) {
 namespace generation {
 
 std::string to_latex(Syntax_tree::const_traverser t) {
-	/// Shorthand to convert a child subtree to latex, since it's used so much.
-	auto child              = [&](size_t index){return to_latex(t.child(index));};
-
-	// Shorthands to get a specific type of data from the node that t is pointing at:
-
-	auto get_typesetting    = [&](){return std::get<Typesetting_type>   (*t->data);};
-	auto get_accent         = [&](){return std::get<Accent_type>        (*t->data);};
-	auto get_special_symbol = [&](){return std::get<Special_symbol_type>(*t->data);};
-	auto get_unary          = [&](){return std::get<Unop_type>          (*t->data);};
-	auto get_binary         = [&](){return std::get<Binop_type>         (*t->data);};
-	auto get_range          = [&](){return std::get<Rangeop_type>       (*t->data);};
-	auto get_string         = [&](){return std::get<std::string>        (*t->data);};
-	auto get_char           = [&](){return std::get<char>               (*t->data);};
-
-	switch (t->type) {
-	case Construction::Type::Expr_parentheses:
-		return parenthesize(child(0));
-	case Construction::Type::Expr_range:
-		return child(0) + child(1) + child(2);
-	case Construction::Type::Expr_binop:
-		return child(0) + child(1) + child(2);
-	case Construction::Type::Expr_unop:
-		return child(0) + child(1);
-	case Construction::Type::Expr_of:
-		return child(0) + parenthesize(child(1));
-	case Construction::Type::Expr_func:
-		return child(0);
-	case Construction::Type::Expr_frac:
-		return command("frac") + brace(child(0)) + brace(child(1));
-	case Construction::Type::Expr_symbol:
-		return child(0);
-	case Construction::Type::Func:
-		return child(0);
-	case Construction::Type::Func_mapsto:
-		return child(0) + ", " + child(1);
-	case Construction::Type::Mapsto:
-		return child(0) + " " + command("mapsto ") + child(1);
-	case Construction::Type::Openfunc:
-		return child(0) + ": " + child(1) + " " + command("to ") + child(2);
-	case Construction::Type::Range:
-		return "_" + brace(child(0)) + "^" + brace(child(1));
-	case Construction::Type::Rangeop:
-		return texify_rangeop(get_range());
-	case Construction::Type::Binop:
-		return texify_binop(get_binary());
-	case Construction::Type::Binop_negated:
-		return command("not ") + child(0);
-	case Construction::Type::Unop:
-		return texify_unop(get_unary());
-	case Construction::Type::Symbol_variable:
-		return child(0);
-	case Construction::Type::Symbol_digit:
-		return child(0);
-	case Construction::Type::Symbol_special:
-		return texify_special_symbol(get_special_symbol());
-	case Construction::Type::Variable_accent:
-		return child(1) + brace(child(0));
-	case Construction::Type::Variable_typesetting:
-		return child(0) + brace(child(1));
-	case Construction::Type::Variable_letter:
-		return child(0);
-	case Construction::Type::Accent:
-		return texify_accent(get_accent());
-	case Construction::Type::Typesetting:
-		return texify_typesetting(get_typesetting());
-	case Construction::Type::Letter:
-		return std::string(1, get_char()); // Why is there no constructor for just a char??
-	case Construction::Type::Greek_symbol:
-		return texify_greek_symbol(get_string());
-	case Construction::Type::Digit:
-		return texify_digit(get_string());
-	}
-	return ERROR_TARGET; // Invalid type, should never happen
+	std::string latex;
+	append_latex(t, latex);
+	return latex;
 }
 
+void append_latex(Syntax_tree::const_traverser t, std::string& out) {
+	Latex_writer(out, nullptr).write(t, true);
+}
+
+void append_latex(Syntax_tree::const_traverser t, std::string& out, std::vector<Latex_range>& out_ranges) {
+	Latex_writer(out, &out_ranges).write(t, true);
+}
 
 std::string to_display_style(const std::string& latex_expression) {
 	return command("[") + " " + latex_expression + " " + command("]");
 }
 
-/** Returns the TalkTeX LaTeX header, including \begin{document} */
-std::string talktex_header() {
-	static const std::string header =
-R"latex(% This file was generated by TalkTeX
+namespace {
 
-\documentclass[12pt, english, DIV=9]{scrartcl}
+const char GENERATED_COMMENT[] = "% This file was generated by TalkTeX\n\n";
+
+const char PREAMBLE[] =
+R"latex(\documentclass[12pt, english, DIV=9]{scrartcl}
 \usepackage{talktex}
 \usepackage{amsfonts}
 \usepackage{amsmath}
+)latex";
 
+const char DOCUMENT_START[] =
+R"latex(
 \begin{document}
 
 \begin{center}
@@ -241,9 +301,23 @@ R"latex(% This file was generated by TalkTeX
 \end{center}
 
 )latex";
+
+} // unnamed namespace
+
+/** Returns the TalkTeX LaTeX header, including \begin{document} */
+std::string talktex_header() {
+	static const std::string header = std::string(GENERATED_COMMENT) + PREAMBLE + DOCUMENT_START;
 	return header;
 }
 
+std::string talktex_preamble() {
+	return PREAMBLE;
+}
+
+std::string talktex_format_header(const std::string& format_name) {
+	return "%&" + format_name + "\n" + GENERATED_COMMENT + DOCUMENT_START;
+}
+
 /** Returns the TalkTeX LaTeX footer, including \end{document} */
 std::string talktex_footer() {
 	static const std::string footer =
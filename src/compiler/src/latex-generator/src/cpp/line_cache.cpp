@@ -0,0 +1,103 @@
+#include "line_cache.h"
+
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <thread>
+#include <utility>
+
+#include "stats.h"
+
+namespace {
+
+/** What a cached line costs besides its strings: its list node, map node and their allocations */
+constexpr size_t NODE_OVERHEAD = 128;
+
+} // unnamed namespace
+
+Line_cache::Line_cache(size_t max_bytes, size_t shards) {
+	if (shards == 0) shards = 4 * std::max(1u, std::thread::hardware_concurrency());
+	size_t count = 1;
+	while (count < shards) count *= 2;
+	this->shards = std::make_unique<Shard[]>(count);
+	shard_mask = count - 1;
+	bytes_per_shard = max_bytes / count;
+}
+
+Line_cache::Shard& Line_cache::shard_of(std::string_view line) {
+	size_t hash = std::hash<std::string_view>()(line);
+	// The maps of the shards use the low bits, so pick the shard with the high ones. Shifting by
+	// fractions of the width keeps the shifts defined where size_t has 32 bits.
+	constexpr unsigned int HALF_BITS = sizeof(size_t) * CHAR_BIT / 2;
+	return shards[(hash >> HALF_BITS ^ hash >> HALF_BITS / 2) & shard_mask];
+}
+
+bool Line_cache::find(std::string_view line, Entry& out_entry) {
+	stats::Stage_timer timer(stats::CACHE);
+	Shard& shard = shard_of(line);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	auto found = shard.index.find(line);
+	if (found == shard.index.end()) {
+		++shard.statistics.misses;
+		stats::count(stats::CACHE_MISSES);
+		return false;
+	}
+	shard.recency.splice(shard.recency.begin(), shard.recency, found->second);
+	out_entry = found->second->entry;
+	++shard.statistics.hits;
+	stats::count(stats::CACHE_HITS);
+	stats::count(stats::CACHE_SAVED_NANOSECONDS, out_entry.nanoseconds);
+	return true;
+}
+
+void Line_cache::insert(std::string_view line, Entry entry) {
+	size_t bytes = line.size() + entry.output.size() + entry.diagnostics.size() + NODE_OVERHEAD;
+	if (bytes > bytes_per_shard) return;
+
+	stats::Stage_timer timer(stats::CACHE);
+	Shard& shard = shard_of(line);
+	// Evicted nodes are destroyed after unlocking, so that other threads need not wait for that
+	std::list<Node> evicted;
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto found = shard.index.find(line);
+		if (found != shard.index.end()) {
+			Node& node = *found->second;
+			shard.bytes -= node.bytes;
+			node.entry = std::move(entry);
+			node.bytes = bytes;
+			shard.recency.splice(shard.recency.begin(), shard.recency, found->second);
+		}
+		else {
+			shard.recency.push_front(Node{std::string(line), std::move(entry), bytes});
+			// The key views the line of the node, which stays where it is until it is evicted
+			shard.index.emplace(shard.recency.front().line, shard.recency.begin());
+			++shard.statistics.insertions;
+		}
+		shard.bytes += bytes;
+
+		while (shard.bytes > bytes_per_shard) {
+			auto oldest = std::prev(shard.recency.end());
+			shard.index.erase(oldest->line);
+			shard.bytes -= oldest->bytes;
+			evicted.splice(evicted.end(), shard.recency, oldest);
+			++shard.statistics.evictions;
+		}
+	}
+	stats::count(stats::CACHE_EVICTIONS, evicted.size());
+}
+
+Line_cache::Statistics Line_cache::statistics() const {
+	Statistics total;
+	for (size_t i = 0; i <= shard_mask; ++i) {
+		const Shard& shard = shards[i];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		total.hits       += shard.statistics.hits;
+		total.misses     += shard.statistics.misses;
+		total.insertions += shard.statistics.insertions;
+		total.evictions  += shard.statistics.evictions;
+		total.entries    += shard.recency.size();
+		total.bytes      += shard.bytes;
+	}
+	return total;
+}
@@ -0,0 +1,203 @@
+#include "service.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace service {
+
+//==================================================================================================
+// Helper functions
+//==================================================================================================
+
+namespace {
+
+constexpr size_t LENGTH_SIZE = 4;
+
+void put_length(std::string& out, uint32_t length) {
+	for (int shift = 24; shift >= 0; shift -= 8) {
+		out.push_back(static_cast<char>((length >> shift) & 0xff));
+	}
+}
+
+uint32_t get_length(const char* bytes) {
+	uint32_t length = 0;
+	for (size_t i = 0; i < LENGTH_SIZE; ++i) {
+		length = (length << 8) | static_cast<unsigned char>(bytes[i]);
+	}
+	return length;
+}
+
+/** Reads exactly [size] bytes. Returns false at the end of the stream or on errors. */
+bool read_all(int fd, char* data, size_t size) {
+	while (size != 0) {
+		ssize_t count = ::read(fd, data, size);
+		if (count < 0 && errno == EINTR) continue;
+		if (count <= 0) return false;
+		data += count;
+		size -= static_cast<size_t>(count);
+	}
+	return true;
+}
+
+bool write_all(int fd, const char* data, size_t size) {
+	while (size != 0) {
+		// send() with MSG_NOSIGNAL does not raise SIGPIPE when the peer is gone, but it only works
+		// on sockets, so we fall back to write() for pipes
+		ssize_t count = ::send(fd, data, size, MSG_NOSIGNAL);
+		if (count < 0 && errno == ENOTSOCK) count = ::write(fd, data, size);
+		if (count < 0 && errno == EINTR) continue;
+		if (count < 0) return false;
+		data += count;
+		size -= static_cast<size_t>(count);
+	}
+	return true;
+}
+
+} // unnamed namespace
+
+std::string default_socket_path() {
+	if (const char* path = std::getenv("TALKTEX_SOCKET")) {
+		return path;
+	}
+	const char* directory = std::getenv("XDG_RUNTIME_DIR");
+	if (directory == nullptr) directory = "/tmp";
+	return std::string(directory) + "/talktex-" + std::to_string(getuid()) + ".sock";
+}
+
+//==================================================================================================
+// Framing
+//==================================================================================================
+
+bool read_frame(int fd, std::string& payload) {
+	char length_bytes[LENGTH_SIZE];
+	if (!read_all(fd, length_bytes, LENGTH_SIZE)) return false;
+
+	uint32_t length = get_length(length_bytes);
+	if (length > MAX_FRAME_SIZE) return false;
+
+	payload.resize(length);
+	return read_all(fd, payload.data(), length);
+}
+
+bool write_frame(int fd, std::string_view payload) {
+	if (payload.size() > MAX_FRAME_SIZE) return false;
+
+	// One write for small frames, so that they don't end up in separate packets
+	std::string frame;
+	frame.reserve(LENGTH_SIZE + payload.size());
+	put_length(frame, static_cast<uint32_t>(payload.size()));
+	frame.append(payload);
+	return write_all(fd, frame.data(), frame.size());
+}
+
+std::string encode_request(const Request& request) {
+	std::string payload;
+	payload.reserve(1 + request.text.size());
+	payload.push_back(static_cast<char>(request.create_document ? CREATE_DOCUMENT : 0));
+	payload.append(request.text);
+	return payload;
+}
+
+std::string encode_response(const Response& response) {
+	std::string payload;
+	payload.reserve(1 + LENGTH_SIZE + response.output.size() + response.diagnostics.size());
+	payload.push_back(static_cast<char>(response.success ? 0 : 1));
+	put_length(payload, static_cast<uint32_t>(response.output.size()));
+	payload.append(response.output);
+	payload.append(response.diagnostics);
+	return payload;
+}
+
+bool decode_request(std::string_view payload, Request& out_request) {
+	if (payload.empty()) return false;
+	auto flags = static_cast<uint8_t>(payload[0]);
+	if ((flags & ~CREATE_DOCUMENT) != 0) return false;
+
+	out_request.create_document = (flags & CREATE_DOCUMENT) != 0;
+	out_request.text.assign(payload.substr(1));
+	return true;
+}
+
+bool decode_response(std::string_view payload, Response& out_response) {
+	if (payload.size() < 1 + LENGTH_SIZE) return false;
+	auto status = static_cast<uint8_t>(payload[0]);
+	uint32_t output_size = get_length(payload.data() + 1);
+	if (status > 1 || output_size > payload.size() - 1 - LENGTH_SIZE) return false;
+
+	out_response.success = (status == 0);
+	out_response.output.assign(payload.substr(1 + LENGTH_SIZE, output_size));
+	out_response.diagnostics.assign(payload.substr(1 + LENGTH_SIZE + output_size));
+	return true;
+}
+
+//==================================================================================================
+// Client
+//==================================================================================================
+
+Client::Client() noexcept : socket_fd(-1) {}
+
+Client::Client(Client&& other) noexcept
+		: socket_fd(std::exchange(other.socket_fd, -1))
+		, buffer   (std::move(other.buffer))
+{}
+
+Client& Client::operator=(Client&& other) noexcept {
+	if (this != &other) {
+		close();
+		socket_fd = std::exchange(other.socket_fd, -1);
+		buffer = std::move(other.buffer);
+	}
+	return *this;
+}
+
+Client::~Client() {
+	close();
+}
+
+bool Client::connect(const std::string& socket_path) {
+	close();
+
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	if (socket_path.size() >= sizeof(address.sun_path)) return false;
+	std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+	int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) return false;
+	if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+		::close(fd);
+		return false;
+	}
+	socket_fd = fd;
+	return true;
+}
+
+void Client::close() noexcept {
+	if (socket_fd >= 0) {
+		::close(socket_fd);
+	}
+	socket_fd = -1;
+}
+
+bool Client::is_connected() const noexcept {
+	return socket_fd >= 0;
+}
+
+bool Client::convert(const Request& request, Response& out_response) {
+	if (!is_connected()) return false;
+	if (!write_frame(socket_fd, encode_request(request))
+	    || !read_frame(socket_fd, buffer)
+	    || !decode_response(buffer, out_response)) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+} // namespace service
@@ -0,0 +1,243 @@
+#include "service_server.h"
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "aec_styles.h"
+#include "batch_conversion.h"
+#include "grammar.h"
+#include "latex_cache.h"
+#include "latex_generation.h"
+#include "logger.h"
+#include "syntax_visitor.h"
+#include "trace.h"
+
+namespace service {
+
+//==================================================================================================
+// Helper functions
+//==================================================================================================
+
+namespace {
+
+/** The socket file to remove when we are killed. Static, because signal handlers can't allocate. */
+char socket_path_to_unlink[sizeof(sockaddr_un::sun_path)];
+
+extern "C" void unlink_socket_and_exit(int) {
+	::unlink(socket_path_to_unlink);
+	::_exit(0);
+}
+
+void print_error_message(const std::string& message, const std::string& socket_path) {
+	std::cerr << aec_style::error << "Error:" << aec::reset << " " << message << " "
+	          << aec_style::filename << socket_path << aec::reset << "\n";
+}
+
+/**
+ * Converts the text of [request] with [visitor], whose logger should write to [diagnostics]. If
+ * [cache] is given, every line is looked up in it first, and converted lines are stored in it. The
+ * text is padded in place, so that its lines can be scanned without copying them again.
+ */
+Response convert(
+	Request& request, Syntax_visitor& visitor, Memory_sink& diagnostics, Line_cache* cache
+) {
+	size_t size = request.text.size();
+	request.text.append(grammar::SCAN_PADDING, '\0');
+	char* text = request.text.data();
+	const char* text_end = text + request.text.size();
+
+	Response response;
+	if (request.create_document) response.output = generation::talktex_header();
+	size_t failed_lines = 0;
+	if (cache) {
+		thread_local std::string key;
+		thread_local Line_cache::Entry entry;
+		Logger& logger = visitor.logger;
+		grammar::for_each_line(text, size, [&](char* line, size_t length) {
+			if (length == 0) return; // Ignore empty lines
+			// The lines of full documents are converted differently, so they get keys of their own
+			key.assign(request.create_document ? "d " : "m ");
+			key += latex_cache::normalize(std::string_view(line, length));
+
+			if (cache->find(key, entry)) {
+				response.output += entry.output;
+			}
+			else {
+				uint64_t start = trace::now();
+				size_t output_size = response.output.size();
+				uint64_t messages = logger.n_infos() + logger.n_warnings() + logger.n_errors();
+				auto counts = batch::convert_lines(
+					line, length, text_end, visitor, request.create_document, response.output
+				);
+				entry.output.assign(response.output, output_size);
+				entry.success = (counts.failed_lines == 0);
+				entry.diagnostics.clear();
+				// Only wait for the messages of the line if there are any
+				if (logger.n_infos() + logger.n_warnings() + logger.n_errors() != messages) {
+					logger.flush();
+					entry.diagnostics = diagnostics.take();
+				}
+				entry.nanoseconds = trace::now() - start;
+				cache->insert(key, entry);
+			}
+			response.diagnostics += entry.diagnostics;
+			if (!entry.success) ++failed_lines;
+		});
+	}
+	else {
+		auto counts = batch::convert_lines(
+			text, size, text_end, visitor, request.create_document, response.output
+		);
+		failed_lines = counts.failed_lines;
+	}
+	if (request.create_document) response.output += generation::talktex_footer();
+
+	response.success = (failed_lines == 0);
+	visitor.logger.flush();
+	response.diagnostics += diagnostics.take();
+	return response;
+}
+
+/** Returns the listening socket, or -1 after logging an error message */
+int listen_on(const std::string& socket_path) {
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	if (socket_path.size() >= sizeof(address.sun_path)) {
+		print_error_message("Socket path too long:", socket_path);
+		return -1;
+	}
+	std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+	int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		print_error_message("Could not create socket", socket_path);
+		return -1;
+	}
+
+	auto bind_address = [&] {
+		return ::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+	};
+	bool bound = bind_address();
+	if (!bound && errno == EADDRINUSE) {
+		// Either another server is listening, or one left its socket file behind
+		Client probe;
+		if (probe.connect(socket_path)) {
+			print_error_message("A server is listening already on", socket_path);
+			::close(fd);
+			return -1;
+		}
+		::unlink(socket_path.c_str());
+		bound = bind_address();
+	}
+	if (!bound || ::listen(fd, SOMAXCONN) != 0) {
+		print_error_message(std::string("Could not listen (") + std::strerror(errno) + ") on", socket_path);
+		::close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * The number of connections that are served, shared by serve and the threads of the connections,
+ * which may outlive it
+ */
+struct Connection_count {
+	std::mutex mutex;
+	std::condition_variable finished;
+	size_t active = 0;
+};
+
+} // unnamed namespace
+
+//==================================================================================================
+// Serving
+//==================================================================================================
+
+bool serve_connection(int in_fd, int out_fd, Line_cache* cache) {
+	// The parser context of this connection stays warm between its requests
+	Memory_sink diagnostics;
+	Logger logger(diagnostics);
+	Syntax_visitor visitor(logger);
+
+	std::string frame;
+	Request request;
+	while (read_frame(in_fd, frame)) {
+		if (!decode_request(frame, request)) return false;
+		if (!write_frame(out_fd, encode_response(convert(request, visitor, diagnostics, cache)))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool serve(const std::string& socket_path, const Server_options& options) {
+	int listen_fd = listen_on(socket_path);
+	if (listen_fd < 0) return false;
+
+	std::strcpy(socket_path_to_unlink, socket_path.c_str());
+	std::signal(SIGINT, unlink_socket_and_exit);
+	std::signal(SIGTERM, unlink_socket_and_exit);
+
+	using Clock = std::chrono::steady_clock;
+	auto connections = std::make_shared<Connection_count>();
+	auto last_activity = Clock::now();
+	int poll_timeout = (options.idle_timeout == 0 ? -1 : 1000); // ms
+
+	for (;;) {
+		pollfd listener{listen_fd, POLLIN, 0};
+		int ready = ::poll(&listener, 1, poll_timeout);
+		if (ready < 0 && errno == EINTR) continue;
+		if (ready < 0) break;
+		if (ready == 0) {
+			bool active;
+			{
+				std::lock_guard<std::mutex> lock(connections->mutex);
+				active = connections->active != 0;
+			}
+			if (active) {
+				last_activity = Clock::now();
+			}
+			else if (Clock::now() - last_activity >= std::chrono::seconds(options.idle_timeout)) {
+				break;
+			}
+			continue;
+		}
+
+		int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+		if (fd < 0) continue;
+		last_activity = Clock::now();
+
+		{
+			std::lock_guard<std::mutex> lock(connections->mutex);
+			++connections->active;
+		}
+		std::thread([fd, connections, cache = options.cache] {
+			serve_connection(fd, fd, cache);
+			::close(fd);
+			std::lock_guard<std::mutex> lock(connections->mutex);
+			--connections->active;
+			connections->finished.notify_all();
+		}).detach();
+	}
+
+	::close(listen_fd);
+	::unlink(socket_path.c_str());
+	// The connections use the cache of the caller, so we only return once they are served
+	std::unique_lock<std::mutex> lock(connections->mutex);
+	connections->finished.wait(lock, [&] { return connections->active == 0; });
+	return true;
+}
+
+} // namespace service
@@ -0,0 +1,240 @@
+#include "session_history.h"
+
+#include <algorithm>
+#include <array>
+
+#include "grammar.h"
+#include "latex_generation.h"
+#include "stats.h"
+#include "syntax_visitor.h"
+
+namespace {
+
+constexpr std::array<std::string_view, 10> DIGIT_WORDS = {
+	"zero", "one", "two", "three", "four", "five", "six", "seven", "eight", "nine"
+};
+
+/** The words of an utterance, read one by one */
+class Words {
+public:
+	explicit Words(std::string_view text) : text(text) {}
+
+	/** Consumes and returns the next word; empty if there is none */
+	std::string_view next() {
+		size_t begin = text.find_first_not_of(" \t\r\n", position);
+		if (begin == std::string_view::npos) {
+			position = text.size();
+			return {};
+		}
+		size_t end = std::min(text.find_first_of(" \t\r\n", begin), text.size());
+		position = end;
+		return text.substr(begin, end - begin);
+	}
+
+	/** Consumes the next word if it is [word] */
+	bool accept(std::string_view word) {
+		size_t before = position;
+		if (next() == word) return true;
+		position = before;
+		return false;
+	}
+
+	/** Whether all words were consumed */
+	bool done() {
+		size_t before = position;
+		bool result = next().empty();
+		position = before;
+		return result;
+	}
+
+	/** The text after the consumed words */
+	std::string_view rest() const {
+		return text.substr(position);
+	}
+
+	/**
+	 * Consumes "line" and a spoken line number, and sets [out_index] to its index. Returns false if
+	 * they are not next, or the number is 0.
+	 */
+	bool accept_line_number(size_t& out_index) {
+		size_t before = position;
+		if (!accept("line")) return false;
+		size_t number = 0;
+		size_t digits = 0;
+		while (true) {
+			size_t digit_position = position;
+			std::string_view word = next();
+			auto digit = std::find(DIGIT_WORDS.begin(), DIGIT_WORDS.end(), word);
+			if (word.empty() || digit == DIGIT_WORDS.end()) {
+				position = digit_position;
+				break;
+			}
+			number = number * 10 + static_cast<size_t>(digit - DIGIT_WORDS.begin());
+			++digits;
+		}
+		if (digits == 0 || number == 0) {
+			position = before;
+			return false;
+		}
+		out_index = number - 1;
+		return true;
+	}
+
+private:
+	std::string_view text;
+	size_t position = 0;
+};
+
+} // namespace
+
+Session_history::Session_history() : versions(1) {}
+
+bool Session_history::dictate(std::string_view utterance, Logger& logger) {
+	return dictate(utterance, nullptr, nullptr, logger);
+}
+
+bool Session_history::dictate(const grammar::Spoken_line& utterance, Logger& logger) {
+	return dictate(utterance.text, &utterance, nullptr, logger);
+}
+
+bool Session_history::dictate(std::string_view utterance, const Line& converted, Logger& logger) {
+	return dictate(utterance, nullptr, &converted, logger);
+}
+
+bool Session_history::dictate(
+	std::string_view utterance, const grammar::Spoken_line* spoken, const Line* converted, Logger& logger
+) {
+	Words words(utterance);
+	if (words.done()) return false;
+	size_t index;
+	if (words.accept("undo") && words.done()) return undo();
+	words = Words(utterance);
+	if (words.accept("redo") && words.done()) return redo();
+	words = Words(utterance);
+	if (words.accept("scratch") && words.accept("that") && words.done()) {
+		return size() > 0 && erase_line(size() - 1);
+	}
+	words = Words(utterance);
+	if (words.accept("clear") && words.accept("all") && words.done()) return clear();
+	words = Words(utterance);
+	if (words.accept("delete") && words.accept_line_number(index) && words.done()) {
+		return erase_line(index);
+	}
+	words = Words(utterance);
+	if (words.accept("replace") && words.accept_line_number(index) && words.accept("with")) {
+		return replace_line(index, words.rest(), spoken, logger);
+	}
+	words = Words(utterance);
+	if (words.accept("insert") && words.accept("before") && words.accept_line_number(index)) {
+		return insert_line(index, words.rest(), spoken, logger);
+	}
+	if (converted) {
+		commit(versions[current].insert(size(), std::make_shared<const Line>(*converted)));
+		return true;
+	}
+	return insert_line(size(), utterance, spoken, logger);
+}
+
+bool Session_history::add_line(std::string_view text, Logger& logger) {
+	return insert_line(size(), text, logger);
+}
+
+bool Session_history::insert_line(size_t index, std::string_view text, Logger& logger) {
+	return insert_line(index, text, nullptr, logger);
+}
+
+bool Session_history::insert_line(
+	size_t index, std::string_view text, const grammar::Spoken_line* spoken, Logger& logger
+) {
+	if (index > size()) return false;
+	std::shared_ptr<const Line> line = convert(text, spoken, logger);
+	if (!line) return false;
+	commit(versions[current].insert(index, std::move(line)));
+	return true;
+}
+
+bool Session_history::replace_line(size_t index, std::string_view text, Logger& logger) {
+	return replace_line(index, text, nullptr, logger);
+}
+
+bool Session_history::replace_line(
+	size_t index, std::string_view text, const grammar::Spoken_line* spoken, Logger& logger
+) {
+	if (index >= size()) return false;
+	std::shared_ptr<const Line> line = convert(text, spoken, logger);
+	if (!line) return false;
+	commit(versions[current].set(index, std::move(line)));
+	return true;
+}
+
+bool Session_history::erase_line(size_t index) {
+	if (index >= size()) return false;
+	commit(versions[current].erase(index));
+	return true;
+}
+
+bool Session_history::clear() {
+	if (size() == 0) return false;
+	commit(Lines());
+	return true;
+}
+
+bool Session_history::undo() {
+	if (current == 0) return false;
+	--current;
+	return true;
+}
+
+bool Session_history::redo() {
+	if (current + 1 == versions.size()) return false;
+	++current;
+	return true;
+}
+
+std::string Session_history::latex() const {
+	std::string result;
+	versions[current].for_each([&](const std::shared_ptr<const Line>& line) {
+		result += line->latex;
+	});
+	return result;
+}
+
+std::shared_ptr<const Session_history::Line> Session_history::convert(
+	std::string_view text, const grammar::Spoken_line* spoken, Logger& logger
+) {
+	size_t begin = text.find_first_not_of(" \t\r\n");
+	if (begin == std::string_view::npos) return nullptr; // Empty lines are ignored, like by texify
+	size_t end = text.find_last_not_of(" \t\r\n") + 1;
+	Line line;
+	line.text = text.substr(begin, end - begin);
+
+	Syntax_visitor visitor(logger);
+	if (spoken) {
+		// The tokens of the line are the ones of the utterance from where its text begins
+		auto offset = static_cast<uint32_t>(text.data() + begin - spoken->text.data());
+		const auto& tokens = spoken->tokens;
+		auto first = std::lower_bound(tokens.begin(), tokens.end(), offset, [](const grammar::Token& token, uint32_t offset) {
+			return token.begin < offset;
+		});
+		size_t skipped = static_cast<size_t>(first - tokens.begin());
+		if (grammar::parse_token_list(tokens.data() + skipped, tokens.size() - skipped, visitor) != 0) return nullptr;
+	}
+	else if (grammar::generate_from_string(line.text, visitor) != 0) {
+		return nullptr;
+	}
+	{
+		stats::Stage_timer timer(stats::TO_LATEX);
+		line.latex = generation::to_latex(visitor.syntax_tree.entrance());
+	}
+	{
+		stats::Stage_timer timer(stats::TO_DISPLAY_STYLE);
+		line.latex = generation::to_display_style(line.latex) + "\n";
+	}
+	return std::make_shared<const Line>(std::move(line));
+}
+
+void Session_history::commit(Lines lines) {
+	versions.resize(current + 1);
+	versions.push_back(std::move(lines));
+	++current;
+}
@@ -0,0 +1,113 @@
+#include "speculative_preview.h"
+
+#include <algorithm>
+
+#include "latex_generation.h"
+#include "spoken_tokens.h"
+#include "stats.h"
+
+namespace {
+
+/** The letter of the tokens of a completion, which no spoken letter is; becomes PLACEHOLDER */
+constexpr char PLACEHOLDER_LETTER = '\x01';
+
+/** Returns [text] without the whitespace around it, like Session_history keeps the text of a line */
+std::string_view trim(std::string_view text) {
+	size_t begin = text.find_first_not_of(" \t\r\n");
+	if (begin == std::string_view::npos) return {};
+	return text.substr(begin, text.find_last_not_of(" \t\r\n") + 1 - begin);
+}
+
+} // unnamed namespace
+
+Speculative_preview::Speculative_preview(Logger& logger) : visitor(logger) {
+	reset();
+}
+
+void Speculative_preview::reset() {
+	hypothesis.clear();
+	tokens.clear();
+	trackers.assign(1, grammar::Parser_tracker());
+	preview = Session_history::Line();
+	is_complete = false;
+}
+
+bool Speculative_preview::update(std::string_view words) {
+	if (words == hypothesis && !tokens.empty()) return !preview.latex.empty();
+	hypothesis.assign(words);
+	scratch.assign(grammar::padded_copy(words));
+	std::vector<grammar::Token> scanned;
+	scanned.reserve(tokens.size() + 4);
+	grammar::scan_tokens(scratch.data(), words.size(), scratch.data() + scratch.size(), scanned);
+
+	// The parser states after the tokens that did not change are still right
+	size_t kept = 0;
+	while (kept + 1 < trackers.size() && kept < scanned.size() && scanned[kept].same_as(tokens[kept])) {
+		++kept;
+	}
+	trackers.resize(kept + 1);
+	tokens.swap(scanned);
+	for (size_t i = kept; i < tokens.size(); ++i) {
+		trackers.push_back(trackers.back());
+		if (!trackers.back().push(tokens[i].kind)) {
+			trackers.pop_back(); // The hypothesis is no line from here on, whatever comes after it
+			break;
+		}
+	}
+
+	size_t viable = trackers.size() - 1;
+	preview = Session_history::Line();
+	is_complete = false;
+	if (viable == 0 || !trackers.back().completion(MAX_COMPLETION, completion)) return false;
+	is_complete = (viable == tokens.size() && completion.empty());
+	return convert();
+}
+
+bool Speculative_preview::convert() {
+	size_t viable = trackers.size() - 1;
+	line_tokens.assign(tokens.begin(), tokens.begin() + viable);
+	for (int kind : completion) {
+		grammar::Token token;
+		token.kind = kind;
+		token.letter = PLACEHOLDER_LETTER;
+		token.begin = token.end = tokens[viable - 1].end;
+		line_tokens.push_back(std::move(token));
+	}
+	if (grammar::parse_token_list(line_tokens.data(), line_tokens.size(), visitor) != 0) {
+		is_complete = false;
+		return false;
+	}
+
+	std::string latex;
+	{
+		stats::Stage_timer timer(stats::TO_LATEX);
+		latex = generation::to_latex(visitor.syntax_tree.entrance());
+		for (size_t i = latex.find(PLACEHOLDER_LETTER); i != std::string::npos; i = latex.find(PLACEHOLDER_LETTER, i)) {
+			latex.replace(i, 1, PLACEHOLDER);
+		}
+	}
+	{
+		stats::Stage_timer timer(stats::TO_DISPLAY_STYLE);
+		preview.latex = generation::to_display_style(latex) + "\n";
+	}
+	preview.text.assign(hypothesis, tokens[0].begin, tokens[viable - 1].end - tokens[0].begin);
+	return true;
+}
+
+bool Speculative_preview::confirms(std::string_view utterance) const {
+	return is_complete && trim(utterance) == preview.text;
+}
+
+bool Speculative_preview::finish(std::string_view utterance, Session_history& session, Logger& logger) {
+	bool result;
+	if (confirms(utterance)) {
+		++confirmed_count;
+		result = session.dictate(utterance, preview, logger);
+	}
+	else {
+		if (!preview.latex.empty()) ++discarded_count;
+		result = session.dictate(utterance, logger);
+	}
+	reset();
+	return result;
+}
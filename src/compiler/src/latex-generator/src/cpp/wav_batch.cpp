@@ -0,0 +1,414 @@
+#include "wav_batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include "aec_styles.h"
+#include "batch_conversion.h"
+#include "grammar.h"
+#include "latex_generation.h"
+#include "resampler.h"
+#include "speculative_preview.h"
+#include "spoken_tokens.h"
+#include "stats.h"
+#include "syntax_visitor.h"
+#include "wav.h"
+
+namespace batch {
+
+//==================================================================================================
+// Helper functions
+//==================================================================================================
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start) {
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/** Returns [path] with its extension, if any, replaced by [extension] */
+std::string replace_extension(const std::string& path, const std::string& extension) {
+	size_t name = path.find_last_of('/');
+	name = (name == std::string::npos ? 0 : name + 1);
+	size_t dot = path.find_last_of('.');
+	if (dot == std::string::npos || dot < name) dot = path.size();
+	return path.substr(0, dot) + extension;
+}
+
+/** Returns the path of the .tex file of the recording at [path] */
+std::string output_path(const std::string& path, const std::string& directory) {
+	std::string tex = replace_extension(path, ".tex");
+	if (directory.empty()) return tex;
+	size_t name = tex.find_last_of('/');
+	return directory + "/" + (name == std::string::npos ? tex : tex.substr(name + 1));
+}
+
+/** The state of a worker thread, which it reuses for every recording it transcribes */
+struct Worker {
+	Worker(Recognizer& recognizer, const Wav_options& options)
+			: recognizer(recognizer)
+			, options(options)
+			, logger(*options.log_sink)
+			, visitor(logger)
+			, pauses(options.initial_break_threshold)
+			, preview(logger)
+	{}
+
+	Recognizer& recognizer;
+	const Wav_options& options;
+	Logger logger;
+	Syntax_visitor visitor;
+	std::string words;
+	std::string scratch;
+	std::vector<Timed_token> tokens;
+	std::vector<grammar::Recognized_token> recognized_tokens;
+	grammar::Spoken_line spoken; // Of the tokens, if the recognizer gives them
+	grammar::Pause_model pauses; // Of the speaker of the current recording
+	std::string output;
+	Wav_report report; // Of the recordings of this worker
+
+	// The audio of the current recording
+	std::vector<int16_t> block; // As read
+	std::vector<int16_t> mono;  // Of the block
+	std::vector<int16_t> kept;  // At 16 kHz, from the window or the utterance on
+
+	// The preview of the current utterance
+	Speculative_preview preview;
+	size_t next_preview = 0;  // In samples from the start of the utterance
+	size_t first_preview = 0; // 0 if there is none yet
+};
+
+/** Previews the hypothesis of the recognizer for the [count] samples at [samples], the utterance so far */
+void preview_utterance(Worker& worker, const int16_t* samples, size_t count) {
+	auto start = Clock::now();
+	worker.words.clear();
+	if (worker.recognizer.recognize_partial(samples, count, worker.words)) {
+		std::replace(worker.words.begin(), worker.words.end(), '\n', ' ');
+		if (worker.preview.update(worker.words) && worker.first_preview == 0) worker.first_preview = count;
+	}
+	worker.report.preview_seconds += seconds_since(start);
+}
+
+/**
+ * Recognizes the [count] samples at [samples] as the words of [worker], and if the recognizer gives
+ * timed tokens, reads them into its spoken line, with breaks where the speaker paused for one.
+ * Returns false if they could not be recognized.
+ */
+bool recognize_utterance(Worker& worker, const int16_t* samples, size_t count) {
+	worker.words.clear();
+	if (!worker.recognizer.gives_timed_tokens()) {
+		return worker.recognizer.recognize(samples, count, worker.words);
+	}
+	worker.tokens.clear();
+	if (!worker.recognizer.recognize_tokens(samples, count, worker.tokens)) return false;
+	worker.recognized_tokens.clear();
+	for (const Timed_token& token : worker.tokens) {
+		worker.recognized_tokens.push_back(grammar::Recognized_token{token.text.c_str(), token.start_time});
+	}
+	grammar::read_spoken_line(worker.recognized_tokens.data(), worker.recognized_tokens.size(), worker.pauses, worker.spoken);
+	worker.words = worker.spoken.text;
+	return true;
+}
+
+/**
+ * Converts the spoken line of [worker] into a line of display style LaTeX, from its tokens, like
+ * convert_lines does for a line of text. Returns false if it could not be fully parsed.
+ */
+bool convert_spoken_line(Worker& worker) {
+	const auto& tokens = worker.spoken.tokens;
+	if (tokens.empty()) return true; // Empty lines are ignored, like by convert_lines
+	worker.visitor.syntax_tree = Syntax_tree(); // Don't print the tree of the previous line on failure
+	bool parsed = grammar::parse_token_list(tokens.data(), tokens.size(), worker.visitor) == 0;
+	if (worker.visitor.syntax_tree.entrance().is_valid()) {
+		size_t output_size = worker.output.size();
+		std::string latex;
+		{
+			stats::Stage_timer timer(stats::TO_LATEX);
+			latex = generation::to_latex(worker.visitor.syntax_tree.entrance());
+		}
+		{
+			stats::Stage_timer timer(stats::TO_DISPLAY_STYLE);
+			worker.output += generation::to_display_style(latex);
+		}
+		worker.output += '\n';
+		stats::count(stats::OUTPUT_BYTES, worker.output.size() - output_size);
+	}
+	return parsed;
+}
+
+/** Recognizes the [count] samples at [samples] as an utterance, and converts its words into a line of LaTeX */
+void transcribe_utterance(Worker& worker, const int16_t* samples, size_t count) {
+	++worker.report.utterances;
+	if (worker.first_preview > 0) {
+		++worker.report.previewed;
+		worker.report.first_preview_audio += static_cast<double>(worker.first_preview) / RECOGNIZER_RATE;
+		worker.report.final_audio += static_cast<double>(count) / RECOGNIZER_RATE;
+		worker.first_preview = 0;
+	}
+	auto start = Clock::now();
+	bool recognized = recognize_utterance(worker, samples, count);
+	worker.report.recognize_seconds += seconds_since(start);
+	if (!recognized) {
+		++worker.report.unrecognized;
+		worker.preview.reset();
+		return;
+	}
+
+	// A confirmed preview is the LaTeX of the utterance already
+	start = Clock::now();
+	std::replace(worker.words.begin(), worker.words.end(), '\n', ' ');
+	if (worker.preview.confirms(worker.words)) {
+		++worker.report.confirmed_previews;
+		worker.output += worker.preview.line().latex;
+		worker.preview.reset();
+		worker.report.convert_seconds += seconds_since(start);
+		return;
+	}
+	worker.preview.reset();
+
+	if (worker.recognizer.gives_timed_tokens()) {
+		worker.report.failed_utterances += !convert_spoken_line(worker);
+		worker.report.convert_seconds += seconds_since(start);
+		return;
+	}
+
+	// The recognizer gives one line of words; the scanner needs it in a writable, padded buffer
+	worker.scratch.assign(worker.words);
+	worker.scratch.append(grammar::SCAN_PADDING, '\0');
+	auto counts = convert_lines(
+		worker.scratch.data(), worker.words.size(), worker.scratch.data() + worker.scratch.size(),
+		worker.visitor, true, worker.output // In display style, like texify
+	);
+	worker.report.failed_utterances += counts.failed_lines;
+	worker.report.convert_seconds += seconds_since(start);
+}
+
+/** The audio that is read, mixed down and resampled at a time */
+constexpr size_t BLOCK_MS = 250;
+
+/**
+ * Streams the recording at [path] through the stages, utterance by utterance, and writes its LaTeX.
+ * Throws std::runtime_error if it can not be read or written.
+ */
+void transcribe_recording(Worker& worker, const std::string& path) {
+	const Wav_options& options = worker.options;
+	Wav_report& report = worker.report;
+
+	audio::Wav_reader reader(path);
+	report.audio_seconds += reader.seconds();
+	std::optional<audio::Resampler> resampler;
+	if (reader.sample_rate() != RECOGNIZER_RATE) resampler.emplace(reader.sample_rate(), RECOGNIZER_RATE);
+	size_t block_frames = std::max<size_t>(reader.sample_rate() * BLOCK_MS / 1000, 1);
+
+	worker.recognizer.begin_recording(path);
+	worker.pauses = grammar::Pause_model(options.initial_break_threshold);
+	worker.output.clear();
+	if (options.create_document) worker.output += generation::talktex_header();
+
+	// Like VADAudio.vad_collector, an utterance runs from the frame at which the segmenter begins it
+	// up to and including the frame at which it ends it. Recognizing and converting it right away
+	// keeps only the current utterance in flight. The audio is kept from frame [kept_begin] on:
+	// outside an utterance only the frames that an utterance may begin with, the window of the
+	// segmenter, and inside an utterance the frames from its beginning.
+	size_t frame = std::max<size_t>(RECOGNIZER_RATE * options.frame_ms / 1000, 1);
+	audio::Vad_segmenter segmenter(std::max<size_t>(options.padding_ms / std::max<size_t>(options.frame_ms, 1), 1), options.ratio);
+	size_t padding_frames = segmenter.padding_frames();
+	size_t preview_step = RECOGNIZER_RATE * options.preview_ms / 1000;
+	std::vector<int16_t>& block = worker.block;
+	std::vector<int16_t>& mono = worker.mono;
+	std::vector<int16_t>& kept = worker.kept;
+	kept.clear();
+	uint64_t kept_begin = 0;
+	size_t next_frame = 0; // In [kept], the first sample that was not pushed to the segmenter
+
+	while (true) {
+		auto start = Clock::now();
+		size_t frames = reader.read(block, block_frames);
+		if (frames == 0) break;
+		const int16_t* samples = block.data();
+		if (reader.channels() > 1) {
+			mono.resize(frames);
+			audio::mix_to_mono(block.data(), frames, reader.channels(), mono.data());
+			samples = mono.data();
+		}
+		if (resampler) resampler->process(samples, frames, kept);
+		else kept.insert(kept.end(), samples, samples + frames);
+		report.decode_seconds += seconds_since(start);
+
+		start = Clock::now();
+		for (; next_frame + frame <= kept.size(); next_frame += frame) {
+			auto event = segmenter.push(options.vad(&kept[next_frame], frame));
+			size_t end = next_frame + frame;
+			if (event == audio::Vad_segmenter::Event::BEGIN) worker.next_preview = preview_step;
+			if (event == audio::Vad_segmenter::Event::END) {
+				size_t begin = (segmenter.utterance_begin() - kept_begin) * frame;
+				report.segment_seconds += seconds_since(start);
+				transcribe_utterance(worker, &kept[begin], end - begin);
+				start = Clock::now();
+			}
+			else if (preview_step > 0 && segmenter.in_utterance()) {
+				// The utterance began before the segmenter noticed it, so a preview may be due right away
+				size_t begin = (segmenter.utterance_begin() - kept_begin) * frame;
+				size_t count = end - begin;
+				if (count < worker.next_preview) continue;
+				report.segment_seconds += seconds_since(start);
+				preview_utterance(worker, &kept[begin], count);
+				worker.next_preview = (count / preview_step + 1) * preview_step;
+				start = Clock::now();
+			}
+		}
+
+		// Forget the frames that no utterance can begin with any more, once there are enough of them
+		// to make moving the rest worth it
+		uint64_t keep = segmenter.frames() - std::min<uint64_t>(segmenter.frames(), padding_frames);
+		if (segmenter.in_utterance()) keep = segmenter.utterance_begin();
+		if (keep > kept_begin + padding_frames) {
+			size_t dropped = (keep - kept_begin) * frame;
+			kept.erase(kept.begin(), kept.begin() + dropped);
+			next_frame -= dropped;
+			kept_begin = keep;
+		}
+		report.segment_seconds += seconds_since(start);
+	}
+	if (segmenter.in_utterance()) {
+		size_t begin = (segmenter.utterance_begin() - kept_begin) * frame;
+		transcribe_utterance(worker, &kept[begin], next_frame - begin);
+	}
+
+	if (options.create_document) worker.output += generation::talktex_footer();
+	std::string tex_path = output_path(path, options.output_directory);
+	std::ofstream stream(tex_path, std::ios::binary);
+	if (!stream.write(worker.output.data(), worker.output.size())) {
+		throw std::runtime_error("could not write " + tex_path);
+	}
+}
+
+/** Adds the counts and times of [other] to [report] */
+void add_to(Wav_report& report, const Wav_report& other) {
+	report.recordings += other.recordings;
+	report.failed_recordings += other.failed_recordings;
+	report.utterances += other.utterances;
+	report.unrecognized += other.unrecognized;
+	report.failed_utterances += other.failed_utterances;
+	report.audio_seconds += other.audio_seconds;
+	report.decode_seconds += other.decode_seconds;
+	report.segment_seconds += other.segment_seconds;
+	report.recognize_seconds += other.recognize_seconds;
+	report.convert_seconds += other.convert_seconds;
+	report.preview_seconds += other.preview_seconds;
+	report.previewed += other.previewed;
+	report.confirmed_previews += other.confirmed_previews;
+	report.first_preview_audio += other.first_preview_audio;
+	report.final_audio += other.final_audio;
+}
+
+} // unnamed namespace
+
+//==================================================================================================
+// Recognizers
+//==================================================================================================
+
+void Transcript_recognizer::begin_recording(const std::string& path) {
+	lines.clear();
+	next_line = 0;
+	std::string transcript = replace_extension(path, ".txt");
+	std::ifstream stream(transcript);
+	if (!stream) throw std::runtime_error("could not open the transcript " + transcript);
+	for (std::string line; std::getline(stream, line); ) {
+		if (!line.empty()) lines.push_back(std::move(line));
+	}
+}
+
+bool Transcript_recognizer::recognize(const int16_t* samples, size_t count, std::string& out_words) {
+	(void) samples;
+	(void) count;
+	if (next_line == lines.size()) return false;
+	out_words = lines[next_line++];
+	return true;
+}
+
+bool Transcript_recognizer::recognize_partial(const int16_t* samples, size_t count, std::string& out_words) {
+	(void) samples;
+	if (next_line == lines.size()) return false;
+	auto spoken = static_cast<size_t>(static_cast<double>(count) / RECOGNIZER_RATE * WORDS_PER_SECOND);
+	const std::string& line = lines[next_line];
+	size_t end = 0;
+	for (size_t words = 0; words < spoken; ++words) {
+		size_t begin = line.find_first_not_of(' ', end);
+		if (begin == std::string::npos) break;
+		end = std::min(line.find(' ', begin), line.size());
+	}
+	if (end == 0) return false;
+	out_words.assign(line, 0, end);
+	return true;
+}
+
+//==================================================================================================
+// Report
+//==================================================================================================
+
+double Wav_report::realtime_factor() const {
+	return (seconds > 0 ? audio_seconds / seconds : 0);
+}
+
+//==================================================================================================
+// Transcription
+//==================================================================================================
+
+bool transcribe(
+	const std::vector<std::string>& paths, const Recognizer_factory& make_recognizer,
+	const Wav_options& options, Wav_report& report
+) {
+	auto start = Clock::now();
+
+	size_t threads = options.threads;
+	if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = std::max<size_t>(1, std::min(threads, paths.size()));
+
+	// Recordings take very different times, so every worker takes the next one when it is done
+	std::atomic<size_t> next_recording{0};
+	std::mutex report_mutex;
+	report = Wav_report();
+	auto work = [&] {
+		std::unique_ptr<Recognizer> recognizer = make_recognizer();
+		Worker worker(*recognizer, options);
+		for (size_t index; (index = next_recording.fetch_add(1)) < paths.size(); ) {
+			++worker.report.recordings;
+			try {
+				transcribe_recording(worker, paths[index]);
+			} catch (std::runtime_error& e) {
+				std::lock_guard<std::mutex> lock(report_mutex);
+				std::cerr << aec_style::error << "Error:" << aec::reset << " " << paths[index] << ": " << e.what() << "\n";
+				++worker.report.failed_recordings;
+			}
+		}
+		std::lock_guard<std::mutex> lock(report_mutex);
+		add_to(report, worker.report);
+	};
+
+	std::vector<std::thread> workers;
+	workers.reserve(threads - 1);
+	for (size_t i = 1; i < threads; ++i) {
+		workers.emplace_back(work);
+	}
+	work(); // The calling thread is a worker too
+	for (auto& worker : workers) {
+		worker.join();
+	}
+
+	report.threads = (paths.empty() ? 0 : threads);
+	report.seconds = seconds_since(start);
+	return report.failed_recordings == 0 && report.unrecognized == 0 && report.failed_utterances == 0;
+}
+
+} // namespace batch
@@ -0,0 +1,77 @@
+/* Conversion of many lines at once, e.g. of memory-mapped files on several threads */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "logger.h"
+#include "syntax_visitor.h"
+
+namespace batch {
+
+struct Options {
+	/** Whether to write display style LaTeX (for a full document) instead of plain math code */
+	bool create_document = false;
+
+	/** The number of threads that convert lines. 0 means one per hardware thread. */
+	unsigned int threads = 0;
+
+	/** The approximate number of input bytes per unit of work. Chunks always end at a newline. */
+	size_t chunk_size = size_t(1) << 20;
+
+	/** Where the errors of lines that fail to parse are logged. Must outlive the conversion. */
+	Log_sink* log_sink = &STDERR_SINK;
+};
+
+struct Report {
+	size_t bytes        = 0; // Input bytes
+	size_t lines        = 0; // Non-empty input lines
+	size_t failed_lines = 0; // Lines that could not be fully parsed
+	size_t threads      = 0; // Worker threads used
+	double seconds      = 0; // Wall-clock time, including writing the output
+	// The time that all threads together spent in every stage
+	double read_seconds     = 0; // Splitting the input into chunks and copying them out of the mapping
+	double parse_seconds    = 0; // Scanning and parsing, including the grammar actions that build the tree
+	double generate_seconds = 0; // Generating LaTeX from the trees
+	double write_seconds    = 0; // Writing the output
+
+	double megabytes_per_second() const;
+	double lines_per_second() const;
+};
+
+struct Line_counts {
+	size_t lines        = 0; // Non-empty lines
+	size_t failed_lines = 0; // Lines that could not be fully parsed
+	double parse_seconds    = 0;
+	double generate_seconds = 0;
+};
+
+/**
+ * Converts every non-empty line of the [size] characters at [text] to LaTeX and appends the results
+ * to [output], one line per successfully parsed input line. The lines are scanned in place, so
+ * [text] must lie in a writable buffer ending at [buffer_end] (see grammar::generate_from_buffer).
+ * Errors are logged through the logger of [visitor].
+ */
+Line_counts convert_lines(
+	char* text, size_t size, const char* buffer_end, Syntax_visitor& visitor, bool create_document,
+	std::string& output
+);
+
+/**
+ * Converts every non-empty line of the [size] characters at [data] to LaTeX and writes the results
+ * to the file descriptor [output_fd], one line per successfully parsed input line, in input order.
+ * Lines that fail to parse produce no output; their errors are logged to [options].log_sink.
+ *
+ * The input is split into chunks that are converted on [options].threads threads. The calling
+ * thread writes the output of finished chunks in order with writev, so at most a few chunks per
+ * thread are kept in memory at once. [data] is only read, so it may be a read-only mapping.
+ *
+ * Fills [report] with throughput figures. Returns false if any line failed to parse or if writing
+ * the output failed.
+ */
+bool convert(
+	const char* data, size_t size, int output_fd, const Options& options, Report& report
+);
+
+} // namespace batch
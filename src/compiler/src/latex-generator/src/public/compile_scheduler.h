@@ -0,0 +1,171 @@
+/* Compilation of the LaTeX of a dictation to PDF in the background, for a live preview */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Compile_options {
+	/** Where the .tex file is written and compiled */
+	std::string output_directory = ".";
+	std::string tex_name = "output.tex";
+
+	/**
+	 * The program that compiles and its arguments, to which the path of the .tex file is added.
+	 * Empty means latexmk -pdf -output-directory=[output_directory].
+	 */
+	std::vector<std::string> command;
+
+	/** A document is compiled once no newer one was submitted for this long... */
+	double debounce_seconds = 0.15;
+
+	/** ...or once the oldest document that waits for a compile has waited this long */
+	double max_delay_seconds = 1.0;
+
+	/**
+	 * Whether the preamble of the documents (generation::talktex_preamble) is dumped into the LaTeX
+	 * format [format_name] in [output_directory], which the documents then load instead of
+	 * processing the preamble on every compile. The format is built before the first compile and
+	 * rebuilt only when the preamble, the talktex.sty at [style_path] or [format_command] changes,
+	 * also across runs. Documents that do not start with generation::talktex_header are compiled as
+	 * they are, and so are all documents if the format can not be built. A document whose compile
+	 * with the format fails is compiled again with its preamble, unless the log of the compile
+	 * (the .log file beside the .tex file) has an error in its body; if that succeeds, the format
+	 * is not used any more in this run and rebuilt in the next.
+	 */
+	bool precompile_preamble = false;
+	std::string format_name = "talktex-preamble";
+
+	/** The talktex.sty that the format is built with. Empty means [output_directory]/talktex.sty. */
+	std::string style_path;
+
+	/**
+	 * The program that dumps the format and its arguments, to which the path of the preamble is
+	 * added. Empty means pdflatex -ini in [output_directory].
+	 */
+	std::vector<std::string> format_command;
+};
+
+/** The distribution of a number of durations, in seconds */
+struct Latency_summary {
+	size_t count = 0;
+	double mean  = 0;
+	double p50   = 0;
+	double p95   = 0;
+	double max   = 0;
+};
+
+struct Compile_report {
+	size_t submitted     = 0; // Documents
+	size_t compiles      = 0; // Runs of the command
+	size_t failed        = 0; // Runs that could not start or did not exit with 0
+	size_t coalesced     = 0; // Documents that were replaced by a newer one before their compile
+	size_t write_errors  = 0; // Documents that could not be written
+	size_t format_builds = 0; // Runs of the format command
+	size_t format_failed = 0; // Runs of the format command that did not exit with 0
+	size_t format_fallbacks = 0; // Documents that only compiled with their preamble
+	size_t body_errors   = 0; // Documents that failed with the format because of an error in their body
+	// From the submission of a document to the end of the first compile that shows it, which may
+	// be that of a newer document
+	Latency_summary latency;
+	Latency_summary compile; // Of the runs of the command
+};
+
+/**
+ * Compiles the documents of a dictation on a thread of its own, at most one at a time, like
+ * compiler.py used to after every utterance. A document that is submitted while another waits
+ * replaces it, so a burst of utterances makes one compile of the newest document, and every
+ * compile runs alone in the output directory. A document waits until no newer one was submitted
+ * for debounce_seconds, or until it waited max_delay_seconds, and until the compile before it is
+ * done.
+ *
+ * The .tex file is written to a temporary file beside it and renamed, so that the command never
+ * reads a half-written document. The compiles are traced as "latexmk" events if tracing is on, and
+ * the builds of the format of the preamble as "format" events.
+ */
+class Compile_scheduler {
+public:
+	explicit Compile_scheduler(Compile_options options);
+
+	/** Compiles the document that waits, if any, and waits for the compiles to end */
+	~Compile_scheduler();
+
+	Compile_scheduler(const Compile_scheduler&) = delete;
+	Compile_scheduler& operator=(const Compile_scheduler&) = delete;
+
+	/** Makes [document] the next one to compile, in place of the one that waits, if any */
+	void submit(std::string document);
+
+	/**
+	 * Compiles [document] right away, after the compile that runs, if any, and waits for it. A
+	 * document that waits is replaced. Returns whether the compile that showed it, or a newer
+	 * document, succeeded.
+	 */
+	bool compile_now(std::string document);
+
+	/** Waits until no document waits and no compile runs */
+	void wait_idle();
+
+	Compile_report report() const;
+
+	/** The path of the .tex file */
+	const std::string& tex_path() const {
+		return path;
+	}
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	/** Takes the documents that wait, when it is time, and compiles them until it is stopped */
+	void run();
+
+	/**
+	 * Compiles [document], with the format of the preamble if it is precompiled. Returns whether it
+	 * succeeded.
+	 */
+	bool compile(const std::string& document);
+
+	/**
+	 * Writes [document] to the .tex file and runs the command, and counts it. Returns whether both
+	 * succeeded.
+	 */
+	bool write_and_run(const std::string& document);
+
+	/**
+	 * Builds the format of the preamble if it is not built from the current preamble, talktex.sty
+	 * and format command yet. Returns whether the documents can load it.
+	 */
+	bool prepare_format();
+
+	Compile_options options;
+	std::string path;
+	std::string log_path; // That pdflatex writes for [path]
+
+	// Only used by the worker thread
+	std::vector<std::string> environment; // Of the commands, with the output directory in the TeX paths
+	std::string format_inputs;            // That the format was built from or failed to build from
+	bool format_ready = false;            // Whether it was built from [format_inputs]
+
+	mutable std::mutex mutex;
+	std::condition_variable changed;
+	std::string pending;           // The document that waits...
+	bool has_pending = false;
+	bool urgent = false;           // ...to be compiled without debouncing, for compile_now
+	std::vector<Clock::time_point> submit_times; // Of the documents that it replaced, and its own
+	Clock::time_point last_submit;
+	bool compiling = false;
+	size_t compiled = 0;           // The number of submitted documents that a finished compile shows
+	bool last_succeeded = false;   // Of the last finished compile
+	bool stopping = false;
+
+	Compile_report counts;         // Without the summaries
+	std::vector<double> latencies; // In seconds
+	std::vector<double> durations;
+
+	std::thread worker;
+};
@@ -0,0 +1,63 @@
+/* The LaTeX of a line that is edited token by token, as while dictating */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "incremental_parse.h"
+#include "latex_generation.h"
+#include "logger.h"
+
+/**
+ * A line and its LaTeX, which can be edited token by token. An edit reparses only the expression
+ * around it (see grammar::Incremental_parse) and regenerates only the LaTeX of that expression,
+ * which it splices into the LaTeX of the line. The result is the same as converting the edited line
+ * from scratch.
+ */
+class Incremental_line {
+public:
+	/** Logs syntax errors to [logger] */
+	explicit Incremental_line(Logger& logger);
+
+	/**
+	 * Converts [line] from scratch.
+	 * @return the returncode, like generate_from_string
+	 */
+	int convert(std::string_view line);
+
+	/**
+	 * Replaces the tokens [first, last) of the line by [replacement] (see
+	 * grammar::Incremental_parse::edit), and converts the result.
+	 * @return the returncode, like generate_from_string
+	 */
+	int edit(size_t first, size_t last, std::string_view replacement);
+
+	/** The LaTeX of the line, without display style; empty if it does not parse */
+	const std::string& latex() const {
+		return output;
+	}
+
+	const grammar::Incremental_parse& parsed() const {
+		return parse;
+	}
+
+private:
+	/** Updates the LaTeX after the last parse or edit */
+	void update();
+
+	/**
+	 * Appends the ranges of the expressions [first, first + count) of the parse to [out_ranges],
+	 * given the ranges of their nodes, [node_ranges]. An anyexpr that is an openexpr shares its node.
+	 */
+	void expression_ranges(
+		const std::vector<generation::Latex_range>& node_ranges, size_t first, size_t count,
+		std::vector<generation::Latex_range>& out_ranges
+	) const;
+
+	grammar::Incremental_parse parse;
+	std::string output;
+	std::vector<generation::Latex_range> ranges; // Of the expressions of the parse, in their order
+};
@@ -0,0 +1,43 @@
+/* The persistent cache of the conversions of dictated lines, which texify consults before parsing */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "persistent_cache.h"
+
+namespace latex_cache {
+
+/**
+ * Opens the cache in the file at [path], of at most [max_bytes] bytes, for all threads of the
+ * process, replacing the cache that was open. Other processes may use the same file at the same
+ * time. The entries are tied to the builds of the grammar and latex-generator libraries: if either
+ * is rebuilt, the cache starts empty.
+ * Returns false if the file could not be opened (see Persistent_cache::open).
+ */
+bool open(const std::string& path, size_t max_bytes);
+
+/** Closes the cache, if any. Waits for the threads that are looking up or storing lines. */
+void close();
+
+bool is_open();
+
+/**
+ * Returns [line] without the spaces and tabs around it, which the scanner ignores. Lines that are
+ * equal after this are converted equally.
+ */
+std::string_view normalize(std::string_view line);
+
+/**
+ * Returns true, and sets [out_entry], if the cache is open and has the conversion of the
+ * normalized line [utterance]. Counts the hit or miss, and the time the cached conversion took,
+ * in the statistics.
+ */
+bool find(std::string_view utterance, Persistent_cache::Entry& out_entry);
+
+/** Stores the conversion of the normalized line [utterance], if the cache is open */
+void insert(std::string_view utterance, const Persistent_cache::Entry& entry);
+
+} // namespace latex_cache
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <vector>
+
 #include "syntax_tree.h"
 
 namespace generation {
@@ -8,6 +10,21 @@ namespace generation {
 /** Returns the LaTeX math code needed to render the expression tree that [t] points to */
 std::string to_latex(Syntax_tree::const_traverser t);
 
+/** Appends to_latex([t]) to [out] */
+void append_latex(Syntax_tree::const_traverser t, std::string& out);
+
+/** Where the LaTeX of an expression (anyexpr in compiler.y) is in the output of append_latex */
+struct Latex_range {
+	size_t begin;
+	size_t end;
+};
+
+/**
+ * Appends to_latex([t]) to [out], and the range of the LaTeX of each expression in the tree to
+ * [out_ranges], in pre-order (see grammar::is_expression_child). Ranges of nested expressions nest.
+ */
+void append_latex(Syntax_tree::const_traverser t, std::string& out, std::vector<Latex_range>& out_ranges);
+
 /**
  * Converts LaTeX math code into the code needed to render it in display style.
  * The resulting string should be used in LaTeX text mode.
@@ -17,6 +34,19 @@ std::string to_display_style(const std::string& latex_expression);
 /** Returns the TalkTeX LaTeX header, including \begin{document} */
 std::string talktex_header();
 
+/**
+ * Returns the preamble of the TalkTeX LaTeX header: the document class and the packages, without
+ * \begin{document}. It is the same in every document.
+ */
+std::string talktex_preamble();
+
+/**
+ * Returns the TalkTeX LaTeX header for documents that load the preamble from the LaTeX format
+ * [format_name], in which it was dumped (see Compile_options::precompile_preamble), instead of
+ * processing it: a %& line that makes pdflatex load the format, and the header without the preamble.
+ */
+std::string talktex_format_header(const std::string& format_name);
+
 /** Returns the TalkTeX LaTeX footer, including \end{document} */
 std::string talktex_footer();
 
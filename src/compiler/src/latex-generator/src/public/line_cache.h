@@ -0,0 +1,91 @@
+/* An in-memory cache of line conversions, shared by the threads of a server */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/**
+ * A least recently used cache from lines to their conversions, which many threads can use at once.
+ *
+ * The entries are spread over shards by the hash of their line. Every shard has a lock, a hash map
+ * and a recency list of its own, so threads that look up different lines rarely wait for each other,
+ * and nothing locks the whole cache. Every shard gets an equal part of the memory budget, and evicts
+ * its least recently used entries when it goes over its part.
+ */
+class Line_cache {
+public:
+	struct Entry {
+		std::string output;       // The LaTeX of the line, with its newline; empty if it has none
+		std::string diagnostics;  // The formatted messages that were logged while converting it
+		bool success = true;      // Whether the line was fully parsed
+		uint64_t nanoseconds = 0; // How long the conversion took
+	};
+
+	struct Statistics {
+		uint64_t hits       = 0;
+		uint64_t misses     = 0;
+		uint64_t insertions = 0;
+		uint64_t evictions  = 0; // Entries removed to stay within the budget
+		size_t entries      = 0;
+		size_t bytes        = 0; // Counted against the budget, including bookkeeping
+	};
+
+	/**
+	 * Creates a cache of at most [max_bytes] bytes, in [shards] shards. The number of shards is
+	 * rounded up to a power of two; 0 means four per hardware thread.
+	 */
+	explicit Line_cache(size_t max_bytes, size_t shards = 0);
+
+	Line_cache(const Line_cache&) = delete;
+	Line_cache& operator=(const Line_cache&) = delete;
+
+	/**
+	 * Returns true, and copies the entry of [line] to [out_entry], if there is one. The entry
+	 * becomes the most recently used of its shard. Counts the hit or miss, and the time the cached
+	 * conversion took, in the statistics of stats.h as well.
+	 */
+	bool find(std::string_view line, Entry& out_entry);
+
+	/**
+	 * Stores [entry] for [line], replacing the entry [line] had, and evicts the least recently used
+	 * entries of its shard until the shard fits in its budget again. Entries that are larger than
+	 * the budget of a shard on their own are not stored.
+	 */
+	void insert(std::string_view line, Entry entry);
+
+	/** Sums the statistics of all shards. Conversions in flight may change them meanwhile. */
+	Statistics statistics() const;
+
+	size_t shard_count() const {
+		return shard_mask + 1;
+	}
+
+private:
+	struct Node {
+		std::string line;
+		Entry entry;
+		size_t bytes; // Counted against the budget
+	};
+
+	// Aligned so that the locks of neighbouring shards are not on the same cache line
+	struct alignas(64) Shard {
+		mutable std::mutex mutex;
+		std::list<Node> recency; // Most recently used first
+		std::unordered_map<std::string_view, std::list<Node>::iterator> index; // Into recency's lines
+		size_t bytes = 0;
+		Statistics statistics;
+	};
+
+	Shard& shard_of(std::string_view line);
+
+	std::unique_ptr<Shard[]> shards;
+	size_t shard_mask;
+	size_t bytes_per_shard;
+};
@@ -0,0 +1,109 @@
+/* The protocol between a conversion server (compiler_latex_generator --serve) and its clients */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/*
+	Protocol
+
+	Messages are sent over a Unix domain stream socket, or over a pair of pipes. Every message is a
+	frame: a 4 byte big-endian payload length followed by the payload.
+
+		request         flags (1 byte, see Request_flag), followed by the running text to convert
+		response        status (1 byte, 0 if every line was parsed, 1 otherwise), the 4 byte
+		                big-endian length of the output, the output, and the diagnostics (the error
+		                messages logged during the conversion) in the rest of the frame
+
+	A connection can carry any number of requests. They are answered in order.
+*/
+
+namespace service {
+
+/** Frames larger than this are refused, so that a bad length can't make us allocate gigabytes */
+inline constexpr uint32_t MAX_FRAME_SIZE = uint32_t(64) << 20;
+
+enum Request_flag : uint8_t {
+	/** Create a full LaTeX document (header, display style lines, footer), like the -d option */
+	CREATE_DOCUMENT = 1 << 0,
+};
+
+struct Request {
+	bool create_document = false;
+	std::string text;
+};
+
+struct Response {
+	bool success = false;
+	std::string output;
+	std::string diagnostics;
+};
+
+/**
+ * Returns the socket path to use if none is given: $TALKTEX_SOCKET if set, otherwise a per-user
+ * socket in $XDG_RUNTIME_DIR or /tmp.
+ */
+std::string default_socket_path();
+
+//==================================================================================================
+// Framing
+//==================================================================================================
+
+/**
+ * Reads one frame from [fd] into [payload].
+ * Returns false at the end of the stream, on errors and if the frame is larger than MAX_FRAME_SIZE.
+ */
+bool read_frame(int fd, std::string& payload);
+
+/** Writes [payload] as one frame to [fd]. Returns false on errors. */
+bool write_frame(int fd, std::string_view payload);
+
+std::string encode_request(const Request& request);
+std::string encode_response(const Response& response);
+
+/** Returns false if [payload] is not a valid request */
+bool decode_request(std::string_view payload, Request& out_request);
+
+/** Returns false if [payload] is not a valid response */
+bool decode_response(std::string_view payload, Response& out_response);
+
+//==================================================================================================
+// Client
+//==================================================================================================
+
+/**
+ * A connection to a conversion server. Client objects can be moved, but not copied. The connection
+ * is closed when the object is destroyed.
+ */
+class Client {
+public:
+	Client() noexcept;
+	Client(Client&& other) noexcept;
+	Client& operator=(Client&& other) noexcept;
+	~Client();
+
+	Client(const Client&) = delete;
+	Client& operator=(const Client&) = delete;
+
+	/** Connects to the server listening at [socket_path]. Returns false if that fails. */
+	bool connect(const std::string& socket_path);
+
+	void close() noexcept;
+
+	bool is_connected() const noexcept;
+
+	/**
+	 * Sends [request] and waits for its response. Returns false, and closes the connection, if the
+	 * request could not be sent or no valid response was received.
+	 */
+	bool convert(const Request& request, Response& out_response);
+
+private:
+	int socket_fd;
+	std::string buffer; // Reused between requests
+};
+
+} // namespace service
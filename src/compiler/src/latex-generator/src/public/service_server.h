@@ -0,0 +1,38 @@
+/* The conversion server, which answers the requests described in service.h */
+
+#pragma once
+
+#include <string>
+
+#include "line_cache.h"
+#include "service.h"
+
+namespace service {
+
+struct Server_options {
+	/** Stop serving after this many seconds without any connection. 0 means never. */
+	unsigned int idle_timeout = 0;
+
+	/** The conversions of lines, shared by all connections, if not null. Must outlive serve. */
+	Line_cache* cache = nullptr;
+};
+
+/**
+ * Answers the requests read from [in_fd] on [out_fd] until the end of the stream. If [cache] is
+ * given, every line is looked up in it before it is converted, and converted lines are stored in it.
+ * Returns false if a malformed request was received or a response could not be written.
+ */
+bool serve_connection(int in_fd, int out_fd, Line_cache* cache = nullptr);
+
+/**
+ * Listens on a Unix domain socket at [socket_path] and serves every connection on its own thread.
+ * A stale socket file left by a server that is gone is replaced. The socket file is removed when
+ * the server stops, which is after the idle timeout or on SIGINT or SIGTERM.
+ *
+ * Returns false, after logging an error message to stderr, if the socket could not be set up
+ * (e.g. because another server is listening on it already). Otherwise returns true when stopping,
+ * once the connections that were open are served.
+ */
+bool serve(const std::string& socket_path, const Server_options& options);
+
+} // namespace service
@@ -0,0 +1,128 @@
+/* The lines dictated in a session, with every earlier version of them for undo and redo */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "avds/persistent_sequence.h"
+#include "logger.h"
+#include "spoken_tokens.h"
+
+/**
+ * The lines of a dictation session and their LaTeX, with unlimited undo and redo.
+ *
+ * Every version of the session is an avds::persistent_sequence of lines, so an edit makes a new
+ * version in O(log n) that shares all unchanged lines with the version before, and undo and redo
+ * only move between versions, in O(1). The history costs memory in proportion to the edits, not to
+ * the number of versions times the number of lines. Only lines that parse are added: a line that
+ * does not parse leaves the session as it is.
+ */
+class Session_history {
+public:
+	/** A dictated line and its conversion */
+	struct Line {
+		std::string text;
+		std::string latex; // In display style, with its newline, like texify gives it
+	};
+
+	/** Starts with an empty session */
+	Session_history();
+
+	/**
+	 * Carries out [utterance]: one of the spoken commands below, or else a line to add.
+	 *   undo                              undoes the last edit
+	 *   redo                              redoes the last undone edit
+	 *   scratch that                      removes the last line
+	 *   delete line N                     removes line N
+	 *   replace line N with <line>        replaces line N by <line>
+	 *   insert before line N <line>       inserts <line> before line N
+	 *   clear all                         removes all lines
+	 * Line numbers are spoken digit by digit and start at one, e.g. "line one two" is line 12.
+	 * Parse errors are logged to [logger]. Returns false if the line does not parse or the command
+	 * can not be carried out; the session is then unchanged.
+	 */
+	bool dictate(std::string_view utterance, Logger& logger);
+
+	/**
+	 * Like dictate, for an utterance of a speech recognizer (see grammar::read_spoken_line). Its
+	 * line is parsed from the tokens of [utterance], with the breaks where the speaker paused,
+	 * without scanning its text again.
+	 */
+	bool dictate(const grammar::Spoken_line& utterance, Logger& logger);
+
+	/**
+	 * Like dictate, for an utterance whose conversion as a line is [converted], e.g. a confirmed
+	 * Speculative_preview. If it is a line to add, it is added without converting it again.
+	 */
+	bool dictate(std::string_view utterance, const Line& converted, Logger& logger);
+
+	/** Adds [text] as the last line, if it parses. Returns whether it did. */
+	bool add_line(std::string_view text, Logger& logger);
+
+	/** Inserts [text] before line [index], if it parses and there is such a line or [index] is size() */
+	bool insert_line(size_t index, std::string_view text, Logger& logger);
+
+	/** Replaces line [index] by [text], if it parses and there is such a line */
+	bool replace_line(size_t index, std::string_view text, Logger& logger);
+
+	/** Removes line [index], if there is one */
+	bool erase_line(size_t index);
+
+	/** Removes all lines, if there are any */
+	bool clear();
+
+	/** Goes back to the version before the last edit. Returns false if there is none. */
+	bool undo();
+
+	/** Goes forward to the version that the last undo went back from. Returns false if there is none. */
+	bool redo();
+
+	/** The number of lines of the current version */
+	size_t size() const {
+		return versions[current].size();
+	}
+
+	/** Line [index] of the current version, in O(log n) */
+	const Line& line(size_t index) const {
+		return *versions[current][index];
+	}
+
+	/** The LaTeX of all lines of the current version, like texify gives it for their text */
+	std::string latex() const;
+
+	/** The number of versions kept, including the ones that redo goes to */
+	size_t version_count() const {
+		return versions.size();
+	}
+
+private:
+	using Lines = avds::persistent_sequence<std::shared_ptr<const Line>>;
+
+	/**
+	 * Carries out [utterance], which is the text of [spoken] if that is given. A line to add is
+	 * [converted] if that is given.
+	 */
+	bool dictate(
+		std::string_view utterance, const grammar::Spoken_line* spoken, const Line* converted, Logger& logger
+	);
+
+	bool insert_line(size_t index, std::string_view text, const grammar::Spoken_line* spoken, Logger& logger);
+
+	bool replace_line(size_t index, std::string_view text, const grammar::Spoken_line* spoken, Logger& logger);
+
+	/**
+	 * Converts [text], returning nullptr if it does not parse. If [spoken] is given, [text] is a
+	 * part of its text, and is parsed from its tokens.
+	 */
+	static std::shared_ptr<const Line> convert(std::string_view text, const grammar::Spoken_line* spoken, Logger& logger);
+
+	/** Makes [lines] the current version, dropping the versions that redo went to */
+	void commit(Lines lines);
+
+	std::vector<Lines> versions; // Oldest first
+	size_t current = 0;
+};
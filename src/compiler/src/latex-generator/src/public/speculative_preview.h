@@ -0,0 +1,102 @@
+/* Provisional LaTeX of an utterance while it is spoken, from the hypotheses of a speech recognizer */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "grammar.h"
+#include "incremental_parse.h"
+#include "logger.h"
+#include "session_history.h"
+#include "syntax_visitor.h"
+
+/**
+ * The LaTeX of the words of an utterance recognized so far, before the voice activity detection
+ * ends the utterance.
+ *
+ * Recognizers like DeepSpeech give a hypothesis of the words spoken so far whenever they are asked.
+ * Such a hypothesis usually stops in the middle of an expression, e.g. "fraction x plus", so it is
+ * parsed up to its longest prefix that the parser accepts as the start of a line, and completed with
+ * the fewest tokens that make it a line (see grammar::Parser_tracker::completion). Missing operands
+ * are shown as PLACEHOLDER. The next hypothesis usually extends the last one, so the parser states
+ * after every token of the last one are kept, and only the tokens after their common prefix are
+ * followed again.
+ *
+ * When the final words arrive, the preview is confirmed if they are the last hypothesis and that
+ * was a line without completion; its LaTeX is then used as it is. Otherwise it is discarded, and the
+ * final words are converted as usual.
+ */
+class Speculative_preview {
+public:
+	/** The LaTeX that stands for an operand that was not spoken yet */
+	static constexpr const char* PLACEHOLDER = "{\\ldots}";
+
+	/** The most tokens a hypothesis is completed with */
+	static constexpr size_t MAX_COMPLETION = 8;
+
+	/** Logs syntax errors to [logger] */
+	explicit Speculative_preview(Logger& logger);
+
+	Speculative_preview(const Speculative_preview&) = delete;
+	Speculative_preview& operator=(const Speculative_preview&) = delete;
+
+	/**
+	 * Updates the preview to [hypothesis], the words of the utterance recognized so far. Returns
+	 * whether there is a preview, i.e. a prefix of [hypothesis] could be completed to a line.
+	 */
+	bool update(std::string_view hypothesis);
+
+	/**
+	 * The preview, like Session_history gives its lines: its text is the part of the hypothesis that
+	 * it shows, and its LaTeX is in display style with its newline. Empty if there is none.
+	 */
+	const Session_history::Line& line() const {
+		return preview;
+	}
+
+	/** Whether the whole hypothesis is a line by itself, so that the preview is not provisional */
+	bool complete() const {
+		return is_complete;
+	}
+
+	/** Whether the preview is the conversion of the final words [utterance] */
+	bool confirms(std::string_view utterance) const;
+
+	/**
+	 * Carries out the final words [utterance] in [session], like Session_history::dictate. If the
+	 * preview confirms them, they are added as its line, without parsing them again. Starts over for
+	 * the next utterance.
+	 */
+	bool finish(std::string_view utterance, Session_history& session, Logger& logger);
+
+	/** Forgets the hypotheses, for the next utterance */
+	void reset();
+
+	/** The number of previews that finish confirmed and discarded */
+	size_t confirmed() const {
+		return confirmed_count;
+	}
+
+	size_t discarded() const {
+		return discarded_count;
+	}
+
+private:
+	/** Parses the viable tokens and their completion, and generates the LaTeX of the preview */
+	bool convert();
+
+	Syntax_visitor visitor;
+	std::string hypothesis;               // The last one, as it was given
+	std::string scratch;                  // Its padded copy, for the scanner
+	std::vector<grammar::Token> tokens;   // Of the last hypothesis
+	std::vector<grammar::Parser_tracker> trackers; // [i] has followed the tokens [0, i) of it
+	std::vector<int> completion;
+	std::vector<grammar::Token> line_tokens; // The viable tokens and their completion
+	Session_history::Line preview;
+	bool is_complete = false;
+	size_t confirmed_count = 0;
+	size_t discarded_count = 0;
+};
@@ -0,0 +1,178 @@
+/* Transcription of many recordings to LaTeX at once, on several threads */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "logger.h"
+#include "vad_segmenter.h"
+
+namespace batch {
+
+/** The rate of the audio that recognizers get */
+inline constexpr uint32_t RECOGNIZER_RATE = 16000;
+
+/** A token of a recognizer, with the time at which it starts, like DeepSpeech's TokenMetadata */
+struct Timed_token {
+	std::string text;  // A character or a word; " " separates words
+	double start_time; // In seconds from the start of the utterance
+};
+
+/** Turns the audio of an utterance into the words that were spoken, like DeepSpeech does */
+class Recognizer {
+public:
+	virtual ~Recognizer() = default;
+
+	/** Called before the utterances of the recording at [path] */
+	virtual void begin_recording(const std::string& path) {
+		(void) path;
+	}
+
+	/**
+	 * Returns the words spoken in the [count] samples of 16 kHz mono audio at [samples], e.g.
+	 * "x plus one". Returns false if it could not recognize them.
+	 */
+	virtual bool recognize(const int16_t* samples, size_t count, std::string& out_words) = 0;
+
+	/**
+	 * Whether the recognizer gives the tokens of an utterance with their times, with
+	 * recognize_tokens, which is then called instead of recognize. The breaks of the utterance are
+	 * then where the speaker paused for one (see grammar::Pause_model), like in live dictation.
+	 */
+	virtual bool gives_timed_tokens() const {
+		return false;
+	}
+
+	/**
+	 * Appends the tokens spoken in the [count] samples of 16 kHz mono audio at [samples] to
+	 * [out_tokens]. Returns false if it could not recognize them.
+	 */
+	virtual bool recognize_tokens(const int16_t* samples, size_t count, std::vector<Timed_token>& out_tokens) {
+		(void) samples;
+		(void) count;
+		(void) out_tokens;
+		return false;
+	}
+
+	/**
+	 * Returns the words spoken so far in the [count] samples at [samples], the start of an utterance
+	 * that is still being spoken, like the intermediateDecode of a DeepSpeech stream. Returns false
+	 * if it has no hypothesis, which is what recognizers without them do.
+	 */
+	virtual bool recognize_partial(const int16_t* samples, size_t count, std::string& out_words) {
+		(void) samples;
+		(void) count;
+		(void) out_words;
+		return false;
+	}
+};
+
+/**
+ * A stand-in for a speech recognizer, for tests and measurements: it recognizes the utterances of
+ * a recording as the lines of its transcript, the file next to it with the extension .txt instead
+ * of .wav, in order. Utterances beyond the last line are not recognized. While an utterance is
+ * spoken, its hypothesis is as many words of its line as are spoken at WORDS_PER_SECOND.
+ */
+class Transcript_recognizer : public Recognizer {
+public:
+	static constexpr double WORDS_PER_SECOND = 2.5;
+
+	void begin_recording(const std::string& path) override;
+
+	bool recognize(const int16_t* samples, size_t count, std::string& out_words) override;
+
+	bool recognize_partial(const int16_t* samples, size_t count, std::string& out_words) override;
+
+private:
+	std::vector<std::string> lines;
+	size_t next_line = 0;
+};
+
+/** Makes a recognizer for a worker thread. Every worker uses its own. */
+using Recognizer_factory = std::function<std::unique_ptr<Recognizer>()>;
+
+struct Wav_options {
+	/** The number of recordings transcribed at once. 0 means one per hardware thread. */
+	unsigned int threads = 0;
+
+	/** The voice activity detection; see audio::Vad_segmenter and VADAudio.vad_collector */
+	audio::Vad vad = audio::Energy_vad();
+	size_t frame_ms = 20;
+	size_t padding_ms = 3000;
+	double ratio = 0.6;
+
+	/**
+	 * For recognizers that give timed tokens: the pauses of more than this many seconds are breaks,
+	 * until the pauses of the speaker of a recording are learned. Every recording starts anew.
+	 */
+	double initial_break_threshold = 1.0;
+
+	/**
+	 * The directory to write the LaTeX of every recording to, as a file with the name of the
+	 * recording and the extension .tex. Empty means next to the recording.
+	 */
+	std::string output_directory;
+
+	/**
+	 * Every this many milliseconds of an utterance, the hypothesis of the recognizer is previewed
+	 * (see Speculative_preview). The preview is used for the LaTeX of the utterance if the final
+	 * words confirm it. 0 means no previews.
+	 */
+	size_t preview_ms = 0;
+
+	/** Whether to put the header and footer of a document around the lines */
+	bool create_document = false;
+
+	/** Where the errors of utterances that fail to parse are logged. Must outlive the transcription. */
+	Log_sink* log_sink = &STDERR_SINK;
+};
+
+struct Wav_report {
+	size_t recordings          = 0;
+	size_t failed_recordings   = 0; // That could not be read or written
+	size_t utterances          = 0;
+	size_t unrecognized        = 0; // Utterances the recognizer gave no words for
+	size_t failed_utterances   = 0; // Utterances whose words could not be fully parsed
+	size_t threads             = 0;
+	double audio_seconds       = 0;
+	double seconds             = 0; // Wall-clock time
+	// The time that all threads together spent in every stage
+	double decode_seconds      = 0; // Reading, mixing down and resampling
+	double segment_seconds     = 0;
+	double recognize_seconds   = 0;
+	double convert_seconds     = 0; // Parsing and generating LaTeX
+	double preview_seconds     = 0; // Recognizing and converting hypotheses
+	// Of the utterances that had a preview before they ended, in seconds of audio from their start
+	size_t previewed           = 0;
+	size_t confirmed_previews  = 0; // Whose final words confirmed the preview
+	double first_preview_audio = 0; // Up to their first preview, summed
+	double final_audio         = 0; // Up to the end of the utterance, when the final LaTeX is made
+
+	/** Seconds of audio transcribed per second of wall-clock time */
+	double realtime_factor() const;
+};
+
+/**
+ * Transcribes the 16-bit PCM WAV files at [paths] to LaTeX, on a pool of worker threads that each
+ * take the next recording when they are done with one. A worker streams a recording through the
+ * stages one utterance at a time: it is read in blocks of a quarter of a second, mixed down to mono
+ * and resampled to 16 kHz, split into utterances by voice activity detection, recognized by the
+ * recognizer of the worker, and every utterance that parses becomes a line of display style LaTeX,
+ * like texify makes it. Only the audio of the current utterance, or of the window of the voice
+ * activity detection, is kept, so long recordings take little memory. The LaTeX of a recording is
+ * written to a .tex file (see [options].output_directory).
+ *
+ * Fills [report]. Returns false if a recording could not be read or written, or an utterance was
+ * not recognized or did not parse.
+ */
+bool transcribe(
+	const std::vector<std::string>& paths, const Recognizer_factory& make_recognizer,
+	const Wav_options& options, Wav_report& report
+);
+
+} // namespace batch
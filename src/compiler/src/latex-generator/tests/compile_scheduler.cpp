@@ -0,0 +1,99 @@
+/* Tests of when the compile scheduler compiles a document again with its preamble */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "aec_styles.h"
+#include "compile_scheduler.h"
+#include "latex_generation.h"
+
+namespace {
+
+bool success = true;
+
+void fail(const std::string& test, const std::string& message) {
+	std::cerr << aec_style::error << "Error:" << aec::reset << " " << test << ": " << message << "\n";
+	success = false;
+}
+
+/**
+ * Stands in for latexmk, and gets the path of the .tex file as $1. A document that loads the format
+ * fails with an error in the log at the line of BODY_ERROR, or at its first line if it has
+ * FORMAT_ERROR, as if the format did not load. NO_LOG fails without a log. Without the format, only
+ * BODY_ERROR fails.
+ */
+const char COMMAND[] = R"sh(
+tex="$1"
+log="${tex%.tex}.log"
+if grep -q BODY_ERROR "$tex"; then
+	line=$(grep -n BODY_ERROR "$tex" | cut -d: -f1)
+	printf 'This is pdfTeX\n! Undefined control sequence.\nl.%s BODY_ERROR\n' "$line" > "$log"
+	exit 1
+fi
+if head -n 1 "$tex" | grep -q '^%&'; then
+	if grep -q FORMAT_ERROR "$tex"; then
+		printf 'This is pdfTeX\n! Fatal format file error.\nl.1 %%&talktex-preamble\n' > "$log"
+		exit 1
+	fi
+	if grep -q NO_LOG "$tex"; then exit 1; fi
+fi
+printf 'This is pdfTeX\n' > "$log"
+)sh";
+
+/** Compiles a document with [body] with a precompiled preamble, and returns the report */
+Compile_report compile(const std::string& directory, const std::string& body, bool& out_succeeded) {
+	Compile_options options;
+	options.output_directory = directory;
+	options.command = {"sh", "-c", COMMAND, "sh"};
+	options.precompile_preamble = true;
+	options.format_command = {"sh", "-c", "exit 0", "sh"};
+	Compile_scheduler scheduler(options);
+	out_succeeded = scheduler.compile_now(generation::talktex_header() + body + "\n" + generation::talktex_footer());
+	return scheduler.report();
+}
+
+void test_body_error(const std::string& directory) {
+	const std::string test = "error in the body";
+	bool succeeded;
+	Compile_report report = compile(directory, "BODY_ERROR", succeeded);
+	if (succeeded) fail(test, "the compile succeeded");
+	if (report.compiles != 1) fail(test, std::to_string(report.compiles) + " compiles instead of 1");
+	if (report.body_errors != 1) fail(test, "the error is not counted as one in the body");
+	if (report.format_fallbacks != 0) fail(test, "the format was dropped");
+}
+
+void test_format_error(const std::string& directory) {
+	const std::string test = "error before the body";
+	bool succeeded;
+	Compile_report report = compile(directory, "FORMAT_ERROR", succeeded);
+	if (!succeeded) fail(test, "the compile with the preamble failed");
+	if (report.compiles != 2) fail(test, std::to_string(report.compiles) + " compiles instead of 2");
+	if (report.format_fallbacks != 1) fail(test, "the format was not dropped");
+}
+
+void test_no_log(const std::string& directory) {
+	const std::string test = "no log";
+	bool succeeded;
+	// The log of the compile before must not be taken for the one of this compile
+	compile(directory, "BODY_ERROR", succeeded);
+	Compile_report report = compile(directory, "NO_LOG", succeeded);
+	if (!succeeded) fail(test, "the compile with the preamble failed");
+	if (report.compiles != 2) fail(test, std::to_string(report.compiles) + " compiles instead of 2");
+}
+
+} // unnamed namespace
+
+int main() {
+	char directory[] = "/tmp/test_compile_scheduler.XXXXXX";
+	if (!mkdtemp(directory)) {
+		fail("setup", "could not create a temporary directory");
+		return 1;
+	}
+	test_body_error(directory);
+	test_format_error(directory);
+	test_no_log(directory);
+	std::system(("rm -r '" + std::string(directory) + "'").c_str());
+	return (success ? 0 : 1);
+}
@@ -1,13 +1,31 @@
 import os
+import json
 import subprocess as sp
+import ctypes as ct
 from shutil import copyfile
 
+from generator import COMPILE_STATISTICS_MAX_SIZE
+
 OUTPUT_FILENAME_ROOT = "output"
 TALKTEX_PACKAGE_FILENAME = "talktex.sty"
 TALKTEX_PACKAGE_RELATIVE_DIR_PATH = "../../latex"
 
+DEFAULT_DEBOUNCE_SECONDS = 0.15
+DEFAULT_MAX_DELAY_SECONDS = 1.0
+
 class Compiler:
-	def __init__(self, script_dir, output_dir_path):
+	# Compiles with the scheduler of generator (a Generator): at most one latexmk at a time, on the
+	# newest document, once no newer one came for debounce_seconds or it waited max_delay_seconds.
+	# If precompile_preamble, the preamble is dumped into a LaTeX format once, which the documents load;
+	# a document that fails to compile with the format is compiled with its preamble.
+	# The latexmk runs are added to the trace of generator, if it is started.
+	def __init__(self, script_dir, output_dir_path, generator,
+	             debounce_seconds=DEFAULT_DEBOUNCE_SECONDS, max_delay_seconds=DEFAULT_MAX_DELAY_SECONDS,
+	             precompile_preamble=False):
+		self.generator = generator
+		self.debounce_seconds = debounce_seconds
+		self.max_delay_seconds = max_delay_seconds
+		self.precompile_preamble = precompile_preamble
 		self.output_dir_path = output_dir_path
 		self.output_tex_path = os.path.join(output_dir_path, OUTPUT_FILENAME_ROOT + ".tex")
 		self.output_pdf_path = os.path.join(output_dir_path, OUTPUT_FILENAME_ROOT + ".pdf")
@@ -15,20 +33,18 @@ class Compiler:
 		self.talktex_package_path = os.path.join(
 			script_dir, TALKTEX_PACKAGE_RELATIVE_DIR_PATH, TALKTEX_PACKAGE_FILENAME)
 
+		self.handle = None
+		self.final_statistics = None
 		self.reader_process = None
 
 
-	def compile(self, latex_string):
-		# Write LaTeX string to LaTeX file
-		f = open(self.output_tex_path, 'w+')
-		f.write(latex_string)
-		f.close()
+	def __del__(self):
+		self.close()
 
-		# Compile LaTeX file into PDF non-blockingly
-		sp.Popen("latexmk -pdf -output-directory=" + self.output_dir_path + " " + self.output_tex_path,
-		         shell=True,
-		         stdout=sp.DEVNULL,
-		         stderr=sp.DEVNULL)
+
+	def compile(self, latex_string):
+		# Compile LaTeX string into PDF non-blockingly, after the compile that runs
+		self.generator.compiler_submit(self.handle, latex_string.encode('utf-8'))
 
 
 	def initialize(self, latex_string):
@@ -38,18 +54,33 @@ class Compiler:
 		# Copy talktex.sty to output directory
 		copyfile(self.talktex_package_path, self.output_talktex_package_path)
 
-		# Write LaTeX string to LaTeX file
-		f = open(self.output_tex_path, 'w+')
-		f.write(latex_string)
-		f.close()
-
-		# Compile LaTeX file into PDF blockingly
-		sp.run("latexmk -pdf -output-directory=" + self.output_dir_path + " " + self.output_tex_path,
-		       shell=True,
-		       stdout=sp.DEVNULL,
-		       stderr=sp.DEVNULL)
+		# Compile LaTeX string into PDF blockingly
+		self.handle = ct.c_void_p(self.generator.compiler_new(
+			self.output_dir_path.encode('utf-8'), self.debounce_seconds, self.max_delay_seconds,
+			self.precompile_preamble))
+		self.generator.compiler_compile(self.handle, latex_string.encode('utf-8'))
 
 		print("pdf path is " + self.output_pdf_path)
 
 		# Open PDF reader
 		self.reader_process = sp.Popen("xdg-open " + self.output_pdf_path, shell=True)
+
+
+	# Returns the numbers of documents and compiles so far, and the distributions of the latencies
+	# from the submission of a document to the end of its compile and of the durations of the compiles
+	def statistics(self):
+		if not self.handle:
+			return self.final_statistics
+		c_statistics = ct.create_string_buffer(COMPILE_STATISTICS_MAX_SIZE)
+		if not self.generator.compiler_statistics(self.handle, c_statistics, ct.sizeof(c_statistics)):
+			return None
+		return json.loads(c_statistics.value.decode('utf-8'))
+
+
+	# Compiles the document that waits, if any, and waits for the compiles to end
+	def close(self):
+		if self.handle:
+			self.generator.compiler_wait(self.handle)
+			self.final_statistics = self.statistics()
+			self.generator.compiler_free(self.handle)
+			self.handle = None
@@ -1,13 +1,24 @@
 import os
+import sys
 import ctypes as ct
 
 
 GENERATOR_RELATIVE_PATH = "../../compiler/build/src/latex-generator/libcompiler_latex_generator.so"
 LATEX_MAX_SIZE = 1048576 #1MB should do for now right?
+CACHE_MAX_SIZE = 16777216 #16MB holds about 32000 lines
+PREFIX_TOKENS_MAX_SIZE = 4096 #The names of all tokens
+PREFIX_STATUSES = ["viable", "complete", "dead"]
+COMPILE_STATISTICS_MAX_SIZE = 1024
+
+#bool recognize(const int16_t* samples, size_t count, char* words, size_t words_size, void* context)
+RECOGNIZE_FUNCTION = ct.CFUNCTYPE(ct.c_bool, ct.POINTER(ct.c_int16), ct.c_size_t, ct.c_void_p, ct.c_size_t, ct.c_void_p)
+#bool recognize_tokens(const int16_t* samples, size_t count, void* tokens, void* context)
+RECOGNIZE_TOKENS_FUNCTION = ct.CFUNCTYPE(ct.c_bool, ct.POINTER(ct.c_int16), ct.c_size_t, ct.c_void_p, ct.c_void_p)
 
 class Generator:
 	def __init__(self, script_dir):
-		self.lib = ct.cdll.LoadLibrary(os.path.join(script_dir, GENERATOR_RELATIVE_PATH))
+		#TALKTEX_GENERATOR_LIBRARY can point at another build, like the one of pgo-build.sh
+		self.lib = ct.cdll.LoadLibrary(os.environ.get("TALKTEX_GENERATOR_LIBRARY") or os.path.join(script_dir, GENERATOR_RELATIVE_PATH))
 
 		#Function that converts running text into latex
 		self.texify = self.lib.texify
@@ -22,6 +33,133 @@ class Generator:
 		self.footer = self.lib.talktex_footer
 		self.footer.argtypes = [ct.c_char_p, ct.c_size_t]
 
+		#Function that gives the parse errors of the last conversion
+		self.diagnostics = self.lib.talktex_diagnostics
+		self.diagnostics.restype = ct.c_bool
+		self.diagnostics.argtypes = [ct.c_char_p, ct.c_size_t]
+
+		#Functions that keep the conversions of lines in a file, to reuse them in later runs
+		self.cache_open = self.lib.talktex_cache_open
+		self.cache_open.restype = ct.c_bool
+		self.cache_open.argtypes = [ct.c_char_p, ct.c_size_t]
+		self.cache_close = self.lib.talktex_cache_close
+
+		#Functions that record a Chrome trace of the conversions and of the spans we add to it
+		self.trace_start = self.lib.talktex_trace_start
+		self.trace_start.restype = ct.c_bool
+		self.trace_start.argtypes = [ct.c_char_p]
+		self.trace_stop = self.lib.talktex_trace_stop
+		self.trace_stop.restype = ct.c_bool
+		self.trace_clock = self.lib.talktex_trace_clock
+		self.trace_clock.restype = ct.c_uint64
+		self.trace_span = self.lib.talktex_trace_span
+		self.trace_span.argtypes = [ct.c_char_p, ct.c_char_p, ct.c_uint64, ct.c_uint64]
+
+		#Functions that keep the dictated lines of a session, with every earlier version for undo
+		self.session_new = self.lib.talktex_session_new
+		self.session_new.restype = ct.c_void_p
+		self.session_free = self.lib.talktex_session_free
+		self.session_free.argtypes = [ct.c_void_p]
+		self.session_dictate = self.lib.talktex_session_dictate
+		self.session_dictate.restype = ct.c_bool
+		self.session_dictate.argtypes = [ct.c_void_p, ct.c_char_p]
+		self.session_undo = self.lib.talktex_session_undo
+		self.session_undo.restype = ct.c_bool
+		self.session_undo.argtypes = [ct.c_void_p]
+		self.session_redo = self.lib.talktex_session_redo
+		self.session_redo.restype = ct.c_bool
+		self.session_redo.argtypes = [ct.c_void_p]
+		self.session_lines = self.lib.talktex_session_lines
+		self.session_lines.restype = ct.c_size_t
+		self.session_lines.argtypes = [ct.c_void_p]
+		self.session_latex = self.lib.talktex_session_latex
+		self.session_latex.restype = ct.c_bool
+		self.session_latex.argtypes = [ct.c_void_p, ct.c_char_p, ct.c_size_t]
+
+		#Functions that learn when a speaker pauses for a break, and dictate the tokens of a recognizer
+		self.speaker_new = self.lib.talktex_speaker_new
+		self.speaker_new.restype = ct.c_void_p
+		self.speaker_new.argtypes = [ct.c_double]
+		self.speaker_free = self.lib.talktex_speaker_free
+		self.speaker_free.argtypes = [ct.c_void_p]
+		self.speaker_threshold = self.lib.talktex_speaker_threshold
+		self.speaker_threshold.restype = ct.c_double
+		self.speaker_threshold.argtypes = [ct.c_void_p]
+		self.session_dictate_tokens = self.lib.talktex_session_dictate_tokens
+		self.session_dictate_tokens.restype = ct.c_bool
+		self.session_dictate_tokens.argtypes = [ct.c_void_p, ct.c_void_p, ct.POINTER(ct.c_char_p), ct.POINTER(ct.c_double), ct.c_size_t]
+
+		#Function that tells whether the start of a line can still become a line
+		self.check_prefix_function = self.lib.talktex_check_prefix
+		self.check_prefix_function.restype = ct.c_int
+		self.check_prefix_function.argtypes = [ct.c_char_p, ct.c_char_p, ct.c_size_t]
+
+		#Functions that tell which words of a vocabulary the parser may accept next, in constant time
+		self.parser_state = self.lib.talktex_parser_state
+		self.parser_state.restype = ct.c_int
+		self.parser_state.argtypes = [ct.c_char_p]
+		self.next_words_new = self.lib.talktex_next_words_new
+		self.next_words_new.restype = ct.c_void_p
+		self.next_words_new.argtypes = [ct.POINTER(ct.c_char_p), ct.c_size_t]
+		self.next_words_free = self.lib.talktex_next_words_free
+		self.next_words_free.argtypes = [ct.c_void_p]
+		self.next_words_row_size = self.lib.talktex_next_words_row_size
+		self.next_words_row_size.restype = ct.c_size_t
+		self.next_words_row_size.argtypes = [ct.c_void_p]
+		self.next_words_row = self.lib.talktex_next_words_row
+		self.next_words_row.restype = ct.POINTER(ct.c_uint64)
+		self.next_words_row.argtypes = [ct.c_void_p, ct.c_int]
+
+		#Functions that preview the LaTeX of an utterance from the words recognized so far
+		self.preview_new = self.lib.talktex_preview_new
+		self.preview_new.restype = ct.c_void_p
+		self.preview_free = self.lib.talktex_preview_free
+		self.preview_free.argtypes = [ct.c_void_p]
+		self.preview_update = self.lib.talktex_preview_update
+		self.preview_update.restype = ct.c_bool
+		self.preview_update.argtypes = [ct.c_void_p, ct.c_char_p, ct.c_char_p, ct.c_size_t]
+		self.preview_reset = self.lib.talktex_preview_reset
+		self.preview_reset.argtypes = [ct.c_void_p]
+		self.preview_finish = self.lib.talktex_preview_finish
+		self.preview_finish.restype = ct.c_bool
+		self.preview_finish.argtypes = [ct.c_void_p, ct.c_void_p, ct.c_char_p]
+
+		#Functions that resample audio to the rate of the speech recognition
+		self.resampler_new = self.lib.talktex_resampler_new
+		self.resampler_new.restype = ct.c_void_p
+		self.resampler_new.argtypes = [ct.c_uint32, ct.c_uint32]
+		self.resampler_free = self.lib.talktex_resampler_free
+		self.resampler_free.argtypes = [ct.c_void_p]
+		self.resampler_process = self.lib.talktex_resampler_process
+		self.resampler_process.restype = ct.c_size_t
+		self.resampler_process.argtypes = [ct.c_void_p, ct.c_char_p, ct.c_size_t, ct.c_void_p, ct.c_size_t]
+
+		#Function that transcribes WAV files to LaTeX on several threads, with a recognizer of ours
+		self.transcribe = self.lib.talktex_transcribe_wavs
+		self.transcribe.restype = ct.c_bool
+		self.transcribe.argtypes = [ct.POINTER(ct.c_char_p), ct.c_size_t, ct.c_char_p, ct.c_uint, ct.c_bool,
+		                            RECOGNIZE_FUNCTION, RECOGNIZE_TOKENS_FUNCTION, ct.c_double, ct.c_void_p,
+		                            ct.POINTER(ct.c_double), ct.POINTER(ct.c_double)]
+		self.tokens_add = self.lib.talktex_tokens_add
+		self.tokens_add.argtypes = [ct.c_void_p, ct.c_char_p, ct.c_double]
+
+		#Functions that compile the documents of a dictation to PDF in the background, one at a time
+		self.compiler_new = self.lib.talktex_compiler_new
+		self.compiler_new.restype = ct.c_void_p
+		self.compiler_new.argtypes = [ct.c_char_p, ct.c_double, ct.c_double, ct.c_bool]
+		self.compiler_free = self.lib.talktex_compiler_free
+		self.compiler_free.argtypes = [ct.c_void_p]
+		self.compiler_submit = self.lib.talktex_compiler_submit
+		self.compiler_submit.argtypes = [ct.c_void_p, ct.c_char_p]
+		self.compiler_wait = self.lib.talktex_compiler_wait
+		self.compiler_wait.argtypes = [ct.c_void_p]
+		self.compiler_compile = self.lib.talktex_compiler_compile
+		self.compiler_compile.restype = ct.c_bool
+		self.compiler_compile.argtypes = [ct.c_void_p, ct.c_char_p]
+		self.compiler_statistics = self.lib.talktex_compiler_statistics
+		self.compiler_statistics.restype = ct.c_bool
+		self.compiler_statistics.argtypes = [ct.c_void_p, ct.c_char_p, ct.c_size_t]
+
 
 	'''Returns whether a conversion from running text to LaTeX succeeded
 	and if it did, also returns the resulting LaTeX string.'''
@@ -34,9 +172,27 @@ class Generator:
 		if success:
 			return success, latex_string
 		else:
+			sys.stderr.write(self.get_diagnostics())
 			return success, ""
 
 
+	'''Returns the LaTeX header and footer of a document, as a pair of strings.'''
+	def get_header_footer(self):
+		c_header_buffer = ct.create_string_buffer(LATEX_MAX_SIZE)
+		self.header(c_header_buffer, ct.sizeof(c_header_buffer))
+		c_footer_buffer = ct.create_string_buffer(LATEX_MAX_SIZE)
+		self.footer(c_footer_buffer, ct.sizeof(c_footer_buffer))
+		return c_header_buffer.value.decode('utf-8'), c_footer_buffer.value.decode('utf-8')
+
+
+	'''Returns the errors of the last conversion on this thread, one per line.'''
+	def get_diagnostics(self):
+		c_diagnostics_buffer = ct.create_string_buffer(LATEX_MAX_SIZE)
+		if not self.diagnostics(c_diagnostics_buffer, ct.sizeof(c_diagnostics_buffer)):
+			return ""
+		return c_diagnostics_buffer.value.decode('utf-8')
+
+
 	'''Returns whether a conversion from running text to LaTeX succeeded
 	and if it did, also returns the resulting full LaTeX document.'''
 	def generate_latex_doc(self, token_string):
@@ -56,3 +212,212 @@ class Generator:
 			return success, header_string + latex_string + footer_string
 		else:
 			return success, ""
+
+
+	'''Transcribes the WAV files at paths to LaTeX documents in .tex files next to them, or in
+	output_directory, on threads threads (0 for one per processor). recognize is called on those
+	threads with the bytes of the 16 kHz mono 16-bit audio of every utterance, and returns its tokens,
+	a list of (text, start_time) pairs like those of DeepSpeech metadata, or None if it could not
+	recognize them. The breaks are at the pauses that a Speaker of every recording, starting with
+	initial_break_threshold, takes for breaks. Returns whether everything was transcribed, with the
+	seconds of audio transcribed per second.'''
+	def transcribe_wavs(self, paths, recognize, output_directory=None, threads=0, initial_break_threshold=1.0):
+		def recognize_tokens(samples, count, tokens, context):
+			recognized = recognize(ct.string_at(samples, 2 * count))
+			if recognized is None:
+				return False
+			for text, start_time in recognized:
+				self.tokens_add(tokens, text.encode('utf-8'), start_time)
+			return True
+
+		c_paths = (ct.c_char_p * len(paths))(*[path.encode('utf-8') for path in paths])
+		c_output_directory = output_directory.encode('utf-8') if output_directory else None
+		audio_seconds, seconds = ct.c_double(), ct.c_double()
+		success = self.transcribe(c_paths, len(paths), c_output_directory, threads, True,
+		                          RECOGNIZE_FUNCTION(), RECOGNIZE_TOKENS_FUNCTION(recognize_tokens),
+		                          initial_break_threshold, None, ct.byref(audio_seconds), ct.byref(seconds))
+		return success, (audio_seconds.value / seconds.value if seconds.value > 0 else 0)
+
+
+	'''Makes all conversions reuse the lines converted before, in this and earlier runs, by keeping
+	them in a cache of at most max_bytes bytes in the file at path. Returns whether that succeeded.'''
+	def open_cache(self, path, max_bytes=CACHE_MAX_SIZE):
+		return self.cache_open(path.encode('utf-8'), max_bytes)
+
+
+	'''Starts writing a Chrome trace of all conversions, and of the spans that are added to it,
+	to the file at path. Returns whether that succeeded.'''
+	def start_trace(self, path):
+		return self.trace_start(path.encode('utf-8'))
+
+
+	'''Stops tracing and completes the trace file. Returns whether that succeeded.'''
+	def stop_trace(self):
+		return self.trace_stop()
+
+
+	'''Returns the current time in nanoseconds on the clock of the trace.'''
+	def trace_now(self):
+		return self.trace_clock()
+
+
+	'''Returns whether the words, the start of a line, can still become a line: "viable" if they are
+	not a line yet but can become one, "complete" if they are one and "dead" if no words can make
+	them one. Also returns the names of the tokens that can come next, like "B_PLUS", with "ENDFILE"
+	for the end of the line.'''
+	def check_prefix(self, words):
+		c_next_tokens = ct.create_string_buffer(PREFIX_TOKENS_MAX_SIZE)
+		status = self.check_prefix_function(words.encode('utf-8'), c_next_tokens, ct.sizeof(c_next_tokens))
+		return PREFIX_STATUSES[status], c_next_tokens.value.decode('utf-8').split()
+
+	'''Adds a span named name from start to end (see trace_now) to the trace, if it is started.'''
+	def add_span(self, name, start, end):
+		self.trace_span(name.encode('utf-8'), b"python", start, end)
+
+
+class Session:
+	'''The lines dictated so far and their LaTeX, with unlimited undo and redo. An utterance is either
+	a spoken command ("undo", "redo", "scratch that", "delete line two", "replace line two with ...",
+	"insert before line two ...", "clear all") or a line to add. Every edit costs time and memory in
+	proportion to the logarithm of the number of lines, not to the length of the transcript.'''
+	def __init__(self, generator):
+		self.generator = generator
+		self.handle = ct.c_void_p(generator.session_new())
+
+	def __del__(self):
+		if self.handle:
+			self.generator.session_free(self.handle)
+			self.handle = None
+
+	'''Carries out an utterance. Returns whether it could be; if not, the session is unchanged.'''
+	def dictate(self, utterance):
+		return self.generator.session_dictate(self.handle, utterance.encode('utf-8'))
+
+	'''Carries out the utterance of the tokens of a speech recognizer, a list of (text, start_time)
+	pairs, with a break wherever the speaker, a Speaker, paused for one. Returns whether it could be;
+	if not, the session is unchanged.'''
+	def dictate_tokens(self, speaker, tokens):
+		c_texts = (ct.c_char_p * len(tokens))(*[text.encode('utf-8') for text, _ in tokens])
+		c_start_times = (ct.c_double * len(tokens))(*[start_time for _, start_time in tokens])
+		return self.generator.session_dictate_tokens(self.handle, speaker.handle, c_texts, c_start_times, len(tokens))
+
+	'''Undoes the last edit. Returns whether there was one.'''
+	def undo(self):
+		return self.generator.session_undo(self.handle)
+
+	'''Redoes the last undone edit. Returns whether there was one.'''
+	def redo(self):
+		return self.generator.session_redo(self.handle)
+
+	def line_count(self):
+		return self.generator.session_lines(self.handle)
+
+	'''Returns the LaTeX of all lines, like Generator.generate_latex_string does for their text.'''
+	def get_latex(self):
+		c_latex_buffer = ct.create_string_buffer(LATEX_MAX_SIZE)
+		if not self.generator.session_latex(self.handle, c_latex_buffer, ct.sizeof(c_latex_buffer)):
+			return ""
+		return c_latex_buffer.value.decode('utf-8')
+
+
+class Speaker:
+	'''Learns how long a speaker pauses between words, to tell the pauses that are breaks, like the
+	word "end", from the ones that are not. It starts with breaks at pauses of more than
+	initial_threshold seconds.'''
+	def __init__(self, generator, initial_threshold):
+		self.generator = generator
+		self.handle = ct.c_void_p(generator.speaker_new(initial_threshold))
+
+	def __del__(self):
+		if self.handle:
+			self.generator.speaker_free(self.handle)
+			self.handle = None
+
+	'''Returns the number of seconds of the pauses that are breaks, as it is estimated now.'''
+	def threshold(self):
+		return self.generator.speaker_threshold(self.handle)
+
+
+class Preview:
+	'''Provisional LaTeX of an utterance while it is spoken, from the words a speech recognizer has
+	recognized so far, e.g. with intermediateDecode. The part of a hypothesis that is not a line yet is
+	completed, with \\ldots for the operands that were not spoken yet.'''
+	def __init__(self, generator):
+		self.generator = generator
+		self.handle = ct.c_void_p(generator.preview_new())
+
+	def __del__(self):
+		if self.handle:
+			self.generator.preview_free(self.handle)
+			self.handle = None
+
+	'''Returns the LaTeX of the hypothesis, the words recognized so far, or "" if there is none.'''
+	def update(self, hypothesis):
+		c_latex_buffer = ct.create_string_buffer(LATEX_MAX_SIZE)
+		if not self.generator.preview_update(self.handle, hypothesis.encode('utf-8'), c_latex_buffer, ct.sizeof(c_latex_buffer)):
+			return ""
+		return c_latex_buffer.value.decode('utf-8')
+
+	'''Carries out the final words of the utterance in a Session, like Session.dictate. If the last
+	preview was of these words, its LaTeX is used without converting them again.'''
+	def finish(self, session, utterance):
+		return self.generator.preview_finish(self.handle, session.handle, utterance.encode('utf-8'))
+
+	'''Discards the preview, for the next utterance.'''
+	def reset(self):
+		self.generator.preview_reset(self.handle)
+
+
+class NextWords:
+	'''The words of a vocabulary, like the spellings of the tokens in compiler.l, that the parser may
+	accept next in each of its states, for a speech recognizer that drops the hypotheses the grammar
+	rules out. A word that the parser may accept can still make the line dead; Generator.check_prefix
+	tells exactly.'''
+	def __init__(self, generator, words):
+		self.generator = generator
+		self.words = list(words)
+		c_words = (ct.c_char_p * len(self.words))(*[word.encode('utf-8') for word in self.words])
+		self.handle = ct.c_void_p(generator.next_words_new(c_words, len(self.words)))
+		self.row_size = generator.next_words_row_size(self.handle)
+
+	def __del__(self):
+		if self.handle:
+			self.generator.next_words_free(self.handle)
+			self.handle = None
+
+	'''Returns the state in which the parser asks for the token after words, the start of a line, or
+	-1 if no words can make them a line.'''
+	def state(self, words):
+		return self.generator.parser_state(words.encode('utf-8'))
+
+	'''Returns the row of state as an int, with bit i set if the parser may accept word i next.'''
+	def row(self, state):
+		blocks = self.generator.next_words_row(self.handle, state)
+		return sum(blocks[i] << (64 * i) for i in range(self.row_size))
+
+	'''Returns the words that the parser may accept next in state.'''
+	def allowed(self, state):
+		row = self.row(state)
+		return [word for i, word in enumerate(self.words) if (row >> i) & 1]
+
+
+class Resampler:
+	'''Resamples a stream of 16-bit mono audio block by block, with a polyphase filter that carries its
+	state across blocks, so that the blocks join without discontinuities.'''
+	def __init__(self, generator, input_rate, output_rate):
+		self.generator = generator
+		self.input_rate = input_rate
+		self.output_rate = output_rate
+		self.handle = ct.c_void_p(generator.resampler_new(input_rate, output_rate))
+
+	def __del__(self):
+		if self.handle:
+			self.generator.resampler_free(self.handle)
+			self.handle = None
+
+	'''Returns the resampled audio of the next block of the stream, both as bytes of 16-bit samples.'''
+	def process(self, data):
+		count = len(data) // 2
+		c_output_buffer = ct.create_string_buffer(2 * (count * self.output_rate // self.input_rate + 1))
+		written = self.generator.resampler_process(self.handle, data, count, c_output_buffer, len(c_output_buffer) // 2)
+		return c_output_buffer.raw[:2 * written]
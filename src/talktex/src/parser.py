@@ -1,4 +1,6 @@
-from generator import Generator
+import sys
+
+from generator import Generator, Preview, Session, Speaker
 
 class TokenString:
 	def __init__(self):
@@ -15,56 +17,41 @@ class TokenString:
 
 class Parser:
 	def __init__(self, script_dir, break_threshold=1.0):
-		self.current_string = ""
-		self.current_output = ""
-		self.prev_string = ""
-		self.prev_output = ""
+		self.tokens = []
 		self.generator = Generator(script_dir)
-		self.break_token = "end "
-		self.break_threshold = break_threshold
+		self.session = Session(self.generator)
+		self.speaker = Speaker(self.generator, break_threshold)
+		self.preview = Preview(self.generator)
 
+	'''Adds the tokens of DeepSpeech metadata to the utterance. The latex generator inserts the breaks
+	where the speaker paused long enough, as it learns how long they pause between words.'''
 	def add_tokens(self, metadata):
-		transcripts = metadata.transcripts
-		transcript = transcripts[0]
-		tokens = transcript.tokens
-		last_token_space = False
-		last_token_time=0
-
-		#Process the list of tokens
-		for token in tokens:
-			self.current_string += token.text
-			if token.text == ' ':
-				if (token.start_time-last_token_time) > self.break_threshold:
-					self.current_string += self.break_token
-			last_token_time = token.start_time
+		self.tokens += [(token.text, token.start_time) for token in metadata.transcripts[0].tokens]
 
-		#add newline
-		self.current_string += "\n"
+	'''Returns the provisional LaTeX of the words of the utterance recognized so far, or "" if they
+	can not be previewed.'''
+	def preview_latex(self, hypothesis):
+		return self.preview.update(hypothesis)
 
 	def finalize(self):
-		self.current_string += " "
+		self.tokens.append((" ", self.tokens[-1][1] if self.tokens else 0))
 
+	'''Carries out the utterance of the tokens added since the last call, which is a line or a spoken
+	command like "undo" or "scratch that", and returns whether that succeeded, with the LaTeX of all
+	lines. If it did not, the session stays as it was.'''
 	def get_latex_string(self):
-		success, self.current_output = self.generator.generate_latex_string(self.current_string)
-		if success:
-			self.prev_string = self.current_string
-			self.prev_output = self.current_output
-			return success, self.current_output
-		else:
-			print("ERROR: Input is not valid LaTeX.\nINPUT:\n" + self.current_string)
-			self.current_string = self.prev_string
-			self.current_output = self.prev_output
-			return success, self.prev_output
+		tokens, self.tokens = self.tokens, []
+		self.preview.reset() # The pauses of the tokens may add breaks that the preview does not have
+		success = self.session.dictate_tokens(self.speaker, tokens)
+		if not success:
+			print("ERROR: Input is not valid LaTeX.\nINPUT:\n" + "".join(text for text, _ in tokens))
+			sys.stderr.write(self.generator.get_diagnostics())
+		return success, self.session.get_latex()
 
 	def get_latex_doc(self):
-		success, latex_output = self.generator.generate_latex_doc(self.current_string)
-		if success:
-			return latex_output
-		else:
-			return "ERROR: Input is not valid LaTeX"
+		header, footer = self.generator.get_header_footer()
+		return header + self.session.get_latex() + footer
 
 	def clear(self):
-		self.current_string = ""
-		self.current_output = ""
-		self.prev_string = ""
-		self.prev_output = ""
+		self.tokens = []
+		self.session = Session(self.generator)
@@ -13,7 +13,7 @@ from scipy import signal
 
 from parser import Parser
 from compiler import Compiler
-from generator import Generator
+from generator import Generator, Resampler
 logging.basicConfig(level=20)
 
 class Audio(object):
@@ -25,7 +25,7 @@ class Audio(object):
 	CHANNELS = 1
 	BLOCKS_PER_SECOND = 50
 
-	def __init__(self, callback=None, device=None, input_rate=RATE_PROCESS, file=None):
+	def __init__(self, callback=None, device=None, input_rate=RATE_PROCESS, file=None, resampler=None):
 		def proxy_callback(in_data, frame_count, time_info, status):
 			#pylint: disable=unused-argument
 			if self.chunk is not None:
@@ -36,6 +36,7 @@ class Audio(object):
 		self.buffer_queue = queue.Queue()
 		self.device = device
 		self.input_rate = input_rate
+		self.resampler = resampler
 		self.sample_rate = self.RATE_PROCESS
 		self.block_size = int(self.RATE_PROCESS / float(self.BLOCKS_PER_SECOND))
 		self.block_size_input = int(self.input_rate / float(self.BLOCKS_PER_SECOND))
@@ -71,6 +72,8 @@ class Audio(object):
 			data (binary): Input audio stream
 			input_rate (int): Input audio rate to resample from
 		"""
+		if self.resampler is not None:
+			return self.resampler.process(data)
 		data16 = np.fromstring(string=data, dtype=np.int16)
 		resample_size = int(len(data16) / self.input_rate * self.RATE_PROCESS)
 		resample = signal.resample(data16, resample_size)
@@ -108,8 +111,8 @@ class Audio(object):
 class VADAudio(Audio):
 	"""Filter & segment audio with voice activity detection."""
 
-	def __init__(self, aggressiveness=3, device=None, input_rate=None, file=None):
-		super().__init__(device=device, input_rate=input_rate, file=file)
+	def __init__(self, aggressiveness=3, device=None, input_rate=None, file=None, resampler=None):
+		super().__init__(device=device, input_rate=input_rate, file=file, resampler=resampler)
 		self.vad = webrtcvad.Vad(aggressiveness)
 
 	def frame_generator(self):
@@ -156,64 +159,147 @@ class VADAudio(Audio):
 					yield None
 					ring_buffer.clear()
 
+def transcribe_batch(parser, ARGS):
+	'''Transcribes the recordings of ARGS.batch to LaTeX documents in ARGS.output, several at once.
+	Every thread of the latex generator recognizes with a DeepSpeech model of its own. The breaks are
+	where the speaker paused for one, learned per recording like in live dictation.'''
+	# By thread identifier: a threading.local does not keep its values between the calls from a thread
+	# that Python did not start
+	models = {}
+	models_lock = threading.Lock()
+	def recognize(audio):
+		with models_lock:
+			model = models.get(threading.get_ident())
+		if model is None:
+			model = deepspeech.Model(ARGS.model)
+			if ARGS.scorer: model.enableExternalScorer(ARGS.scorer)
+			with models_lock:
+				models[threading.get_ident()] = model
+		metadata = model.sttWithMetadata(np.frombuffer(audio, np.int16))
+		return [(token.text, token.start_time) for token in metadata.transcripts[0].tokens]
+
+	os.makedirs(ARGS.output, exist_ok=True)
+	success, realtime_factor = parser.generator.transcribe_wavs(ARGS.batch, recognize, ARGS.output, ARGS.jobs,
+	                                                            ARGS.threshold)
+	print(f"Transcribed {len(ARGS.batch)} recordings at {realtime_factor:.1f} seconds of audio per second")
+	if not success:
+		print("ERROR: Not all recordings could be transcribed")
+
+def print_compile_statistics(statistics):
+	'''Prints how many documents were compiled and how long it took until they showed in the PDF.'''
+	if not statistics or statistics["compiles"] == 0: return
+	latency = statistics["latency"]
+	print(f"Compiled {statistics['submitted']} documents in {statistics['compiles']} runs of latexmk"
+	      f" ({statistics['coalesced']} coalesced, {statistics['failed'] + statistics['write_errors']} failed),"
+	      f" in the PDF after {latency['p50']:.2f} s (p50), {latency['p95']:.2f} s (p95), {latency['max']:.2f} s (max)")
+
 def main(script_dir, ARGS):
 	# Create parser object
 	parser = Parser(script_dir, ARGS.threshold)
 
-	# Create compiler object
-	if not ARGS.no_autocompile:
-		compiler = Compiler(script_dir, ARGS.output)
-		# We assume that generator.generate_latex_doc always succeeds on an empty string, which
-		# relies on the latex generator binary succeeding on an empty string.
-		compiler.initialize(Generator(script_dir).generate_latex_doc("")[1])
-
-	# Load DeepSpeech model
-	if os.path.isdir(ARGS.model):
-		model_dir = ARGS.model
-		ARGS.model = os.path.join(model_dir, 'output_graph.pb')
-		ARGS.scorer = os.path.join(model_dir, ARGS.scorer)
-
-	print('Initializing model...')
-	logging.info("ARGS.model: %s", ARGS.model)
-	model = deepspeech.Model(ARGS.model)
-	if ARGS.scorer:
-		logging.info("ARGS.scorer: %s", ARGS.scorer)
-		model.enableExternalScorer(ARGS.scorer)
-
-	# Start audio with VAD
-	vad_audio = VADAudio(aggressiveness=ARGS.vad_aggressiveness,
-						 device=ARGS.device,
-						 input_rate=ARGS.rate,
-						 file=ARGS.file)
-	print("Listening (ctrl-C to exit)...")
-	frames = vad_audio.vad_collector(padding_ms=3000, ratio=0.6)
-
-	# Stream from microphone to DeepSpeech using VAD
-	spinner = None
-	if not ARGS.nospinner:
-		spinner = Halo(spinner='line')
-	stream_context = model.createStream()
-	wav_data = bytearray()
-	for frame in frames:
-		if frame is not None:
-			if spinner: spinner.start()
-			logging.debug("streaming frame")
-			stream_context.feedAudioContent(np.frombuffer(frame, np.int16))
-			if ARGS.savewav: wav_data.extend(frame)
-		else:
-			if spinner: spinner.stop()
-			logging.debug("end utterence")
-			if ARGS.savewav:
-				vad_audio.write_wav(os.path.join(ARGS.savewav, datetime.now().strftime("savewav_%Y-%m-%d_%H-%M-%S_%f.wav")), wav_data)
-				wav_data = bytearray()
-			metadata = stream_context.finishStreamWithMetadata()
-			parser.add_tokens(metadata)
-			success, latex_string = parser.get_latex_string()
-			if success:
-				print(latex_string)
-				if not ARGS.no_autocompile and success:
-					compiler.compile(parser.get_latex_doc())
-			stream_context = model.createStream()
+	# Reuse the conversions of lines that were dictated before
+	if ARGS.cache:
+		os.makedirs(os.path.dirname(os.path.abspath(ARGS.cache)), exist_ok=True)
+		if not parser.generator.open_cache(ARGS.cache):
+			print("ERROR: Could not open cache file " + ARGS.cache)
+
+	# Trace the conversions, and our own work, on one timeline. The finally stops the trace however
+	# we leave, also when loading the model fails.
+	tracer = None
+	compiler = None
+	try:
+		if ARGS.trace:
+			tracer = parser.generator
+			if not tracer.start_trace(ARGS.trace):
+				print("ERROR: Could not create trace file " + ARGS.trace)
+				tracer = None
+
+		# Find the DeepSpeech model
+		if os.path.isdir(ARGS.model):
+			model_dir = ARGS.model
+			ARGS.model = os.path.join(model_dir, 'output_graph.pb')
+			ARGS.scorer = os.path.join(model_dir, ARGS.scorer)
+
+		if ARGS.batch:
+			transcribe_batch(parser, ARGS)
+			return
+
+		# Create compiler object
+		if not ARGS.no_autocompile:
+			compiler = Compiler(script_dir, ARGS.output, parser.generator, ARGS.compile_debounce_ms / 1000,
+			                    precompile_preamble=ARGS.precompiled_preamble)
+			# We assume that generator.generate_latex_doc always succeeds on an empty string, which
+			# relies on the latex generator binary succeeding on an empty string.
+			compiler.initialize(parser.generator.generate_latex_doc("")[1])
+
+		# Load DeepSpeech model
+		print('Initializing model...')
+		logging.info("ARGS.model: %s", ARGS.model)
+		model = deepspeech.Model(ARGS.model)
+		if ARGS.scorer:
+			logging.info("ARGS.scorer: %s", ARGS.scorer)
+			model.enableExternalScorer(ARGS.scorer)
+
+		# Start audio with VAD
+		# Resample in the latex generator library, which keeps the filter state between blocks
+		resampler = None
+		if ARGS.rate != Audio.RATE_PROCESS:
+			resampler = Resampler(parser.generator, ARGS.rate, Audio.RATE_PROCESS)
+		vad_audio = VADAudio(aggressiveness=ARGS.vad_aggressiveness,
+							 device=ARGS.device,
+							 input_rate=ARGS.rate,
+							 file=ARGS.file,
+							 resampler=resampler)
+		print("Listening (ctrl-C to exit)...")
+		frames = vad_audio.vad_collector(padding_ms=3000, ratio=0.6)
+
+		# Stream from microphone to DeepSpeech using VAD
+		spinner = None
+		if not ARGS.nospinner:
+			spinner = Halo(spinner='line')
+		stream_context = model.createStream()
+		wav_data = bytearray()
+		utterance_start = None
+		utterance_ms = 0
+		next_preview_ms = ARGS.preview_ms
+		for frame in frames:
+			if frame is not None:
+				if spinner: spinner.start()
+				logging.debug("streaming frame")
+				if tracer and utterance_start is None: utterance_start = tracer.trace_now()
+				stream_context.feedAudioContent(np.frombuffer(frame, np.int16))
+				if ARGS.savewav: wav_data.extend(frame)
+				utterance_ms += vad_audio.frame_duration_ms
+				if ARGS.preview_ms > 0 and utterance_ms >= next_preview_ms:
+					next_preview_ms = utterance_ms + ARGS.preview_ms
+					latex_preview = parser.preview_latex(stream_context.intermediateDecode())
+					if latex_preview: print("Preview: " + latex_preview.strip())
+			else:
+				if spinner: spinner.stop()
+				logging.debug("end utterence")
+				if tracer and utterance_start is not None:
+					tracer.add_span("utterance", utterance_start, tracer.trace_now())
+					utterance_start = None
+				if ARGS.savewav:
+					vad_audio.write_wav(os.path.join(ARGS.savewav, datetime.now().strftime("savewav_%Y-%m-%d_%H-%M-%S_%f.wav")), wav_data)
+					wav_data = bytearray()
+				start = tracer.trace_now() if tracer else 0
+				metadata = stream_context.finishStreamWithMetadata()
+				if tracer: tracer.add_span("speech to text", start, tracer.trace_now())
+				parser.add_tokens(metadata)
+				success, latex_string = parser.get_latex_string()
+				if success:
+					print(latex_string)
+					if not ARGS.no_autocompile and success:
+						compiler.compile(parser.get_latex_doc())
+				stream_context = model.createStream()
+				utterance_ms = 0
+				next_preview_ms = ARGS.preview_ms
+	finally:
+		if compiler:
+			compiler.close()
+			print_compile_statistics(compiler.statistics())
+		if tracer: tracer.stop_trace()
 
 if __name__ == '__main__':
 	DEFAULT_SAMPLE_RATE = 16000
@@ -232,6 +318,10 @@ if __name__ == '__main__':
 						help="Save .wav files of utterences to given directory")
 	parser.add_argument('-f', '--file',
 						help="Read from .wav file instead of microphone")
+	parser.add_argument('--batch', nargs='+', metavar='WAV',
+						help="Transcribe these .wav files to .tex files in the output directory as fast as possible, instead of in real time")
+	parser.add_argument('-j', '--jobs', type=int, default=0,
+						help="The number of recordings to transcribe at once with --batch. Default: one per processor.")
 
 	parser.add_argument('-m', '--model', default=f"{script_dir}/../deepspeech/models/deepspeech-0.9.3-models.pbmm",
 						help="Path to the model (protocol buffer binary file, or entire directory containing all standard-named files for model)")
@@ -243,8 +333,18 @@ if __name__ == '__main__':
 						help=f"Input device sample rate. Default: {DEFAULT_SAMPLE_RATE}. Your device may require 44100.")
 	parser.add_argument('-t', '--threshold', type=int, default=DEFAULT_BREAK_THRESHOLD,
 											help=f"The threshold that determines whether a silence in speech is a space or an actual break. Default: {DEFAULT_BREAK_THRESHOLD}.")
+	parser.add_argument('--preview-ms', type=int, default=0,
+	                    help="Show a preview of the LaTeX of the words recognized so far this often while an utterance is spoken, instead of only after it ends. Default: 0, no previews.")
 	parser.add_argument('--no-autocompile', action='store_true',
 						help="Do not write output to a file and do not compile it to a pdf")
+	parser.add_argument('--compile-debounce-ms', type=int, default=150,
+	                    help="Compile the PDF once no utterance came for this long, so that a burst of utterances makes one compile of the newest document. Default: 150.")
+	parser.add_argument('--precompiled-preamble', action='store_true',
+	                    help="Dump the preamble of the document into a LaTeX format once and load that, instead of processing the preamble on every compile (experimental)")
+	parser.add_argument('--trace',
+	                    help="Write a Chrome trace of the utterances, their conversion and the LaTeX compilation to this file, which Perfetto and chrome://tracing open")
+	parser.add_argument('--cache', nargs='?', const=os.path.expanduser("~/.cache/talktex/latex.cache"),
+	                    help="Keep the LaTeX of the dictated lines in this file, so that lines dictated again, also in later runs, need not be converted again. Default file: ~/.cache/talktex/latex.cache")
 	parser.add_argument('-o', '--output', default=f"{script_dir}/../../../latex-output",
 	                    help="The output directory for the LaTeX and PDF files")
 	ARGS = parser.parse_args()
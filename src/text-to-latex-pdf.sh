@@ -27,5 +27,5 @@ fi
 
 mkdir -p "$LATEX_OUTPUT_DIR"
 cp "latex/talktex.sty" "$LATEX_OUTPUT_DIR"
-compiler/run-latex-generator.sh -d -i "$input" > "$LATEX_OUTPUT_DIR/output.tex"
+compiler/run-latex-client.sh -d -i "$input" > "$LATEX_OUTPUT_DIR/output.tex"
 latex/render-latex.sh "$LATEX_OUTPUT_DIR/output.tex"